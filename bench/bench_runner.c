@@ -0,0 +1,157 @@
+/*! @file
+  @brief
+  mruby/c benchmark runner for POSIX
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (usage)
+  bench_runner [-t tasks] [-m pool size] file.mrb [file2.mrb ...]
+
+  Runs each file as a task (or -t tasks of each) on the scheduler, and
+  reports the time, the executed opcodes per second, the peak usage of
+  the memory pool and its fragmentation after the run, in one line:
+
+  ## fib.mrb  time 0.812 s  ops 3556945  4.38 Mops/s  peak 2968  used 1236  frag 2
+
+  The opcode count needs MRBC_USE_TASK_STATS and the peak needs
+  MRBC_ALLOC_PROFILE; they are "-" without them. (see bench/Makefile)
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mrubyc.h"
+
+#define DEFAULT_POOL_SIZE (1024*64)
+#define MAX_TASKS 16
+
+
+static uint8_t * load_mrb_file(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+
+  if( fp == NULL ) {
+    fprintf(stderr, "File not found: %s\n", filename);
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  uint8_t *p = malloc(size);
+  if( p == NULL || fread(p, sizeof(uint8_t), size, fp) != size ) {
+    fprintf(stderr, "Read error: %s\n", filename);
+    free(p);
+    p = NULL;
+  }
+  fclose(fp);
+
+  return p;
+}
+
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-t tasks] [-m pool size] file.mrb ...\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int n_times = 1;
+  unsigned int pool_size = DEFAULT_POOL_SIZE;
+  int opt = 1;
+
+  for( ; opt < argc && argv[opt][0] == '-'; opt++ ) {
+    if( opt + 1 >= argc ) break;
+    if( strcmp(argv[opt], "-t") == 0 ) {
+      n_times = atoi(argv[++opt]);
+    } else if( strcmp(argv[opt], "-m") == 0 ) {
+      pool_size = atoi(argv[++opt]);
+    } else {
+      break;
+    }
+  }
+  if( opt >= argc || n_times < 1 ) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint8_t *pool = malloc(pool_size);
+  uint8_t *code[MAX_TASKS];
+  mrbc_tcb *tcb[MAX_TASKS];
+  int n_code = 0, n_tcb = 0;
+
+  if( pool == NULL ) return 1;
+  mrbc_init(pool, pool_size);
+
+  for( ; opt < argc && n_code < MAX_TASKS; opt++ ) {
+    code[n_code] = load_mrb_file(argv[opt]);
+    if( code[n_code] == NULL ) return 1;
+
+    for( int i = 0; i < n_times && n_tcb < MAX_TASKS; i++ ) {
+      tcb[n_tcb] = mrbc_create_task(code[n_code], NULL);
+      if( tcb[n_tcb] == NULL ) {
+        fprintf(stderr, "Can't create the task: %s\n", argv[opt]);
+        return 1;
+      }
+      n_tcb++;
+    }
+    n_code++;
+  }
+#if defined(MRBC_ALLOC_PROFILE)
+  mrbc_alloc_reset_peak();
+#endif
+
+  double t0 = now_sec();
+  mrbc_run();
+  double t = now_sec() - t0;
+  fflush(stdout);
+
+  int total, used, free_size, fragmentation;
+  mrbc_alloc_statistics(&total, &used, &free_size, &fragmentation);
+
+  const char *name = strrchr(argv[argc-1], '/');
+  name = name ? name + 1 : argv[argc-1];
+  printf("## %s  time %.3f s", name, t);
+
+#if MRBC_USE_TASK_STATS
+  uint64_t n_ops = 0;
+  for( int i = 0; i < n_tcb; i++ ) {
+    mrbc_task_stats stats;
+    mrbc_get_task_stats(tcb[i], &stats);
+    n_ops += stats.n_ops;
+  }
+  printf("  ops %llu  %.2f Mops/s", (unsigned long long)n_ops,
+         t > 0 ? n_ops / t / 1e6 : 0.0);
+#else
+  printf("  ops -  - Mops/s");
+#endif
+
+#if defined(MRBC_ALLOC_PROFILE)
+  printf("  peak %d", mrbc_alloc_get_profile()->peak);
+#else
+  printf("  peak -");
+#endif
+  printf("  used %d  frag %d\n", used, fragmentation);
+
+  for( int i = 0; i < n_code; i++ ) free(code[i]);
+  free(pool);
+
+  return 0;
+}
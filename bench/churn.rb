@@ -0,0 +1,44 @@
+#
+# Array and Hash churn benchmark
+#
+#  Short lived Arrays and Hashes, push/pop/shift, and Hash insertion,
+#  lookup and deletion. Stresses the memory pool.
+#
+#  $ make bench
+#
+
+N = 5000
+
+sum = 0
+N.times {|i|
+  a = [i, i + 1, i + 2]
+  a << i * 2
+  a.push(i * 3)
+  sum += a.pop + a.shift + a.size
+}
+puts "array: #{sum}"
+
+sum = 0
+a = []
+N.times {|i|
+  a.push(i)
+  a.push(i + 1)
+  sum += a.shift
+}
+puts "queue: #{sum} #{a.size}"
+
+sum = 0
+N.times {|i|
+  h = {:a => i, :b => i + 1, "c" => i + 2}
+  h[:d] = h[:a] + h[:b]
+  sum += h[:d] + h["c"] + h.size
+}
+puts "hash: #{sum}"
+
+h = {}
+N.times {|i|
+  h[i] = i * 2
+  sum += h[i - 25] if i >= 25
+  h.delete(i - 50) if i >= 50
+}
+puts "hash set/delete: #{sum} #{h.size}"
@@ -0,0 +1,18 @@
+#
+# fib benchmark
+#
+#  Recursive method calls and returns, with Fixnum comparison and
+#  arithmetic.
+#
+#  $ make bench
+#
+
+def fib(n)
+  if n < 2
+    n
+  else
+    fib(n - 1) + fib(n - 2)
+  end
+end
+
+puts "fib(27): #{fib(27)}"
@@ -0,0 +1,42 @@
+#
+# number formatting and parsing benchmark
+#
+#  Integer#to_s, Integer#to_s(16), Float#to_s, String#to_i,
+#  String#to_f and sprintf, as in CSV-ish encode and decode.
+#
+#  $ mrbc bench/format.rb
+#  $ time sample_c/sample_scheduler bench/format.mrb
+#
+
+N = 20000
+
+len = 0
+N.times {|i| len += (i * 12347).to_s.size }
+puts "Integer#to_s: #{len}"
+
+len = 0
+N.times {|i| len += (i * 12347).to_s(16).size }
+puts "Integer#to_s(16): #{len}"
+
+len = 0
+N.times {|i| len += (i * 0.37).to_s.size }
+puts "Float#to_s: #{len}"
+
+len = 0
+N.times {|i| len += sprintf("%d,%g", i, i * 0.5).size }
+puts "sprintf: #{len}"
+
+sum = 0
+s = "1234567"
+N.times { sum += s.to_i }
+puts "String#to_i: #{sum}"
+
+sum = 0
+s = "8191"
+N.times { sum += s.to_i(16) }
+puts "String#to_i(16): #{sum}"
+
+sum = 0.0
+s = "-123.4375"
+N.times { sum += s.to_f }
+puts "String#to_f: #{sum}"
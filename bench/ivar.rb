@@ -0,0 +1,56 @@
+#
+# instance variable benchmark
+#
+#  Object creation, attr_accessor and methods that read and write
+#  several instance variables.
+#
+#  $ make bench
+#
+
+class Particle
+  attr_accessor :x, :y, :vx, :vy
+
+  def initialize(x, y)
+    @x = x
+    @y = y
+    @vx = 1
+    @vy = -1
+  end
+
+  def step
+    @x += @vx
+    @y += @vy
+    @vx = -@vx if @x < 0 || @x > 100
+    @vy = -@vy if @y < 0 || @y > 100
+  end
+end
+
+N = 20000
+
+sum = 0
+N.times {|i|
+  pt = Particle.new(i % 100, i % 37)
+  pt.step
+  sum += pt.x + pt.y
+}
+puts "new: #{sum}"
+
+pts = []
+16.times {|i| pts << Particle.new(i * 6, i * 3) }
+sum = 0
+(N / 16).times {
+  pts.each {|pt|
+    pt.step
+    sum += pt.x
+  }
+}
+puts "step: #{sum}"
+
+sum = 0
+pt = pts[0]
+N.times {|i|
+  pt.x = i
+  pt.y = pt.x + 1
+  sum += pt.y - pt.vx
+}
+puts "accessor: #{sum}"
@@ -0,0 +1,42 @@
+#
+# loop benchmark
+#
+#  Fixnum#times, Range#each on a literal range made in each outer
+#  iteration, and the same loop by while for comparison.
+#
+#  $ mrbc bench/loop.rb
+#  $ time sample_c/sample_scheduler bench/loop.mrb
+#
+
+N = 1000
+M = 100
+
+sum = 0
+M.times do
+  N.times {|i| sum += i }
+end
+puts "times: #{sum}"
+
+sum = 0
+M.times do
+  (0...N).each {|i| sum += i }
+end
+puts "range: #{sum}"
+
+sum = 0
+(M * N).times do |i|
+  (i..i+1).each {|j| sum += j }
+end
+puts "short range: #{sum}"
+
+sum = 0
+j = 0
+while j < M
+  i = 0
+  while i < N
+    sum += i
+    i += 1
+  end
+  j += 1
+end
+puts "while: #{sum}"
@@ -0,0 +1,16 @@
+#
+# background task of the real-time stress benchmark.
+#
+#  Allocates and releases objects at the default priority until the
+#  periodic tasks end, to keep the allocator and the deferred free
+#  queue busy while they are released. (see rt_stress.c)
+#
+#  $ make run-rt
+#
+
+i = 0
+until rt_finished?
+  s = "churn" * (i % 16 + 1)
+  a = [s, i, {:i => i, :s => s}]
+  i += 1
+end
@@ -0,0 +1,26 @@
+#
+# periodic task of the real-time stress benchmark.
+#
+#  Each job allocates some objects and ends by wait_period. The start
+#  of each job is compared with its release time, counted from the
+#  first job, and reported by rt_record. (see rt_stress.c)
+#
+#  $ make run-rt
+#
+
+PERIOD = 20	# ms
+JOBS = 200
+
+change_priority(10)
+set_period(PERIOD)
+wait_period		# align to a release.
+t0 = rt_clock_us
+
+JOBS.times {|k|
+  rt_record(rt_clock_us - t0 - k * PERIOD * 1000)
+
+  a = []
+  8.times {|i| a << "job" * (i + 1) }
+  h = {:k => k, :a => a}
+  wait_period
+}
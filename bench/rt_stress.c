@@ -0,0 +1,262 @@
+/*! @file
+  @brief
+  mruby/c real-time stress benchmark for POSIX
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (usage)
+  rt_stress [-p periodic tasks] [-c churn tasks] [-n alloc ops]
+            rt_periodic.mrb rt_churn.mrb
+
+  Runs the periodic tasks at a high priority, and the churn tasks
+  that keep the allocator and the scheduler busy at the default
+  priority, until the periodic tasks end. Each job of the periodic
+  tasks reports the lateness of its start by rt_record, by the wall
+  clock from the first job, and by the tick from its release.
+  And then, allocates and frees random sizes of blocks in the pool.
+  The worst measured latencies are reported in two lines:
+
+  ## rt_sched  jobs 600  worst 205 us  avg 1 us  worst 0 ticks  overruns 0  skipped 0
+  ## rt_alloc  ops 100000  alloc worst 6396 ns  avg 80 ns  free worst 4832 ns  avg 63 ns  failed 0
+
+  The lateness by the wall clock includes the ticks lost by the OS,
+  and the latencies include the time of clock_gettime() and the noise
+  of the OS. Build it with MRBC_USE_REALTIME. (see bench/Makefile)
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include "mrubyc.h"
+
+#define POOL_SIZE (1024*64)
+#define ALLOC_SLOTS 256
+#define ALLOC_MAX_SIZE 256
+
+#if !MRBC_USE_REALTIME
+#error "Build with -DMRBC_USE_REALTIME=1"
+#endif
+
+
+static mrbc_tcb *periodic_tcb[MAX_VM_COUNT];
+static int n_periodic;
+static double t0_sec;
+
+static uint32_t n_jobs;
+static int64_t sum_late_us;
+static mrbc_int worst_late_us;
+static uint32_t worst_late_ticks;
+
+
+static uint8_t * load_mrb_file(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+
+  if( fp == NULL ) {
+    fprintf(stderr, "File not found: %s\n", filename);
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  uint8_t *p = malloc(size);
+  if( p == NULL || fread(p, sizeof(uint8_t), size, fp) != size ) {
+    fprintf(stderr, "Read error: %s\n", filename);
+    free(p);
+    p = NULL;
+  }
+  fclose(fp);
+
+  return p;
+}
+
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static long now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+//================================================================
+/*! rt_clock_us -> microseconds since the start.
+*/
+static void c_rt_clock_us(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( (mrbc_int)((now_sec() - t0_sec) * 1e6) );
+}
+
+
+//================================================================
+/*! rt_record( lateness_us )
+
+  The lateness by the tick is taken from the TCB of the caller.
+*/
+static void c_rt_record(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc != 1 || v[1].tt != MRBC_TT_FIXNUM ) return;
+
+  mrbc_int late = GET_INT_ARG(1);
+  if( late > worst_late_us ) worst_late_us = late;
+  sum_late_us += late;
+  n_jobs++;
+
+  const mrbc_tcb *tcb = (mrbc_tcb *)((uint8_t *)vm - offsetof(mrbc_tcb, vm));
+  uint32_t late_ticks = mrbc_get_tick() - tcb->release_tick;
+  if( late_ticks > worst_late_ticks ) worst_late_ticks = late_ticks;
+}
+
+
+//================================================================
+/*! rt_finished? -> true if all the periodic tasks ended.
+*/
+static void c_rt_finished(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  int i;
+  for( i = 0; i < n_periodic; i++ ) {
+    if( periodic_tcb[i]->state != TASKSTATE_DORMANT ) {
+      SET_FALSE_RETURN();
+      return;
+    }
+  }
+  SET_TRUE_RETURN();
+}
+
+
+//================================================================
+/*! allocate and free random sizes of blocks, and report the latency.
+*/
+static void alloc_stress(int n_ops)
+{
+  void *slot[ALLOC_SLOTS] = { 0 };
+  long worst_alloc = 0, worst_free = 0, sum_alloc = 0, sum_free = 0;
+  int n_alloc = 0, n_free = 0, n_failed = 0;
+  int i;
+
+  srand(1);
+  for( i = 0; i < n_ops; i++ ) {
+    int n = rand() % ALLOC_SLOTS;
+
+    if( slot[n] == NULL ) {
+      unsigned int size = 4 + rand() % ALLOC_MAX_SIZE;
+      long t = now_nsec();
+      slot[n] = mrbc_raw_alloc( size );
+      t = now_nsec() - t;
+      if( slot[n] == NULL ) {
+        n_failed++;
+        continue;
+      }
+      if( t > worst_alloc ) worst_alloc = t;
+      sum_alloc += t;
+      n_alloc++;
+    } else {
+      long t = now_nsec();
+      mrbc_raw_free( slot[n] );
+      t = now_nsec() - t;
+      slot[n] = NULL;
+      if( t > worst_free ) worst_free = t;
+      sum_free += t;
+      n_free++;
+    }
+  }
+  for( i = 0; i < ALLOC_SLOTS; i++ ) {
+    if( slot[i] ) mrbc_raw_free( slot[i] );
+  }
+
+  printf("## rt_alloc  ops %d  alloc worst %ld ns  avg %ld ns"
+	 "  free worst %ld ns  avg %ld ns  failed %d\n",
+	 n_ops, worst_alloc, n_alloc ? sum_alloc / n_alloc : 0,
+	 worst_free, n_free ? sum_free / n_free : 0, n_failed);
+}
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-p periodic tasks] [-c churn tasks] [-n alloc ops] periodic.mrb churn.mrb\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int n_churn = 2;
+  int n_ops = 100000;
+  int opt = 1;
+
+  n_periodic = 3;
+  for( ; opt < argc && argv[opt][0] == '-'; opt++ ) {
+    if( opt + 1 >= argc ) break;
+    if( strcmp(argv[opt], "-p") == 0 ) {
+      n_periodic = atoi(argv[++opt]);
+    } else if( strcmp(argv[opt], "-c") == 0 ) {
+      n_churn = atoi(argv[++opt]);
+    } else if( strcmp(argv[opt], "-n") == 0 ) {
+      n_ops = atoi(argv[++opt]);
+    } else {
+      break;
+    }
+  }
+  if( opt + 2 != argc || n_periodic < 1 || n_churn < 0 ||
+      n_periodic + n_churn > MAX_VM_COUNT ) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint8_t *periodic_code = load_mrb_file(argv[opt]);
+  uint8_t *churn_code = load_mrb_file(argv[opt+1]);
+  uint8_t *pool = malloc(POOL_SIZE);
+  if( periodic_code == NULL || churn_code == NULL || pool == NULL ) return 1;
+
+  mrbc_init(pool, POOL_SIZE);
+  mrbc_define_method(0, mrbc_class_object, "rt_clock_us", c_rt_clock_us);
+  mrbc_define_method(0, mrbc_class_object, "rt_record", c_rt_record);
+  mrbc_define_method(0, mrbc_class_object, "rt_finished?", c_rt_finished);
+
+  int i;
+  for( i = 0; i < n_periodic; i++ ) {
+    periodic_tcb[i] = mrbc_create_task(periodic_code, NULL);
+    if( periodic_tcb[i] == NULL ) return 1;
+  }
+  for( i = 0; i < n_churn; i++ ) {
+    if( mrbc_create_task(churn_code, NULL) == NULL ) return 1;
+  }
+
+  t0_sec = now_sec();
+  mrbc_run();
+  fflush(stdout);
+
+  uint32_t n_overruns = 0, n_skipped = 0;
+  for( i = 0; i < n_periodic; i++ ) {
+    n_overruns += periodic_tcb[i]->n_overruns;
+    n_skipped += periodic_tcb[i]->n_skipped;
+  }
+  printf("## rt_sched  jobs %u  worst %d us  avg %d us  worst %u ticks"
+	 "  overruns %u  skipped %u\n",
+	 n_jobs, (int)worst_late_us, n_jobs ? (int)(sum_late_us / n_jobs) : 0,
+	 worst_late_ticks, n_overruns, n_skipped);
+
+  alloc_stress(n_ops);
+
+  free(periodic_code);
+  free(churn_code);
+  free(pool);
+
+  return 0;
+}
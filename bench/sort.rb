@@ -0,0 +1,44 @@
+#
+# sort and iteration benchmark
+#
+#  Array#sort, Array#each, Array#collect, Array#max and Array#include?
+#  on pseudo random Fixnums.
+#
+#  $ make bench
+#
+
+N = 200
+M = 50
+
+seed = 12345
+a = []
+N.times {
+  seed = (seed * 1103515245 + 12345) % 65536
+  a << seed
+}
+
+sum = 0
+M.times {
+  b = a.sort
+  sum += b[0] + b[N - 1]
+}
+puts "sort: #{sum}"
+
+sum = 0
+M.times {
+  a.each {|v| sum += v }
+}
+puts "each: #{sum}"
+
+sum = 0
+M.times {
+  b = a.collect {|v| v * 2 }
+  sum += b.max - b.min
+}
+puts "collect: #{sum}"
+
+cnt = 0
+M.times {|i|
+  cnt += 1 if a.include?(i * 1000)
+}
+puts "include?: #{cnt}"
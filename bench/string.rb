@@ -0,0 +1,39 @@
+#
+# string building benchmark
+#
+#  String#<<, String#+, interpolation, Array#join and String#split.
+#
+#  $ make bench
+#
+
+N = 2000
+
+len = 0
+N.times {|i|
+  s = ""
+  10.times {|j| s << "ab" }
+  s << i.to_s
+  len += s.size
+}
+puts "<<: #{len}"
+
+len = 0
+N.times {|i|
+  s = "x" + i.to_s + "y" + (i * 2).to_s
+  len += s.size
+}
+puts "+: #{len}"
+
+len = 0
+N.times {|i|
+  s = "#{i}:#{i + 1}:#{i * 3}"
+  len += s.size
+}
+puts "interpolation: #{len}"
+
+len = 0
+N.times {|i|
+  s = [i, i + 1, i + 2, "z"].join(",")
+  len += s.split(",").size + s.size
+}
+puts "join/split: #{len}"
@@ -0,0 +1,25 @@
+#
+# multi-task benchmark
+#
+#  Run by some tasks at once (bench_runner -t 4 tasks.mrb). Each task
+#  works and relinquishes the CPU, and counts up a global variable
+#  under a Mutex, to measure the task switching of the scheduler.
+#
+#  $ make bench
+#
+
+N = 2000
+
+$mutex ||= Mutex.new
+$count ||= 0
+
+sum = 0
+N.times {|i|
+  10.times {|j| sum += j }
+  relinquish
+
+  $mutex.lock
+  $count += 1
+  $mutex.unlock
+}
+puts "tasks: #{sum} #{$count}"
@@ -38,12 +38,46 @@
     *prev: linked list, pointer to the previous free block of same block size.
     *top : pointer to this block's top.
 
+  MULTIPLE POOLS (MRBC_ALLOC_MAX_POOLS > 1)
+    The pool given to mrbc_init_alloc() and pools added by
+    mrbc_add_alloc_pool() are shared by all VMs, and are tried in the
+    order of registration. A placement hint (e.g. MRBC_ALLOC_HINT_FAST)
+    prefers pools registered with the same attribute.
+    A pool given to mrbc_set_vm_arena() is an arena, that only
+    mrbc_alloc() of its owner VM uses.
+
+  VM BLOCK LIST (MRBC_ALLOC_VMID_LIST)
+    USED_BLOCK with non-zero vm_id is linked to the list of its VM by
+    *vm_next and *vm_prev, which share the place of *next and *prev of
+    FREE_BLOCK. mrbc_free_all() follows the list instead of walking
+    the whole pool.
+
+  ALLOCATION PROFILER (MRBC_ALLOC_PROFILE)
+    USED_BLOCK has a tag (MRBC_ALLOC_TAG_*) given by MRBC_ALLOC_TAG of
+    the caller's translation unit, and live counts and bytes are kept
+    for each tag. See mrbc_alloc_get_profile().
+
+  COMPACTION (MRBC_ALLOC_COMPACT)
+    USED_BLOCK has a pointer to its only reference (owner), if it is
+    registered by mrbc_alloc_set_owner(). mrbc_alloc_compact() moves
+    such a block lying next to free blocks into a smaller free block,
+    so that the free blocks around it merge into a larger one.
+
+  MULTI-CORE (MRBC_SMP_CORES > 1)
+    The global functions hold hal_lock() while they touch the pools.
+    Small blocks of the main pool freed by mrbc_raw_free() go to the
+    cache of the calling core (hal_core_id()) instead, and stay USED.
+    mrbc_raw_alloc() takes them back without the lock. Only one thread
+    for each core may call the allocator.
+
   </pre>
 */
 
 #if !defined(MRBC_ALLOC_LIBC)
 
 /***** Feature test switches ************************************************/
+#define MRBC_SRC_ALLOC_C_	// not to tag own calls. (MRBC_ALLOC_PROFILE)
+
 /***** System headers *******************************************************/
 #include "vm_config.h"
 #include <stdint.h>
@@ -55,8 +89,13 @@
 #include "alloc.h"
 #include "hal_selector.h"
 #include "console.h"
+#include "snapshot.h"
 
 /***** Constant values ******************************************************/
+#if MRBC_SMP_CORES > 1 && defined(MRBC_ALLOC_COMPACT)
+#error "MRBC_ALLOC_COMPACT can't be used with MRBC_SMP_CORES."
+#endif
+
 /*
   Layer 1st(f) and 2nd(s) model
   last 4bit is ignored
@@ -113,6 +152,16 @@ typedef struct USED_BLOCK {
 #if defined(MRBC_ALLOC_VMID)
   uint8_t	       vm_id;		//!< mruby/c VM ID
 #endif
+#if defined(MRBC_ALLOC_PROFILE)
+  uint8_t	       tag;		//!< MRBC_ALLOC_TAG_*
+#endif
+#if defined(MRBC_ALLOC_VMID_LIST)
+  struct USED_BLOCK *vm_next;		//!< linked list of same VM.
+  struct USED_BLOCK *vm_prev;
+#endif
+#if defined(MRBC_ALLOC_COMPACT)
+  void		     **owner;		//!< reference to this block, if movable.
+#endif
 } USED_BLOCK;
 
 typedef struct FREE_BLOCK {
@@ -120,6 +169,9 @@ typedef struct FREE_BLOCK {
 #if defined(MRBC_ALLOC_VMID)
   uint8_t	       vm_id;		//!< dummy
 #endif
+#if defined(MRBC_ALLOC_PROFILE)
+  uint8_t	       tag;		//!< dummy
+#endif
 
   struct FREE_BLOCK *next_free;
   struct FREE_BLOCK *prev_free;
@@ -145,6 +197,16 @@ typedef struct USED_BLOCK {
 #else
   MRBC_ALLOC_MEMSIZE_T size;
 #endif
+#if defined(MRBC_ALLOC_PROFILE)
+  uint8_t	       tag;		//!< MRBC_ALLOC_TAG_*
+#endif
+#if defined(MRBC_ALLOC_VMID_LIST)
+  struct USED_BLOCK *vm_next;		//!< linked list of same VM.
+  struct USED_BLOCK *vm_prev;
+#endif
+#if defined(MRBC_ALLOC_COMPACT)
+  void		     **owner;		//!< reference to this block, if movable.
+#endif
 } USED_BLOCK;
 
 typedef struct FREE_BLOCK {
@@ -154,6 +216,9 @@ typedef struct FREE_BLOCK {
 #else
   MRBC_ALLOC_MEMSIZE_T size;
 #endif
+#if defined(MRBC_ALLOC_PROFILE)
+  uint8_t	       tag;		//!< dummy
+#endif
 
   struct FREE_BLOCK *next_free;
   struct FREE_BLOCK *prev_free;
@@ -164,6 +229,16 @@ typedef struct FREE_BLOCK {
 # error 'define MRBC_ALLOC_*' required.
 #endif
 
+#if defined(MRBC_ALLOC_VMID_LIST) && !defined(MRBC_ALLOC_VMID)
+# error "MRBC_ALLOC_VMID_LIST needs MRBC_ALLOC_VMID"
+#endif
+
+#if defined(MRBC_ALLOC_COMPACT)
+#define SET_OWNER(p,o)	(((USED_BLOCK *)(p))->owner = (o))
+#else
+#define SET_OWNER(p,o)	((void)0)
+#endif
+
 /*
   and operation macro
 */
@@ -193,6 +268,12 @@ typedef struct FREE_BLOCK {
 */
 typedef struct MEMORY_POOL {
   MRBC_ALLOC_MEMSIZE_T size;
+#if MRBC_ALLOC_MAX_POOLS > 1
+  uint8_t attr;			//!< MRBC_ALLOC_HINT_* that this pool serves.
+  uint8_t vm_id;		//!< owner VM ID if arena, or 0.
+  uint8_t flag_foreign;		//!< arena has blocks of other owners.
+  uint8_t flag_spilled;		//!< owner has blocks out of the arena.
+#endif
 
   // free memory bitmap
   uint16_t free_fli_bitmap;
@@ -212,13 +293,121 @@ typedef struct MEMORY_POOL {
 #define NLZ_SLI(x) nlz8(x)
 
 
+#if MRBC_USE_ALLOC_SLAB
+/*
+  slab front-end for small size.
+
+  SLAB CHUNK (one USED_BLOCK in the pool)
+     |USED_BLOCK| SLAB_CHUNK | slot        | slot        | ...
+     +----------+------------+-------------+-------------+---
+     |size      |*next, cls  |hdr| (data)  |hdr| (data)  |
+
+  hdr: USED_BLOCK whose size member is (class << 2) | used flag.
+       It is less than MRBC_MIN_MEMORY_BLOCK_SIZE, so that
+       mrbc_raw_free() can tell slab slots from TLSF blocks.
+       vm_id member is used as it is.
+  free slots are linked by the pointer stored in its data area.
+*/
+#define SLAB_NUM_CLASS	4
+#define SLAB_UNIT	(sizeof(void *) * 2)
+#define SLAB_MAX_SIZE	(SLAB_UNIT * SLAB_NUM_CLASS)
+#define SLAB_CLASS(size) ((size) ? ((size) - 1) / SLAB_UNIT : 0)
+#define SLAB_SIZE(cls)	(SLAB_UNIT * ((cls) + 1))
+#define SLAB_STRIDE(cls) ((sizeof(USED_BLOCK) + SLAB_SIZE(cls) + 3) & ~3)
+#define IS_SLAB_SLOT(p)	(BLOCK_SIZE(p) < MRBC_MIN_MEMORY_BLOCK_SIZE)
+#define SLAB_SLOT_CLASS(p) (BLOCK_SIZE(p) >> 2)
+
+typedef struct SLAB_CHUNK {
+  struct SLAB_CHUNK *next;	//!< next chunk of same class.
+  uint16_t cls;			//!< size class.
+  uint16_t n_slots;		//!< # of slots.
+} SLAB_CHUNK;
+
+#define SLAB_CHUNK_HEADER_SIZE	((sizeof(SLAB_CHUNK) + 3) & ~3)
+#define SLAB_CHUNK_SLOTS(c)	((uint8_t *)(c) + SLAB_CHUNK_HEADER_SIZE)
+#endif
+
+#if MRBC_SMP_CORES > 1 && MRBC_ALLOC_CORE_CACHE_SLOTS > 0 && !defined(MRBC_ALLOC_PROFILE)
+#define ALLOC_CORE_CACHE 1
+/*
+  per-core block cache.
+
+  Class c holds blocks whose size is at least
+  MRBC_MIN_MEMORY_BLOCK_SIZE + CACHE_UNIT * c, linked by the pointer
+  stored in its data area.
+*/
+#define CACHE_NUM_CLASS	8
+#define CACHE_UNIT	8
+#define CACHE_MAX_SIZE	(MRBC_MIN_MEMORY_BLOCK_SIZE + CACHE_UNIT * (CACHE_NUM_CLASS - 1))
+
+typedef struct CORE_CACHE {
+  void *free_list[CACHE_NUM_CLASS];
+  uint8_t n_blocks[CACHE_NUM_CLASS];
+} CORE_CACHE;
+#else
+#define ALLOC_CORE_CACHE 0
+#endif
+
+#if defined(MRBC_ALLOC_PROFILE)
+#if MRBC_USE_ALLOC_SLAB
+#define BLOCK_BYTES(p)	(IS_SLAB_SLOT(p) ? SLAB_STRIDE(SLAB_SLOT_CLASS(p)) \
+					 : BLOCK_SIZE(p))
+#else
+#define BLOCK_BYTES(p)	BLOCK_SIZE(p)
+#endif
+#define TAG_NOT_TRACKED	0xff
+#define PROFILE_ADD(p)	profile_add((USED_BLOCK *)(p), 1)
+#define PROFILE_SUB(p)	profile_add((USED_BLOCK *)(p), -1)
+#define SET_TAG(p,t)	(((USED_BLOCK *)(p))->tag = (t))
+#else
+#define PROFILE_ADD(p)	((void)0)
+#define PROFILE_SUB(p)	((void)0)
+#define SET_TAG(p,t)	((void)0)
+#endif
+
+
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
-// memory pool
-static MEMORY_POOL *memory_pool;
+// memory pools. [0] is the main pool given by mrbc_init_alloc().
+static MRBC_CONTEXT_LOCAL MEMORY_POOL *memory_pools[MRBC_ALLOC_MAX_POOLS];
+#define memory_pool (memory_pools[0])
+#if MRBC_ALLOC_MAX_POOLS > 1
+static MRBC_CONTEXT_LOCAL int num_pools;
+#define NUM_POOLS num_pools
+#else
+#define NUM_POOLS 1
+#endif
+
+#if defined(MRBC_ALLOC_VMID_LIST)
+// list of used blocks for each VM. (index by vm_id)
+static MRBC_CONTEXT_LOCAL USED_BLOCK *vm_blocks[MAX_VM_COUNT+1];
+#endif
+
+#if MRBC_USE_ALLOC_SLAB
+// slab free list and chunk list for each size class.
+static MRBC_CONTEXT_LOCAL void *slab_free_list[SLAB_NUM_CLASS];
+static MRBC_CONTEXT_LOCAL SLAB_CHUNK *slab_chunks[SLAB_NUM_CLASS];
+#endif
+
+#if ALLOC_CORE_CACHE
+static MRBC_CONTEXT_LOCAL CORE_CACHE core_caches[MRBC_SMP_CORES];
+#endif
+
+#if defined(MRBC_ALLOC_PROFILE)
+static MRBC_CONTEXT_LOCAL mrbc_alloc_profile alloc_profile;
+#endif
+
+#if defined(MRBC_ALLOC_COMPACT)
+// some blocks were released after the last compaction.
+static MRBC_CONTEXT_LOCAL uint8_t flag_compact_request;
+#endif
 
 
 /***** Global variables *****************************************************/
+#if defined(MRBC_ALLOC_PROFILE)
+MRBC_CONTEXT_LOCAL uint8_t mrbc_alloc_current_tag;
+#endif
+
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
 //================================================================
@@ -396,67 +585,224 @@ static inline void merge_block(FREE_BLOCK *target, FREE_BLOCK *next)
 }
 
 
-/***** Global functions *****************************************************/
+#if defined(MRBC_ALLOC_PROFILE)
 //================================================================
-/*! initialize
+/*! count up or down the profile
 
-  @param  ptr	pointer to free memory block.
-  @param  size	size. (max 64KB. see MRBC_ALLOC_MEMSIZE_T)
+  @param  tag	MRBC_ALLOC_TAG_*
+  @param  bytes	size of the block.
+  @param  sign	1 if allocated, -1 if released.
 */
-void mrbc_init_alloc(void *ptr, unsigned int size)
+static void profile_count(int tag, int bytes, int sign)
 {
-  assert( MRBC_MIN_MEMORY_BLOCK_SIZE >= sizeof(FREE_BLOCK) );
-  assert( MRBC_MIN_MEMORY_BLOCK_SIZE >= (1 << MRBC_ALLOC_IGNORE_LSBS) );
-  assert( (sizeof(USED_BLOCK) & 0x03) == 0 );
-  assert( (sizeof(FREE_BLOCK) & 0x03) == 0 );
-  assert( size != 0 );
-  assert( size <= (MRBC_ALLOC_MEMSIZE_T)(~0) );
+  int i;
+  for( i = 0; i < MRBC_ALLOC_HISTOGRAM_SIZE - 1; i++ ) {
+    if( bytes <= (16 << i) ) break;
+  }
 
-  if( memory_pool != NULL ) return;
+  alloc_profile.count[tag] += sign;
+  alloc_profile.bytes[tag] += sign * bytes;
+  alloc_profile.histogram[i] += sign;
+  alloc_profile.used += sign * bytes;
+  if( alloc_profile.peak < alloc_profile.used ) {
+    alloc_profile.peak = alloc_profile.used;
+  }
+}
+
+
+//================================================================
+/*! count up or down the profile of the block
+
+  @param  block	pointer to used block.
+  @param  sign	1 if allocated, -1 if released.
+*/
+static void profile_add(USED_BLOCK *block, int sign)
+{
+  if( block->tag >= MRBC_ALLOC_NUM_TAGS ) return;	// not tracked.
+
+  profile_count( block->tag, BLOCK_BYTES(block), sign );
+}
+
+
+#if MRBC_ALLOC_MAX_POOLS > 1 && defined(MRBC_ALLOC_VMID)
+//================================================================
+/*! count down all blocks in the pool (before reset the arena)
+
+  @param  pool	pointer to memory pool.
+*/
+static void profile_sub_pool(MEMORY_POOL *pool)
+{
+  USED_BLOCK *block = BLOCK_TOP(pool);
+
+  while( PHYS_NEXT(block) < BLOCK_END(pool) ) {	// excludes sentinel.
+    if( IS_USED_BLOCK(block) ) PROFILE_SUB(block);
+    block = PHYS_NEXT(block);
+  }
+}
+#endif
+#endif	// defined(MRBC_ALLOC_PROFILE)
+
+
+//================================================================
+/*! initialize a memory pool
+
+  @param  pool	pointer to memory pool.
+  @param  size	size of pool.
+*/
+static void init_pool(MEMORY_POOL *pool, unsigned int size)
+{
   size &= ~(unsigned int)0x03;	// align 4 byte.
-  memory_pool = ptr;
-  memset( memory_pool, 0, sizeof(MEMORY_POOL) );
-  memory_pool->size = size;
+  memset( pool, 0, sizeof(MEMORY_POOL) );
+  pool->size = size;
 
   // initialize memory pool
   //  large free block + zero size used block (sentinel).
   MRBC_ALLOC_MEMSIZE_T sentinel_size = sizeof(USED_BLOCK);
   MRBC_ALLOC_MEMSIZE_T free_size = size - sizeof(MEMORY_POOL) - sentinel_size;
-  FREE_BLOCK *free_block = BLOCK_TOP(memory_pool);
+  FREE_BLOCK *free_block = BLOCK_TOP(pool);
   USED_BLOCK *used_block = (USED_BLOCK *)((uint8_t *)free_block + free_size);
 
   free_block->size = free_size | 0x02;		// flag prev=1, used=0
   used_block->size = sentinel_size | 0x01;	// flag prev=0, used=1
+  SET_OWNER(used_block, NULL);
 
-  add_free_block( memory_pool, free_block );
+  add_free_block( pool, free_block );
 }
 
 
 //================================================================
-/*! cleanup memory pool
+/*! find the memory pool that includes ptr
+
+  @param  ptr	pointer to memory block.
+  @return	pointer to memory pool.
 */
-void mrbc_cleanup_alloc(void)
+static inline MEMORY_POOL * find_pool(const void *ptr)
 {
-#if defined(MRBC_DEBUG)
-  if( memory_pool ) {
-    memset( memory_pool, 0, memory_pool->size );
+#if MRBC_ALLOC_MAX_POOLS > 1
+  int i;
+  for( i = 1; i < num_pools; i++ ) {
+    MEMORY_POOL *pool = memory_pools[i];
+    if( (const void *)pool < ptr && ptr < BLOCK_END(pool) ) return pool;
   }
 #endif
 
-  memory_pool = 0;
+  return memory_pool;
 }
 
 
+#if MRBC_ALLOC_MAX_POOLS > 1 && defined(MRBC_ALLOC_VMID)
 //================================================================
-/*! allocate memory
+/*! find the arena of VM
+
+  @param  vm_id	VM ID.
+  @return	pointer to memory pool or NULL.
+*/
+static inline MEMORY_POOL * find_arena(int vm_id)
+{
+  int i;
+  for( i = 1; i < num_pools; i++ ) {
+    if( memory_pools[i]->vm_id == vm_id ) return memory_pools[i];
+  }
+
+  return NULL;
+}
+#endif
+
+
+#if defined(MRBC_ALLOC_VMID_LIST)
+//================================================================
+/*! link the block to the list of its VM.
+
+  @param  block	pointer to used block.
+*/
+static inline void link_vm_block(USED_BLOCK *block)
+{
+  assert( block->vm_id <= MAX_VM_COUNT );
+  USED_BLOCK **head = &vm_blocks[block->vm_id];
+
+  block->vm_prev = NULL;
+  block->vm_next = *head;
+  if( *head ) (*head)->vm_prev = block;
+  *head = block;
+}
+
+
+//================================================================
+/*! unlink the block from the list of its VM.
+
+  @param  block	pointer to used block.
+*/
+static inline void unlink_vm_block(USED_BLOCK *block)
+{
+  if( block->vm_prev ) {
+    block->vm_prev->vm_next = block->vm_next;
+  } else {
+    vm_blocks[block->vm_id] = block->vm_next;
+  }
+  if( block->vm_next ) block->vm_next->vm_prev = block->vm_prev;
+}
+#endif
+
+
+//================================================================
+/*! set vm id and keep the arena flags and the VM block list.
+
+  @param  ptr	pointer to allocated memory.
+  @param  vm_id	VM ID.
+*/
+static inline void set_vm_id(void *ptr, int vm_id)
+{
+#if defined(MRBC_ALLOC_VMID_LIST)
+  USED_BLOCK *block = (USED_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+  if( block->vm_id == vm_id ) return;
+
+  if( block->vm_id ) unlink_vm_block( block );
+  block->vm_id = vm_id;
+  if( vm_id ) link_vm_block( block );
+#else
+  SET_VM_ID(ptr, vm_id);
+#endif
+
+#if MRBC_ALLOC_MAX_POOLS > 1 && defined(MRBC_ALLOC_VMID)
+  if( num_pools == 1 ) return;
+
+  MEMORY_POOL *pool = find_pool(ptr);
+  if( pool->vm_id ) {
+    if( pool->vm_id != vm_id ) pool->flag_foreign = 1;
+  } else if( vm_id ) {
+    MEMORY_POOL *arena = find_arena(vm_id);
+    if( arena ) arena->flag_spilled = 1;
+  }
+#endif
+}
+
+
+//================================================================
+/*! set vm id, with hal_lock() only if shared lists are updated.
+
+  @param  ptr	pointer to allocated memory.
+  @param  vm_id	VM ID.
+*/
+static inline void set_vm_id_locked(void *ptr, int vm_id)
+{
+#if defined(MRBC_ALLOC_VMID_LIST) || MRBC_ALLOC_MAX_POOLS > 1
+  hal_lock();
+  set_vm_id(ptr, vm_id);
+  hal_unlock();
+#else
+  set_vm_id(ptr, vm_id);
+#endif
+}
+
+
+//================================================================
+/*! calculate the block size from request size.
 
   @param  size	request size.
-  @return void * pointer to allocated memory.
-  @retval NULL	error.
+  @return	block size.
 */
-void * mrbc_raw_alloc(unsigned int size)
+static inline MRBC_ALLOC_MEMSIZE_T calc_alloc_size(unsigned int size)
 {
-  MEMORY_POOL *pool = memory_pool;
   MRBC_ALLOC_MEMSIZE_T alloc_size = size + sizeof(USED_BLOCK);
 
   // align 4 byte
@@ -465,6 +811,20 @@ void * mrbc_raw_alloc(unsigned int size)
   // check minimum alloc size.
   if( alloc_size < MRBC_MIN_MEMORY_BLOCK_SIZE ) alloc_size = MRBC_MIN_MEMORY_BLOCK_SIZE;
 
+  return alloc_size;
+}
+
+
+//================================================================
+/*! allocate memory from the pool
+
+  @param  pool		pointer to memory pool.
+  @param  alloc_size	block size. (returned by calc_alloc_size)
+  @return void * pointer to allocated memory.
+  @retval NULL	no enough memory in this pool.
+*/
+static void * alloc_from_pool(MEMORY_POOL *pool, MRBC_ALLOC_MEMSIZE_T alloc_size)
+{
   FREE_BLOCK *target;
   unsigned int fli, sli;
   unsigned int index = calc_index(alloc_size);
@@ -500,6 +860,10 @@ void * mrbc_raw_alloc(unsigned int size)
     goto FOUND_FLI_SLI;
   }
 
+#if MRBC_USE_REALTIME
+  return NULL;  // ENOMEM, without the search in a list.
+#endif
+
   // Change strategy to First-fit.
   target = pool->free_blocks[--index];
   while( target ) {
@@ -510,12 +874,6 @@ void * mrbc_raw_alloc(unsigned int size)
     target = target->next_free;
   }
 
-  // else out of memory
-  static const char msg[] = "Fatal error: Out of memory.\n";
-  hal_write(1, msg, sizeof(msg)-1);
-#if defined(MRBC_OUT_OF_MEMORY)
-  MRBC_OUT_OF_MEMORY();
-#endif
   return NULL;  // ENOMEM
 
 
@@ -553,6 +911,9 @@ void * mrbc_raw_alloc(unsigned int size)
 #if defined(MRBC_ALLOC_VMID)
   target->vm_id = 0;
 #endif
+  SET_TAG(target, mrbc_alloc_current_tag);
+  PROFILE_ADD(target);
+  SET_OWNER(target, NULL);
 
 #ifdef MRBC_DEBUG
   memset( (uint8_t *)target + sizeof(USED_BLOCK), 0xaa,
@@ -564,111 +925,589 @@ void * mrbc_raw_alloc(unsigned int size)
 
 
 //================================================================
-/*! allocate memory that cannot free and realloc
+/*! allocate memory from the shared pools
 
   @param  size	request size.
+  @param  hint	MRBC_ALLOC_HINT_*
   @return void * pointer to allocated memory.
   @retval NULL	error.
 */
-void * mrbc_raw_alloc_no_free(unsigned int size)
+static void * alloc_shared(unsigned int size, int hint)
 {
-  MEMORY_POOL *pool = memory_pool;
-  MRBC_ALLOC_MEMSIZE_T alloc_size = size + (-size & 3);	// align 4 byte
-
-  // find the tail block
-  FREE_BLOCK *tail = BLOCK_TOP(pool);
-  FREE_BLOCK *prev;
-  do {
-    prev = tail;
-    tail = PHYS_NEXT(tail);
-  } while( PHYS_NEXT(tail) < BLOCK_END(pool) );
+  MRBC_ALLOC_MEMSIZE_T alloc_size = calc_alloc_size(size);
+  void *ptr;
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+  // first, the pools that matches the hint, and then the others.
+  int pass, i;
+  for( pass = 0; pass < 2; pass++ ) {
+    for( i = 0; i < num_pools; i++ ) {
+      MEMORY_POOL *pool = memory_pools[i];
+      if( pool->vm_id ) continue;			// arena
+      if( (pool->attr == hint) != (pass == 0) ) continue;
+
+      ptr = alloc_from_pool( pool, alloc_size );
+      if( ptr ) return ptr;
+    }
+  }
+#else
+  ptr = alloc_from_pool( memory_pool, alloc_size );
+  if( ptr ) return ptr;
+#endif
 
-  // can resize it block?
-  if( IS_USED_BLOCK(prev) ) goto FALLBACK;
-  if( (BLOCK_SIZE(prev) - sizeof(USED_BLOCK)) < size ) goto FALLBACK;
+  // else out of memory
+  static const char msg[] = "Fatal error: Out of memory.\n";
+  hal_write(1, msg, sizeof(msg)-1);
+#if defined(MRBC_OUT_OF_MEMORY)
+  MRBC_OUT_OF_MEMORY();
+#endif
+  return NULL;  // ENOMEM
+}
 
-  remove_free_block( pool, prev );
-  MRBC_ALLOC_MEMSIZE_T free_size = BLOCK_SIZE(prev) - alloc_size;
 
-  if( free_size <= MRBC_MIN_MEMORY_BLOCK_SIZE ) {
-    // no split, use all
-    prev->size += BLOCK_SIZE(tail);
-    SET_USED_BLOCK( prev );
-    tail = prev;
-  }
-  else {
-    // split block
-    MRBC_ALLOC_MEMSIZE_T tail_size = tail->size + alloc_size;	// w/ flags.
-    tail = (FREE_BLOCK*)((uint8_t *)tail - alloc_size);
-    tail->size = tail_size;
-    prev->size -= alloc_size;		// w/ flags.
-    add_free_block( pool, prev );
-  }
+#if defined(MRBC_ALLOC_VMID) && !defined(MRBC_ALLOC_VMID_LIST)
+//================================================================
+/*! release all blocks of the VM in the pool.
 
-  return (uint8_t *)tail + sizeof(USED_BLOCK);
+  @param  pool	pointer to memory pool.
+  @param  vm_id	VM ID.
+*/
+static void free_by_vm_id(MEMORY_POOL *pool, int vm_id)
+{
+  USED_BLOCK *target = BLOCK_TOP(pool);
+  USED_BLOCK *next;
 
- FALLBACK:
-  return mrbc_raw_alloc(alloc_size);
+  while( target < (USED_BLOCK *)BLOCK_END(pool) ) {
+    next = PHYS_NEXT(target);
+    if( IS_USED_BLOCK(target) && (target->vm_id == vm_id) ) {
+      mrbc_raw_free( (uint8_t *)target + sizeof(USED_BLOCK) );
+    }
+    target = next;
+  }
 }
+#endif
 
 
+#if MRBC_USE_ALLOC_SLAB
 //================================================================
-/*! release memory
+/*! release a slab slot
 
-  @param  ptr	Return value of mrbc_raw_alloc()
+  @param  slot	pointer to header of the slot.
 */
-void mrbc_raw_free(void *ptr)
+static inline void slab_free(USED_BLOCK *slot)
 {
-  MEMORY_POOL *pool = memory_pool;
+  int cls = SLAB_SLOT_CLASS(slot);
+  void **p = (void **)((uint8_t *)slot + sizeof(USED_BLOCK));
 
-  // get target block
-  FREE_BLOCK *target = (FREE_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+  SET_FREE_BLOCK(slot);
+#ifdef MRBC_DEBUG
+  memset( p, 0xff, SLAB_SIZE(cls) );
+#endif
+  *p = slab_free_list[cls];
+  slab_free_list[cls] = p;
+}
 
-  // check next block, merge?
-  FREE_BLOCK *next = PHYS_NEXT(target);
 
-  if( IS_FREE_BLOCK(next) ) {
-    remove_free_block( pool, next );
-    merge_block(target, next);
-  } else {
-    SET_PREV_FREE(next);
+//================================================================
+/*! allocate new chunk and add the slots to free list.
+
+  @param  cls	size class.
+  @return	0 if no error.
+*/
+static int slab_refill(int cls)
+{
+  int stride = SLAB_STRIDE(cls);
+  int n = MRBC_ALLOC_SLAB_CHUNK_SLOTS;
+  SLAB_CHUNK *chunk = mrbc_raw_alloc( SLAB_CHUNK_HEADER_SIZE + stride * n );
+  if( !chunk ) return -1;
+  PROFILE_SUB( (uint8_t *)chunk - sizeof(USED_BLOCK) );	// count slots only.
+  SET_TAG( (uint8_t *)chunk - sizeof(USED_BLOCK), TAG_NOT_TRACKED );
+
+  chunk->next = slab_chunks[cls];
+  chunk->cls = cls;
+  chunk->n_slots = n;
+  slab_chunks[cls] = chunk;
+
+  // link in ascending address order.
+  uint8_t *slot = SLAB_CHUNK_SLOTS(chunk) + stride * (n - 1);
+  while( n-- > 0 ) {
+    ((USED_BLOCK *)slot)->size = cls << 2;
+    slab_free( (USED_BLOCK *)slot );
+    slot -= stride;
   }
 
-  // check prev block, merge?
-  if( IS_PREV_FREE(target) ) {
-    FREE_BLOCK *prev = *((FREE_BLOCK **)((uint8_t*)target - sizeof(FREE_BLOCK *)));
+  return 0;
+}
 
-    assert( IS_FREE_BLOCK(prev) );
-    remove_free_block( pool, prev );
-    merge_block(prev, target);
-    target = prev;
+
+//================================================================
+/*! allocate a slab slot
+
+  @param  size	request size. (SLAB_MAX_SIZE or less)
+  @return	pointer to allocated memory.
+  @retval NULL	error.
+*/
+static inline void *slab_alloc(unsigned int size)
+{
+  int cls = SLAB_CLASS(size);
+
+  if( !slab_free_list[cls] && slab_refill(cls) != 0 ) return NULL;
+
+  void **p = slab_free_list[cls];
+  slab_free_list[cls] = *p;
+
+  USED_BLOCK *slot = (USED_BLOCK *)((uint8_t *)p - sizeof(USED_BLOCK));
+  SET_USED_BLOCK(slot);
+#if defined(MRBC_ALLOC_VMID)
+  slot->vm_id = 0;
+#endif
+  SET_TAG(slot, mrbc_alloc_current_tag);
+  PROFILE_ADD(slot);
+  SET_OWNER(slot, NULL);
+#ifdef MRBC_DEBUG
+  memset( p, 0xaa, SLAB_SIZE(cls) );
+#endif
+
+  return p;
+}
+#endif
+
+
+#if defined(MRBC_ALLOC_COMPACT)
+//================================================================
+/*! size of the largest free block in the pool
+
+  @param  pool	pointer to memory pool.
+  @return	size of the block.
+*/
+static int largest_free_block(const MEMORY_POOL *pool)
+{
+  int index = SIZE_FREE_BLOCKS - 1;
+  while( index >= 0 && pool->free_blocks[index] == NULL ) index--;
+  if( index < 0 ) return 0;
+
+  int size = 0;
+  const FREE_BLOCK *block;
+  for( block = pool->free_blocks[index]; block; block = block->next_free ) {
+    if( size < BLOCK_SIZE(block) ) size = BLOCK_SIZE(block);
   }
+  return size;
+}
 
-  // target, add to index
-  add_free_block( pool, target );
+
+//================================================================
+/*! move the block into another free block, if it merges free blocks.
+
+  @param  pool		pointer to memory pool.
+  @param  target	pointer to used block which has the owner.
+  @return		free block that contains old target, or NULL if not moved.
+*/
+static FREE_BLOCK * move_block(MEMORY_POOL *pool, USED_BLOCK *target)
+{
+  FREE_BLOCK *next = PHYS_NEXT(target);
+  FREE_BLOCK *end = IS_FREE_BLOCK(next) ? PHYS_NEXT(next) : next;
+  MRBC_ALLOC_MEMSIZE_T merged_size = (uint8_t *)end - (uint8_t *)target;
+
+  if( IS_PREV_FREE(target) ) {
+    FREE_BLOCK *prev = *((FREE_BLOCK **)((uint8_t*)target - sizeof(FREE_BLOCK *)));
+    merged_size += BLOCK_SIZE(prev);
+  }
+  if( merged_size == BLOCK_SIZE(target) ) return NULL;	// no free neighbors.
+
+  uint8_t *ptr = (uint8_t *)target + sizeof(USED_BLOCK);
+  uint8_t *new_ptr = alloc_from_pool( pool, BLOCK_SIZE(target) );
+  if( new_ptr == NULL ) return NULL;
+
+  // it must go into smaller free block, and not into the next one
+  // so that the compaction always makes progress, and must not waste
+  // the rest of the free block.
+  USED_BLOCK *new_block = (USED_BLOCK *)(new_ptr - sizeof(USED_BLOCK));
+  FREE_BLOCK *new_next = PHYS_NEXT(new_block);
+  MRBC_ALLOC_MEMSIZE_T used_size = BLOCK_SIZE(new_block);
+  if( IS_FREE_BLOCK(new_next) ) used_size += BLOCK_SIZE(new_next);
+
+  if( (void *)new_block == (void *)next || used_size >= merged_size ||
+      BLOCK_SIZE(new_block) != BLOCK_SIZE(target) ) {
+    mrbc_raw_free( new_ptr );
+    return NULL;
+  }
+
+  memcpy( new_ptr, ptr, BLOCK_SIZE(target) - sizeof(USED_BLOCK) );
+  set_vm_id( new_ptr, GET_VM_ID(ptr) );
+#if defined(MRBC_ALLOC_PROFILE)
+  mrbc_alloc_set_tag( new_ptr, target->tag );
+#endif
+  new_block->owner = target->owner;
+  *new_block->owner = new_ptr;
+
+  mrbc_raw_free( ptr );
+
+  return *((FREE_BLOCK **)((uint8_t*)end - sizeof(FREE_BLOCK *)));
 }
+#endif
 
 
+#if ALLOC_CORE_CACHE
 //================================================================
-/*! re-allocate memory
+/*! take a block from the cache of the calling core.
 
-  @param  ptr	Return value of mrbc_raw_alloc()
-  @param  size	request size
+  @param  size	request size.
+  @return	pointer to allocated memory, or NULL if not cached.
+*/
+static inline void * cache_alloc(unsigned int size)
+{
+  MRBC_ALLOC_MEMSIZE_T alloc_size = calc_alloc_size(size);
+  if( alloc_size > CACHE_MAX_SIZE ) return NULL;
+
+  int core = hal_core_id();
+  if( core >= MRBC_SMP_CORES ) return NULL;
+
+  CORE_CACHE *cache = &core_caches[core];
+  int cls = (alloc_size - MRBC_MIN_MEMORY_BLOCK_SIZE + CACHE_UNIT - 1) / CACHE_UNIT;
+  void *ptr = cache->free_list[cls];
+  if( ptr ) {
+    cache->free_list[cls] = *(void **)ptr;
+    cache->n_blocks[cls]--;
+  }
+
+  return ptr;
+}
+
+
+//================================================================
+/*! put a block into the cache of the calling core.
+
+  @param  block	pointer to header of the block.
+  @return	non-zero if cached.
+*/
+static inline int cache_free(USED_BLOCK *block)
+{
+  if( BLOCK_SIZE(block) < MRBC_MIN_MEMORY_BLOCK_SIZE ) return 0;  // slab
+  if( BLOCK_SIZE(block) > CACHE_MAX_SIZE + CACHE_UNIT - 4 ) return 0;
+  if( find_pool(block) != memory_pool ) return 0;
+
+  int core = hal_core_id();
+  if( core >= MRBC_SMP_CORES ) return 0;
+
+  CORE_CACHE *cache = &core_caches[core];
+  int cls = (BLOCK_SIZE(block) - MRBC_MIN_MEMORY_BLOCK_SIZE) / CACHE_UNIT;
+  if( cache->n_blocks[cls] >= MRBC_ALLOC_CORE_CACHE_SLOTS ) return 0;
+
+  // not to be released by mrbc_free_all().
+#if defined(MRBC_ALLOC_VMID_LIST)
+  if( block->vm_id ) {
+    hal_lock();
+    unlink_vm_block( block );
+    hal_unlock();
+  }
+#endif
+#if defined(MRBC_ALLOC_VMID)
+  block->vm_id = 0;
+#endif
+
+  void **p = (void **)((uint8_t *)block + sizeof(USED_BLOCK));
+  *p = cache->free_list[cls];
+  cache->free_list[cls] = p;
+  cache->n_blocks[cls]++;
+
+  return 1;
+}
+#endif
+
+
+/***** Global functions *****************************************************/
+//================================================================
+/*! initialize
+
+  @param  ptr	pointer to free memory block.
+  @param  size	size. (max 64KB. see MRBC_ALLOC_MEMSIZE_T)
+*/
+void mrbc_init_alloc(void *ptr, unsigned int size)
+{
+  assert( MRBC_MIN_MEMORY_BLOCK_SIZE >= sizeof(FREE_BLOCK) );
+  assert( MRBC_MIN_MEMORY_BLOCK_SIZE >= (1 << MRBC_ALLOC_IGNORE_LSBS) );
+  assert( (sizeof(USED_BLOCK) & 0x03) == 0 );
+  assert( (sizeof(FREE_BLOCK) & 0x03) == 0 );
+  assert( size != 0 );
+  assert( size <= (MRBC_ALLOC_MEMSIZE_T)(~0) );
+
+  if( memory_pool != NULL ) return;
+  memory_pool = ptr;
+  init_pool( memory_pool, size );
+#if MRBC_ALLOC_MAX_POOLS > 1
+  num_pools = 1;
+#endif
+#if defined(MRBC_ALLOC_VMID_LIST)
+  memset( vm_blocks, 0, sizeof(vm_blocks) );
+#endif
+#if defined(MRBC_ALLOC_PROFILE)
+  memset( &alloc_profile, 0, sizeof(alloc_profile) );
+#endif
+
+#if MRBC_USE_ALLOC_SLAB
+  assert( (SLAB_NUM_CLASS << 2) <= MRBC_MIN_MEMORY_BLOCK_SIZE );
+  memset( slab_free_list, 0, sizeof(slab_free_list) );
+  memset( slab_chunks, 0, sizeof(slab_chunks) );
+#endif
+#if ALLOC_CORE_CACHE
+  assert( MRBC_MIN_MEMORY_BLOCK_SIZE >= sizeof(USED_BLOCK) + sizeof(void *) );
+  memset( core_caches, 0, sizeof(core_caches) );
+#endif
+}
+
+
+//================================================================
+/*! cleanup memory pool
+*/
+void mrbc_cleanup_alloc(void)
+{
+  int i;
+  for( i = 0; i < NUM_POOLS; i++ ) {
+#if defined(MRBC_DEBUG)
+    if( memory_pools[i] ) {
+      memset( memory_pools[i], 0, memory_pools[i]->size );
+    }
+#endif
+    memory_pools[i] = 0;
+  }
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+  num_pools = 0;
+#endif
+}
+
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+//================================================================
+/*! add a shared memory pool
+
+  @param  ptr	pointer to free memory block.
+  @param  size	size. (max 16M bytes)
+  @param  attr	MRBC_ALLOC_HINT_* that this pool serves first.
+  @retval 0	No error.
+  @retval -1	too many pools.
+*/
+int mrbc_add_alloc_pool(void *ptr, unsigned int size, int attr)
+{
+  assert( memory_pool != NULL );
+  assert( size <= (MRBC_ALLOC_MEMSIZE_T)(~0) );
+
+  if( num_pools >= MRBC_ALLOC_MAX_POOLS ) return -1;
+
+  MEMORY_POOL *pool = ptr;
+  init_pool( pool, size );
+  pool->attr = attr;
+  memory_pools[num_pools++] = pool;
+
+  return 0;
+}
+#endif
+
+
+//================================================================
+/*! allocate memory
+
+  @param  size	request size.
   @return void * pointer to allocated memory.
   @retval NULL	error.
 */
-void * mrbc_raw_realloc(void *ptr, unsigned int size)
+void * mrbc_raw_alloc(unsigned int size)
+{
+  void *ptr = NULL;
+
+#if ALLOC_CORE_CACHE
+  ptr = cache_alloc(size);
+  if( ptr ) return ptr;
+#endif
+
+  hal_lock();
+#if MRBC_USE_ALLOC_SLAB
+  if( size <= SLAB_MAX_SIZE ) ptr = slab_alloc(size);
+#endif
+  if( ptr == NULL ) ptr = alloc_shared( size, MRBC_ALLOC_HINT_NORMAL );
+  hal_unlock();
+
+  return ptr;
+}
+
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+//================================================================
+/*! allocate memory with placement hint
+
+  @param  size	request size.
+  @param  hint	MRBC_ALLOC_HINT_*
+  @return void * pointer to allocated memory.
+  @retval NULL	error.
+*/
+void * mrbc_raw_alloc_hint(unsigned int size, int hint)
 {
+  if( hint == MRBC_ALLOC_HINT_NORMAL ) return mrbc_raw_alloc(size);
+
+  hal_lock();
+  void *ptr = alloc_shared( size, hint );
+  hal_unlock();
+
+  return ptr;
+}
+#endif
+
+
+//================================================================
+/*! allocate memory that cannot free and realloc
+
+  @param  size	request size.
+  @return void * pointer to allocated memory.
+  @retval NULL	error.
+*/
+void * mrbc_raw_alloc_no_free(unsigned int size)
+{
+#if MRBC_USE_REALTIME
+  // finding the tail block takes the time of the number of blocks.
+  return mrbc_raw_alloc(size);
+#else
   MEMORY_POOL *pool = memory_pool;
+  MRBC_ALLOC_MEMSIZE_T alloc_size = size + (-size & 3);	// align 4 byte
+
+  hal_lock();
+  // find the tail block
+  FREE_BLOCK *tail = BLOCK_TOP(pool);
+  FREE_BLOCK *prev;
+  do {
+    prev = tail;
+    tail = PHYS_NEXT(tail);
+  } while( PHYS_NEXT(tail) < BLOCK_END(pool) );
+
+  // can resize it block?
+  if( IS_USED_BLOCK(prev) ) goto FALLBACK;
+  if( (BLOCK_SIZE(prev) - sizeof(USED_BLOCK)) < size ) goto FALLBACK;
+
+  remove_free_block( pool, prev );
+  MRBC_ALLOC_MEMSIZE_T free_size = BLOCK_SIZE(prev) - alloc_size;
+
+  if( free_size <= MRBC_MIN_MEMORY_BLOCK_SIZE ) {
+    // no split, use all
+    prev->size += BLOCK_SIZE(tail);
+    SET_USED_BLOCK( prev );
+    tail = prev;
+  }
+  else {
+    // split block
+    MRBC_ALLOC_MEMSIZE_T tail_size = tail->size + alloc_size;	// w/ flags.
+    tail = (FREE_BLOCK*)((uint8_t *)tail - alloc_size);
+    tail->size = tail_size;
+    prev->size -= alloc_size;		// w/ flags.
+    add_free_block( pool, prev );
+  }
+#if defined(MRBC_ALLOC_VMID)
+  ((USED_BLOCK *)tail)->vm_id = 0;
+#endif
+#if defined(MRBC_ALLOC_PROFILE)
+  // the tail block holds all no_free areas, so count this area only.
+  SET_TAG(tail, TAG_NOT_TRACKED);
+  profile_count( mrbc_alloc_current_tag, alloc_size, 1 );
+#endif
+  SET_OWNER(tail, NULL);
+  hal_unlock();
+
+  return (uint8_t *)tail + sizeof(USED_BLOCK);
+
+ FALLBACK:
+  hal_unlock();
+  return mrbc_raw_alloc(alloc_size);
+#endif
+}
+
+
+//================================================================
+/*! release memory
+
+  @param  ptr	Return value of mrbc_raw_alloc()
+*/
+void mrbc_raw_free(void *ptr)
+{
+  // get target block
+  FREE_BLOCK *target = (FREE_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+
+#if ALLOC_CORE_CACHE
+  if( cache_free( (USED_BLOCK *)target ) ) return;
+#endif
+
+  hal_lock();
+  MEMORY_POOL *pool = find_pool(ptr);
+
+#if defined(MRBC_ALLOC_VMID_LIST)
+  if( target->vm_id ) unlink_vm_block( (USED_BLOCK *)target );
+#endif
+  PROFILE_SUB(target);
+
+#if MRBC_USE_ALLOC_SLAB
+  if( IS_SLAB_SLOT(target) ) {
+    slab_free( (USED_BLOCK *)target );
+    hal_unlock();
+    return;
+  }
+#endif
+
+#if defined(MRBC_ALLOC_COMPACT)
+  flag_compact_request = 1;
+#endif
+
+  // check next block, merge?
+  FREE_BLOCK *next = PHYS_NEXT(target);
+
+  if( IS_FREE_BLOCK(next) ) {
+    remove_free_block( pool, next );
+    merge_block(target, next);
+  } else {
+    SET_PREV_FREE(next);
+  }
+
+  // check prev block, merge?
+  if( IS_PREV_FREE(target) ) {
+    FREE_BLOCK *prev = *((FREE_BLOCK **)((uint8_t*)target - sizeof(FREE_BLOCK *)));
+
+    assert( IS_FREE_BLOCK(prev) );
+    remove_free_block( pool, prev );
+    merge_block(prev, target);
+    target = prev;
+  }
+
+  // target, add to index
+  add_free_block( pool, target );
+  hal_unlock();
+}
+
+
+//================================================================
+/*! re-allocate memory (body of mrbc_raw_realloc)
+*/
+static void * raw_realloc(void *ptr, unsigned int size)
+{
+  MEMORY_POOL *pool = find_pool(ptr);
   USED_BLOCK *target = (USED_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
-  MRBC_ALLOC_MEMSIZE_T alloc_size = size + sizeof(USED_BLOCK);
+  MRBC_ALLOC_MEMSIZE_T alloc_size = calc_alloc_size(size);
   FREE_BLOCK *next;
 
-  // align 4 byte
-  alloc_size += (-alloc_size & 3);
+#if MRBC_USE_ALLOC_SLAB
+  if( IS_SLAB_SLOT(target) ) {
+    int cls = SLAB_SLOT_CLASS(target);
+    if( size <= SLAB_SIZE(cls) ) return ptr;
 
-  // check minimum alloc size.
-  if( alloc_size < MRBC_MIN_MEMORY_BLOCK_SIZE ) alloc_size = MRBC_MIN_MEMORY_BLOCK_SIZE;
+    void *new_ptr = mrbc_raw_alloc(size);
+    if( new_ptr == NULL ) return NULL;  // ENOMEM
+
+    memcpy(new_ptr, ptr, SLAB_SIZE(cls));
+    set_vm_id(new_ptr, GET_VM_ID(ptr));
+#if defined(MRBC_ALLOC_PROFILE)
+    mrbc_alloc_set_tag(new_ptr, target->tag);
+#endif
+    SET_OWNER((uint8_t *)new_ptr - sizeof(USED_BLOCK), target->owner);
+    mrbc_raw_free(ptr);
+
+    return new_ptr;
+  }
+#endif
 
   // expand? part1.
   // next phys block is free and enough size?
@@ -677,13 +1516,17 @@ void * mrbc_raw_realloc(void *ptr, unsigned int size)
     if( IS_USED_BLOCK(next) ) goto ALLOC_AND_COPY;
     if( (BLOCK_SIZE(target) + BLOCK_SIZE(next)) < alloc_size ) goto ALLOC_AND_COPY;
 
+    PROFILE_SUB(target);
     remove_free_block( pool, next );
     merge_block((FREE_BLOCK *)target, next);
+    PROFILE_ADD(target);
   }
   next = PHYS_NEXT(target);
 
   // try shrink.
+  PROFILE_SUB(target);
   FREE_BLOCK *release = split_block((FREE_BLOCK *)target, alloc_size);
+  PROFILE_ADD(target);
   if( release != NULL ) {
     SET_PREV_USED(release);
   } else {
@@ -705,11 +1548,20 @@ void * mrbc_raw_realloc(void *ptr, unsigned int size)
   // expand part2.
   // new alloc and copy
  ALLOC_AND_COPY: {
-    void *new_ptr = mrbc_raw_alloc(size);
+    void *new_ptr = NULL;
+#if MRBC_ALLOC_MAX_POOLS > 1
+    // keep it in the arena if possible.
+    if( pool->vm_id ) new_ptr = alloc_from_pool( pool, alloc_size );
+#endif
+    if( new_ptr == NULL ) new_ptr = mrbc_raw_alloc(size);
     if( new_ptr == NULL ) return NULL;  // ENOMEM
 
     memcpy(new_ptr, ptr, BLOCK_SIZE(target) - sizeof(USED_BLOCK));
-    SET_VM_ID(new_ptr, target->vm_id);
+    set_vm_id(new_ptr, GET_VM_ID(ptr));
+#if defined(MRBC_ALLOC_PROFILE)
+    mrbc_alloc_set_tag(new_ptr, target->tag);
+#endif
+    SET_OWNER((uint8_t *)new_ptr - sizeof(USED_BLOCK), target->owner);
 
     mrbc_raw_free(ptr);
 
@@ -718,6 +1570,24 @@ void * mrbc_raw_realloc(void *ptr, unsigned int size)
 }
 
 
+//================================================================
+/*! re-allocate memory
+
+  @param  ptr	Return value of mrbc_raw_alloc()
+  @param  size	request size
+  @return void * pointer to allocated memory.
+  @retval NULL	error.
+*/
+void * mrbc_raw_realloc(void *ptr, unsigned int size)
+{
+  hal_lock();
+  void *new_ptr = raw_realloc(ptr, size);
+  hal_unlock();
+
+  return new_ptr;
+}
+
+
 #if defined(MRBC_ALLOC_VMID)
 //================================================================
 /*! allocate memory
@@ -729,12 +1599,123 @@ void * mrbc_raw_realloc(void *ptr, unsigned int size)
 */
 void * mrbc_alloc(const struct VM *vm, unsigned int size)
 {
-  void *ptr = mrbc_raw_alloc(size);
-  if( ptr == NULL ) return NULL;	// ENOMEM
+  return mrbc_alloc_hint(vm, size, MRBC_ALLOC_HINT_NORMAL);
+}
 
-  if( vm ) SET_VM_ID(ptr, vm->vm_id);
 
-  return ptr;
+//================================================================
+/*! allocate memory with placement hint
+
+  @param  vm	pointer to VM.
+  @param  size	request size.
+  @param  hint	MRBC_ALLOC_HINT_*
+  @return void * pointer to allocated memory.
+  @retval NULL	error.
+*/
+void * mrbc_alloc_hint(const struct VM *vm, unsigned int size, int hint)
+{
+  void *ptr = NULL;
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+  // use the arena first, if the VM has.
+  hal_lock();
+  MEMORY_POOL *arena = vm ? find_arena(vm->vm_id) : NULL;
+  if( arena ) {
+    ptr = alloc_from_pool( arena, calc_alloc_size(size) );
+    if( ptr == NULL ) arena->flag_spilled = 1;
+  }
+  hal_unlock();
+#endif
+  if( ptr == NULL ) ptr = mrbc_raw_alloc_hint(size, hint);
+
+  if( ptr && vm ) set_vm_id_locked(ptr, vm->vm_id);
+
+  return ptr;			// or NULL if ENOMEM.
+}
+
+
+//================================================================
+/*! release memory, vm used. (body of mrbc_free_all)
+*/
+static void free_all(const struct VM *vm)
+{
+  int vm_id = vm->vm_id;
+
+#if defined(MRBC_ALLOC_VMID_LIST)
+  USED_BLOCK *block = vm_blocks[vm_id];
+  USED_BLOCK *next;
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+  // release the blocks out of the arena, and drop the whole arena.
+  MEMORY_POOL *arena = find_arena(vm_id);
+  if( arena && !arena->flag_foreign ) {
+    for( ; arena->flag_spilled && block; block = next ) {
+      next = block->vm_next;
+      if( find_pool(block) != arena ) {
+	mrbc_raw_free( (uint8_t *)block + sizeof(USED_BLOCK) );
+      }
+    }
+#if defined(MRBC_ALLOC_PROFILE)
+    profile_sub_pool( arena );
+#endif
+    init_pool( arena, arena->size );
+    arena->vm_id = vm_id;
+    vm_blocks[vm_id] = NULL;
+    return;
+  }
+  if( arena ) arena->flag_spilled = 0;
+#endif
+
+  for( ; block; block = next ) {
+    next = block->vm_next;
+    mrbc_raw_free( (uint8_t *)block + sizeof(USED_BLOCK) );
+  }
+
+#else
+#if MRBC_ALLOC_MAX_POOLS > 1
+  // drop the whole arena, or release the owner's blocks if it is shared.
+  MEMORY_POOL *arena = find_arena(vm_id);
+  if( arena ) {
+    int flag_spilled = arena->flag_spilled;
+    if( arena->flag_foreign ) {
+      free_by_vm_id( arena, vm_id );
+    } else {
+#if defined(MRBC_ALLOC_PROFILE)
+      profile_sub_pool( arena );
+#endif
+      init_pool( arena, arena->size );
+      arena->vm_id = vm_id;
+    }
+    arena->flag_spilled = 0;
+    if( !flag_spilled ) return;
+  }
+
+  int i;
+  for( i = 0; i < num_pools; i++ ) {
+    if( memory_pools[i]->vm_id == 0 ) free_by_vm_id( memory_pools[i], vm_id );
+  }
+#else
+  free_by_vm_id( memory_pool, vm_id );
+#endif
+
+#if MRBC_USE_ALLOC_SLAB
+  int cls;
+  for( cls = 0; cls < SLAB_NUM_CLASS; cls++ ) {
+    SLAB_CHUNK *chunk;
+    for( chunk = slab_chunks[cls]; chunk; chunk = chunk->next ) {
+      uint8_t *slot = SLAB_CHUNK_SLOTS(chunk);
+      int j;
+      for( j = 0; j < chunk->n_slots; j++, slot += SLAB_STRIDE(cls) ) {
+	USED_BLOCK *target = (USED_BLOCK *)slot;
+	if( IS_USED_BLOCK(target) && (target->vm_id == vm_id) ) {
+	  PROFILE_SUB( target );
+	  slab_free( target );
+	}
+      }
+    }
+  }
+#endif
+#endif	// defined(MRBC_ALLOC_VMID_LIST)
 }
 
 
@@ -745,21 +1726,79 @@ void * mrbc_alloc(const struct VM *vm, unsigned int size)
 */
 void mrbc_free_all(const struct VM *vm)
 {
-  MEMORY_POOL *pool = memory_pool;
-  USED_BLOCK *target = BLOCK_TOP(pool);
-  USED_BLOCK *next;
-  int vm_id = vm->vm_id;
+  hal_lock();
+  free_all(vm);
+  hal_unlock();
+}
 
-  while( target < (USED_BLOCK *)BLOCK_END(pool) ) {
-    next = PHYS_NEXT(target);
-    if( IS_USED_BLOCK(target) && (target->vm_id == vm_id) ) {
-      mrbc_raw_free( (uint8_t *)target + sizeof(USED_BLOCK) );
+
+#if MRBC_ALLOC_MAX_POOLS > 1
+//================================================================
+/*! set or release the arena of VM (body of mrbc_set_vm_arena)
+*/
+static int set_vm_arena(const struct VM *vm, void *ptr, unsigned int size)
+{
+  MEMORY_POOL *arena = find_arena(vm->vm_id);
+
+  if( ptr == NULL ) {
+    if( !arena ) return 0;
+
+    // keep it as a shared pool, if blocks of other owners are alive.
+    if( arena->flag_foreign ) {
+      USED_BLOCK *block = BLOCK_TOP(arena);
+      while( PHYS_NEXT(block) < BLOCK_END(arena) ) {	// excludes sentinel.
+	if( IS_USED_BLOCK(block) ) {
+	  arena->vm_id = 0;
+	  return 1;
+	}
+	block = PHYS_NEXT(block);
+      }
     }
-    target = next;
+
+    int i;
+    for( i = 1; memory_pools[i] != arena; i++ )
+      ;
+    for( num_pools--; i < num_pools; i++ ) {
+      memory_pools[i] = memory_pools[i+1];
+    }
+    return 0;
   }
+
+  if( arena ) return -1;
+  if( mrbc_add_alloc_pool( ptr, size, MRBC_ALLOC_HINT_NORMAL ) != 0 ) return -1;
+  memory_pools[num_pools-1]->vm_id = vm->vm_id;
+
+  return 0;
 }
 
 
+//================================================================
+/*! set or release the arena of VM
+
+  mrbc_alloc() of the VM uses the arena first, and mrbc_free_all()
+  drops it at once. If a block in the arena was handed to another
+  owner by mrbc_set_vm_id(), the arena is released block by block
+  instead, and if such blocks are still alive when released by
+  ptr == NULL, it remains as a shared pool.
+
+  @param  vm	pointer to VM. (after mrbc_vm_open)
+  @param  ptr	pointer to free memory block, or NULL to release.
+  @param  size	size. (max 16M bytes)
+  @retval 0	No error.
+  @retval 1	released, but remains as a shared pool.
+  @retval -1	too many pools, or the VM already has an arena.
+*/
+int mrbc_set_vm_arena(const struct VM *vm, void *ptr, unsigned int size)
+{
+  hal_lock();
+  int ret = set_vm_arena(vm, ptr, size);
+  hal_unlock();
+
+  return ret;
+}
+#endif
+
+
 //================================================================
 /*! set vm id
 
@@ -768,7 +1807,7 @@ void mrbc_free_all(const struct VM *vm)
 */
 void mrbc_set_vm_id(void *ptr, int vm_id)
 {
-  SET_VM_ID(ptr, vm_id);
+  set_vm_id_locked(ptr, vm_id);
 }
 
 
@@ -785,6 +1824,119 @@ int mrbc_get_vm_id(void *ptr)
 #endif	// defined(MRBC_ALLOC_VMID)
 
 
+#if defined(MRBC_ALLOC_COMPACT)
+//================================================================
+/*! register the only reference to the block, to make it movable.
+
+  @param  ptr	Return value of mrbc_raw_alloc()
+  @param  owner	pointer to the pointer that holds ptr, or NULL.
+  @note	The owner must not be in a movable block.
+*/
+void mrbc_alloc_set_owner(void *ptr, void **owner)
+{
+  USED_BLOCK *block = (USED_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+
+  block->owner = owner;
+}
+
+
+//================================================================
+/*! compaction
+
+  Move the movable blocks next to free blocks upto max_moves times,
+  to merge free blocks. Call it when no VM is running, e.g. at idle.
+
+  @param  max_moves	maximum number of blocks to be moved.
+  @return		bytes grown of the largest free block.
+*/
+int mrbc_alloc_compact(int max_moves)
+{
+  if( !flag_compact_request ) return 0;
+
+  int recovered = 0;
+  int i;
+  for( i = 0; i < NUM_POOLS; i++ ) {
+    MEMORY_POOL *pool = memory_pools[i];
+    int largest = largest_free_block( pool );
+    USED_BLOCK *block = BLOCK_TOP(pool);
+
+    while( max_moves > 0 && PHYS_NEXT(block) < BLOCK_END(pool) ) {
+      if( IS_USED_BLOCK(block) && block->owner ) {
+	FREE_BLOCK *moved = move_block( pool, block );
+	if( moved ) {
+	  max_moves--;
+	  block = (USED_BLOCK *)moved;
+	}
+      }
+      block = PHYS_NEXT(block);
+    }
+
+    recovered += largest_free_block( pool ) - largest;
+    if( max_moves <= 0 ) return recovered;	// continue at next time.
+  }
+
+  flag_compact_request = 0;
+  return recovered;
+}
+#endif	// defined(MRBC_ALLOC_COMPACT)
+
+
+#if defined(MRBC_ALLOC_PROFILE)
+//================================================================
+/*! change the tag of the block
+
+  @param  ptr	Return value of mrbc_raw_alloc()
+  @param  tag	MRBC_ALLOC_TAG_*
+*/
+void mrbc_alloc_set_tag(void *ptr, int tag)
+{
+  USED_BLOCK *block = (USED_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+
+  PROFILE_SUB(block);
+  block->tag = tag;
+  PROFILE_ADD(block);
+}
+
+
+//================================================================
+/*! get the allocation profile
+
+  @return	pointer to the profile.
+*/
+const mrbc_alloc_profile * mrbc_alloc_get_profile(void)
+{
+  return &alloc_profile;
+}
+
+
+//================================================================
+/*! reset the high-water mark to the current used bytes.
+*/
+void mrbc_alloc_reset_peak(void)
+{
+  alloc_profile.peak = alloc_profile.used;
+}
+
+
+//================================================================
+/*! get the name of the tag
+
+  @param  tag	MRBC_ALLOC_TAG_*
+  @return	name of the tag.
+*/
+const char * mrbc_alloc_tag_name(int tag)
+{
+  static const char * const names[MRBC_ALLOC_NUM_TAGS] = {
+    "other", "string", "array", "kv", "object",
+    "range", "irep", "callinfo", "symbol", "vm",
+  };
+
+  if( tag < 0 || tag >= MRBC_ALLOC_NUM_TAGS ) return "?";
+  return names[tag];
+}
+#endif	// defined(MRBC_ALLOC_PROFILE)
+
+
 #if defined(MRBC_DEBUG)
 //================================================================
 /*! statistics
@@ -796,38 +1948,56 @@ int mrbc_get_vm_id(void *ptr)
 */
 void mrbc_alloc_statistics(int *total, int *used, int *free, int *fragmentation)
 {
-  MEMORY_POOL *pool = memory_pool;
-  *total = pool->size;
+  *total = 0;
   *used = 0;
   *free = 0;
-  *fragmentation = -1;
-
-  USED_BLOCK *block = BLOCK_TOP(pool);
-  int flag_used_free = IS_USED_BLOCK(block);
+  *fragmentation = 0;
 
-  while( block < (USED_BLOCK *)BLOCK_END(pool) ) {
-    if( IS_FREE_BLOCK(block) ) {
-      *free += BLOCK_SIZE(block);
-    } else {
-      *used += BLOCK_SIZE(block);
+  int i;
+  for( i = 0; i < NUM_POOLS; i++ ) {
+    MEMORY_POOL *pool = memory_pools[i];
+    *total += pool->size;
+    (*fragmentation)--;
+
+    USED_BLOCK *block = BLOCK_TOP(pool);
+    int flag_used_free = IS_USED_BLOCK(block);
+
+    while( block < (USED_BLOCK *)BLOCK_END(pool) ) {
+      if( IS_FREE_BLOCK(block) ) {
+	*free += BLOCK_SIZE(block);
+      } else {
+	*used += BLOCK_SIZE(block);
+      }
+      if( flag_used_free != IS_USED_BLOCK(block) ) {
+	(*fragmentation)++;
+	flag_used_free = IS_USED_BLOCK(block);
+      }
+      block = PHYS_NEXT(block);
     }
-    if( flag_used_free != IS_USED_BLOCK(block) ) {
-      (*fragmentation)++;
-      flag_used_free = IS_USED_BLOCK(block);
+  }
+
+#if MRBC_USE_ALLOC_SLAB
+  // free slots in slab chunks are counted as free.
+  int cls;
+  for( cls = 0; cls < SLAB_NUM_CLASS; cls++ ) {
+    void **p;
+    for( p = slab_free_list[cls]; p; p = *p ) {
+      *used -= SLAB_STRIDE(cls);
+      *free += SLAB_STRIDE(cls);
     }
-    block = PHYS_NEXT(block);
   }
+#endif
 }
 
 
 //================================================================
 /*! print memory block for debug.
 
+  @param  pool	pointer to memory pool.
 */
-void mrbc_alloc_print_memory_pool( void )
+static void print_memory_pool( MEMORY_POOL *pool )
 {
   int i;
-  MEMORY_POOL *pool = memory_pool;
 
   console_printf("== MEMORY POOL HEADER DUMP ==\n");
   console_printf(" Address: %p - %p - %p\n", pool,
@@ -863,6 +2033,9 @@ void mrbc_alloc_print_memory_pool( void )
     console_printf("%p", block );
 #if defined(MRBC_ALLOC_VMID)
     console_printf(" id:%02x", block->vm_id );
+#endif
+#if defined(MRBC_ALLOC_PROFILE)
+    if( IS_USED_BLOCK(block) ) console_printf(" tag:%02x", block->tag );
 #endif
     console_printf(" size:%5d(%04x) use:%d prv:%d ",
 		   block->size & ~0x03, block->size & ~0x03,
@@ -896,5 +2069,77 @@ void mrbc_alloc_print_memory_pool( void )
   }
 }
 
+
+//================================================================
+/*! print memory block for debug.
+
+*/
+void mrbc_alloc_print_memory_pool( void )
+{
+  int n;
+  for( n = 0; n < NUM_POOLS; n++ ) {
+    print_memory_pool( memory_pools[n] );
+  }
+}
+
 #endif // defined(MRBC_DEBUG)
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the allocator. (see snapshot.c)
+
+  The main pool itself is copied by snapshot.c. The inside of the free
+  block before the tail block is not needed, so that only the top of
+  the pool up to its header, and its footer with the tail block are.
+*/
+void mrbc_snapshot_alloc(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, memory_pools );
+#if MRBC_ALLOC_MAX_POOLS > 1
+  MRBC_SNAPSHOT_VAR( s, num_pools );
+#endif
+#if defined(MRBC_ALLOC_VMID_LIST)
+  MRBC_SNAPSHOT_VAR( s, vm_blocks );
+#endif
+#if MRBC_USE_ALLOC_SLAB
+  MRBC_SNAPSHOT_VAR( s, slab_free_list );
+  MRBC_SNAPSHOT_VAR( s, slab_chunks );
+#endif
+#if ALLOC_CORE_CACHE
+  MRBC_SNAPSHOT_VAR( s, core_caches );
+#endif
+#if defined(MRBC_ALLOC_PROFILE)
+  MRBC_SNAPSHOT_VAR( s, alloc_profile );
+#endif
+#if defined(MRBC_ALLOC_COMPACT)
+  MRBC_SNAPSHOT_VAR( s, flag_compact_request );
+#endif
+  if( s->mode == MRBC_SNAPSHOT_MODE_RESTORE ) return;
+
+  // only the main pool can be saved.
+  if( memory_pool == NULL || NUM_POOLS != 1 ) {
+    s->flag_error = 1;
+    return;
+  }
+  s->old_pool = (uintptr_t)memory_pool;
+  s->pool_size = memory_pool->size;
+  s->pool_head = memory_pool->size;
+  s->pool_tail = 0;
+
+  // find the tail block. (see mrbc_raw_alloc_no_free)
+  FREE_BLOCK *tail = BLOCK_TOP(memory_pool);
+  FREE_BLOCK *prev;
+  do {
+    prev = tail;
+    tail = PHYS_NEXT(tail);
+  } while( PHYS_NEXT(tail) < BLOCK_END(memory_pool) );
+  if( IS_USED_BLOCK(prev) ) return;
+
+  s->pool_head = (uint8_t *)prev + sizeof(FREE_BLOCK) - (uint8_t *)memory_pool;
+  s->pool_tail = (uint8_t *)BLOCK_END(memory_pool) - (uint8_t *)tail
+	       + sizeof(FREE_BLOCK *);
+}
+#endif
+
 #endif // !defined(MRBC_ALLOC_LIBC)
@@ -21,17 +21,68 @@ extern "C" {
 #endif
 
 /***** Feature test switches ************************************************/
+#include "vm_config.h"
+
 /***** System headers *******************************************************/
+#include <stdint.h>
 #if defined(MRBC_ALLOC_LIBC)
 #include <stdlib.h>
 #endif
 
 /***** Local headers ********************************************************/
 /***** Constant values ******************************************************/
+// placement hints, and attributes of memory pool.
+#define MRBC_ALLOC_HINT_NORMAL	0
+#define MRBC_ALLOC_HINT_FAST	1	//!< hot objects. e.g. internal SRAM.
+
+// number of size classes in the profile histogram.
+//  The class N holds blocks up to (16 << N) bytes, and the last one
+//  holds all larger blocks.
+#define MRBC_ALLOC_HISTOGRAM_SIZE 8
+
 /***** Macros ***************************************************************/
+// tag of the allocations in this translation unit. (MRBC_ALLOC_PROFILE)
+#if !defined(MRBC_ALLOC_TAG)
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_OTHER
+#endif
+
 /***** Typedefs *************************************************************/
 struct VM;
 
+//================================================================
+/*!@brief
+  Allocation tag (Type or call site of the block)
+*/
+typedef enum {
+  MRBC_ALLOC_TAG_OTHER = 0,
+  MRBC_ALLOC_TAG_STRING,
+  MRBC_ALLOC_TAG_ARRAY,
+  MRBC_ALLOC_TAG_KV,		//!< Hash and key-value tables.
+  MRBC_ALLOC_TAG_OBJECT,	//!< Instance, Class and Method.
+  MRBC_ALLOC_TAG_RANGE,
+  MRBC_ALLOC_TAG_IREP,
+  MRBC_ALLOC_TAG_CALLINFO,
+  MRBC_ALLOC_TAG_SYMBOL,
+  MRBC_ALLOC_TAG_VM,
+
+  MRBC_ALLOC_NUM_TAGS
+} mrbc_alloc_tag;
+
+
+//================================================================
+/*!@brief
+  Allocation profile
+
+  Counts are of live blocks, and bytes include the block headers.
+*/
+typedef struct mrbc_alloc_profile {
+  int count[MRBC_ALLOC_NUM_TAGS];
+  int bytes[MRBC_ALLOC_NUM_TAGS];
+  int histogram[MRBC_ALLOC_HISTOGRAM_SIZE];
+  int used;		//!< total bytes of live blocks.
+  int peak;		//!< high-water mark of used.
+} mrbc_alloc_profile;
+
 /***** Global variables *****************************************************/
 /***** Function prototypes and inline functions *****************************/
 #if !defined(MRBC_ALLOC_LIBC)
@@ -47,6 +98,14 @@ void *mrbc_raw_realloc(void *ptr, unsigned int size);
 #define mrbc_free(vm,ptr)		mrbc_raw_free(ptr)
 #define mrbc_realloc(vm,ptr,size)	mrbc_raw_realloc(ptr, size)
 
+#if MRBC_ALLOC_MAX_POOLS > 1
+// Enables multiple memory pools.
+int mrbc_add_alloc_pool(void *ptr, unsigned int size, int attr);
+void *mrbc_raw_alloc_hint(unsigned int size, int hint);
+#else
+#define mrbc_raw_alloc_hint(size,hint)	mrbc_raw_alloc(size)
+#endif
+
 // for statistics or debug. (need #define MRBC_DEBUG)
 void mrbc_alloc_statistics(int *total, int *used, int *free, int *fragmentation);
 void mrbc_alloc_print_memory_pool(void);
@@ -55,18 +114,58 @@ void mrbc_alloc_print_memory_pool(void);
 #if defined(MRBC_ALLOC_VMID)
 // Enables memory management by VMID.
 void *mrbc_alloc(const struct VM *vm, unsigned int size);
+void *mrbc_alloc_hint(const struct VM *vm, unsigned int size, int hint);
 void mrbc_free_all(const struct VM *vm);
 void mrbc_set_vm_id(void *ptr, int vm_id);
 int mrbc_get_vm_id(void *ptr);
+#if MRBC_ALLOC_MAX_POOLS > 1
+int mrbc_set_vm_arena(const struct VM *vm, void *ptr, unsigned int size);
+#endif
 
 # else
 #define mrbc_alloc(vm,size)	mrbc_raw_alloc(size)
+#define mrbc_alloc_hint(vm,size,hint)	mrbc_raw_alloc_hint(size, hint)
 #define mrbc_free_all(vm)	((void)0)
 #define mrbc_set_vm_id(ptr,id)	((void)0)
 #define mrbc_get_vm_id(ptr)	0
 #endif
 
 
+#if defined(MRBC_ALLOC_COMPACT)
+// Enables compaction.
+void mrbc_alloc_set_owner(void *ptr, void **owner);
+int mrbc_alloc_compact(int max_moves);
+#endif
+
+
+#if defined(MRBC_ALLOC_PROFILE)
+// Enables allocation profiler.
+extern MRBC_CONTEXT_LOCAL uint8_t mrbc_alloc_current_tag;
+void mrbc_alloc_set_tag(void *ptr, int tag);
+const mrbc_alloc_profile *mrbc_alloc_get_profile(void);
+void mrbc_alloc_reset_peak(void);
+const char *mrbc_alloc_tag_name(int tag);
+
+#if !defined(MRBC_SRC_ALLOC_C_)
+// tag the allocations by MRBC_ALLOC_TAG of the caller.
+#define MRBC_ALLOC_TAGGED(call)	(mrbc_alloc_current_tag = MRBC_ALLOC_TAG, call)
+#define mrbc_raw_alloc(size)	MRBC_ALLOC_TAGGED(mrbc_raw_alloc(size))
+#define mrbc_raw_alloc_no_free(size) \
+			MRBC_ALLOC_TAGGED(mrbc_raw_alloc_no_free(size))
+#if MRBC_ALLOC_MAX_POOLS > 1
+#define mrbc_raw_alloc_hint(size,hint) \
+			MRBC_ALLOC_TAGGED(mrbc_raw_alloc_hint(size, hint))
+#endif
+#if defined(MRBC_ALLOC_VMID)
+#define mrbc_alloc(vm,size)	MRBC_ALLOC_TAGGED(mrbc_alloc(vm, size))
+#define mrbc_alloc_hint(vm,size,hint) \
+			MRBC_ALLOC_TAGGED(mrbc_alloc_hint(vm, size, hint))
+#endif
+#endif
+#define MRBC_ALLOC_SET_TAG(ptr,tag)	mrbc_alloc_set_tag(ptr, tag)
+#endif	// MRBC_ALLOC_PROFILE
+
+
 #elif defined(MRBC_ALLOC_LIBC)
 /*
   use the system (libc) memory allocator.
@@ -74,6 +173,15 @@ int mrbc_get_vm_id(void *ptr);
 #if defined(MRBC_ALLOC_VMID)
 #error "Can't use MRBC_ALLOC_LIBC with MRBC_ALLOC_VMID"
 #endif
+#if defined(MRBC_ALLOC_PROFILE)
+#error "Can't use MRBC_ALLOC_LIBC with MRBC_ALLOC_PROFILE"
+#endif
+#if defined(MRBC_ALLOC_COMPACT)
+#error "Can't use MRBC_ALLOC_LIBC with MRBC_ALLOC_COMPACT"
+#endif
+#if MRBC_USE_REALTIME
+#error "Can't use MRBC_ALLOC_LIBC with MRBC_USE_REALTIME"
+#endif
 
 static inline void mrbc_init_alloc(void *ptr, unsigned int size) {}
 static inline void mrbc_cleanup_alloc(void) {}
@@ -98,6 +206,12 @@ static inline void * mrbc_realloc(const struct VM *vm, void *ptr, unsigned int s
 static inline void *mrbc_alloc(const struct VM *vm, unsigned int size) {
   return malloc(size);
 }
+static inline void *mrbc_raw_alloc_hint(unsigned int size, int hint) {
+  return malloc(size);
+}
+static inline void *mrbc_alloc_hint(const struct VM *vm, unsigned int size, int hint) {
+  return malloc(size);
+}
 static inline void mrbc_free_all(const struct VM *vm) {
 }
 static inline void mrbc_set_vm_id(void *ptr, int vm_id) {
@@ -107,6 +221,13 @@ static inline int mrbc_get_vm_id(void *ptr) {
 }
 #endif	// MRBC_ALLOC_LIBC
 
+#if !defined(MRBC_ALLOC_PROFILE)
+#define MRBC_ALLOC_SET_TAG(ptr,tag)	((void)0)
+#endif
+#if !defined(MRBC_ALLOC_COMPACT)
+#define mrbc_alloc_set_owner(ptr,owner)	((void)0)
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -11,6 +11,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_ARRAY
 #include "vm_config.h"
 #include <string.h>
 #include <assert.h>
@@ -21,8 +22,11 @@
 #include "class.h"
 #include "c_array.h"
 #include "c_string.h"
+#include "c_range.h"
 #include "console.h"
+#include "symbol_builtin.h"
 #include "opcode.h"
+#include "gc.h"
 
 /*
   function summary
@@ -82,7 +86,12 @@ mrbc_value mrbc_array_new(struct VM *vm, int size)
   MRBC_INIT_OBJECT_HEADER( h, "AR" );
   h->data_size = size;
   h->n_stored = 0;
+  h->head = 0;
   h->data = data;
+#if MRBC_USE_SHARED_SLICE
+  h->shared = NULL;
+#endif
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
 
   value.array = h;
   return value;
@@ -98,6 +107,16 @@ void mrbc_array_delete(mrbc_value *ary)
 {
   mrbc_array *h = ary->array;
 
+  mrbc_gc_forget(ary);
+
+#if MRBC_USE_SHARED_SLICE
+  // the slice does not own the references.
+  if( h->shared ) {
+    mrbc_array_delete_handle(ary);
+    return;
+  }
+#endif
+
   mrbc_value *p1 = h->data;
   const mrbc_value *p2 = p1 + h->n_stored;
   while( p1 < p2 ) {
@@ -109,7 +128,8 @@ void mrbc_array_delete(mrbc_value *ary)
 
 
 //================================================================
-/*! clear vm_id
+/*! clear vm_id of the handle and the data, not of the elements.
+  (see mrbc_clear_vm_id)
 
   @param  ary	pointer to target value
 */
@@ -119,12 +139,68 @@ void mrbc_array_clear_vm_id(mrbc_value *ary)
 
   mrbc_set_vm_id( h, 0 );
 
-  mrbc_value *p1 = h->data;
+#if MRBC_USE_SHARED_SLICE
+  if( h->shared ) return;	// the data is of the owner.
+#endif
+  if( h->data ) mrbc_set_vm_id( h->data - h->head, 0 );
+}
+
+
+//================================================================
+/*! move the data to the top of the buffer, and release the head room.
+
+  @param  h	pointer to Array handle.
+*/
+static void array_drop_head(mrbc_array *h)
+{
+  if( h->head == 0 ) return;
+
+  mrbc_value *top = h->data - h->head;
+  memmove( top, h->data, sizeof(mrbc_value) * h->n_stored );
+  h->data = top;
+  h->data_size += h->head;
+  h->head = 0;
+
+  // movable again, because data points the top of the block.
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
+}
+
+
+#if MRBC_USE_SHARED_SLICE
+//================================================================
+/*! make own buffer of the slice, and release the shared array.
+
+  @param  ary	pointer to target value
+  @param  size	buffer size. (at least n_stored)
+  @return	mrbc_error_code
+*/
+int mrbc_array_unshare(mrbc_value *ary, int size)
+{
+  mrbc_array *h = ary->array;
+  if( size < h->n_stored ) size = h->n_stored;
+
+  mrbc_value *data = mrbc_raw_alloc( sizeof(mrbc_value) * size );
+  if( !data ) return E_NOMEMORY_ERROR;	// ENOMEM
+
+  mrbc_set_vm_id( data, mrbc_get_vm_id(h) );
+  memcpy( data, h->data, sizeof(mrbc_value) * h->n_stored );
+
+  mrbc_value *p1 = data;
   const mrbc_value *p2 = p1 + h->n_stored;
   while( p1 < p2 ) {
-    mrbc_clear_vm_id(p1++);
+    mrbc_incref(p1++);
   }
+
+  mrbc_value shared = {.tt = MRBC_TT_ARRAY, .array = h->shared};
+  h->shared = NULL;
+  h->data_size = size;
+  h->data = data;
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
+  mrbc_decref( &shared );
+
+  return 0;
 }
+#endif
 
 
 //================================================================
@@ -138,6 +214,10 @@ int mrbc_array_resize(mrbc_value *ary, int size)
 {
   mrbc_array *h = ary->array;
 
+#if MRBC_USE_SHARED_SLICE
+  if( h->shared ) return mrbc_array_unshare(ary, size);
+#endif
+  array_drop_head( h );
   mrbc_value *data2 = mrbc_raw_realloc(h->data, sizeof(mrbc_value) * size);
   if( !data2 ) return E_NOMEMORY_ERROR;	// ENOMEM
 
@@ -164,6 +244,7 @@ int mrbc_array_set(mrbc_value *ary, int idx, mrbc_value *set_val)
     idx = h->n_stored + idx;
     if( idx < 0 ) return E_INDEX_ERROR;		// raise?
   }
+  if( mrbc_array_make_writable(ary) != 0 ) return E_NOMEMORY_ERROR; // ENOMEM
 
   // need resize?
   if( idx >= h->data_size && mrbc_array_resize(ary, idx + 1) != 0 ) {
@@ -218,9 +299,15 @@ int mrbc_array_push(mrbc_value *ary, mrbc_value *set_val)
   mrbc_array *h = ary->array;
 
   if( h->n_stored >= h->data_size ) {
-    int size = h->data_size + 6;
-    if( mrbc_array_resize(ary, size) != 0 )
-      return E_NOMEMORY_ERROR;		// ENOMEM
+    // reuse the head room if it is as large as the data, so that
+    //  each moved data is paid by a shift before. (FIFO use)
+    if( h->head > 0 && h->head >= h->n_stored ) {
+      array_drop_head( h );
+    } else {
+      int size = h->data_size + 6;
+      if( mrbc_array_resize(ary, size) != 0 )
+	return E_NOMEMORY_ERROR;	// ENOMEM
+    }
   }
 
   h->data[h->n_stored++] = *set_val;
@@ -240,6 +327,17 @@ mrbc_value mrbc_array_pop(mrbc_value *ary)
   mrbc_array *h = ary->array;
 
   if( h->n_stored <= 0 ) return mrbc_nil_value();
+
+#if MRBC_USE_SHARED_SLICE
+  // the slice does not own the references, and keeps data_size == n_stored.
+  if( h->shared ) {
+    mrbc_value ret = h->data[--h->n_stored];
+    h->data_size--;
+    mrbc_incref( &ret );
+    return ret;
+  }
+#endif
+
   return h->data[--h->n_stored];
 }
 
@@ -253,7 +351,37 @@ mrbc_value mrbc_array_pop(mrbc_value *ary)
 */
 int mrbc_array_unshift(mrbc_value *ary, mrbc_value *set_val)
 {
-  return mrbc_array_insert(ary, 0, set_val);
+  mrbc_array *h = ary->array;
+
+  if( h->n_stored == 0 ) return mrbc_array_insert(ary, 0, set_val);
+
+  // make the head room in proportion to the data size,
+  //  and move all of the spare area at the tail to the head.
+  if( h->head == 0 ) {
+    int room = h->n_stored / 8 + 6;
+    if( h->data_size - h->n_stored < room ) {
+      // (note) fall back to insert, if it can't be extended enough.
+      if( h->n_stored + room > 0xffff ||
+	  mrbc_array_resize(ary, h->n_stored + room) != 0 ) {
+	return mrbc_array_insert(ary, 0, set_val);
+      }
+    }
+    room = h->data_size - h->n_stored;
+    memmove( h->data + room, h->data, sizeof(mrbc_value) * h->n_stored );
+    mrbc_alloc_set_owner( h->data, NULL );	// data is not the top.
+    h->data += room;
+    h->data_size -= room;
+    h->head = room;
+  }
+
+  h->data--;
+  h->data_size++;
+  h->head--;
+  h->data[0] = *set_val;
+  h->n_stored++;
+  if( h->head == 0 ) mrbc_alloc_set_owner( h->data, (void **)&h->data );
+
+  return 0;
 }
 
 
@@ -270,7 +398,23 @@ mrbc_value mrbc_array_shift(mrbc_value *ary)
   if( h->n_stored <= 0 ) return mrbc_nil_value();
 
   mrbc_value ret = h->data[0];
-  memmove(h->data, h->data+1, sizeof(mrbc_value) * --h->n_stored);
+
+#if MRBC_USE_SHARED_SLICE
+  if( h->shared ) {
+    h->data++;
+    h->data_size--;
+    h->n_stored--;
+    mrbc_incref( &ret );
+    return ret;
+  }
+#endif
+
+  // (note) not move the data, but make the head room.
+  if( h->head == 0 ) mrbc_alloc_set_owner( h->data, NULL );
+  h->data++;
+  h->data_size--;
+  h->head++;
+  if( --h->n_stored == 0 ) array_drop_head( h );
 
   return ret;
 }
@@ -292,6 +436,7 @@ int mrbc_array_insert(mrbc_value *ary, int idx, mrbc_value *set_val)
     idx = h->n_stored + idx + 1;
     if( idx < 0 ) return E_INDEX_ERROR;		// raise?
   }
+  if( mrbc_array_make_writable(ary) != 0 ) return E_NOMEMORY_ERROR; // ENOMEM
 
   // need resize?
   int size = 0;
@@ -340,6 +485,8 @@ mrbc_value mrbc_array_remove(mrbc_value *ary, int idx)
 
   if( idx < 0 ) idx = h->n_stored + idx;
   if( idx < 0 || idx >= h->n_stored ) return mrbc_nil_value();
+  if( idx == 0 ) return mrbc_array_shift(ary);
+  if( mrbc_array_make_writable(ary) != 0 ) return mrbc_nil_value(); // ENOMEM
 
   mrbc_value val = h->data[idx];
   h->n_stored--;
@@ -361,6 +508,15 @@ void mrbc_array_clear(mrbc_value *ary)
 {
   mrbc_array *h = ary->array;
 
+#if MRBC_USE_SHARED_SLICE
+  if( h->shared ) {
+    h->n_stored = 0;
+    h->data_size = 0;
+    mrbc_array_unshare( ary, 0 );	// if ENOMEM, remains empty slice.
+    return;
+  }
+#endif
+
   mrbc_value *p1 = h->data;
   const mrbc_value *p2 = p1 + h->n_stored;
   while( p1 < p2 ) {
@@ -368,6 +524,7 @@ void mrbc_array_clear(mrbc_value *ary)
   }
 
   h->n_stored = 0;
+  array_drop_head( h );
 }
 
 
@@ -456,6 +613,116 @@ mrbc_value mrbc_array_dup(struct VM *vm, const mrbc_value *ary)
 }
 
 
+#if MRBC_USE_SHARED_SLICE
+//================================================================
+/*! make a slice that shares the elements.
+
+  At the first time, ary passes its buffer to a new hidden array,
+  and both refer to it.
+*/
+static mrbc_value array_slice_shared(struct VM *vm, mrbc_value *ary, int idx, int len)
+{
+  mrbc_array *h = ary->array;
+  mrbc_value ret = {.tt = MRBC_TT_ARRAY};
+
+  mrbc_array *h2 = mrbc_alloc(vm, sizeof(mrbc_array));
+  if( !h2 ) return ret;		// ENOMEM
+
+  if( !h->shared ) {
+    mrbc_array *shared = mrbc_raw_alloc(sizeof(mrbc_array));
+    if( !shared ) {		// ENOMEM
+      mrbc_raw_free( h2 );
+      return ret;
+    }
+
+    // move the buffer. it can't be moved by compaction any more.
+    *shared = *h;
+    MRBC_INIT_OBJECT_HEADER( shared, "AR" );
+    mrbc_set_vm_id( shared, mrbc_get_vm_id(h) );
+    if( shared->head == 0 ) mrbc_alloc_set_owner( shared->data, NULL );
+    h->data_size = h->n_stored;
+    h->head = 0;
+    h->shared = shared;
+  }
+
+  MRBC_INIT_OBJECT_HEADER( h2, "AR" );
+  h2->data_size = len;
+  h2->n_stored = len;
+  h2->head = 0;
+  h2->data = h->data + idx;
+  h2->shared = h->shared;
+  h->shared->ref_count++;
+
+  ret.array = h2;
+  return ret;
+}
+
+
+//================================================================
+/*! make an array that shares all the elements of the hidden array.
+
+  @param  vm	pointer to VM.
+  @param  owner	hidden array that owns the elements. (not a slice)
+  @return	result
+*/
+mrbc_value mrbc_array_new_shared(struct VM *vm, mrbc_value *owner)
+{
+  mrbc_array *sh = owner->array;
+  mrbc_value ret = {.tt = MRBC_TT_ARRAY};
+
+  mrbc_array *h = mrbc_alloc(vm, sizeof(mrbc_array));
+  if( !h ) return ret;		// ENOMEM
+
+  MRBC_INIT_OBJECT_HEADER( h, "AR" );
+  h->data_size = sh->n_stored;
+  h->n_stored = sh->n_stored;
+  h->head = 0;
+  h->data = sh->data;
+  h->shared = sh;
+  sh->ref_count++;
+
+  ret.array = h;
+  return ret;
+}
+#endif
+
+
+//================================================================
+/*! slice
+
+  With MRBC_USE_SHARED_SLICE, the result shares the elements with ary
+  if it is long enough.
+
+  @param  vm	pointer to VM.
+  @param  ary	source
+  @param  idx	start index. (0 <= idx <= size)
+  @param  len	length. (0 <= len <= size - idx)
+  @return	result
+*/
+mrbc_value mrbc_array_slice(struct VM *vm, mrbc_value *ary, int idx, int len)
+{
+#if MRBC_USE_SHARED_SLICE
+  if( len >= MRBC_SHARED_SLICE_MIN && len > 0 ) {
+    return array_slice_shared(vm, ary, idx, len);
+  }
+#endif
+
+  mrbc_value ret = mrbc_array_new(vm, len);
+  if( ret.array == NULL ) return ret;		// ENOMEM
+
+  memcpy( ret.array->data, ary->array->data + idx, sizeof(mrbc_value) * len );
+  ret.array->n_stored = len;
+
+  mrbc_value *p1 = ret.array->data;
+  const mrbc_value *p2 = p1 + len;
+  while( p1 < p2 ) {
+    mrbc_incref(p1++);
+  }
+
+  return ret;
+}
+
+
 //================================================================
 /*! method new
 */
@@ -589,16 +856,37 @@ static void c_array_get(struct VM *vm, mrbc_value v[], int argc)
 					// min( v[2].i, (len - idx) )
     if( size < 0 ) goto RETURN_NIL;
 
-    mrbc_value ret = mrbc_array_new(vm, size);
+    mrbc_value ret = mrbc_array_slice(vm, v, idx, size);
     if( ret.array == NULL ) return;		// ENOMEM
 
-    int i;
-    for( i = 0; i < size; i++ ) {
-      mrbc_value val = mrbc_array_get(v, v[1].i + i);
-      mrbc_incref(&val);
-      mrbc_array_push(&ret, &val);
+    SET_RETURN(ret);
+    return;
+  }
+
+  /*
+    in case of self[range] -> Array | nil
+  */
+  if( argc == 1 && v[1].tt == MRBC_TT_RANGE ) {
+    mrbc_value first = mrbc_range_first(&v[1]);
+    mrbc_value last = mrbc_range_last(&v[1]);
+    if( first.tt != MRBC_TT_FIXNUM || last.tt != MRBC_TT_FIXNUM ) {
+      console_print( "TypeError\n" );	// raise?
+      return;
     }
 
+    int len = mrbc_array_size(&v[0]);
+    int idx = first.i;
+    int end = last.i;
+    if( idx < 0 ) idx += len;
+    if( idx < 0 || idx > len ) goto RETURN_NIL;
+    if( end < 0 ) end += len;
+    if( !mrbc_range_exclude_end(&v[1]) ) end++;
+    if( end > len ) end = len;
+    if( end < idx ) end = idx;
+
+    mrbc_value ret = mrbc_array_slice(vm, v, idx, end - idx);
+    if( ret.array == NULL ) return;		// ENOMEM
+
     SET_RETURN(ret);
     return;
   }
@@ -725,6 +1013,25 @@ static void c_array_include(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_array_first(struct VM *vm, mrbc_value v[], int argc)
 {
+  /*
+    in case of first(n) -> Array
+  */
+  if( argc == 1 && v[1].tt == MRBC_TT_FIXNUM ) {
+    int len = mrbc_array_size(&v[0]);
+    int n = v[1].i;
+    if( n < 0 ) {
+      console_print( "ArgumentError\n" );	// raise?
+      return;
+    }
+    if( n > len ) n = len;
+
+    mrbc_value ret = mrbc_array_slice(vm, v, 0, n);
+    if( ret.array == NULL ) return;		// ENOMEM
+
+    SET_RETURN(ret);
+    return;
+  }
+
   mrbc_value val = mrbc_array_get(v, 0);
   mrbc_incref(&val);
   SET_RETURN(val);
@@ -736,6 +1043,25 @@ static void c_array_first(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_array_last(struct VM *vm, mrbc_value v[], int argc)
 {
+  /*
+    in case of last(n) -> Array
+  */
+  if( argc == 1 && v[1].tt == MRBC_TT_FIXNUM ) {
+    int len = mrbc_array_size(&v[0]);
+    int n = v[1].i;
+    if( n < 0 ) {
+      console_print( "ArgumentError\n" );	// raise?
+      return;
+    }
+    if( n > len ) n = len;
+
+    mrbc_value ret = mrbc_array_slice(vm, v, len - n, n);
+    if( ret.array == NULL ) return;		// ENOMEM
+
+    SET_RETURN(ret);
+    return;
+  }
+
   mrbc_value val = mrbc_array_get(v, -1);
   mrbc_incref(&val);
   SET_RETURN(val);
@@ -964,6 +1290,151 @@ static void c_array_join(struct VM *vm, mrbc_value v[], int argc)
 #endif
 
 
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! sort values by mrbc_compare() (merge sort, stable)
+
+  @param  data	values to sort.
+  @param  work	work area, for n/2 values.
+  @param  n	number of values.
+*/
+static void sort_values(mrbc_value *data, mrbc_value *work, int n)
+{
+  if( n <= 8 || work == NULL ) {
+    // insertion sort.
+    int i, j;
+    for( i = 1; i < n; i++ ) {
+      mrbc_value x = data[i];
+      for( j = i; j > 0 && mrbc_compare( &data[j-1], &x ) > 0; j-- ) {
+	data[j] = data[j-1];
+      }
+      data[j] = x;
+    }
+    return;
+  }
+
+  int half = n / 2;
+  sort_values( data, work, half );
+  sort_values( data + half, work, n - half );
+  if( mrbc_compare( &data[half-1], &data[half] ) <= 0 ) return;
+
+  // merge
+  memcpy( work, data, sizeof(mrbc_value) * half );
+  int i = 0, j = half, k = 0;
+  while( i < half && j < n ) {
+    if( mrbc_compare( &data[j], &work[i] ) < 0 ) {
+      data[k++] = data[j++];
+    } else {
+      data[k++] = work[i++];
+    }
+  }
+  while( i < half ) {
+    data[k++] = work[i++];
+  }
+}
+
+
+//================================================================
+/*! (iterator step) sort with block
+
+  Binary insertion sort, yields a pair of values for each comparison.
+  v[2] is the index to insert, v[3] and v[4] is the range to search.
+*/
+static int step_array_sort(struct VM *vm, mrbc_value v[])
+{
+  mrbc_array *h = v[0].array;
+  int i = v[2].i;
+  int lo = v[3].i;
+  int hi = v[4].i;
+
+  if( i == 0 ) {
+    i = 1;
+    hi = 1;
+  } else {
+    // the result of the last block call, compared data[i] with data[mid].
+    int mid = (lo + hi) / 2;
+    int cmp = 0;
+    if( v[7].tt == MRBC_TT_FIXNUM ) cmp = (v[7].i > 0) - (v[7].i < 0);
+#if MRBC_USE_FLOAT
+    if( v[7].tt == MRBC_TT_FLOAT ) cmp = (v[7].d > 0) - (v[7].d < 0);
+#endif
+    if( cmp < 0 ) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  // (note) the block may change the array.
+  while( i < h->n_stored ) {
+    if( lo < hi ) {
+      int mid = (lo + hi) / 2;
+      v[2].i = i;
+      v[3].i = lo;
+      v[4].i = hi;
+      v[8] = h->data[i];
+      mrbc_incref( &v[8] );
+      v[9] = h->data[mid];
+      mrbc_incref( &v[9] );
+      return 2;
+    }
+
+    // insert data[i] at lo.
+    if( mrbc_array_make_writable(&v[0]) != 0 ) return -1;	// ENOMEM
+    mrbc_value x = h->data[i];
+    memmove( &h->data[lo+1], &h->data[lo], sizeof(mrbc_value) * (i - lo) );
+    h->data[lo] = x;
+
+    i++;
+    lo = 0;
+    hi = i;
+  }
+
+  return -1;
+}
+
+static const mrbc_native_iter iter_array_sort =
+  { MRBC_SYMID_sort_EXC, step_array_sort };
+
+
+//================================================================
+/*! (method) sort!
+*/
+static void c_array_sort_self(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( mrbc_array_make_writable(&v[0]) != 0 ) return;	// ENOMEM
+
+  if( v[argc+1].tt == MRBC_TT_PROC ) {
+    mrbc_native_iter_start( vm, v, argc, &iter_array_sort );
+    return;
+  }
+
+  mrbc_array *h = v[0].array;
+  int n = h->n_stored;
+  mrbc_value *work = NULL;
+  if( n > 8 ) {
+    work = mrbc_alloc( vm, sizeof(mrbc_value) * (n / 2) );
+    // if ENOMEM, sort without work area.
+  }
+  sort_values( h->data, work, n );
+  if( work ) mrbc_free( vm, work );
+}
+
+
+//================================================================
+/*! (method) sort
+*/
+static void c_array_sort(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_value ret = mrbc_array_dup( vm, &v[0] );
+  if( ret.array == NULL ) return;		// ENOMEM
+
+  mrbc_decref( &v[0] );
+  v[0] = ret;
+  c_array_sort_self( vm, v, argc );
+}
+#endif
+
 /* MRBC_AUTOGEN_METHOD_TABLE
 
   CLASS("Array")
@@ -1001,3 +1472,124 @@ static void c_array_join(struct VM *vm, mrbc_value v[], int argc)
 #endif
 */
 #include "method_table_array.h"
+
+
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! (iterator step) each
+*/
+static int step_array_each(struct VM *vm, mrbc_value v[])
+{
+  int i = v[2].i++;
+  if( i >= v[0].array->n_stored ) return -1;
+
+  v[8] = v[0].array->data[i];
+  mrbc_incref( &v[8] );
+  return 1;
+}
+
+
+//================================================================
+/*! (iterator step) each_with_index
+*/
+static int step_array_each_with_index(struct VM *vm, mrbc_value v[])
+{
+  int i = v[2].i++;
+  if( i >= v[0].array->n_stored ) return -1;
+
+  v[8] = v[0].array->data[i];
+  mrbc_incref( &v[8] );
+  v[9] = mrbc_fixnum_value(i);
+  return 2;
+}
+
+
+//================================================================
+/*! (iterator step) collect
+*/
+static int step_array_collect(struct VM *vm, mrbc_value v[])
+{
+  int i = v[2].i++;
+
+  if( i == 0 ) {
+    mrbc_decref( &v[5] );
+    v[5] = mrbc_array_new( vm, v[0].array->n_stored );
+    if( v[5].array == NULL ) {
+      v[5] = mrbc_nil_value();
+      return -1;	// ENOMEM
+    }
+  } else {
+    // the result of the last block call.
+    mrbc_array_set( &v[5], i-1, &v[7] );
+    v[7].tt = MRBC_TT_EMPTY;
+  }
+
+  if( i >= v[0].array->n_stored ) return -1;
+
+  v[8] = v[0].array->data[i];
+  mrbc_incref( &v[8] );
+  return 1;
+}
+
+
+static const mrbc_native_iter iter_array_each =
+  { MRBC_SYMID_each, step_array_each };
+static const mrbc_native_iter iter_array_each_with_index =
+  { MRBC_SYMID_each_with_index, step_array_each_with_index };
+static const mrbc_native_iter iter_array_collect =
+  { MRBC_SYMID_collect, step_array_collect };
+static const mrbc_native_iter iter_array_map =
+  { MRBC_SYMID_map, step_array_collect };
+
+
+//================================================================
+/*! (method) each
+*/
+static void c_array_each(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_array_each );
+}
+
+
+//================================================================
+/*! (method) each_with_index
+*/
+static void c_array_each_with_index(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_array_each_with_index );
+}
+
+
+//================================================================
+/*! (method) collect
+*/
+static void c_array_collect(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_array_collect );
+}
+
+
+//================================================================
+/*! (method) map
+*/
+static void c_array_map(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_array_map );
+}
+
+
+//================================================================
+/*! define native iterators.
+
+  Call after mrblib, to take precedence over the Ruby versions.
+*/
+void mrbc_init_class_array_iterator(void)
+{
+  mrbc_define_method(0, mrbc_class_array, "each", c_array_each);
+  mrbc_define_method(0, mrbc_class_array, "each_with_index", c_array_each_with_index);
+  mrbc_define_method(0, mrbc_class_array, "collect", c_array_collect);
+  mrbc_define_method(0, mrbc_class_array, "map", c_array_map);
+  mrbc_define_method(0, mrbc_class_array, "sort!", c_array_sort_self);
+  mrbc_define_method(0, mrbc_class_array, "sort", c_array_sort);
+}
+#endif
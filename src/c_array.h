@@ -24,13 +24,25 @@ extern "C" {
 //================================================================
 /*!@brief
   Define Array handle.
+
+  The buffer may have free slots before the first data (head room),
+  so that shift and unshift need not move the data. data_size counts
+  from data[0], and the buffer is allocated at (data - head).
+
+  A slice (see mrbc_array_slice) has 'shared', the hidden array that
+  owns the buffer and the references of the elements. data points in
+  that buffer, and is made own by mrbc_array_make_writable().
 */
 typedef struct RArray {
   MRBC_OBJECT_HEADER;
 
   uint16_t data_size;	//!< data buffer size.
   uint16_t n_stored;	//!< # of stored.
-  mrbc_value *data;	//!< pointer to allocated memory.
+  uint16_t head;	//!< # of free slots before data[0].
+  mrbc_value *data;	//!< pointer to the first data.
+#if MRBC_USE_SHARED_SLICE
+  struct RArray *shared;	//!< owner of data if a slice, or NULL.
+#endif
 
 } mrbc_array;
 
@@ -51,6 +63,11 @@ void mrbc_array_clear(mrbc_value *ary);
 int mrbc_array_compare(const mrbc_value *v1, const mrbc_value *v2);
 void mrbc_array_minmax(mrbc_value *ary, mrbc_value **pp_min_value, mrbc_value **pp_max_value);
 mrbc_value mrbc_array_dup(struct VM *vm, const mrbc_value *ary);
+mrbc_value mrbc_array_slice(struct VM *vm, mrbc_value *ary, int idx, int len);
+#if MRBC_USE_SHARED_SLICE
+int mrbc_array_unshare(mrbc_value *ary, int size);
+mrbc_value mrbc_array_new_shared(struct VM *vm, mrbc_value *owner);
+#endif
 
 
 //================================================================
@@ -69,11 +86,36 @@ static inline void mrbc_array_delete_handle(mrbc_value *ary)
 {
   mrbc_array *h = ary->array;
 
-  mrbc_raw_free(h->data);
+#if MRBC_USE_SHARED_SLICE
+  if( h->shared ) {
+    mrbc_value shared = {.tt = MRBC_TT_ARRAY, .array = h->shared};
+    mrbc_raw_free(h);
+    mrbc_decref(&shared);
+    return;
+  }
+#endif
+  mrbc_raw_free(h->data - h->head);
   mrbc_raw_free(h);
 }
 
 
+//================================================================
+/*! make own buffer of the slice, before modifying the contents.
+
+  @param  ary	pointer to target value
+  @return	mrbc_error_code
+*/
+static inline int mrbc_array_make_writable(mrbc_value *ary)
+{
+#if MRBC_USE_SHARED_SLICE
+  if( ary->array->shared ) {
+    return mrbc_array_unshare(ary, ary->array->n_stored);
+  }
+#endif
+  return 0;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_KV
 #include "vm_config.h"
 #include <string.h>
 #include <assert.h>
@@ -22,6 +23,7 @@
 #include "c_array.h"
 #include "c_hash.h"
 #include "c_string.h"
+#include "symbol_builtin.h"
 
 /*
   function summary
@@ -71,13 +73,57 @@ mrbc_value mrbc_hash_new(struct VM *vm, int size)
   MRBC_INIT_OBJECT_HEADER( h, "HA" );
   h->data_size = size * 2;
   h->n_stored = 0;
+  h->head = 0;
   h->data = data;
+#if MRBC_USE_SHARED_SLICE
+  h->shared = NULL;
+#endif
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  h->index_size = 0;
+  h->index = NULL;
+#endif
 
   value.hash = h;
   return value;
 }
 
 
+#if MRBC_USE_SHARED_SLICE
+//================================================================
+/*! make a hash that shares all the pairs of the hidden hash.
+
+  The pairs are copied when first modified. (see mrbc_array_make_writable)
+
+  @param  vm	pointer to VM.
+  @param  owner	hidden hash that owns the pairs.
+  @return	hash object
+*/
+mrbc_value mrbc_hash_new_shared(struct VM *vm, mrbc_value *owner)
+{
+  mrbc_hash *sh = owner->hash;
+  mrbc_value value = {.tt = MRBC_TT_HASH};
+
+  mrbc_hash *h = mrbc_alloc(vm, sizeof(mrbc_hash));
+  if( !h ) return value;	// ENOMEM
+
+  MRBC_INIT_OBJECT_HEADER( h, "HA" );
+  h->data_size = sh->n_stored;
+  h->n_stored = sh->n_stored;
+  h->head = 0;
+  h->data = sh->data;
+  h->shared = sh;
+  sh->ref_count++;
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  h->index_size = 0;
+  h->index = NULL;
+#endif
+
+  value.hash = h;
+  return value;
+}
+#endif
+
+
 //================================================================
 /*! destructor
 
@@ -85,12 +131,156 @@ mrbc_value mrbc_hash_new(struct VM *vm, int size)
 */
 void mrbc_hash_delete(mrbc_value *hash)
 {
-  // TODO: delete other members (for search).
-
+  mrbc_hash_clear_index(hash);
   mrbc_array_delete(hash);
 }
 
 
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+//================================================================
+/*! calculate hash value of the key
+
+  Keys that mrbc_compare() treats as equal must get the same value.
+
+  @param  key	pointer to key value
+  @return	hash value
+*/
+static uint32_t calc_key_hash(const mrbc_value *key)
+{
+  uint32_t h;
+
+  switch( mrbc_type(*key) ) {
+  case MRBC_TT_FIXNUM:
+  case MRBC_TT_SYMBOL:
+    h = (uint32_t)mrbc_fixnum(*key);
+#if defined(MRBC_INT64)
+    h ^= (uint32_t)(mrbc_fixnum(*key) >> 32);
+#endif
+    break;
+
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT: {
+    // integral float must be the same as Fixnum. (1 == 1.0)
+    mrbc_float d = mrbc_float(*key);
+    const mrbc_float lim = (mrbc_float)((mrbc_int)1 << (sizeof(mrbc_int)*8-2)) * 2;
+    if( -lim <= d && d < lim && d == (mrbc_int)d ) {
+      mrbc_value v = mrbc_fixnum_value((mrbc_int)d);
+      return calc_key_hash(&v);
+    }
+    h = 0;
+    const uint8_t *p = (const uint8_t *)&d;
+    int n;
+    for( n = 0; n < sizeof(d); n++ ) {
+      h = h * 31 + p[n];
+    }
+  } break;
+#endif
+
+#if MRBC_USE_STRING
+  case MRBC_TT_STRING:
+    h = mrbc_string_hash(key);
+    break;
+#endif
+
+  case MRBC_TT_CLASS:
+  case MRBC_TT_OBJECT:
+  case MRBC_TT_PROC:
+    h = (uint32_t)((uintptr_t)key->proc >> 3);
+    break;
+
+  case MRBC_TT_EMPTY:	// same as nil
+    h = MRBC_TT_NIL;
+    break;
+
+  default:
+    // other types are found by comparing all keys in the same slot chain.
+    h = mrbc_type(*key);
+    break;
+  }
+
+  // mix upper bits into lower, because the table size is small.
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+
+  return h;
+}
+
+
+//================================================================
+/*! insert pair number into the index
+
+  @param  h	pointer to hash handle
+  @param  key	pointer to key value
+  @param  nth	pair number
+*/
+static void index_insert(mrbc_hash *h, const mrbc_value *key, int nth)
+{
+  unsigned int mask = h->index_size - 1;
+  unsigned int i = calc_key_hash(key) & mask;
+
+  while( h->index[i] != 0 ) {
+    i = (i + 1) & mask;
+  }
+  h->index[i] = nth + 1;
+}
+
+
+//================================================================
+/*! (re)build index
+
+  @param  h	pointer to hash handle
+  @return	mrbc_error_code
+*/
+static int index_build(mrbc_hash *h)
+{
+  int n_pairs = h->n_stored / 2;
+  unsigned int size = 16;
+  while( size < n_pairs * 2 ) size <<= 1;
+  if( size > 0x8000 ) return E_NOMEMORY_ERROR;
+
+  if( h->index_size != size ) {
+    if( h->index ) mrbc_raw_free( h->index );
+    h->index_size = 0;
+    uint16_t *index = mrbc_raw_alloc( sizeof(uint16_t) * size );
+    h->index = index;
+    if( !index ) return E_NOMEMORY_ERROR;	// ENOMEM
+    mrbc_set_vm_id( index, mrbc_get_vm_id(h) );
+    h->index = index;
+    h->index_size = size;
+  }
+  memset( h->index, 0, sizeof(uint16_t) * size );
+
+  int i;
+  for( i = 0; i < n_pairs; i++ ) {
+    index_insert( h, &h->data[i * 2], i );
+  }
+
+  return 0;
+}
+#endif
+
+
+//================================================================
+/*! release search index
+
+  The index is rebuilt on the next search if needed.
+
+  @param  hash	pointer to target hash
+*/
+void mrbc_hash_clear_index(mrbc_value *hash)
+{
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  mrbc_hash *h = hash->hash;
+  if( h->index ) {
+    mrbc_raw_free( h->index );
+    h->index = NULL;
+    h->index_size = 0;
+  }
+#endif
+}
+
+
 //================================================================
 /*! search key
 
@@ -100,6 +290,33 @@ void mrbc_hash_delete(mrbc_value *hash)
 */
 mrbc_value * mrbc_hash_search(const mrbc_value *hash, const mrbc_value *key)
 {
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  mrbc_hash *h = hash->hash;
+
+  if( h->index == NULL && h->n_stored >= MRBC_HASH_INDEX_THRESHOLD * 2 ) {
+    if( index_build(h) != 0 ) mrbc_hash_clear_index((mrbc_value *)hash);
+  }
+
+  if( h->index ) {
+    unsigned int mask = h->index_size - 1;
+    unsigned int i = calc_key_hash(key) & mask;
+    int nth;
+
+    while( (nth = h->index[i]) != 0 ) {
+      mrbc_value *p = &h->data[(nth - 1) * 2];
+      i = (i + 1) & mask;
+#if MRBC_USE_STRING
+      // compare cached hash values before bytes.
+      if( mrbc_type(*key) == MRBC_TT_STRING &&
+          mrbc_type(*p) == MRBC_TT_STRING &&
+          mrbc_string_hash(p) != mrbc_string_hash(key) ) continue;
+#endif
+      if( mrbc_compare(p, key) == 0 ) return p;
+    }
+    return NULL;
+  }
+#endif
+
 #ifndef MRBC_HASH_SEARCH_LINER
 #define MRBC_HASH_SEARCH_LINER
 #endif
@@ -141,10 +358,30 @@ int mrbc_hash_set(mrbc_value *hash, mrbc_value *key, mrbc_value *val)
   if( v == NULL ) {
     // set a new value
     if( (ret = mrbc_array_push(hash, key)) != 0 ) goto RETURN;
-    ret = mrbc_array_push(hash, val);
+    if( (ret = mrbc_array_push(hash, val)) != 0 ) goto RETURN;
+
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+    // keep the load factor of the index 1/2 or less.
+    mrbc_hash *h = hash->hash;
+    if( h->index ) {
+      int n_pairs = h->n_stored / 2;
+      if( n_pairs * 2 > h->index_size ) {
+        if( index_build(h) != 0 ) mrbc_hash_clear_index(hash);
+      } else {
+        index_insert( h, key, n_pairs - 1 );
+      }
+    }
+#endif
 
   } else {
     // replace a value
+#if MRBC_USE_SHARED_SLICE
+    if( hash->hash->shared ) {
+      int idx = v - hash->hash->data;
+      if( (ret = mrbc_array_make_writable(hash)) != 0 ) goto RETURN;
+      v = hash->hash->data + idx;
+    }
+#endif
     mrbc_decref(v);
     *v = *key;
     mrbc_decref(++v);
@@ -182,6 +419,13 @@ mrbc_value mrbc_hash_remove(mrbc_value *hash, mrbc_value *key)
   mrbc_value *v = mrbc_hash_search(hash, key);
   if( v == NULL ) return mrbc_nil_value();
 
+#if MRBC_USE_SHARED_SLICE
+  if( hash->hash->shared ) {
+    int idx = v - hash->hash->data;
+    if( mrbc_array_make_writable(hash) != 0 ) return mrbc_nil_value(); // ENOMEM
+    v = hash->hash->data + idx;
+  }
+#endif
   mrbc_decref(v);		// key
   mrbc_value val = v[1];	// value
 
@@ -190,7 +434,8 @@ mrbc_value mrbc_hash_remove(mrbc_value *hash, mrbc_value *key)
 
   memmove(v, v+2, (char*)(h->data + h->n_stored) - (char*)v);
 
-  // TODO: re-index hash table if need.
+  // pair numbers after the removed one have changed.
+  mrbc_hash_clear_index(hash);
 
   return val;
 }
@@ -204,8 +449,7 @@ mrbc_value mrbc_hash_remove(mrbc_value *hash, mrbc_value *key)
 void mrbc_hash_clear(mrbc_value *hash)
 {
   mrbc_array_clear(hash);
-
-  // TODO: re-index hash table if need.
+  mrbc_hash_clear_index(hash);
 }
 
 
@@ -254,7 +498,7 @@ mrbc_value mrbc_hash_dup( struct VM *vm, mrbc_value *src )
     mrbc_incref(p1++);
   }
 
-  // TODO: dup other members.
+  // index will be built on demand.
 
   return ret;
 }
@@ -333,8 +577,6 @@ static void c_hash_delete(struct VM *vm, mrbc_value v[], int argc)
 
   mrbc_value ret = mrbc_hash_remove(v, v+1);
 
-  // TODO: re-index hash table if need.
-
   SET_RETURN(ret);
 }
 
@@ -539,6 +781,122 @@ static void c_hash_inspect(struct VM *vm, mrbc_value v[], int argc)
 #endif
 
 
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! (iterator step) get the next pair.
+
+  The position is kept as an index in v[2], not in the iterator,
+  because the block may store into the hash and move its data.
+*/
+static mrbc_value *step_hash_next(mrbc_value v[])
+{
+  int i = v[2].i;
+  if( i >= v[0].hash->n_stored ) return NULL;
+  v[2].i += 2;
+
+  mrbc_hash_iterator ite = mrbc_hash_iterator_new(&v[0]);
+  ite.point += i;
+  return mrbc_hash_i_next(&ite);
+}
+
+
+//================================================================
+/*! (iterator step) each
+*/
+static int step_hash_each(struct VM *vm, mrbc_value v[])
+{
+  mrbc_value *kv = step_hash_next(v);
+  if( !kv ) return -1;
+
+  v[8] = kv[0];
+  mrbc_incref( &v[8] );
+  v[9] = kv[1];
+  mrbc_incref( &v[9] );
+  return 2;
+}
+
+
+//================================================================
+/*! (iterator step) each_key
+*/
+static int step_hash_each_key(struct VM *vm, mrbc_value v[])
+{
+  mrbc_value *kv = step_hash_next(v);
+  if( !kv ) return -1;
+
+  v[8] = kv[0];
+  mrbc_incref( &v[8] );
+  return 1;
+}
+
+
+//================================================================
+/*! (iterator step) each_value
+*/
+static int step_hash_each_value(struct VM *vm, mrbc_value v[])
+{
+  mrbc_value *kv = step_hash_next(v);
+  if( !kv ) return -1;
+
+  v[8] = kv[1];
+  mrbc_incref( &v[8] );
+  return 1;
+}
+
+
+static const mrbc_native_iter iter_hash_each =
+  { MRBC_SYMID_each, step_hash_each };
+static const mrbc_native_iter iter_hash_each_key =
+  { MRBC_SYMID_each_key, step_hash_each_key };
+static const mrbc_native_iter iter_hash_each_value =
+  { MRBC_SYMID_each_value, step_hash_each_value };
+
+
+//================================================================
+/*! (method) each
+*/
+static void c_hash_each(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_hash_each );
+}
+
+
+//================================================================
+/*! (method) each_key
+
+  There is no Ruby version to fall back to; returns self without a block.
+*/
+static void c_hash_each_key(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( v[1].tt != MRBC_TT_PROC ) return;
+  mrbc_native_iter_start( vm, v, argc, &iter_hash_each_key );
+}
+
+
+//================================================================
+/*! (method) each_value
+
+  There is no Ruby version to fall back to; returns self without a block.
+*/
+static void c_hash_each_value(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( v[1].tt != MRBC_TT_PROC ) return;
+  mrbc_native_iter_start( vm, v, argc, &iter_hash_each_value );
+}
+
+
+//================================================================
+/*! define native iterators.
+
+  Call after mrblib, to take precedence over the Ruby versions.
+*/
+void mrbc_init_class_hash_iterator(void)
+{
+  mrbc_define_method(0, mrbc_class_hash, "each", c_hash_each);
+}
+#endif
+
+
 /* MRBC_AUTOGEN_METHOD_TABLE
 
   CLASS("Hash")
@@ -563,6 +921,10 @@ static void c_hash_inspect(struct VM *vm, mrbc_value v[], int argc)
   METHOD( "merge!",	c_hash_merge_self )
   METHOD( "to_h",	c_ineffect )
   METHOD( "values",	c_hash_values )
+#if MRBC_USE_NATIVE_ITERATOR
+  METHOD( "each_key",	c_hash_each_key )
+  METHOD( "each_value",	c_hash_each_value )
+#endif
 #if MRBC_USE_STRING
   METHOD( "inspect",	c_hash_inspect )
   METHOD( "to_s",	c_hash_inspect )
@@ -28,13 +28,22 @@ extern "C" {
 typedef struct RHash {
   // (NOTE)
   //  Needs to be same members and order as RArray.
+  //  A shared literal (see mrbc_hash_new_shared) has 'shared' as a slice
+  //  of Array has.
   MRBC_OBJECT_HEADER;
 
   uint16_t data_size;	//!< data buffer size.
   uint16_t n_stored;	//!< # of stored.
+  uint16_t head;	//!< always 0.
   mrbc_value *data;	//!< pointer to allocated memory.
+#if MRBC_USE_SHARED_SLICE
+  struct RHash *shared;	//!< owner of data if shared, or NULL.
+#endif
 
-  // TODO: and other member for search.
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  uint16_t index_size;	//!< index slot count. (power of 2)
+  uint16_t *index;	//!< open addressing index. (pair number + 1)
+#endif
 
 } mrbc_hash;
 
@@ -51,6 +60,9 @@ typedef struct RHashIterator {
 
 
 mrbc_value mrbc_hash_new(struct VM *vm, int size);
+#if MRBC_USE_SHARED_SLICE
+mrbc_value mrbc_hash_new_shared(struct VM *vm, mrbc_value *owner);
+#endif
 void mrbc_hash_delete(mrbc_value *hash);
 mrbc_value *mrbc_hash_search(const mrbc_value *hash, const mrbc_value *key);
 int mrbc_hash_set(mrbc_value *hash, mrbc_value *key, mrbc_value *val);
@@ -59,6 +71,7 @@ mrbc_value mrbc_hash_remove(mrbc_value *hash, mrbc_value *key);
 void mrbc_hash_clear(mrbc_value *hash);
 int mrbc_hash_compare(const mrbc_value *v1, const mrbc_value *v2);
 mrbc_value mrbc_hash_dup(struct VM *vm, mrbc_value *src);
+void mrbc_hash_clear_index(mrbc_value *hash);
 
 
 
@@ -74,6 +87,9 @@ static inline int mrbc_hash_size(const mrbc_value *hash) {
 */
 static inline void mrbc_hash_clear_vm_id(mrbc_value *hash) {
   mrbc_array_clear_vm_id(hash);
+#if MRBC_HASH_INDEX_THRESHOLD > 0
+  if( hash->hash->index ) mrbc_set_vm_id( hash->hash->index, 0 );
+#endif
 }
 
 //================================================================
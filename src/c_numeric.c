@@ -22,6 +22,7 @@
 
 #include "value.h"
 #include "class.h"
+#include "vm.h"
 #include "console.h"
 #include "c_numeric.h"
 #include "c_string.h"
@@ -70,7 +71,19 @@ static void c_fixnum_power(struct VM *vm, mrbc_value v[], int argc)
 
     if( v[1].i < 0 ) x = 0;
     for( i = 0; i < v[1].i; i++ ) {
-      x *= v[0].i;;
+#if MRBC_USE_FLOAT && MRBC_INT_OVERFLOW_TO_FLOAT
+      mrbc_int r;
+      if( mrbc_int_mul_overflow( x, v[0].i, &r ) ) {
+        // overflowed. continue in Float.
+        mrbc_float d = x;
+        for( ; i < v[1].i; i++ ) d *= v[0].i;
+        SET_FLOAT_RETURN( d );
+        return;
+      }
+      x = r;
+#else
+      x *= v[0].i;
+#endif
     }
     SET_INT_RETURN( x );
   }
@@ -217,14 +230,10 @@ static void c_fixnum_to_s(struct VM *vm, mrbc_value v[], int argc)
     }
   }
 
-  mrbc_printf pf;
-  char buf[16];
-  mrbc_printf_init( &pf, buf, sizeof(buf), NULL );
-  pf.fmt.type = 'd';
-  mrbc_printf_int( &pf, v->i, base );
-  mrbc_printf_end( &pf );
+  char buf[MRBC_FORMAT_INT_BUFSIZE];
+  int len = mrbc_format_int( buf, v->i, base );
 
-  mrbc_value value = mrbc_string_new_cstr(vm, buf);
+  mrbc_value value = mrbc_string_new(vm, buf, len);
   SET_RETURN(value);
 }
 #endif
@@ -261,6 +270,45 @@ static void c_fixnum_to_s(struct VM *vm, mrbc_value v[], int argc)
 #include "method_table_fixnum.h"
 
 
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! (iterator step) times
+*/
+static int step_fixnum_times(struct VM *vm, mrbc_value v[])
+{
+  mrbc_int i = v[2].i++;
+  if( i >= v[0].i ) return -1;
+
+  v[8] = mrbc_fixnum_value(i);
+  return 1;
+}
+
+
+static const mrbc_native_iter iter_fixnum_times =
+  { MRBC_SYMID_times, step_fixnum_times };
+
+
+//================================================================
+/*! (method) times
+*/
+static void c_fixnum_times(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_native_iter_start( vm, v, argc, &iter_fixnum_times );
+}
+
+
+//================================================================
+/*! define native iterators.
+
+  Call after mrblib, to take precedence over the Ruby versions.
+*/
+void mrbc_init_class_fixnum_iterator(void)
+{
+  mrbc_define_method(0, mrbc_class_fixnum, "times", c_fixnum_times);
+}
+#endif
+
+
 
 // Float
 #if MRBC_USE_FLOAT
@@ -329,10 +377,10 @@ static void c_float_to_i(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_float_to_s(struct VM *vm, mrbc_value v[], int argc)
 {
-  char buf[16];
+  char buf[MRBC_FORMAT_FLOAT_BUFSIZE];
+  int len = mrbc_format_float( buf, v->d );
 
-  snprintf( buf, sizeof(buf), "%g", v->d );
-  mrbc_value value = mrbc_string_new_cstr(vm, buf);
+  mrbc_value value = mrbc_string_new(vm, buf, len);
   SET_RETURN(value);
 }
 #endif
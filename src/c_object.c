@@ -32,9 +32,14 @@
 #include "c_array.h"
 #include "c_hash.h"
 #include "console.h"
+#include "hal_selector.h"
 
 #include "opcode.h"
 
+#if MRBC_USE_THREAD_CONTEXT && MRBC_USE_MRBLIB_IMAGE
+#error "MRBC_USE_MRBLIB_IMAGE can't be used with MRBC_USE_THREAD_CONTEXT. (shared method caches)"
+#endif
+
 
 /***** Functions ************************************************************/
 
@@ -63,6 +68,9 @@ static void c_object_new(struct VM *vm, mrbc_value v[], int argc)
     OP_SEND, 0, 0, argc,
     OP_ABORT,
   };
+#if MRBC_USE_INLINE_METHOD_CACHE
+  mrbc_method_cache cache = {0};
+#endif
   mrbc_irep irep = {
 #if defined(MRBC_DEBUG)
     .type = "IR",
@@ -72,9 +80,16 @@ static void c_object_new(struct VM *vm, mrbc_value v[], int argc)
     .rlen = 0,
     .ilen = sizeof(code)/sizeof(uint8_t),
     .plen = 0,
+    .slen = 1,
     .code = (uint8_t *)code,
     .pools = NULL,
     .ptr_to_sym = (uint8_t *)syms,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+    .sym_ids = &sym_id,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+    .method_cache = &cache,
+#endif
     .reps = NULL,
   };
 
@@ -171,7 +186,8 @@ static void c_object_dup(struct VM *vm, mrbc_value v[], int argc)
 {
   if( v->tt == MRBC_TT_OBJECT ) {
     mrbc_value new_obj = mrbc_instance_new(vm, v->instance->cls, 0);
-    mrbc_kv_dup( &v->instance->ivar, &new_obj.instance->ivar );
+    if( new_obj.instance == NULL ) return;	// ENOMEM
+    mrbc_instance_dup_ivar( &new_obj, v );
 
     mrbc_decref( v );
     *v = new_obj;
@@ -307,10 +323,15 @@ static void c_object_raise(struct VM *vm, mrbc_value v[], int argc)
       vm->exc = v[1].cls;
       vm->exc_message = v[2];
     }
+    MRBC_TRACE( vm, MRBC_TRACE_RAISE, vm->exc ? vm->exc->sym_id : 0 );
   } else {
     // in exception
   }
 
+#if MRBC_USE_RESCUE_TABLE
+  if( mrbc_rescue_by_table( vm ) ) return;
+#endif
+
   // do nothing if no rescue, no ensure
   if( vm->exception_tail == NULL ){
     return;
@@ -329,7 +350,7 @@ static void c_object_raise(struct VM *vm, mrbc_value v[], int argc)
       vm->pc_irep = callinfo->pc_irep;
       vm->inst = callinfo->inst;
       vm->target_class = callinfo->target_class;
-      mrbc_free(vm, callinfo);
+      mrbc_callinfo_free(vm, callinfo);
       callinfo = vm->exception_tail;
     } else {
       // "ensure"
@@ -337,9 +358,9 @@ static void c_object_raise(struct VM *vm, mrbc_value v[], int argc)
       vm->exception_tail = callinfo->prev;
       vm->current_regs = callinfo->current_regs;
       vm->pc_irep = callinfo->pc_irep;
-      vm->inst = callinfo->inst;
+      vm->inst = callinfo->pc_irep->code;
       vm->target_class = callinfo->target_class;
-      mrbc_free(vm, callinfo);
+      mrbc_callinfo_free(vm, callinfo);
       //
       callinfo = vm->exception_tail;
       if( callinfo != NULL ){
@@ -400,15 +421,17 @@ static void c_object_instance_variables(struct VM *vm, mrbc_value v[], int argc)
 {
   // temporary code for operation check.
 #if 1
-  mrbc_kv_handle *kvh = &v[0].instance->ivar;
+  mrbc_instance *h = v[0].instance;
 
-  console_printf( "n = %d/%d ", kvh->n_stored, kvh->data_size );
+  console_printf( "n = %d/%d ", h->n_ivar, h->cls->n_ivar );
   console_printf( "[" );
 
-  int i;
-  for( i = 0; i < kvh->n_stored; i++ ) {
-    console_printf( "%s:@%s", (i == 0 ? "" : ", "),
-		    symid_to_str( kvh->data[i].sym_id ));
+  int i, flag_first = 1;
+  for( i = 0; i < h->n_ivar; i++ ) {
+    if( h->ivar[i].tt == MRBC_TT_EMPTY ) continue;
+    console_printf( "%s:@%s", (flag_first ? "" : ", "),
+		    symid_to_str( h->cls->ivar_syms[i] ));
+    flag_first = 0;
   }
 
   console_printf( "]\n" );
@@ -432,6 +455,22 @@ static void c_object_memory_statistics(struct VM *vm, mrbc_value v[], int argc)
   console_printf("  Free : %d\n", free);
   console_printf("  Frag.: %d\n", frag);
 
+#if defined(MRBC_ALLOC_PROFILE)
+  const mrbc_alloc_profile *prof = mrbc_alloc_get_profile();
+  int i;
+
+  console_printf("  Peak : %d\n", prof->peak);
+  for( i = 0; i < MRBC_ALLOC_NUM_TAGS; i++ ) {
+    if( prof->count[i] == 0 ) continue;
+    console_printf("  %-8s %5d blocks %7d bytes\n",
+		   mrbc_alloc_tag_name(i), prof->count[i], prof->bytes[i]);
+  }
+  for( i = 0; i < MRBC_ALLOC_HISTOGRAM_SIZE - 1; i++ ) {
+    console_printf("  <=%-5d %5d\n", 16 << i, prof->histogram[i]);
+  }
+  console_printf("  larger  %5d\n", prof->histogram[i]);
+#endif
+
   SET_NIL_RETURN();
 }
 #endif  // MRBC_ALLOC_LIBC)
@@ -511,106 +550,318 @@ static void c_object_attr_accessor(struct VM *vm, mrbc_value v[], int argc)
 
 
 #if MRBC_USE_STRING
+#if MRBC_USE_STRING_COW && MRBC_SPRINTF_CACHE_SIZE > 0
 //================================================================
-/*! (method) sprintf
+/*! sprintf format cache entry.
 */
-static void c_object_sprintf(struct VM *vm, mrbc_value v[], int argc)
+typedef struct RSprintfCache {
+  const char *fstr;		//!< literal format string, or NULL.
+  int n_item;			//!< number of items, or -1 if not parsed.
+  mrbc_printf_item item[MRBC_SPRINTF_MAX_ITEMS];
+} mrbc_sprintf_cache;
+
+static MRBC_CONTEXT_LOCAL mrbc_sprintf_cache sprintf_cache[MRBC_SPRINTF_CACHE_SIZE];
+static MRBC_CONTEXT_LOCAL int sprintf_cache_next;
+
+
+//================================================================
+/*! clear the sprintf format cache.
+
+  Call it when the literals may be released. (see mrbc_irep_free)
+*/
+void mrbc_sprintf_cache_clear(void)
 {
-  static const int BUF_INC_STEP = 32;	// bytes.
+  if( !sprintf_cache[0].fstr ) return;	// the first entry is used first.
 
-  mrbc_value *format = &v[1];
-  if( format->tt != MRBC_TT_STRING ) {
-    console_printf( "TypeError\n" );	// raise?
-    return;
+  hal_lock();
+  memset( sprintf_cache, 0, sizeof(sprintf_cache) );
+  sprintf_cache_next = 0;
+  hal_unlock();
+}
+#endif
+
+
+//================================================================
+/*! split the format string, or get it from the cache.
+
+  @param  format	format string.
+  @param  item		array of MRBC_SPRINTF_MAX_ITEMS items.
+  @return		number of items or -1 if too many.
+*/
+static int sprintf_compile( const mrbc_value *format, mrbc_printf_item *item )
+{
+  const char *fstr = mrbc_string_cstr(format);
+
+#if MRBC_USE_STRING_COW && MRBC_SPRINTF_CACHE_SIZE > 0
+  // only the literal in the bytecode has a stable address.
+  if( format->string->flag_literal
+#if MRBC_USE_SHARED_SLICE
+      && !format->string->shared
+#endif
+      ) {
+    hal_lock();
+    mrbc_sprintf_cache *cache;
+    int i;
+    for( i = 0; i < MRBC_SPRINTF_CACHE_SIZE; i++ ) {
+      cache = &sprintf_cache[i];
+      if( cache->fstr == fstr ) goto FOUND;
+    }
+
+    cache = &sprintf_cache[sprintf_cache_next];
+    if( ++sprintf_cache_next == MRBC_SPRINTF_CACHE_SIZE ) {
+      sprintf_cache_next = 0;
+    }
+    cache->fstr = fstr;
+    cache->n_item = mrbc_printf_compile( fstr, cache->item,
+					 MRBC_SPRINTF_MAX_ITEMS );
+
+  FOUND:;
+    int n = cache->n_item;
+    if( n > 0 ) memcpy( item, cache->item, sizeof(mrbc_printf_item) * n );
+    hal_unlock();
+
+    return n;
   }
+#endif
 
-  int buflen = BUF_INC_STEP;
-  char *buf = mrbc_alloc(vm, buflen);
-  if( !buf ) { return; }	// ENOMEM raise?
+  return mrbc_printf_compile( fstr, item, MRBC_SPRINTF_MAX_ITEMS );
+}
 
-  mrbc_printf pf;
-  mrbc_printf_init( &pf, buf, buflen, mrbc_string_cstr(format) );
 
+//================================================================
+/*! estimate the result length of sprintf.
+
+  @param  item	parsed format string.
+  @param  n	number of items.
+  @param  v	v[] of sprintf.
+  @param  argc	argc of sprintf.
+  @return	length.
+*/
+static int sprintf_estimate( const mrbc_printf_item *item, int n,
+			     mrbc_value v[], int argc )
+{
+  int len = 0;
   int i = 2;
-  int ret;
-  while( 1 ) {
-    mrbc_printf pf_bak = pf;
-    ret = mrbc_printf_main( &pf );
-    if( ret == 0 ) break;	// normal break loop.
-    if( ret < 0 ) goto INCREASE_BUFFER;
+  int k;
 
-    if( i > argc ) {console_print("ArgumentError\n"); break;}	// raise?
+  for( k = 0; k < n; k++ ) {
+    len += item[k].lit_len;
+    if( item[k].fmt.type == 0 ) continue;
 
-    // maybe ret == 1
-    switch(pf.fmt.type) {
+    int w;
+    switch( item[k].fmt.type ) {
     case 'c':
-      if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_char( &pf, v[i].i );
-      } else if( v[i].tt == MRBC_TT_STRING ) {
-	ret = mrbc_printf_char( &pf, mrbc_string_cstr(&v[i])[0] );
-      }
+      w = 1;
       break;
 
     case 's':
+      w = 0;
+      if( i > argc ) break;
       if( v[i].tt == MRBC_TT_STRING ) {
-	ret = mrbc_printf_bstr( &pf, mrbc_string_cstr(&v[i]), mrbc_string_size(&v[i]),' ');
+	w = mrbc_string_size(&v[i]);
       } else if( v[i].tt == MRBC_TT_SYMBOL ) {
-	ret = mrbc_printf_str( &pf, mrbc_symbol_cstr( &v[i] ), ' ');
-      }
-      break;
-
-    case 'd':
-    case 'i':
-    case 'u':
-      if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_int( &pf, v[i].i, 10);
-#if MRBC_USE_FLOAT
-      } else if( v[i].tt == MRBC_TT_FLOAT ) {
-	ret = mrbc_printf_int( &pf, (mrbc_int)v[i].d, 10);
-#endif
-      } else if( v[i].tt == MRBC_TT_STRING ) {
-	mrbc_int ival = atol(mrbc_string_cstr(&v[i]));
-	ret = mrbc_printf_int( &pf, ival, 10 );
-      }
-      break;
-
-    case 'b':
-    case 'B':
-      if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_bit( &pf, v[i].i, 1);
-      }
-      break;
-
-    case 'x':
-    case 'X':
-      if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_bit( &pf, v[i].i, 4);
-      }
-      break;
-
-    case 'o':
-      if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_bit( &pf, v[i].i, 3);
+	w = strlen(mrbc_symbol_cstr(&v[i]));
       }
       break;
 
-#if MRBC_USE_FLOAT
     case 'f':
     case 'e':
     case 'E':
     case 'g':
     case 'G':
-      if( v[i].tt == MRBC_TT_FLOAT ) {
-	ret = mrbc_printf_float( &pf, v[i].d );
-      } else if( v[i].tt == MRBC_TT_FIXNUM ) {
-	ret = mrbc_printf_float( &pf, v[i].i );
-      }
+      w = MRBC_FORMAT_FLOAT_BUFSIZE + item[k].fmt.precision;
       break;
-#endif
 
     default:
+      w = MRBC_FORMAT_INT_BUFSIZE;
       break;
     }
+    if( w < item[k].fmt.width ) w = item[k].fmt.width;
+    len += w;
+    i++;
+  }
+
+  return len;
+}
+
+
+//================================================================
+/*! format a value for sprintf.
+
+  @param  pf	pointer to mrbc_printf, with the directive.
+  @param  v	value.
+  @retval 0	done.
+  @retval -1	buffer full.
+*/
+static int sprintf_value( mrbc_printf *pf, mrbc_value *v )
+{
+  switch(pf->fmt.type) {
+  case 'c':
+    if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_char( pf, v->i );
+    } else if( v->tt == MRBC_TT_STRING ) {
+      return mrbc_printf_char( pf, mrbc_string_cstr(v)[0] );
+    }
+    break;
+
+  case 's':
+    if( v->tt == MRBC_TT_STRING ) {
+      return mrbc_printf_bstr( pf, mrbc_string_cstr(v), mrbc_string_size(v),' ');
+    } else if( v->tt == MRBC_TT_SYMBOL ) {
+      return mrbc_printf_str( pf, mrbc_symbol_cstr( v ), ' ');
+    }
+    break;
+
+  case 'd':
+  case 'i':
+  case 'u':
+    if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_int( pf, v->i, 10);
+#if MRBC_USE_FLOAT
+    } else if( v->tt == MRBC_TT_FLOAT ) {
+      return mrbc_printf_int( pf, (mrbc_int)v->d, 10);
+#endif
+    } else if( v->tt == MRBC_TT_STRING ) {
+      mrbc_int ival = atol(mrbc_string_cstr(v));
+      return mrbc_printf_int( pf, ival, 10 );
+    }
+    break;
+
+  case 'b':
+  case 'B':
+    if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_bit( pf, v->i, 1);
+    }
+    break;
+
+  case 'x':
+  case 'X':
+    if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_bit( pf, v->i, 4);
+    }
+    break;
+
+  case 'o':
+    if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_bit( pf, v->i, 3);
+    }
+    break;
+
+#if MRBC_USE_FLOAT
+  case 'f':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+    if( v->tt == MRBC_TT_FLOAT ) {
+      return mrbc_printf_float( pf, v->d );
+    } else if( v->tt == MRBC_TT_FIXNUM ) {
+      return mrbc_printf_float( pf, v->i );
+    }
+    break;
+#endif
+
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! grow the sprintf buffer.
+
+  @param  vm	pointer to VM.
+  @param  pf	pointer to mrbc_printf.
+  @param  size	bytes to add.
+  @retval 0	done.
+  @retval -1	ENOMEM. the buffer is released.
+*/
+static int sprintf_grow( struct VM *vm, mrbc_printf *pf, int size )
+{
+  int buflen = pf->buf_end - pf->buf + 1 + size;
+  char *buf = mrbc_realloc(vm, pf->buf, buflen);
+  if( !buf ) {
+    mrbc_free(vm, pf->buf);
+    return -1;		// ENOMEM
+  }
+  mrbc_printf_replace_buffer(pf, buf, buflen);
+
+  return 0;
+}
+
+
+//================================================================
+/*! (method) sprintf
+*/
+static void c_object_sprintf(struct VM *vm, mrbc_value v[], int argc)
+{
+  static const int BUF_INC_STEP = 32;	// bytes.
+
+  mrbc_value *format = &v[1];
+  if( format->tt != MRBC_TT_STRING ) {
+    console_printf( "TypeError\n" );	// raise?
+    return;
+  }
+
+  const char *fstr = mrbc_string_cstr(format);
+  mrbc_printf_item item[MRBC_SPRINTF_MAX_ITEMS];
+  int n_item = sprintf_compile( format, item );
+  int buflen = BUF_INC_STEP;
+
+  // allocate the result at once, if the format string is split.
+  // the directives are given to mrbc_printf_* functions one by one.
+  if( n_item > 0 ) buflen = sprintf_estimate( item, n_item, v, argc ) + 1;
+
+  char *buf = mrbc_alloc(vm, buflen);
+  if( !buf ) { return; }	// ENOMEM raise?
+
+  mrbc_printf pf;
+  mrbc_printf_init( &pf, buf, buflen, fstr );
+
+  int i = 2;
+  int ret;
+  if( n_item < 0 ) goto PARSE_EACH_TIME;
+
+  int k;
+  for( k = 0; k < n_item; k++ ) {
+    int len = item[k].lit_len;
+    if( pf.buf_end - pf.p < len &&
+	sprintf_grow( vm, &pf, len + BUF_INC_STEP ) ) return;	// ENOMEM
+    memcpy( pf.p, fstr + item[k].lit_ofs, len );
+    pf.p += len;
+    if( item[k].fmt.type == 0 ) continue;
+
+    if( i > argc ) {console_print("ArgumentError\n"); break;}	// raise?
+
+    char *p = pf.p;
+    while( 1 ) {
+      pf.fmt = item[k].fmt;
+      pf.fstr = fstr + item[k].fmt_end;	// see mrbc_printf_float
+      if( sprintf_value( &pf, &v[i] ) >= 0 ) break;
+
+      // maybe buffer full.
+      pf.p = p;
+      if( sprintf_grow( vm, &pf, item[k].fmt.width + BUF_INC_STEP ) ) return;
+      p = pf.p;
+    }
+    i++;
+  }
+  goto DONE;
+
+
+ PARSE_EACH_TIME:
+  while( 1 ) {
+    mrbc_printf pf_bak = pf;
+    ret = mrbc_printf_main( &pf );
+    if( ret == 0 ) break;	// normal break loop.
+    if( ret < 0 ) goto INCREASE_BUFFER;
+
+    if( i > argc ) {console_print("ArgumentError\n"); break;}	// raise?
+
+    // maybe ret == 1
+    ret = sprintf_value( &pf, &v[i] );
     if( ret >= 0 ) {
       i++;
       continue;		// normal next loop.
@@ -626,6 +877,8 @@ static void c_object_sprintf(struct VM *vm, mrbc_value v[], int argc)
     if( !buf ) { return; }	// ENOMEM raise? TODO: leak memory.
     mrbc_printf_replace_buffer(&pf, buf, buflen);
   }
+
+ DONE:
   mrbc_printf_end( &pf );
 
   buflen = mrbc_printf_len( &pf );
@@ -760,6 +1013,8 @@ void c_proc_call(struct VM *vm, mrbc_value v[], int argc)
 {
   assert( v[0].tt == MRBC_TT_PROC );
 
+  if( mrbc_check_regs( vm, v, v[0].proc->irep ) ) return;
+
   mrbc_callinfo *callinfo_self = v[0].proc->callinfo_self;
   mrbc_callinfo *callinfo = mrbc_push_callinfo(vm,
 				(callinfo_self ? callinfo_self->method_id : 0),
@@ -976,6 +1231,9 @@ static void mrbc_run_mrblib(const uint8_t bytecode[])
   mrbc_vm_run(vm);
 
   // not necessary to call mrbc_vm_end()
+#if MRBC_USE_DYNAMIC_REGS
+  mrbc_raw_free( vm->regs );
+#endif
 
   // instead of mrbc_vm_close()
   mrbc_raw_free( vm );
@@ -988,7 +1246,11 @@ static void mrbc_run_mrblib(const uint8_t bytecode[])
  */
 void mrbc_init_class(void)
 {
+#if MRBC_USE_MRBLIB_IMAGE
+  extern const mrbc_prelinked_image mrblib_image;
+#else
   extern const uint8_t mrblib_bytecode[];
+#endif
   mrbc_class *mrbc_init_class_symbol(struct VM *vm);
   mrbc_class *mrbc_init_class_fixnum(struct VM *vm);
   mrbc_class *mrbc_init_class_float(struct VM *vm);
@@ -997,7 +1259,16 @@ void mrbc_init_class(void)
   mrbc_class *mrbc_init_class_array(struct VM *);
   mrbc_class *mrbc_init_class_range(struct VM *);
   mrbc_class *mrbc_init_class_hash(struct VM *);
+  mrbc_class *mrbc_init_class_packed_array(struct VM *);
+  mrbc_class *mrbc_init_class_json(struct VM *);
+  mrbc_class *mrbc_init_class_msgpack(struct VM *);
   void mrbc_init_class_exception(struct VM *);
+#if MRBC_USE_NATIVE_ITERATOR
+  void mrbc_init_class_array_iterator(void);
+  void mrbc_init_class_fixnum_iterator(void);
+  void mrbc_init_class_range_iterator(void);
+  void mrbc_init_class_hash_iterator(void);
+#endif
 
 
   mrbc_class_object =	mrbc_init_class_object(0);
@@ -1019,7 +1290,27 @@ void mrbc_init_class(void)
   mrbc_class_array =	mrbc_init_class_array(0);
   mrbc_class_range =	mrbc_init_class_range(0);
   mrbc_class_hash =	mrbc_init_class_hash(0);
+#if MRBC_USE_PACKED_ARRAY
+  mrbc_class_packedarray = mrbc_init_class_packed_array(0);
+#endif
+#if MRBC_USE_STRING && MRBC_USE_JSON
+  mrbc_init_class_json(0);
+#endif
+#if MRBC_USE_STRING && MRBC_USE_MSGPACK
+  mrbc_init_class_msgpack(0);
+#endif
   mrbc_init_class_exception(0);
 
+#if MRBC_USE_MRBLIB_IMAGE
+  mrbc_run_mrblib((const uint8_t *)&mrblib_image);
+#else
   mrbc_run_mrblib(mrblib_bytecode);
+#endif
+
+#if MRBC_USE_NATIVE_ITERATOR
+  mrbc_init_class_array_iterator();
+  mrbc_init_class_fixnum_iterator();
+  mrbc_init_class_range_iterator();
+  mrbc_init_class_hash_iterator();
+#endif
 }
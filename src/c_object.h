@@ -31,6 +31,11 @@ extern "C" {
 /***** Function prototypes **************************************************/
 void c_proc_call(struct VM *vm, mrbc_value v[], int argc);
 void mrbc_init_class(void);
+#if MRBC_USE_STRING && MRBC_USE_STRING_COW && MRBC_SPRINTF_CACHE_SIZE > 0
+void mrbc_sprintf_cache_clear(void);
+#else
+#define mrbc_sprintf_cache_clear()	((void)0)
+#endif
 
 
 /***** Inline functions *****************************************************/
@@ -0,0 +1,732 @@
+/*! @file
+  @brief
+  mruby/c PackedArray class
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "value.h"
+#include "vm.h"
+#include "class.h"
+#include "c_array.h"
+#include "c_packed_array.h"
+#include "console.h"
+#include "symbol_builtin.h"
+
+
+#if MRBC_USE_PACKED_ARRAY
+/*
+  PackedArray stores numbers of one element type contiguously,
+  e.g. 1000 int16 samples take 2000 bytes instead of 1000 mrbc_value.
+
+    a = PackedArray.new(:int16, 100)	# zero filled.
+    b = PackedArray.from(:float32, [1, 2.5, 3])
+    a[0] = 1234
+    a.sum, a.min, a.max, a.mean
+    a.scale(2, 100)			# a[i] = a[i] * 2 + 100
+    a.moving_average(8)		# returns new PackedArray.
+    a.to_a
+
+  Integer elements are clamped to the range of the element type.
+*/
+
+static const struct {
+  mrbc_sym sym_id;
+  uint8_t size;
+} packed_types[] = {
+  { MRBC_SYMID_int8,	1 },	// MRBC_PACKED_INT8
+  { MRBC_SYMID_int16,	2 },	// MRBC_PACKED_INT16
+  { MRBC_SYMID_int32,	4 },	// MRBC_PACKED_INT32
+#if MRBC_USE_FLOAT
+  { MRBC_SYMID_float32,	4 },	// MRBC_PACKED_FLOAT32
+  { MRBC_SYMID_float64,	8 },	// MRBC_PACKED_FLOAT64
+#endif
+};
+#define NUM_PACKED_TYPES (sizeof(packed_types) / sizeof(packed_types[0]))
+
+static const int32_t packed_int_min[] = { INT8_MIN, INT16_MIN, INT32_MIN };
+static const int32_t packed_int_max[] = { INT8_MAX, INT16_MAX, INT32_MAX };
+
+// loop over the elements as type T, for the compiler to vectorize.
+#define PACKED_LOOP(h, T, stmt) do {		\
+    T *p = (T *)(h)->data;			\
+    int n = (h)->n_stored;			\
+    int i;					\
+    for( i = 0; i < n; i++ ) { stmt; }		\
+  } while(0)
+
+
+//================================================================
+/*! get element type from symbol
+
+  @param  v	pointer to symbol value.
+  @return	element type or -1 if not found.
+*/
+static int get_packed_type(const mrbc_value *v)
+{
+  if( v->tt != MRBC_TT_SYMBOL ) return -1;
+
+  int i;
+  for( i = 0; i < NUM_PACKED_TYPES; i++ ) {
+    if( packed_types[i].sym_id == v->i ) return i;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*! constructor with class
+
+  @param  vm	pointer to VM.
+  @param  cls	PackedArray or its subclass.
+  @param  type	element type.
+  @param  size	number of elements.
+  @return	PackedArray object. (instance is NULL if ENOMEM)
+*/
+static mrbc_value packed_array_new(struct VM *vm, mrbc_class *cls, int type, int size)
+{
+  int data_size = packed_types[type].size * size;
+  mrbc_value value = mrbc_instance_new(vm, cls, sizeof(mrbc_packed_array) + data_size);
+  if( value.instance == NULL ) return value;	// ENOMEM
+
+  mrbc_packed_array *h = mrbc_packed_array_handle(&value);
+  h->type = type;
+  h->elem_size = packed_types[type].size;
+  h->n_stored = size;
+  memset( h->data, 0, data_size );
+
+  return value;
+}
+
+
+//================================================================
+/*! constructor
+
+  @param  vm	pointer to VM.
+  @param  type	element type. MRBC_PACKED_*
+  @param  size	number of elements.
+  @return	PackedArray object. (instance is NULL if error)
+*/
+mrbc_value mrbc_packed_array_new(struct VM *vm, int type, int size)
+{
+  if( type < 0 || type >= NUM_PACKED_TYPES || size < 0 || size > 0xffff ) {
+    return (mrbc_value){.tt = MRBC_TT_OBJECT, .instance = NULL};
+  }
+
+  return packed_array_new( vm, mrbc_class_packedarray, type, size );
+}
+
+
+//================================================================
+/*! get an element as mrbc_value
+*/
+static mrbc_value get_element(const mrbc_packed_array *h, int idx)
+{
+  switch( h->type ) {
+  case MRBC_PACKED_INT8:
+    return mrbc_fixnum_value( ((const int8_t *)h->data)[idx] );
+  case MRBC_PACKED_INT16:
+    return mrbc_fixnum_value( ((const int16_t *)h->data)[idx] );
+  case MRBC_PACKED_INT32:
+    return mrbc_fixnum_value( ((const int32_t *)h->data)[idx] );
+#if MRBC_USE_FLOAT
+  case MRBC_PACKED_FLOAT32:
+    return mrbc_float_value( 0, ((const float *)h->data)[idx] );
+  case MRBC_PACKED_FLOAT64:
+    return mrbc_float_value( 0, ((const double *)h->data)[idx] );
+#endif
+  }
+  return mrbc_nil_value();
+}
+
+
+//================================================================
+/*! store an integer to element, with clamping.
+*/
+static void store_int(mrbc_packed_array *h, int idx, int64_t x)
+{
+  if( h->type <= MRBC_PACKED_INT32 ) {
+    if( x < packed_int_min[h->type] ) x = packed_int_min[h->type];
+    if( x > packed_int_max[h->type] ) x = packed_int_max[h->type];
+  }
+
+  switch( h->type ) {
+  case MRBC_PACKED_INT8:	((int8_t *)h->data)[idx] = x;	break;
+  case MRBC_PACKED_INT16:	((int16_t *)h->data)[idx] = x;	break;
+  case MRBC_PACKED_INT32:	((int32_t *)h->data)[idx] = x;	break;
+#if MRBC_USE_FLOAT
+  case MRBC_PACKED_FLOAT32:	((float *)h->data)[idx] = x;	break;
+  case MRBC_PACKED_FLOAT64:	((double *)h->data)[idx] = x;	break;
+#endif
+  }
+}
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! store a float to element. integer elements are clamped and truncated.
+*/
+static void store_double(mrbc_packed_array *h, int idx, double d)
+{
+  switch( h->type ) {
+  case MRBC_PACKED_FLOAT32:	((float *)h->data)[idx] = d;	return;
+  case MRBC_PACKED_FLOAT64:	((double *)h->data)[idx] = d;	return;
+  }
+
+  if( d != d ) d = 0;	// NaN
+  if( d < packed_int_min[h->type] ) d = packed_int_min[h->type];
+  if( d > packed_int_max[h->type] ) d = packed_int_max[h->type];
+  store_int( h, idx, (int64_t)d );
+}
+#endif
+
+
+//================================================================
+/*! store mrbc_value to element
+
+  @return	0 if success, or -1 if not a number.
+*/
+static int set_element(mrbc_packed_array *h, int idx, const mrbc_value *val)
+{
+  switch( val->tt ) {
+  case MRBC_TT_FIXNUM:
+    store_int( h, idx, val->i );
+    return 0;
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT:
+    store_double( h, idx, val->d );
+    return 0;
+#endif
+  default:
+    return -1;
+  }
+}
+
+
+//================================================================
+/*! (method) new
+
+  PackedArray.new(type, size [, init])
+*/
+static void c_packed_array_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  int type = (argc >= 2) ? get_packed_type(&v[1]) : -1;
+  if( type < 0 || v[2].tt != MRBC_TT_FIXNUM ||
+      v[2].i < 0 || v[2].i > 0xffff ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+
+  mrbc_value ret = packed_array_new(vm, v[0].cls, type, v[2].i);
+  if( ret.instance == NULL ) return;		// ENOMEM
+
+  if( argc >= 3 ) {
+    mrbc_packed_array *h = mrbc_packed_array_handle(&ret);
+    int i;
+    for( i = 0; i < h->n_stored; i++ ) {
+      if( set_element( h, i, &v[3] ) != 0 ) {
+	console_print( "TypeError\n" );	// raise?
+	break;
+      }
+    }
+  }
+
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! (method) from
+
+  PackedArray.from(type, array_or_packed_array)
+*/
+static void c_packed_array_from(struct VM *vm, mrbc_value v[], int argc)
+{
+  int type = (argc >= 2) ? get_packed_type(&v[1]) : -1;
+  if( type < 0 ) goto ARGUMENT_ERROR;
+
+  mrbc_value ret;
+  int i;
+
+  if( v[2].tt == MRBC_TT_ARRAY ) {
+    int n = mrbc_array_size(&v[2]);
+    if( n > 0xffff ) goto ARGUMENT_ERROR;
+
+    ret = packed_array_new(vm, v[0].cls, type, n);
+    if( ret.instance == NULL ) return;		// ENOMEM
+
+    mrbc_packed_array *h = mrbc_packed_array_handle(&ret);
+    for( i = 0; i < n; i++ ) {
+      if( set_element( h, i, &v[2].array->data[i] ) != 0 ) {
+	mrbc_decref( &ret );
+	console_print( "TypeError\n" );	// raise?
+	return;
+      }
+    }
+
+  } else if( v[2].tt == MRBC_TT_OBJECT &&
+	     mrbc_obj_is_kind_of( &v[2], mrbc_class_packedarray ) ) {
+    const mrbc_packed_array *src = mrbc_packed_array_handle(&v[2]);
+
+    ret = packed_array_new(vm, v[0].cls, type, src->n_stored);
+    if( ret.instance == NULL ) return;		// ENOMEM
+
+    mrbc_packed_array *h = mrbc_packed_array_handle(&ret);
+    for( i = 0; i < src->n_stored; i++ ) {
+      mrbc_value val = get_element( src, i );
+      set_element( h, i, &val );
+    }
+
+  } else {
+    goto ARGUMENT_ERROR;
+  }
+
+  SET_RETURN(ret);
+  return;
+
+ ARGUMENT_ERROR:
+  console_print( "ArgumentError\n" );	// raise?
+}
+
+
+//================================================================
+/*! (method) []
+*/
+static void c_packed_array_get(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+
+  if( argc != 1 || v[1].tt != MRBC_TT_FIXNUM ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+
+  int idx = v[1].i;
+  if( idx < 0 ) idx += h->n_stored;
+  if( idx < 0 || idx >= h->n_stored ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  SET_RETURN( get_element( h, idx ) );
+}
+
+
+//================================================================
+/*! (method) []=
+*/
+static void c_packed_array_set(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_packed_array *h = mrbc_packed_array_handle(v);
+
+  if( argc != 2 || v[1].tt != MRBC_TT_FIXNUM ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+
+  int idx = v[1].i;
+  if( idx < 0 ) idx += h->n_stored;
+  if( idx < 0 || idx >= h->n_stored ) {
+    console_print( "IndexError\n" );	// raise?
+    return;
+  }
+
+  if( set_element( h, idx, &v[2] ) != 0 ) {
+    console_print( "TypeError\n" );	// raise?
+  }
+}
+
+
+//================================================================
+/*! (method) size, length
+*/
+static void c_packed_array_size(struct VM *vm, mrbc_value v[], int argc)
+{
+  int n = mrbc_packed_array_size(v);
+
+  SET_INT_RETURN(n);
+}
+
+
+//================================================================
+/*! (method) type
+*/
+static void c_packed_array_type(struct VM *vm, mrbc_value v[], int argc)
+{
+  int type = mrbc_packed_array_handle(v)->type;
+
+  SET_RETURN( mrbc_symbol_value( packed_types[type].sym_id ) );
+}
+
+
+//================================================================
+/*! (method) dup
+*/
+static void c_packed_array_dup(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+
+  mrbc_value ret = packed_array_new(vm, v[0].instance->cls, h->type, h->n_stored);
+  if( ret.instance == NULL ) return;		// ENOMEM
+
+  memcpy( mrbc_packed_array_data(&ret), h->data, h->elem_size * h->n_stored );
+  mrbc_instance_dup_ivar( &ret, v );
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! (method) fill
+*/
+static void c_packed_array_fill(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  int i;
+
+  if( h->n_stored == 0 ) return;
+  if( set_element( h, 0, &v[1] ) != 0 ) {
+    console_print( "TypeError\n" );	// raise?
+    return;
+  }
+  for( i = 1; i < h->n_stored; i++ ) {
+    memcpy( h->data + h->elem_size * i, h->data, h->elem_size );
+  }
+}
+
+
+//================================================================
+/*! (method) to_a
+*/
+static void c_packed_array_to_a(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+
+  mrbc_value ret = mrbc_array_new(vm, h->n_stored);
+  if( ret.array == NULL ) return;		// ENOMEM
+
+  int i;
+  for( i = 0; i < h->n_stored; i++ ) {
+    ret.array->data[i] = get_element( h, i );
+  }
+  ret.array->n_stored = h->n_stored;
+
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! (method) sum
+*/
+static void c_packed_array_sum(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  int64_t sum = 0;
+
+  switch( h->type ) {
+  case MRBC_PACKED_INT8:  PACKED_LOOP( h, const int8_t,  sum += p[i] ); break;
+  case MRBC_PACKED_INT16: PACKED_LOOP( h, const int16_t, sum += p[i] ); break;
+  case MRBC_PACKED_INT32: PACKED_LOOP( h, const int32_t, sum += p[i] ); break;
+#if MRBC_USE_FLOAT
+  case MRBC_PACKED_FLOAT32: {
+    double d = 0;
+    PACKED_LOOP( h, const float, d += p[i] );
+    SET_FLOAT_RETURN(d);
+  } return;
+  case MRBC_PACKED_FLOAT64: {
+    double d = 0;
+    PACKED_LOOP( h, const double, d += p[i] );
+    SET_FLOAT_RETURN(d);
+  } return;
+#endif
+  }
+
+  SET_INT_RETURN(sum);
+}
+
+
+//================================================================
+/*! (method) mean
+
+  returns Float, or Integer if Float is not supported.
+*/
+static void c_packed_array_mean(struct VM *vm, mrbc_value v[], int argc)
+{
+  int n = mrbc_packed_array_size(v);
+  if( n == 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  c_packed_array_sum(vm, v, 0);
+
+#if MRBC_USE_FLOAT
+  if( v[0].tt == MRBC_TT_FIXNUM ) {
+    SET_FLOAT_RETURN( (double)v[0].i / n );
+  } else {
+    SET_FLOAT_RETURN( v[0].d / n );
+  }
+#else
+  SET_INT_RETURN( v[0].i / n );
+#endif
+}
+
+
+//================================================================
+/*! get minimum and maximum value in one pass
+
+  @param  h	pointer to PackedArray handle. (n_stored > 0)
+  @param  min	returns minimum value.
+  @param  max	returns maximum value.
+*/
+static void packed_array_minmax(const mrbc_packed_array *h, mrbc_value *min, mrbc_value *max)
+{
+  int n = h->n_stored;
+  int i;
+
+#define MINMAX_LOOP(T, VALUE) {				\
+    const T *p = (const T *)h->data;			\
+    T lo = p[0], hi = p[0];				\
+    for( i = 1; i < n; i++ ) {				\
+      if( p[i] < lo ) lo = p[i];			\
+      if( p[i] > hi ) hi = p[i];			\
+    }							\
+    *min = VALUE(lo);					\
+    *max = VALUE(hi);					\
+  }
+#define FLOAT_VALUE(x) mrbc_float_value(0, x)
+
+  switch( h->type ) {
+  case MRBC_PACKED_INT8:    MINMAX_LOOP( int8_t,  mrbc_fixnum_value ); break;
+  case MRBC_PACKED_INT16:   MINMAX_LOOP( int16_t, mrbc_fixnum_value ); break;
+  case MRBC_PACKED_INT32:   MINMAX_LOOP( int32_t, mrbc_fixnum_value ); break;
+#if MRBC_USE_FLOAT
+  case MRBC_PACKED_FLOAT32: MINMAX_LOOP( float,   FLOAT_VALUE ); break;
+  case MRBC_PACKED_FLOAT64: MINMAX_LOOP( double,  FLOAT_VALUE ); break;
+#endif
+  }
+
+#undef FLOAT_VALUE
+#undef MINMAX_LOOP
+}
+
+
+//================================================================
+/*! (method) min
+*/
+static void c_packed_array_min(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  mrbc_value min, max;
+
+  if( h->n_stored == 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  packed_array_minmax( h, &min, &max );
+  SET_RETURN(min);
+}
+
+
+//================================================================
+/*! (method) max
+*/
+static void c_packed_array_max(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  mrbc_value min, max;
+
+  if( h->n_stored == 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  packed_array_minmax( h, &min, &max );
+  SET_RETURN(max);
+}
+
+
+//================================================================
+/*! (method) minmax
+*/
+static void c_packed_array_minmax(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  mrbc_value ret = mrbc_array_new(vm, 2);
+  if( ret.array == NULL ) return;		// ENOMEM
+
+  if( h->n_stored == 0 ) {
+    ret.array->data[0] = mrbc_nil_value();
+    ret.array->data[1] = mrbc_nil_value();
+  } else {
+    packed_array_minmax( h, &ret.array->data[0], &ret.array->data[1] );
+  }
+  ret.array->n_stored = 2;
+
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! (method) scale
+
+  a.scale(k [, offset])  ->  self
+  a[i] = a[i] * k + offset, in place.
+*/
+static void c_packed_array_scale(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_packed_array *h = mrbc_packed_array_handle(v);
+  mrbc_value zero = mrbc_fixnum_value(0);
+  const mrbc_value *k = &v[1];
+  const mrbc_value *ofs = (argc >= 2) ? &v[2] : &zero;
+
+  if( argc < 1 ) goto ARGUMENT_ERROR;
+
+  // integer factor to integer elements.
+  if( k->tt == MRBC_TT_FIXNUM && ofs->tt == MRBC_TT_FIXNUM &&
+      h->type <= MRBC_PACKED_INT32 ) {
+    int64_t mul = k->i;
+    int64_t add = ofs->i;
+    int64_t lo = packed_int_min[h->type];
+    int64_t hi = packed_int_max[h->type];
+
+#define SCALE_INT(T) \
+    PACKED_LOOP( h, T, int64_t x = p[i] * mul + add;		\
+		 p[i] = (x < lo) ? lo : (x > hi) ? hi : x )
+    switch( h->type ) {
+    case MRBC_PACKED_INT8:  SCALE_INT( int8_t );  break;
+    case MRBC_PACKED_INT16: SCALE_INT( int16_t ); break;
+    case MRBC_PACKED_INT32: SCALE_INT( int32_t ); break;
+    }
+#undef SCALE_INT
+    return;
+  }
+
+#if MRBC_USE_FLOAT
+  double mul, add;
+  switch( k->tt ) {
+  case MRBC_TT_FIXNUM:	mul = k->i;	break;
+  case MRBC_TT_FLOAT:	mul = k->d;	break;
+  default:		goto ARGUMENT_ERROR;
+  }
+  switch( ofs->tt ) {
+  case MRBC_TT_FIXNUM:	add = ofs->i;	break;
+  case MRBC_TT_FLOAT:	add = ofs->d;	break;
+  default:		goto ARGUMENT_ERROR;
+  }
+
+  switch( h->type ) {
+  case MRBC_PACKED_FLOAT32: {
+    float mul_f = mul, add_f = add;
+    PACKED_LOOP( h, float, p[i] = p[i] * mul_f + add_f );
+  } return;
+  case MRBC_PACKED_FLOAT64:
+    PACKED_LOOP( h, double, p[i] = p[i] * mul + add );
+    return;
+  default: {
+    int i;
+    for( i = 0; i < h->n_stored; i++ ) {
+      mrbc_value val = get_element( h, i );
+      store_double( h, i, val.i * mul + add );
+    }
+  } return;
+  }
+#endif
+
+ ARGUMENT_ERROR:
+  console_print( "ArgumentError\n" );	// raise?
+}
+
+
+//================================================================
+/*! (method) moving_average
+
+  a.moving_average(window)  ->  PackedArray
+  returns a new PackedArray of the same type and (size - window + 1)
+  elements. Integer elements are truncated.
+*/
+static void c_packed_array_moving_average(struct VM *vm, mrbc_value v[], int argc)
+{
+  const mrbc_packed_array *h = mrbc_packed_array_handle(v);
+
+  if( argc != 1 || v[1].tt != MRBC_TT_FIXNUM || v[1].i <= 0 ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+  int w = v[1].i;
+  int n = h->n_stored;
+  int n_ret = (n >= w) ? n - w + 1 : 0;
+
+  mrbc_value ret = packed_array_new(vm, v[0].instance->cls, h->type, n_ret);
+  if( ret.instance == NULL ) return;		// ENOMEM
+  if( n_ret == 0 ) goto DONE;
+
+  void *dst_data = mrbc_packed_array_data(&ret);
+  int i;
+
+  // keep a running sum of the window.
+#define MOVING_AVERAGE(T, ACC) {			\
+    const T *src = (const T *)h->data;			\
+    T *dst = (T *)dst_data;				\
+    ACC sum = 0;					\
+    for( i = 0; i < w; i++ ) sum += src[i];		\
+    dst[0] = sum / w;					\
+    for( i = w; i < n; i++ ) {				\
+      sum += src[i] - src[i-w];				\
+      dst[i-w+1] = sum / w;				\
+    }							\
+  }
+
+  switch( h->type ) {
+  case MRBC_PACKED_INT8:    MOVING_AVERAGE( int8_t,  int32_t ); break;
+  case MRBC_PACKED_INT16:   MOVING_AVERAGE( int16_t, int32_t ); break;
+  case MRBC_PACKED_INT32:   MOVING_AVERAGE( int32_t, int64_t ); break;
+#if MRBC_USE_FLOAT
+  case MRBC_PACKED_FLOAT32: MOVING_AVERAGE( float,   double );  break;
+  case MRBC_PACKED_FLOAT64: MOVING_AVERAGE( double,  double );  break;
+#endif
+  }
+#undef MOVING_AVERAGE
+
+ DONE:
+  SET_RETURN(ret);
+}
+
+
+/* MRBC_AUTOGEN_METHOD_TABLE
+
+  CLASS("PackedArray")
+  FILE("method_table_packed_array.h")
+  FUNC("mrbc_init_class_packed_array")
+
+  METHOD( "new",	c_packed_array_new )
+  METHOD( "from",	c_packed_array_from )
+  METHOD( "[]",		c_packed_array_get )
+  METHOD( "[]=",	c_packed_array_set )
+  METHOD( "size",	c_packed_array_size )
+  METHOD( "length",	c_packed_array_size )
+  METHOD( "type",	c_packed_array_type )
+  METHOD( "dup",	c_packed_array_dup )
+  METHOD( "fill",	c_packed_array_fill )
+  METHOD( "to_a",	c_packed_array_to_a )
+  METHOD( "sum",	c_packed_array_sum )
+  METHOD( "mean",	c_packed_array_mean )
+  METHOD( "min",	c_packed_array_min )
+  METHOD( "max",	c_packed_array_max )
+  METHOD( "minmax",	c_packed_array_minmax )
+  METHOD( "scale",	c_packed_array_scale )
+  METHOD( "moving_average", c_packed_array_moving_average )
+*/
+#include "method_table_packed_array.h"
+
+#endif  // MRBC_USE_PACKED_ARRAY
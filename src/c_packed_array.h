@@ -0,0 +1,86 @@
+/*! @file
+  @brief
+  mruby/c PackedArray class
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_PACKED_ARRAY_H_
+#define MRBC_SRC_C_PACKED_ARRAY_H_
+
+#include <stdint.h>
+#include "value.h"
+#include "class.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//================================================================
+/*!@brief
+  element types.
+*/
+enum {
+  MRBC_PACKED_INT8 = 0,
+  MRBC_PACKED_INT16,
+  MRBC_PACKED_INT32,
+  MRBC_PACKED_FLOAT32,
+  MRBC_PACKED_FLOAT64,
+};
+
+
+//================================================================
+/*!@brief
+  Define PackedArray object.
+
+  It is stored in the data area of a mrbc_instance, and the elements
+  follow this header contiguously.
+*/
+typedef struct RPackedArray {
+  uint8_t type;		//!< element type. MRBC_PACKED_*
+  uint8_t elem_size;	//!< element size in bytes.
+  uint16_t n_stored;	//!< # of elements.
+  uint8_t reserved[4];	//!< (note) keeps data[] 8 bytes aligned.
+  uint8_t data[];
+
+} mrbc_packed_array;
+
+
+mrbc_value mrbc_packed_array_new(struct VM *vm, int type, int size);
+
+
+//================================================================
+/*! get the handle of PackedArray object
+*/
+static inline mrbc_packed_array *mrbc_packed_array_handle(const mrbc_value *v)
+{
+  return (mrbc_packed_array *)v->instance->data;
+}
+
+//================================================================
+/*! get the number of elements
+*/
+static inline int mrbc_packed_array_size(const mrbc_value *v)
+{
+  return mrbc_packed_array_handle(v)->n_stored;
+}
+
+//================================================================
+/*! get pointer to the elements
+*/
+static inline void *mrbc_packed_array_data(const mrbc_value *v)
+{
+  return mrbc_packed_array_handle(v)->data;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
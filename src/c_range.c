@@ -11,14 +11,35 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_RANGE
 #include "vm_config.h"
 #include "value.h"
 #include "alloc.h"
 #include "class.h"
+#include "vm.h"
 #include "c_range.h"
 #include "c_string.h"
 #include "console.h"
 #include "opcode.h"
+#include "gc.h"
+#include "hal_selector.h"
+#include "snapshot.h"
+
+
+#if MRBC_RANGE_POOL_SIZE > 0
+/***** Static variables *****************************************************/
+static MRBC_CONTEXT_LOCAL mrbc_range range_pool[MRBC_RANGE_POOL_SIZE];
+static MRBC_CONTEXT_LOCAL uint8_t range_pool_owner[MRBC_RANGE_POOL_SIZE];	//!< vm_id + 1, 0 is free.
+
+//================================================================
+/*! get the index in the range pool, or -1 if not pooled.
+*/
+static inline int range_pool_index(const mrbc_range *r)
+{
+  if( r < range_pool || r >= range_pool + MRBC_RANGE_POOL_SIZE ) return -1;
+  return r - range_pool;
+}
+#endif
 
 
 //================================================================
@@ -34,8 +55,27 @@ mrbc_value mrbc_range_new(struct VM *vm, mrbc_value *first, mrbc_value *last, in
 {
   mrbc_value value = {.tt = MRBC_TT_RANGE};
 
-  value.range = mrbc_alloc(vm, sizeof(mrbc_range));
-  if( !value.range ) return value;		// ENOMEM
+#if MRBC_RANGE_POOL_SIZE > 0
+  // (note) the Fixnum range can't be a member of cycle, and holds
+  //  no object. so it does not need the memory pool.
+  if( first->tt == MRBC_TT_FIXNUM && last->tt == MRBC_TT_FIXNUM ) {
+    int i;
+    hal_lock();
+    for( i = 0; i < MRBC_RANGE_POOL_SIZE; i++ ) {
+      if( range_pool_owner[i] == 0 ) {
+	range_pool_owner[i] = (vm ? vm->vm_id : 0) + 1;
+	value.range = &range_pool[i];
+	break;
+      }
+    }
+    hal_unlock();
+  }
+#endif
+
+  if( !value.range ) {
+    value.range = mrbc_alloc(vm, sizeof(mrbc_range));
+    if( !value.range ) return value;		// ENOMEM
+  }
 
   MRBC_INIT_OBJECT_HEADER( value.range, "RA" );
   value.range->flag_exclude = flag_exclude;
@@ -53,26 +93,73 @@ mrbc_value mrbc_range_new(struct VM *vm, mrbc_value *first, mrbc_value *last, in
 */
 void mrbc_range_delete(mrbc_value *v)
 {
+  mrbc_gc_forget(v);
+
   mrbc_decref( &v->range->first );
   mrbc_decref( &v->range->last );
 
+#if MRBC_RANGE_POOL_SIZE > 0
+  int i = range_pool_index( v->range );
+  if( i >= 0 ) {
+    range_pool_owner[i] = 0;
+    return;
+  }
+#endif
+
   mrbc_raw_free( v->range );
 }
 
 
 //================================================================
-/*! clear vm_id
+/*! clear vm_id of the range, not of first and last.
+  (see mrbc_clear_vm_id)
 
   @param  v 	pointer to target.
 */
 void mrbc_range_clear_vm_id(mrbc_value *v)
 {
+#if MRBC_RANGE_POOL_SIZE > 0
+  int i = range_pool_index( v->range );
+  if( i >= 0 ) {
+    range_pool_owner[i] = 1;	// vm_id 0
+    return;
+  }
+#endif
+
   mrbc_set_vm_id( v->range, 0 );
-  mrbc_clear_vm_id( &v->range->first );
-  mrbc_clear_vm_id( &v->range->last );
 }
 
 
+//================================================================
+/*! release the pooled ranges of the VM. (before free all)
+
+  @param  vm	pointer to VM.
+*/
+void mrbc_range_free_vm(const struct VM *vm)
+{
+#if MRBC_RANGE_POOL_SIZE > 0
+  int i;
+  hal_lock();
+  for( i = 0; i < MRBC_RANGE_POOL_SIZE; i++ ) {
+    if( range_pool_owner[i] == vm->vm_id + 1 ) range_pool_owner[i] = 0;
+  }
+  hal_unlock();
+#endif
+}
+
+
+#if MRBC_USE_SNAPSHOT && MRBC_RANGE_POOL_SIZE > 0
+//================================================================
+/*! save or restore the range pool. (see snapshot.c)
+*/
+void mrbc_snapshot_range(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, range_pool );
+  MRBC_SNAPSHOT_VAR( s, range_pool_owner );
+}
+#endif
+
+
 //================================================================
 /*! compare
 
@@ -195,3 +282,50 @@ static void c_range_inspect(struct VM *vm, mrbc_value v[], int argc)
 #endif
 */
 #include "method_table_range.h"
+
+
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! (iterator step) each
+*/
+static int step_range_each(struct VM *vm, mrbc_value v[])
+{
+  mrbc_range *r = v[0].range;
+  mrbc_int n = r->first.i + v[2].i++;
+
+  if( n > r->last.i || (n == r->last.i && r->flag_exclude) ) return -1;
+
+  v[8] = mrbc_fixnum_value(n);
+  return 1;
+}
+
+
+static const mrbc_native_iter iter_range_each =
+  { MRBC_SYMID_each, step_range_each };
+
+
+//================================================================
+/*! (method) each
+*/
+static void c_range_each(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( v[0].range->first.tt != MRBC_TT_FIXNUM ||
+      v[0].range->last.tt != MRBC_TT_FIXNUM ) {
+    mrbc_native_iter_fallback( vm, v, argc, MRBC_SYMID_each );
+    return;
+  }
+
+  mrbc_native_iter_start( vm, v, argc, &iter_range_each );
+}
+
+
+//================================================================
+/*! define native iterators.
+
+  Call after mrblib, to take precedence over the Ruby versions.
+*/
+void mrbc_init_class_range_iterator(void)
+{
+  mrbc_define_method(0, mrbc_class_range, "each", c_range_each);
+}
+#endif
@@ -38,6 +38,7 @@ typedef struct RRange {
 mrbc_value mrbc_range_new(struct VM *vm, mrbc_value *first, mrbc_value *last, int flag_exclude);
 void mrbc_range_delete(mrbc_value *v);
 void mrbc_range_clear_vm_id(mrbc_value *v);
+void mrbc_range_free_vm(const struct VM *vm);
 int mrbc_range_compare(const mrbc_value *v1, const mrbc_value *v2);
 
 
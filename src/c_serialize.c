@@ -0,0 +1,1051 @@
+/*! @file
+  @brief
+  mruby/c JSON and MessagePack serializer
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#if MRBC_USE_FLOAT
+#include <stdio.h>
+#endif
+
+#include "value.h"
+#include "vm.h"
+#include "alloc.h"
+#include "class.h"
+#include "symbol.h"
+#include "c_string.h"
+#include "c_array.h"
+#include "c_hash.h"
+#include "c_serialize.h"
+#include "console.h"
+
+
+#if MRBC_USE_STRING && (MRBC_USE_JSON || MRBC_USE_MSGPACK)
+/*
+  The encoders walk the value tree and write into one mrbc_printf
+  buffer, which may be a caller supplied fixed buffer.
+
+    JSON.generate({"t"=>12, "v"=>[1.5, nil]})	# => '{"t":12,"v":[1.5,null]}'
+    JSON.generate(obj, buf)		# append to String buf.
+    JSON.parse('{"a":[1,2]}')		# => {"a"=>[1, 2]}
+    MessagePack.pack(obj [, buf])
+    MessagePack.unpack(str)
+
+  The decoders read the source buffer in one pass and make the values
+  directly, so only the contents of strings are copied.
+  Symbols are encoded as strings.
+*/
+
+//! decoder state.
+typedef struct Decoder {
+  struct VM *vm;
+  const uint8_t *p;	//!< read point.
+  const uint8_t *end;	//!< end of the source.
+} mrbc_decoder;
+
+
+//================================================================
+/*! encode into String, growing its buffer.
+
+  @param  str	pointer to String. the output is appended.
+  @param  func	encoder function.
+  @param  v	value to encode.
+  @retval 0	done.
+  @retval -1	ENOMEM.
+  @retval MRBC_SERIALIZE_TYPE_ERROR	not serializable value.
+*/
+static int encode_to_string( mrbc_value *str,
+			int (*func)(mrbc_printf *, const mrbc_value *),
+			const mrbc_value *v )
+{
+  int len0 = mrbc_string_size( str );
+  int room = 32;
+
+  while( 1 ) {
+    if( len0 + room >= 0xffff ) room = 0xffff - 1 - len0;
+    if( room <= 0 ) return -1;
+    if( mrbc_string_reserve( str, len0 + room ) != 0 ) return -1;	// ENOMEM
+
+    // (note) func doesn't allocate memory, so data doesn't move.
+    mrbc_printf pf;
+    mrbc_printf_init( &pf, (char *)str->string->data + len0, room + 1, NULL );
+
+    int ret = func( &pf, v );
+    if( ret == 0 ) {
+      str->string->size = len0 + mrbc_printf_len( &pf );
+      str->string->data[str->string->size] = '\0';
+      mrbc_string_clear_hash( str );
+      return 0;
+    }
+
+    str->string->data[len0] = '\0';
+    if( ret != -1 ) return ret;
+    if( len0 + room == 0xffff - 1 ) return -1;
+    room *= 2;
+  }
+}
+
+
+//================================================================
+/*! common part of generate and pack.
+*/
+static void c_serialize_generate(struct VM *vm, mrbc_value v[], int argc,
+			int (*func)(mrbc_printf *, const mrbc_value *))
+{
+  mrbc_value str;
+
+  if( argc < 1 ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+  if( argc >= 2 ) {
+    if( v[2].tt != MRBC_TT_STRING ) goto TYPE_ERROR;
+    str = v[2];
+    mrbc_incref( &str );
+  } else {
+    str = mrbc_string_new( vm, NULL, 0 );
+    if( !str.string ) return;		// ENOMEM
+  }
+
+  int ret = encode_to_string( &str, func, &v[1] );
+  if( ret == 0 ) {
+    SET_RETURN( str );
+    return;
+  }
+
+  mrbc_decref( &str );
+  if( ret == -1 ) return;		// ENOMEM
+
+ TYPE_ERROR:
+  console_print( "TypeError\n" );	// raise?
+}
+
+
+//================================================================
+/*! common part of parse and unpack.
+*/
+static void c_serialize_parse(struct VM *vm, mrbc_value v[], int argc,
+			mrbc_value (*func)(struct VM *, const void *, int))
+{
+  if( argc < 1 || v[1].tt != MRBC_TT_STRING ) {
+    console_print( "TypeError\n" );	// raise?
+    return;
+  }
+
+  mrbc_value ret = func( vm, mrbc_string_cstr(&v[1]), mrbc_string_size(&v[1]) );
+  if( ret.tt == MRBC_TT_EMPTY ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+
+  SET_RETURN( ret );
+}
+#endif
+
+
+
+#if MRBC_USE_STRING && MRBC_USE_JSON
+//================================================================
+/*! JSON encode string
+
+  @param  pf	pointer to mrbc_printf.
+  @param  s	string.
+  @param  len	length.
+  @retval 0	done.
+  @retval -1	buffer full.
+*/
+static int json_encode_string( mrbc_printf *pf, const char *s, int len )
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *end = s + len;
+  const char *run = s;
+
+  if( mrbc_printf_char( pf, '"' ) < 0 ) return -1;
+
+  for( ; s < end; s++ ) {
+    int ch = *(const uint8_t *)s;
+    if( ch >= 0x20 && ch != '"' && ch != '\\' ) continue;
+
+    if( mrbc_printf_bstr( pf, run, s - run, ' ' ) < 0 ) return -1;
+    run = s + 1;
+
+    char buf[6] = { '\\', ch };
+    int n = 2;
+    switch( ch ) {
+    case '"':
+    case '\\':	break;
+    case '\b':	buf[1] = 'b';	break;
+    case '\f':	buf[1] = 'f';	break;
+    case '\n':	buf[1] = 'n';	break;
+    case '\r':	buf[1] = 'r';	break;
+    case '\t':	buf[1] = 't';	break;
+    default:
+      buf[1] = 'u';
+      buf[2] = '0';
+      buf[3] = '0';
+      buf[4] = hex[ch >> 4];
+      buf[5] = hex[ch & 0x0f];
+      n = 6;
+    }
+    if( mrbc_printf_bstr( pf, buf, n, ' ' ) < 0 ) return -1;
+  }
+
+  if( mrbc_printf_bstr( pf, run, end - run, ' ' ) < 0 ) return -1;
+  return mrbc_printf_char( pf, '"' );
+}
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! JSON encode float
+
+  Uses the shortest of "%g" and "%.15g".."%.17g" that reads back the
+  same value, and appends ".0" to integral values.
+*/
+static int json_encode_float( mrbc_printf *pf, double d )
+{
+  if( d != d || d - d != 0 ) {
+    return mrbc_printf_bstr( pf, "null", 4, ' ' );	// NaN, Infinity
+  }
+
+  char buf[32];
+  int len = mrbc_format_float( buf, d );
+  if( (mrbc_float)mrbc_atof(buf) != (mrbc_float)d ) {
+#if MRBC_USE_FLOAT == 1
+    len = snprintf( buf, sizeof(buf), "%.9g", d );
+#else
+    int prec;
+    for( prec = 15; prec <= 17; prec++ ) {
+      len = snprintf( buf, sizeof(buf), "%.*g", prec, d );
+      if( prec == 17 || mrbc_atof(buf) == d ) break;
+    }
+#endif
+  }
+  if( !strpbrk( buf, ".e" ) ) {
+    buf[len++] = '.';
+    buf[len++] = '0';
+  }
+
+  return mrbc_printf_bstr( pf, buf, len, ' ' );
+}
+#endif
+
+
+//================================================================
+/*! JSON encode sub
+*/
+static int json_encode_sub( mrbc_printf *pf, const mrbc_value *v, int depth )
+{
+  int i;
+
+  switch( v->tt ) {
+  case MRBC_TT_NIL:	return mrbc_printf_bstr( pf, "null", 4, ' ' );
+  case MRBC_TT_FALSE:	return mrbc_printf_bstr( pf, "false", 5, ' ' );
+  case MRBC_TT_TRUE:	return mrbc_printf_bstr( pf, "true", 4, ' ' );
+  case MRBC_TT_FIXNUM:	return mrbc_printf_int( pf, v->i, 10 );
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT:	return json_encode_float( pf, v->d );
+#endif
+  case MRBC_TT_SYMBOL: {
+    const char *s = mrbc_symbol_cstr( v );
+    return json_encode_string( pf, s, strlen(s) );
+  }
+  case MRBC_TT_STRING:
+    return json_encode_string( pf, mrbc_string_cstr(v), mrbc_string_size(v) );
+
+  case MRBC_TT_ARRAY:
+    if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) break;
+    if( mrbc_printf_char( pf, '[' ) < 0 ) return -1;
+    for( i = 0; i < v->array->n_stored; i++ ) {
+      if( i != 0 && mrbc_printf_char( pf, ',' ) < 0 ) return -1;
+      int ret = json_encode_sub( pf, &v->array->data[i], depth+1 );
+      if( ret != 0 ) return ret;
+    }
+    return mrbc_printf_char( pf, ']' );
+
+  case MRBC_TT_HASH: {
+    if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) break;
+    if( mrbc_printf_char( pf, '{' ) < 0 ) return -1;
+    mrbc_hash_iterator ite = mrbc_hash_iterator_new( v );
+    for( i = 0; mrbc_hash_i_has_next(&ite); i++ ) {
+      mrbc_value *kv = mrbc_hash_i_next(&ite);
+      if( i != 0 && mrbc_printf_char( pf, ',' ) < 0 ) return -1;
+
+      // key must be a string in JSON.
+      int ret;
+      if( kv[0].tt == MRBC_TT_STRING || kv[0].tt == MRBC_TT_SYMBOL ) {
+	ret = json_encode_sub( pf, &kv[0], depth+1 );
+      } else if( kv[0].tt == MRBC_TT_FIXNUM ) {
+	ret = mrbc_printf_char( pf, '"' );
+	if( ret == 0 ) ret = mrbc_printf_int( pf, kv[0].i, 10 );
+	if( ret == 0 ) ret = mrbc_printf_char( pf, '"' );
+      } else {
+	return MRBC_SERIALIZE_TYPE_ERROR;
+      }
+      if( ret != 0 ) return ret;
+
+      if( mrbc_printf_char( pf, ':' ) < 0 ) return -1;
+      ret = json_encode_sub( pf, &kv[1], depth+1 );
+      if( ret != 0 ) return ret;
+    }
+    return mrbc_printf_char( pf, '}' );
+  }
+
+  default:
+    break;
+  }
+
+  return MRBC_SERIALIZE_TYPE_ERROR;
+}
+
+
+//================================================================
+/*! JSON encode
+
+  @param  pf	pointer to mrbc_printf.
+  @param  v	value to encode.
+  @retval 0	done.
+  @retval -1	buffer full.
+  @retval MRBC_SERIALIZE_TYPE_ERROR	not serializable value.
+  @note		not terminate ('\0') buffer tail.
+*/
+int mrbc_json_encode( mrbc_printf *pf, const mrbc_value *v )
+{
+  pf->fmt = (struct RPrintfFormat){ .type = 'd' };
+
+  return json_encode_sub( pf, v, 0 );
+}
+
+
+//================================================================
+/*! skip white spaces
+*/
+static void json_skip_space( mrbc_decoder *d )
+{
+  while( d->p < d->end &&
+	 (*d->p == ' ' || *d->p == '\n' || *d->p == '\r' || *d->p == '\t') ) {
+    d->p++;
+  }
+}
+
+
+//================================================================
+/*! read 4 hex digits of "\uXXXX"
+*/
+static int json_hex4( const uint8_t *s, const uint8_t *end, uint32_t *ret )
+{
+  if( end - s < 4 ) return -1;
+
+  uint32_t n = 0;
+  int i;
+  for( i = 0; i < 4; i++ ) {
+    int ch = s[i];
+    if( (unsigned)(ch - '0') < 10 ) {
+      ch -= '0';
+    } else if( (unsigned)((ch | 0x20) - 'a') < 6 ) {
+      ch = (ch | 0x20) - 'a' + 10;
+    } else {
+      return -1;
+    }
+    n = (n << 4) | ch;
+  }
+
+  *ret = n;
+  return 0;
+}
+
+
+//================================================================
+/*! JSON decode string. d->p points next of '"'.
+*/
+static int json_decode_string( mrbc_decoder *d, mrbc_value *ret )
+{
+  const uint8_t *s = d->p;
+  const uint8_t *q;
+  int flag_escape = 0;
+
+  for( q = s; ; q++ ) {
+    if( q >= d->end ) return -1;
+    if( *q == '"' ) break;
+    if( *q < 0x20 ) return -1;
+    if( *q == '\\' ) {
+      flag_escape = 1;
+      if( ++q >= d->end ) return -1;
+    }
+  }
+  d->p = q + 1;
+
+  if( !flag_escape ) {
+    *ret = mrbc_string_new( d->vm, s, q - s );
+    return ret->string ? 0 : -1;	// ENOMEM
+  }
+
+  // (note) decoded string is not longer than the source.
+  uint8_t *buf = mrbc_alloc( d->vm, q - s + 1 );
+  if( !buf ) return -1;			// ENOMEM
+  uint8_t *o = buf;
+
+  while( s < q ) {
+    if( *s != '\\' ) {
+      *o++ = *s++;
+      continue;
+    }
+    s++;
+    switch( *s++ ) {
+    case '"':	*o++ = '"';	break;
+    case '\\':	*o++ = '\\';	break;
+    case '/':	*o++ = '/';	break;
+    case 'b':	*o++ = '\b';	break;
+    case 'f':	*o++ = '\f';	break;
+    case 'n':	*o++ = '\n';	break;
+    case 'r':	*o++ = '\r';	break;
+    case 't':	*o++ = '\t';	break;
+    case 'u': {
+      uint32_t cp, lo;
+      if( json_hex4( s, q, &cp ) != 0 ) goto ERROR;
+      s += 4;
+      if( 0xd800 <= cp && cp < 0xdc00 && q - s >= 6 &&
+	  s[0] == '\\' && s[1] == 'u' && json_hex4( s+2, q, &lo ) == 0 &&
+	  0xdc00 <= lo && lo < 0xe000 ) {
+	cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+	s += 6;
+      }
+
+      // to UTF-8
+      if( cp < 0x80 ) {
+	*o++ = cp;
+      } else if( cp < 0x800 ) {
+	*o++ = 0xc0 | (cp >> 6);
+	*o++ = 0x80 | (cp & 0x3f);
+      } else if( cp < 0x10000 ) {
+	*o++ = 0xe0 | (cp >> 12);
+	*o++ = 0x80 | ((cp >> 6) & 0x3f);
+	*o++ = 0x80 | (cp & 0x3f);
+      } else {
+	*o++ = 0xf0 | (cp >> 18);
+	*o++ = 0x80 | ((cp >> 12) & 0x3f);
+	*o++ = 0x80 | ((cp >> 6) & 0x3f);
+	*o++ = 0x80 | (cp & 0x3f);
+      }
+    } break;
+
+    default:
+      goto ERROR;
+    }
+  }
+
+  int len = o - buf;
+  *o = '\0';
+  *ret = mrbc_string_new_alloc( d->vm, buf, len );
+  if( ret->string ) return 0;
+
+ ERROR:
+  mrbc_raw_free( buf );
+  return -1;
+}
+
+
+//================================================================
+/*! JSON decode number.
+*/
+static int json_decode_number( mrbc_decoder *d, mrbc_value *ret )
+{
+  const uint8_t *s = d->p;
+  const uint8_t *q = s;
+  const uint8_t *end = d->end;
+  int flag_float = 0;
+  int sign = 0;
+
+#define IS_DIGIT(q) ((q) < end && (unsigned)(*(q) - '0') < 10)
+  if( q < end && *q == '-' ) {
+    sign = 1;
+    q++;
+  }
+  if( !IS_DIGIT(q) ) return -1;
+  while( IS_DIGIT(q) ) q++;
+  if( q < end && *q == '.' ) {
+    flag_float = 1;
+    q++;
+    if( !IS_DIGIT(q) ) return -1;
+    while( IS_DIGIT(q) ) q++;
+  }
+  if( q < end && (*q | 0x20) == 'e' ) {
+    flag_float = 1;
+    q++;
+    if( q < end && (*q == '+' || *q == '-') ) q++;
+    if( !IS_DIGIT(q) ) return -1;
+    while( IS_DIGIT(q) ) q++;
+  }
+#undef IS_DIGIT
+  d->p = q;
+
+  if( !flag_float ) {
+    mrbc_uint limit = sign ? (mrbc_uint)MRBC_INT_MAX + 1 : MRBC_INT_MAX;
+    mrbc_uint n = 0;
+    const uint8_t *t;
+    for( t = s + sign; t < q; t++ ) {
+      unsigned int dig = *t - '0';
+      if( n > (limit - dig) / 10 ) break;	// overflow, make Float.
+      n = n * 10 + dig;
+    }
+    if( t == q ) {
+      *ret = mrbc_fixnum_value( sign ? -n : n );
+      return 0;
+    }
+  }
+
+#if MRBC_USE_FLOAT
+  char buf[64];
+  int len = q - s;
+  if( len >= sizeof(buf) ) return -1;
+  memcpy( buf, s, len );
+  buf[len] = '\0';
+  *ret = mrbc_float_value( d->vm, mrbc_atof(buf) );
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+
+//================================================================
+/*! JSON decode sub
+*/
+static int json_decode_sub( mrbc_decoder *d, mrbc_value *ret, int depth )
+{
+  json_skip_space( d );
+  if( d->p >= d->end ) return -1;
+
+  mrbc_value key, val;
+
+  switch( *d->p ) {
+  case '"':
+    d->p++;
+    return json_decode_string( d, ret );
+
+  case '[':
+    if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) return -1;
+    d->p++;
+    *ret = mrbc_array_new( d->vm, 0 );
+    if( !ret->array ) return -1;	// ENOMEM
+
+    json_skip_space( d );
+    if( d->p < d->end && *d->p == ']' ) {
+      d->p++;
+      return 0;
+    }
+    while( 1 ) {
+      if( json_decode_sub( d, &val, depth+1 ) != 0 ) goto ERROR;
+      if( mrbc_array_push( ret, &val ) != 0 ) {
+	mrbc_decref( &val );
+	goto ERROR;
+      }
+      json_skip_space( d );
+      if( d->p >= d->end ) goto ERROR;
+      if( *d->p == ']' ) break;
+      if( *d->p++ != ',' ) goto ERROR;
+    }
+    d->p++;
+    return 0;
+
+  case '{':
+    if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) return -1;
+    d->p++;
+    *ret = mrbc_hash_new( d->vm, 0 );
+    if( !ret->hash ) return -1;		// ENOMEM
+
+    json_skip_space( d );
+    if( d->p < d->end && *d->p == '}' ) {
+      d->p++;
+      return 0;
+    }
+    while( 1 ) {
+      json_skip_space( d );
+      if( d->p >= d->end || *d->p++ != '"' ) goto ERROR;
+      if( json_decode_string( d, &key ) != 0 ) goto ERROR;
+      json_skip_space( d );
+      if( d->p >= d->end || *d->p++ != ':' ||
+	  json_decode_sub( d, &val, depth+1 ) != 0 ) {
+	mrbc_decref( &key );
+	goto ERROR;
+      }
+      if( mrbc_hash_set( ret, &key, &val ) != 0 ) {
+	mrbc_decref( &key );
+	mrbc_decref( &val );
+	goto ERROR;
+      }
+      json_skip_space( d );
+      if( d->p >= d->end ) goto ERROR;
+      if( *d->p == '}' ) break;
+      if( *d->p++ != ',' ) goto ERROR;
+    }
+    d->p++;
+    return 0;
+
+  case 't':
+    if( d->end - d->p < 4 || memcmp( d->p, "true", 4 ) != 0 ) return -1;
+    d->p += 4;
+    *ret = mrbc_true_value();
+    return 0;
+
+  case 'f':
+    if( d->end - d->p < 5 || memcmp( d->p, "false", 5 ) != 0 ) return -1;
+    d->p += 5;
+    *ret = mrbc_false_value();
+    return 0;
+
+  case 'n':
+    if( d->end - d->p < 4 || memcmp( d->p, "null", 4 ) != 0 ) return -1;
+    d->p += 4;
+    *ret = mrbc_nil_value();
+    return 0;
+
+  default:
+    return json_decode_number( d, ret );
+  }
+
+ ERROR:
+  mrbc_decref( ret );
+  return -1;
+}
+
+
+//================================================================
+/*! JSON decode
+
+  @param  vm	pointer to VM.
+  @param  src	JSON text. (need not be terminated by '\0')
+  @param  len	length of src.
+  @return	decoded value, or MRBC_TT_EMPTY if syntax error or ENOMEM.
+*/
+mrbc_value mrbc_json_decode( struct VM *vm, const void *src, int len )
+{
+  mrbc_decoder d = { .vm = vm, .p = src, .end = (const uint8_t *)src + len };
+  mrbc_value ret;
+
+  if( json_decode_sub( &d, &ret, 0 ) != 0 ) goto ERROR;
+  json_skip_space( &d );
+  if( d.p == d.end ) return ret;
+
+  mrbc_decref( &ret );
+ ERROR:
+  return (mrbc_value){.tt = MRBC_TT_EMPTY};
+}
+
+
+//================================================================
+/*! (method) generate
+*/
+static void c_json_generate(struct VM *vm, mrbc_value v[], int argc)
+{
+  c_serialize_generate( vm, v, argc, mrbc_json_encode );
+}
+
+
+//================================================================
+/*! (method) parse
+*/
+static void c_json_parse(struct VM *vm, mrbc_value v[], int argc)
+{
+  c_serialize_parse( vm, v, argc, mrbc_json_decode );
+}
+
+
+/* MRBC_AUTOGEN_METHOD_TABLE
+
+  CLASS("JSON")
+  FILE("method_table_json.h")
+  FUNC("mrbc_init_class_json")
+
+  METHOD( "generate",	c_json_generate )
+  METHOD( "parse",	c_json_parse )
+*/
+#include "method_table_json.h"
+#endif  // MRBC_USE_STRING && MRBC_USE_JSON
+
+
+
+#if MRBC_USE_STRING && MRBC_USE_MSGPACK
+//================================================================
+/*! MessagePack write tag and big endian number
+
+  @param  pf	pointer to mrbc_printf.
+  @param  tag	type tag.
+  @param  n	number.
+  @param  size	bytes of the number. (0, 1, 2, 4 or 8)
+*/
+static int msgpack_put( mrbc_printf *pf, int tag, uint64_t n, int size )
+{
+  uint8_t buf[9];
+  int i;
+
+  buf[0] = tag;
+  for( i = size; i > 0; i-- ) {
+    buf[i] = n;
+    n >>= 8;
+  }
+
+  return mrbc_printf_bstr( pf, (const char *)buf, size + 1, 0 );
+}
+
+
+//================================================================
+/*! MessagePack encode string
+*/
+static int msgpack_encode_string( mrbc_printf *pf, const char *s, int len )
+{
+  int ret;
+
+  if( len < 32 ) {
+    ret = msgpack_put( pf, 0xa0 | len, 0, 0 );
+  } else if( len < 0x100 ) {
+    ret = msgpack_put( pf, 0xd9, len, 1 );
+  } else if( len < 0x10000 ) {
+    ret = msgpack_put( pf, 0xda, len, 2 );
+  } else {
+    ret = msgpack_put( pf, 0xdb, len, 4 );
+  }
+  if( ret != 0 ) return ret;
+
+  return mrbc_printf_bstr( pf, s, len, 0 );
+}
+
+
+//================================================================
+/*! MessagePack encode sub
+*/
+static int msgpack_encode_sub( mrbc_printf *pf, const mrbc_value *v, int depth )
+{
+  int ret, i, n;
+
+  switch( v->tt ) {
+  case MRBC_TT_NIL:	return msgpack_put( pf, 0xc0, 0, 0 );
+  case MRBC_TT_FALSE:	return msgpack_put( pf, 0xc2, 0, 0 );
+  case MRBC_TT_TRUE:	return msgpack_put( pf, 0xc3, 0, 0 );
+
+  case MRBC_TT_FIXNUM: {
+    mrbc_int iv = v->i;
+    if( iv >= 0 ) {
+      if( iv < 0x80 )	return msgpack_put( pf, iv, 0, 0 );
+      if( iv < 0x100 )	return msgpack_put( pf, 0xcc, iv, 1 );
+      if( iv < 0x10000 )	return msgpack_put( pf, 0xcd, iv, 2 );
+#if defined(MRBC_INT64)
+      if( iv > 0xffffffff ) return msgpack_put( pf, 0xcf, iv, 8 );
+#endif
+      return msgpack_put( pf, 0xce, iv, 4 );
+    }
+    if( iv >= -32 )	return msgpack_put( pf, (uint8_t)iv, 0, 0 );
+    if( iv >= -0x80 )	return msgpack_put( pf, 0xd0, iv, 1 );
+    if( iv >= -0x8000 )	return msgpack_put( pf, 0xd1, iv, 2 );
+#if defined(MRBC_INT64)
+    if( iv < -0x7fffffff - 1 ) return msgpack_put( pf, 0xd3, iv, 8 );
+#endif
+    return msgpack_put( pf, 0xd2, iv, 4 );
+  }
+
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT: {
+#if MRBC_USE_FLOAT == 1
+    uint32_t bits;
+    memcpy( &bits, &v->d, 4 );
+    return msgpack_put( pf, 0xca, bits, 4 );
+#else
+    uint64_t bits;
+    memcpy( &bits, &v->d, 8 );
+    return msgpack_put( pf, 0xcb, bits, 8 );
+#endif
+  }
+#endif
+
+  case MRBC_TT_SYMBOL: {
+    const char *s = mrbc_symbol_cstr( v );
+    return msgpack_encode_string( pf, s, strlen(s) );
+  }
+  case MRBC_TT_STRING:
+    return msgpack_encode_string( pf, mrbc_string_cstr(v), mrbc_string_size(v) );
+
+  case MRBC_TT_ARRAY:
+  case MRBC_TT_HASH:
+    if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) break;
+
+    n = v->array->n_stored;
+    if( v->tt == MRBC_TT_ARRAY ) {
+      if( n < 16 )	ret = msgpack_put( pf, 0x90 | n, 0, 0 );
+      else		ret = msgpack_put( pf, 0xdc, n, 2 );
+    } else {
+      int n_pair = n / 2;
+      if( n_pair < 16 )	ret = msgpack_put( pf, 0x80 | n_pair, 0, 0 );
+      else		ret = msgpack_put( pf, 0xde, n_pair, 2 );
+    }
+    if( ret != 0 ) return ret;
+
+    // (note) Hash data is key and value pairs, same layout as Array.
+    for( i = 0; i < n; i++ ) {
+      ret = msgpack_encode_sub( pf, &v->array->data[i], depth+1 );
+      if( ret != 0 ) return ret;
+    }
+    return 0;
+
+  default:
+    break;
+  }
+
+  return MRBC_SERIALIZE_TYPE_ERROR;
+}
+
+
+//================================================================
+/*! MessagePack encode
+
+  @param  pf	pointer to mrbc_printf.
+  @param  v	value to encode.
+  @retval 0	done.
+  @retval -1	buffer full.
+  @retval MRBC_SERIALIZE_TYPE_ERROR	not serializable value.
+*/
+int mrbc_msgpack_encode( mrbc_printf *pf, const mrbc_value *v )
+{
+  pf->fmt = (struct RPrintfFormat){ .type = 'd' };
+
+  return msgpack_encode_sub( pf, v, 0 );
+}
+
+
+//================================================================
+/*! MessagePack read big endian number
+*/
+static int msgpack_get( mrbc_decoder *d, int size, uint64_t *ret )
+{
+  if( d->end - d->p < size ) return -1;
+
+  uint64_t n = 0;
+  while( size-- > 0 ) {
+    n = (n << 8) | *d->p++;
+  }
+
+  *ret = n;
+  return 0;
+}
+
+
+//================================================================
+/*! make Integer, or Float if out of range.
+*/
+static int msgpack_set_int( mrbc_decoder *d, mrbc_value *ret, int64_t n, int flag_unsigned )
+{
+  if( (flag_unsigned && n < 0) || n < MRBC_INT_MIN || n > MRBC_INT_MAX ) {
+#if MRBC_USE_FLOAT
+    *ret = mrbc_float_value( d->vm, flag_unsigned ? (double)(uint64_t)n : (double)n );
+    return 0;
+#else
+    return -1;
+#endif
+  }
+
+  *ret = mrbc_fixnum_value( n );
+  return 0;
+}
+
+
+//================================================================
+/*! MessagePack decode sub
+*/
+static int msgpack_decode_sub( mrbc_decoder *d, mrbc_value *ret, int depth )
+{
+  if( d->p >= d->end ) return -1;
+
+  int tag = *d->p++;
+  uint64_t n;
+  int i;
+
+  if( tag < 0x80 || tag >= 0xe0 ) {	// positive and negative fixint.
+    *ret = mrbc_fixnum_value( (int8_t)tag );
+    return 0;
+  }
+  if( (tag & 0xe0) == 0xa0 ) {
+    n = tag & 0x1f;
+    goto STRING;
+  }
+  if( (tag & 0xf0) == 0x90 ) {
+    n = tag & 0x0f;
+    goto ARRAY;
+  }
+  if( (tag & 0xf0) == 0x80 ) {
+    n = tag & 0x0f;
+    goto MAP;
+  }
+
+  switch( tag ) {
+  case 0xc0: *ret = mrbc_nil_value();	return 0;
+  case 0xc2: *ret = mrbc_false_value();	return 0;
+  case 0xc3: *ret = mrbc_true_value();	return 0;
+
+  case 0xc4:	// bin 8
+  case 0xd9:	// str 8
+    if( msgpack_get( d, 1, &n ) != 0 ) return -1;
+    goto STRING;
+  case 0xc5:	// bin 16
+  case 0xda:	// str 16
+    if( msgpack_get( d, 2, &n ) != 0 ) return -1;
+    goto STRING;
+  case 0xc6:	// bin 32
+  case 0xdb:	// str 32
+    if( msgpack_get( d, 4, &n ) != 0 ) return -1;
+    goto STRING;
+
+  case 0xcc: case 0xcd: case 0xce: case 0xcf:	// uint 8..64
+    if( msgpack_get( d, 1 << (tag - 0xcc), &n ) != 0 ) return -1;
+    return msgpack_set_int( d, ret, n, 1 );
+
+  case 0xd0: case 0xd1: case 0xd2: case 0xd3: {	// int 8..64
+    int size = 1 << (tag - 0xd0);
+    if( msgpack_get( d, size, &n ) != 0 ) return -1;
+    int shift = 64 - size * 8;
+    return msgpack_set_int( d, ret, (int64_t)(n << shift) >> shift, 0 );
+  }
+
+#if MRBC_USE_FLOAT
+  case 0xca: {	// float 32
+    float f;
+    uint32_t bits;
+    if( msgpack_get( d, 4, &n ) != 0 ) return -1;
+    bits = n;
+    memcpy( &f, &bits, 4 );
+    *ret = mrbc_float_value( d->vm, f );
+    return 0;
+  }
+  case 0xcb: {	// float 64
+    double f;
+    if( msgpack_get( d, 8, &n ) != 0 ) return -1;
+    memcpy( &f, &n, 8 );
+    *ret = mrbc_float_value( d->vm, f );
+    return 0;
+  }
+#endif
+
+  case 0xdc:	// array 16
+  case 0xdd:	// array 32
+    if( msgpack_get( d, (tag == 0xdc) ? 2 : 4, &n ) != 0 ) return -1;
+    goto ARRAY;
+  case 0xde:	// map 16
+  case 0xdf:	// map 32
+    if( msgpack_get( d, (tag == 0xde) ? 2 : 4, &n ) != 0 ) return -1;
+    goto MAP;
+
+  default:	// ext and never used.
+    return -1;
+  }
+
+
+ STRING:
+  if( n > d->end - d->p || n >= 0xffff ) return -1;
+  *ret = mrbc_string_new( d->vm, d->p, n );
+  if( !ret->string ) return -1;		// ENOMEM
+  d->p += n;
+  return 0;
+
+
+ ARRAY:
+  // (note) each element takes one byte at least.
+  if( n > d->end - d->p || n > 0x7fff ) return -1;
+  if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) return -1;
+  *ret = mrbc_array_new( d->vm, n );
+  if( !ret->array ) return -1;		// ENOMEM
+
+  for( i = 0; i < n; i++ ) {
+    mrbc_value val;
+    if( msgpack_decode_sub( d, &val, depth+1 ) != 0 ) goto ERROR;
+    mrbc_array_push( ret, &val );	// (note) never fails, room is reserved.
+  }
+  return 0;
+
+
+ MAP:
+  if( n * 2 > d->end - d->p || n > 0x3fff ) return -1;
+  if( depth >= MRBC_SERIALIZE_MAX_DEPTH ) return -1;
+  *ret = mrbc_hash_new( d->vm, n );
+  if( !ret->hash ) return -1;		// ENOMEM
+
+  for( i = 0; i < n; i++ ) {
+    mrbc_value key, val;
+    if( msgpack_decode_sub( d, &key, depth+1 ) != 0 ) goto ERROR;
+    if( msgpack_decode_sub( d, &val, depth+1 ) != 0 ) {
+      mrbc_decref( &key );
+      goto ERROR;
+    }
+    if( mrbc_hash_set( ret, &key, &val ) != 0 ) {
+      mrbc_decref( &key );
+      mrbc_decref( &val );
+      goto ERROR;
+    }
+  }
+  return 0;
+
+
+ ERROR:
+  mrbc_decref( ret );
+  return -1;
+}
+
+
+//================================================================
+/*! MessagePack decode
+
+  @param  vm	pointer to VM.
+  @param  src	source bytes.
+  @param  len	length of src.
+  @return	decoded value, or MRBC_TT_EMPTY if format error or ENOMEM.
+*/
+mrbc_value mrbc_msgpack_decode( struct VM *vm, const void *src, int len )
+{
+  mrbc_decoder d = { .vm = vm, .p = src, .end = (const uint8_t *)src + len };
+  mrbc_value ret;
+
+  if( msgpack_decode_sub( &d, &ret, 0 ) != 0 ) goto ERROR;
+  if( d.p == d.end ) return ret;
+
+  mrbc_decref( &ret );
+ ERROR:
+  return (mrbc_value){.tt = MRBC_TT_EMPTY};
+}
+
+
+//================================================================
+/*! (method) pack
+*/
+static void c_msgpack_pack(struct VM *vm, mrbc_value v[], int argc)
+{
+  c_serialize_generate( vm, v, argc, mrbc_msgpack_encode );
+}
+
+
+//================================================================
+/*! (method) unpack
+*/
+static void c_msgpack_unpack(struct VM *vm, mrbc_value v[], int argc)
+{
+  c_serialize_parse( vm, v, argc, mrbc_msgpack_decode );
+}
+
+
+/* MRBC_AUTOGEN_METHOD_TABLE
+
+  CLASS("MessagePack")
+  FILE("method_table_msgpack.h")
+  FUNC("mrbc_init_class_msgpack")
+
+  METHOD( "pack",	c_msgpack_pack )
+  METHOD( "unpack",	c_msgpack_unpack )
+*/
+#include "method_table_msgpack.h"
+#endif  // MRBC_USE_STRING && MRBC_USE_MSGPACK
@@ -0,0 +1,43 @@
+/*! @file
+  @brief
+  mruby/c JSON and MessagePack serializer
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_SERIALIZE_H_
+#define MRBC_SRC_C_SERIALIZE_H_
+
+#include <stdint.h>
+#include "value.h"
+#include "console.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Constant values ******************************************************/
+//! max nesting level of Array and Hash.
+#define MRBC_SERIALIZE_MAX_DEPTH 32
+
+//! encoder return value, other than 0 (done) and -1 (buffer full).
+#define MRBC_SERIALIZE_TYPE_ERROR -2
+
+
+/***** Function prototypes **************************************************/
+int mrbc_json_encode(mrbc_printf *pf, const mrbc_value *v);
+mrbc_value mrbc_json_decode(struct VM *vm, const void *src, int len);
+int mrbc_msgpack_encode(mrbc_printf *pf, const mrbc_value *v);
+mrbc_value mrbc_msgpack_decode(struct VM *vm, const void *src, int len);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -11,6 +11,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_STRING
 #include "vm_config.h"
 #include <stdlib.h>
 #include <string.h>
@@ -25,27 +26,86 @@
 #include "c_array.h"
 #include "c_string.h"
 #include "console.h"
+#include "hal_selector.h"
+
+
+// strings shorter than this are placed with MRBC_ALLOC_HINT_FAST.
+#define SMALL_STRING_SIZE 32
 
 
 #if MRBC_USE_STRING
 //================================================================
 /*! white space character test
 
+  " \t\r\n\f\v" and '\0'.
+
   @param  ch	character code.
   @return	result.
 */
-static int is_space( int ch )
+static inline int is_space( int ch )
 {
-  static const char ws[] = " \t\r\n\f\v";	// '\0' on tail
+  // '\t','\n','\v','\f','\r' are 0x09..0x0d.
+  return ch == ' ' || (unsigned)(ch - '\t') <= '\r' - '\t' || ch == '\0';
+}
 
-  int i;
-  for( i = 0; i < sizeof(ws); i++ ) {
-    if( ch == ws[i] ) return 1;
+
+//================================================================
+/*! make room for contents of the given length.
+
+  With MRBC_USE_STRING_CAPACITY, the buffer grows by half of its size
+  at least, so that repeated appending costs amortized linear time.
+
+  @param  str	pointer to target value
+  @param  len	new length of the contents, not including '\0'.
+  @return	mrbc_error_code
+*/
+int mrbc_string_reserve(mrbc_value *str, int len)
+{
+  if( mrbc_string_make_writable( str ) != 0 ) return E_NOMEMORY_ERROR;
+  mrbc_string *h = str->string;
+
+#if MRBC_USE_STRING_CAPACITY
+  if( len < h->capacity ) return 0;
+  if( len >= 0xffff ) return E_NOMEMORY_ERROR;	// capacity overflow.
+
+  unsigned int size = h->capacity + h->capacity / 2;
+  if( size < len + 1 ) size = len + 1;
+  if( size > 0xffff ) size = 0xffff;
+
+  uint8_t *buf = mrbc_raw_realloc( h->data, size );
+  if( !buf && size > len + 1 ) {
+    size = len + 1;				// retry without extra room.
+    buf = mrbc_raw_realloc( h->data, size );
   }
+  if( !buf ) return E_NOMEMORY_ERROR;		// ENOMEM
+
+  h->capacity = size;
+#else
+  uint8_t *buf = mrbc_raw_realloc( h->data, len + 1 );
+  if( !buf ) return E_NOMEMORY_ERROR;		// ENOMEM
+#endif
+
+  h->data = buf;
   return 0;
 }
 
 
+//================================================================
+/*! shrink the buffer to suitable size.
+
+  @param  str	pointer to target value
+*/
+static void string_shrink(mrbc_value *str)
+{
+  mrbc_string *h = str->string;
+
+  mrbc_raw_realloc( h->data, h->size + 1 );
+#if MRBC_USE_STRING_CAPACITY
+  h->capacity = h->size + 1;
+#endif
+}
+
+
 //================================================================
 /*! constructor
 
@@ -62,10 +122,12 @@ mrbc_value mrbc_string_new(struct VM *vm, const void *src, int len)
     Allocate handle and string buffer.
   */
   mrbc_string *h;
-  h = (mrbc_string *)mrbc_alloc(vm, sizeof(mrbc_string));
+  h = (mrbc_string *)mrbc_alloc_hint(vm, sizeof(mrbc_string),
+				     MRBC_ALLOC_HINT_FAST);
   if( !h ) return value;		// ENOMEM
 
-  uint8_t *str = mrbc_alloc(vm, len+1);
+  uint8_t *str = mrbc_alloc_hint(vm, len+1, (len < SMALL_STRING_SIZE) ?
+				 MRBC_ALLOC_HINT_FAST : MRBC_ALLOC_HINT_NORMAL);
   if( !str ) {				// ENOMEM
     mrbc_raw_free( h );
     return value;
@@ -73,7 +135,20 @@ mrbc_value mrbc_string_new(struct VM *vm, const void *src, int len)
 
   MRBC_INIT_OBJECT_HEADER( h, "ST" );
   h->size = len;
+#if MRBC_USE_STRING_CAPACITY
+  h->capacity = len + 1;
+#endif
+#if MRBC_USE_STRING_COW
+  h->flag_literal = 0;
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_SHARED_SLICE
+  h->shared = NULL;
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_HOT_RELOAD
+  h->irep = NULL;
+#endif
   h->data = str;
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
 
   /*
     Copy a source string.
@@ -86,6 +161,7 @@ mrbc_value mrbc_string_new(struct VM *vm, const void *src, int len)
   }
 
   value.string = h;
+  mrbc_string_clear_hash( &value );
   return value;
 }
 
@@ -119,18 +195,211 @@ mrbc_value mrbc_string_new_alloc(struct VM *vm, void *buf, int len)
     Allocate handle
   */
   mrbc_string *h;
-  h = (mrbc_string *)mrbc_alloc(vm, sizeof(mrbc_string));
+  h = (mrbc_string *)mrbc_alloc_hint(vm, sizeof(mrbc_string),
+				     MRBC_ALLOC_HINT_FAST);
   if( !h ) return value;		// ENOMEM
 
   MRBC_INIT_OBJECT_HEADER( h, "ST" );
   h->size = len;
+#if MRBC_USE_STRING_CAPACITY
+  h->capacity = len + 1;
+#endif
+#if MRBC_USE_STRING_COW
+  h->flag_literal = 0;
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_SHARED_SLICE
+  h->shared = NULL;
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_HOT_RELOAD
+  h->irep = NULL;
+#endif
   h->data = buf;
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
 
   value.string = h;
+  mrbc_string_clear_hash( &value );
   return value;
 }
 
 
+#if MRBC_USE_STRING_COW
+//================================================================
+/*! constructor by literal
+
+  The string refers to the source bytes without copying them,
+  until it is modified. (see mrbc_string_make_writable)
+  The source must not be changed or freed while the string is alive,
+  and is copied if it is not NUL terminated.
+
+  @param  vm	pointer to VM.
+  @param  src	source string. (e.g. string literal in the bytecode)
+  @param  len	source length
+  @return 	string object
+*/
+mrbc_value mrbc_string_new_literal(struct VM *vm, const void *src, int len)
+{
+  if( ((const uint8_t *)src)[len] != '\0' ) {
+    return mrbc_string_new(vm, src, len);
+  }
+
+  mrbc_value value = {.tt = MRBC_TT_STRING};
+
+  mrbc_string *h;
+  h = (mrbc_string *)mrbc_alloc_hint(vm, sizeof(mrbc_string),
+				     MRBC_ALLOC_HINT_FAST);
+  if( !h ) return value;		// ENOMEM
+
+  MRBC_INIT_OBJECT_HEADER( h, "ST" );
+  h->size = len;
+#if MRBC_USE_STRING_CAPACITY
+  h->capacity = 0;
+#endif
+  h->flag_literal = 1;
+#if MRBC_USE_SHARED_SLICE
+  h->shared = NULL;
+#endif
+#if MRBC_USE_HOT_RELOAD
+  h->irep = NULL;
+#endif
+  h->data = (uint8_t *)src;
+
+  value.string = h;
+  mrbc_string_clear_hash( &value );
+  return value;
+}
+
+
+#if MRBC_USE_HOT_RELOAD
+//================================================================
+/*! keep the irep alive while the literal string refers to its pool.
+
+  The old irep is not freed by the hot reload until it is released.
+  (see mrbc_reload_task)
+
+  @param  str	pointer to the string made by mrbc_string_new_literal.
+  @param  irep	irep that holds the source bytes, or NULL.
+*/
+void mrbc_string_keep_irep(mrbc_value *str, struct IREP *irep)
+{
+  mrbc_string *h = str->string;
+  if( !h || !h->flag_literal || !irep ) return;
+
+  hal_lock();
+  MRBC_IREP_ADD_REF( irep, 1 );
+  hal_unlock();
+  h->irep = irep;
+}
+
+
+//================================================================
+/*! release the irep kept by the literal string.
+
+  @param  h	pointer to String handle.
+*/
+static void string_release_irep(mrbc_string *h)
+{
+  if( !h->irep ) return;
+
+  hal_lock();
+  MRBC_IREP_ADD_REF( h->irep, -1 );
+  hal_unlock();
+  h->irep = NULL;
+}
+#endif
+
+#if MRBC_USE_SHARED_SLICE
+//================================================================
+/*! release the string that owns the data of the slice.
+
+  @param  h	pointer to String handle.
+*/
+static void string_release_shared(mrbc_string *h)
+{
+  if( !h->shared ) return;
+
+  mrbc_value shared = {.tt = MRBC_TT_STRING, .string = h->shared};
+  h->shared = NULL;
+  mrbc_decref( &shared );
+}
+
+
+//================================================================
+/*! make a slice to the end, that shares the bytes.
+
+  At the first time, src passes its buffer to a new hidden string,
+  and both refer to it.
+
+  @param  vm	pointer to VM.
+  @param  src	source string.
+  @param  pos	start position.
+  @return	string object
+*/
+static mrbc_value string_slice_shared(struct VM *vm, mrbc_value *src, int pos)
+{
+  mrbc_string *h = src->string;
+
+  if( !h->flag_literal ) {
+    mrbc_string *shared = mrbc_raw_alloc( sizeof(mrbc_string) );
+    if( !shared ) return mrbc_nil_value();	// ENOMEM
+
+    // move the buffer. it can't be moved by compaction any more.
+    *shared = *h;
+    MRBC_INIT_OBJECT_HEADER( shared, "ST" );
+    mrbc_set_vm_id( shared, mrbc_get_vm_id(h) );
+    mrbc_alloc_set_owner( shared->data, NULL );
+#if MRBC_USE_STRING_CAPACITY
+    h->capacity = 0;
+#endif
+    h->flag_literal = 1;
+    h->shared = shared;
+  }
+
+  mrbc_value ret = mrbc_string_new_literal(vm, h->data + pos, h->size - pos);
+  if( ret.string && h->shared ) {
+    ret.string->shared = h->shared;
+    h->shared->ref_count++;
+  }
+  mrbc_string_keep_irep( &ret, h->irep );
+
+  return ret;
+}
+#endif
+
+
+//================================================================
+/*! copy the literal to own buffer, before modifying the contents.
+
+  @param  str	pointer to target value
+  @return	mrbc_error_code
+*/
+int mrbc_string_make_writable(mrbc_value *str)
+{
+  mrbc_string *h = str->string;
+  if( !h->flag_literal ) return 0;
+
+  uint8_t *buf = mrbc_raw_alloc( h->size + 1 );
+  if( !buf ) return E_NOMEMORY_ERROR;	// ENOMEM
+
+  memcpy( buf, h->data, h->size + 1 );
+  mrbc_set_vm_id( buf, mrbc_get_vm_id(h) );
+#if MRBC_USE_STRING_CAPACITY
+  h->capacity = h->size + 1;
+#endif
+  h->flag_literal = 0;
+  h->data = buf;
+  mrbc_alloc_set_owner( h->data, (void **)&h->data );
+#if MRBC_USE_SHARED_SLICE
+  string_release_shared( h );
+#endif
+#if MRBC_USE_HOT_RELOAD
+  string_release_irep( h );
+#endif
+
+  return 0;
+}
+#endif
+
+
 //================================================================
 /*! destructor
 
@@ -138,6 +407,15 @@ mrbc_value mrbc_string_new_alloc(struct VM *vm, void *buf, int len)
 */
 void mrbc_string_delete(mrbc_value *str)
 {
+#if MRBC_USE_STRING_COW && MRBC_USE_SHARED_SLICE
+  string_release_shared( str->string );
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_HOT_RELOAD
+  string_release_irep( str->string );
+#endif
+#if MRBC_USE_STRING_COW
+  if( !str->string->flag_literal )
+#endif
   mrbc_raw_free(str->string->data);
   mrbc_raw_free(str->string);
 }
@@ -149,9 +427,23 @@ void mrbc_string_delete(mrbc_value *str)
 */
 void mrbc_string_clear(mrbc_value *str)
 {
-  mrbc_raw_realloc(str->string->data, 1);
-  str->string->data[0] = '\0';
   str->string->size = 0;
+  mrbc_string_clear_hash( str );
+
+#if MRBC_USE_STRING_COW
+  if( str->string->flag_literal ) {
+#if MRBC_USE_SHARED_SLICE
+    string_release_shared( str->string );
+#endif
+#if MRBC_USE_HOT_RELOAD
+    string_release_irep( str->string );
+#endif
+    str->string->data = (uint8_t *)"";
+    return;
+  }
+#endif
+  str->string->data[0] = '\0';
+  string_shrink( str );
 }
 
 
@@ -161,6 +453,10 @@ void mrbc_string_clear(mrbc_value *str)
 void mrbc_string_clear_vm_id(mrbc_value *str)
 {
   mrbc_set_vm_id( str->string, 0 );
+#if MRBC_USE_STRING_COW
+  // the literal may be released with the VM's bytecode.
+  if( mrbc_string_make_writable( str ) != 0 ) return;	// ENOMEM
+#endif
   mrbc_set_vm_id( str->string->data, 0 );
 }
 
@@ -176,6 +472,17 @@ mrbc_value mrbc_string_dup(struct VM *vm, mrbc_value *s1)
 {
   mrbc_string *h1 = s1->string;
 
+#if MRBC_USE_STRING_COW
+  if( h1->flag_literal ) {
+#if MRBC_USE_SHARED_SLICE
+    if( h1->shared ) return string_slice_shared(vm, s1, 0);
+#endif
+    mrbc_value value = mrbc_string_new_literal(vm, h1->data, h1->size);
+    mrbc_string_keep_irep( &value, h1->irep );
+    return value;
+  }
+#endif
+
   mrbc_value value = mrbc_string_new(vm, NULL, h1->size);
   if( value.string == NULL ) return value;		// ENOMEM
 
@@ -220,8 +527,8 @@ int mrbc_string_append(mrbc_value *s1, const mrbc_value *s2)
   int len1 = s1->string->size;
   int len2 = (s2->tt == MRBC_TT_STRING) ? s2->string->size : 1;
 
-  uint8_t *str = mrbc_raw_realloc(s1->string->data, len1+len2+1);
-  if( !str ) return E_NOMEMORY_ERROR;
+  if( mrbc_string_reserve( s1, len1+len2 ) != 0 ) return E_NOMEMORY_ERROR;
+  uint8_t *str = s1->string->data;
 
   if( s2->tt == MRBC_TT_STRING ) {
     memcpy(str + len1, s2->string->data, len2 + 1);
@@ -231,7 +538,7 @@ int mrbc_string_append(mrbc_value *s1, const mrbc_value *s2)
   }
 
   s1->string->size = len1 + len2;
-  s1->string->data = str;
+  mrbc_string_clear_hash( s1 );
 
   return 0;
 }
@@ -249,13 +556,13 @@ int mrbc_string_append_cstr(mrbc_value *s1, const char *s2)
   int len1 = s1->string->size;
   int len2 = strlen(s2);
 
-  uint8_t *str = mrbc_raw_realloc(s1->string->data, len1+len2+1);
-  if( !str ) return E_NOMEMORY_ERROR;
+  if( mrbc_string_reserve( s1, len1+len2 ) != 0 ) return E_NOMEMORY_ERROR;
+  uint8_t *str = s1->string->data;
 
   memcpy(str + len1, s2, len2 + 1);
 
   s1->string->size = len1 + len2;
-  s1->string->data = str;
+  mrbc_string_clear_hash( s1 );
 
   return 0;
 }
@@ -271,15 +578,24 @@ int mrbc_string_append_cstr(mrbc_value *s1, const char *s2)
 */
 int mrbc_string_index(const mrbc_value *src, const mrbc_value *pattern, int offset)
 {
-  char *p1 = mrbc_string_cstr(src) + offset;
-  char *p2 = mrbc_string_cstr(pattern);
-  int try_cnt = mrbc_string_size(src) - mrbc_string_size(pattern) - offset;
-
-  while( try_cnt >= 0 ) {
-    if( memcmp( p1, p2, mrbc_string_size(pattern) ) == 0 ) {
-      return p1 - mrbc_string_cstr(src);	// matched.
+  const char *s = mrbc_string_cstr(src);
+  const char *p1 = s + offset;
+  const char *p2 = mrbc_string_cstr(pattern);
+  int len = mrbc_string_size(pattern);
+  int try_cnt = mrbc_string_size(src) - len - offset;
+
+  if( try_cnt < 0 ) return -1;
+  if( len == 0 ) return offset;
+
+  // find the first byte with memchr(), that scans a word or a vector
+  //  at a time in most C libraries, and compare the rest.
+  const char *end = p1 + try_cnt + 1;
+  while( p1 < end ) {
+    p1 = memchr( p1, p2[0], end - p1 );
+    if( p1 == NULL ) break;
+    if( memcmp( p1 + 1, p2 + 1, len - 1 ) == 0 ) {
+      return p1 - s;	// matched.
     }
-    try_cnt--;
     p1++;
   }
 
@@ -318,11 +634,14 @@ int mrbc_string_strip(mrbc_value *src, int mode)
   int new_size = p2 - p1 + 1;
   if( mrbc_string_size(src) == new_size ) return 0;
 
+  int offset = p1 - mrbc_string_cstr(src);
+  if( mrbc_string_make_writable( src ) != 0 ) return 0;	// ENOMEM
   char *buf = mrbc_string_cstr(src);
-  if( p1 != buf ) memmove( buf, p1, new_size );
+  if( offset != 0 ) memmove( buf, buf + offset, new_size );
   buf[new_size] = '\0';
-  mrbc_raw_realloc(buf, new_size+1);	// shrink suitable size.
   src->string->size = new_size;
+  string_shrink( src );
+  mrbc_string_clear_hash( src );
 
   return 1;
 }
@@ -349,9 +668,11 @@ int mrbc_string_chomp(mrbc_value *src)
   int new_size = p2 - p1 + 1;
   if( mrbc_string_size(src) == new_size ) return 0;
 
+  if( mrbc_string_make_writable( src ) != 0 ) return 0;	// ENOMEM
   char *buf = mrbc_string_cstr(src);
   buf[new_size] = '\0';
   src->string->size = new_size;
+  mrbc_string_clear_hash( src );
 
   return 1;
 }
@@ -443,7 +764,7 @@ static void c_string_to_i(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_string_to_f(struct VM *vm, mrbc_value v[], int argc)
 {
-  mrbc_float d = atof(mrbc_string_cstr(v));
+  mrbc_float d = mrbc_atof(mrbc_string_cstr(v));
 
   SET_FLOAT_RETURN( d );
 }
@@ -491,7 +812,14 @@ static void c_string_slice(struct VM *vm, mrbc_value v[], int argc)
   if( len < 0 ) goto RETURN_NIL;
   if( argc == 1 && len <= 0 ) goto RETURN_NIL;
 
-  mrbc_value ret = mrbc_string_new(vm, mrbc_string_cstr(v) + pos, len);
+  mrbc_value ret;
+#if MRBC_USE_STRING_COW && MRBC_USE_SHARED_SLICE
+  // (note) the slice to the end only, because it needs '\0' terminator.
+  if( pos + len == target_len && len >= MRBC_SHARED_SLICE_MIN ) {
+    ret = string_slice_shared(vm, v, pos);
+  } else
+#endif
+  ret = mrbc_string_new(vm, mrbc_string_cstr(v) + pos, len);
   if( !ret.string ) goto RETURN_NIL;		// ENOMEM
 
   SET_RETURN(ret);
@@ -549,14 +877,13 @@ static void c_string_insert(struct VM *vm, mrbc_value v[], int argc)
     return;
   }
 
-  uint8_t *str = mrbc_realloc(vm, mrbc_string_cstr(v), len1 + len2 - len + 1);
-  if( !str ) return;
+  if( mrbc_string_reserve( v, len1 + len2 - len ) != 0 ) return;	// ENOMEM
+  uint8_t *str = v->string->data;
 
   memmove( str + nth + len2, str + nth + len, len1 - nth - len + 1 );
   memcpy( str + nth, mrbc_string_cstr(val), len2 );
   v->string->size = len1 + len2 - len;
-
-  v->string->data = str;
+  mrbc_string_clear_hash( v );
 }
 
 
@@ -735,10 +1062,15 @@ static void c_string_slice_self(struct VM *vm, mrbc_value v[], int argc)
   if( !ret.string ) goto RETURN_NIL;		// ENOMEM
 
   if( len > 0 ) {
+    if( mrbc_string_make_writable( v ) != 0 ) {	// ENOMEM
+      mrbc_decref( &ret );
+      goto RETURN_NIL;
+    }
     memmove( mrbc_string_cstr(v) + pos, mrbc_string_cstr(v) + pos + len,
 	     mrbc_string_size(v) - pos - len + 1 );
     v->string->size = mrbc_string_size(v) - len;
-    mrbc_raw_realloc( mrbc_string_cstr(v), mrbc_string_size(v)+1 );
+    string_shrink( v );
+    mrbc_string_clear_hash( v );
   }
 
   SET_RETURN(ret);
@@ -941,7 +1273,8 @@ static void c_string_strip_self(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_string_to_sym(struct VM *vm, mrbc_value v[], int argc)
 {
-  mrbc_value ret = mrbc_symbol_new(vm, mrbc_string_cstr(&v[0]));
+  mrbc_value ret = mrbc_symbol_new_with_hash(vm, mrbc_string_cstr(&v[0]),
+					     mrbc_string_hash(&v[0]));
 
   SET_RETURN(ret);
 }
@@ -1034,47 +1367,63 @@ static struct tr_pattern * tr_parse_pattern( struct VM *vm, const mrb_value *v_p
   return ret;
 }
 
-static int tr_find_character( const struct tr_pattern *pat, int ch )
+static int tr_get_character( const struct tr_pattern *pat, int n_th )
 {
-  int ret = -1;
   int n_sum = 0;
-  int flag_reverse = pat ? pat->flag_reverse : 0;
-
   while( pat != NULL ) {
-    if( pat->type == 1 ) {	// in-order
-      int i;
-      for( i = 0; i < pat->n; i++ ) {
-	if( pat->ch[i] == ch ) ret = n_sum + i;
-      }
-    } else {	// pat->type == 2  range
-      if( pat->ch[0] <= ch && ch <= pat->ch[1] ) ret = n_sum + ch - pat->ch[0];
+    if( n_th < (n_sum + pat->n) ) {
+      int i = (n_th - n_sum);
+      return (pat->type == 1) ? pat->ch[i] :pat->ch[0] + i;
+    }
+    if( pat->next == NULL ) {
+      return (pat->type == 1) ? pat->ch[pat->n - 1] : pat->ch[1];
     }
     n_sum += pat->n;
     pat = pat->next;
   }
 
-  if( flag_reverse ) {
-    return (ret < 0) ? INT_MAX : -1;
-  }
-  return ret;
+  return -1;
 }
 
-static int tr_get_character( const struct tr_pattern *pat, int n_th )
+//================================================================
+/*! make the lookup table of tr
+
+  Each character of the string is replaced with one table lookup.
+  When the search pattern matches more than once, the last one wins.
+
+  @param  pat	search pattern.
+  @param  rep	replace pattern or NULL.
+  @param  xlat	(output) replaced character. 256 bytes.
+  @param  hit	(output) bitmap of the characters to replace. 32 bytes.
+*/
+static void tr_make_table( const struct tr_pattern *pat, const struct tr_pattern *rep, uint8_t *xlat, uint8_t *hit )
 {
+  int flag_reverse = pat->flag_reverse;
   int n_sum = 0;
+
+  memset( hit, 0, 32 );
   while( pat != NULL ) {
-    if( n_th < (n_sum + pat->n) ) {
-      int i = (n_th - n_sum);
-      return (pat->type == 1) ? pat->ch[i] :pat->ch[0] + i;
-    }
-    if( pat->next == NULL ) {
-      return (pat->type == 1) ? pat->ch[pat->n - 1] : pat->ch[1];
+    int i;
+    for( i = 0; i < pat->n; i++ ) {
+      // (note) the range is in the char type, same as in the string.
+      char ch = (pat->type == 1) ? pat->ch[i] : pat->ch[0] + i;
+      uint8_t c = ch;
+      hit[c >> 3] |= (1 << (c & 7));
+      if( rep ) xlat[c] = tr_get_character( rep, n_sum + i );
     }
     n_sum += pat->n;
     pat = pat->next;
   }
 
-  return -1;
+  if( flag_reverse ) {
+    int c, ch = rep ? tr_get_character( rep, INT_MAX ) : 0;
+    for( c = 0; c < 32; c++ ) {
+      hit[c] = ~hit[c];
+    }
+    for( c = 0; c < 256; c++ ) {
+      xlat[c] = ch;
+    }
+  }
 }
 
 static int tr_main( struct VM *vm, mrbc_value v[], int argc )
@@ -1083,35 +1432,44 @@ static int tr_main( struct VM *vm, mrbc_value v[], int argc )
     console_print("ArgumentError\n");	// raise?
     return -1;
   }
+  if( mrbc_string_make_writable( &v[0] ) != 0 ) return -1;	// ENOMEM
 
   struct tr_pattern *pat = tr_parse_pattern( vm, &v[1], 1 );
   if( pat == NULL ) return 0;
 
   struct tr_pattern *rep = tr_parse_pattern( vm, &v[2], 0 );
+  uint8_t *xlat = mrbc_alloc( vm, 256 + 32 );
+  if( xlat == NULL ) {		// ENOMEM
+    tr_free_pattern( pat );
+    tr_free_pattern( rep );
+    return -1;
+  }
+  uint8_t *hit = xlat + 256;
+  int flag_delete = (rep == NULL);
+  tr_make_table( pat, rep, xlat, hit );
+  tr_free_pattern( pat );
+  tr_free_pattern( rep );
 
   int flag_changed = 0;
-  char *s = mrbc_string_cstr( &v[0] );
+  uint8_t *s = (uint8_t *)mrbc_string_cstr( &v[0] );
   int len = mrbc_string_size( &v[0] );
-  int i;
-  for( i = 0; i < len; i++ ) {
-    int n = tr_find_character( pat, s[i] );
-    if( n < 0 ) continue;
+  int i, j;
+  for( i = j = 0; i < len; i++ ) {
+    uint8_t c = s[i];
+    if( !(hit[c >> 3] & (1 << (c & 7))) ) {
+      s[j++] = c;
+      continue;
+    }
 
     flag_changed = 1;
-    if( rep == NULL ) {
-      memmove( s + i, s + i + 1, len - i );
-      len--;
-      i--;
-    } else {
-      s[i] = tr_get_character( rep, n );
-    }
+    if( !flag_delete ) s[j++] = xlat[c];
   }
-
-  tr_free_pattern( pat );
-  tr_free_pattern( rep );
+  len = j;
+  mrbc_raw_free( xlat );
 
   v[0].string->size = len;
   v[0].string->data[len] = 0;
+  mrbc_string_clear_hash( &v[0] );
 
   return flag_changed;
 }
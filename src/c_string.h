@@ -27,6 +27,7 @@ extern "C" {
 
 /***** Local headers ********************************************************/
 #include "value.h"
+#include "symbol.h"
 
 
 /***** Constant values ******************************************************/
@@ -43,7 +44,22 @@ typedef struct RString {
   MRBC_OBJECT_HEADER;
 
   uint16_t size;	//!< string length.
+#if MRBC_USE_STRING_HASH_CACHE
+  uint16_t hash;	//!< cached hash value, or 0 if not calculated.
+#endif
+#if MRBC_USE_STRING_CAPACITY
+  uint16_t capacity;	//!< allocated buffer size including '\0'.
+#endif
+#if MRBC_USE_STRING_COW
+  uint8_t flag_literal;	//!< data refers to a literal, not own buffer.
+#endif
   uint8_t *data;	//!< pointer to allocated buffer.
+#if MRBC_USE_STRING_COW && MRBC_USE_SHARED_SLICE
+  struct RString *shared;	//!< owner of data if a slice, or NULL.
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_HOT_RELOAD
+  struct IREP *irep;	//!< irep that holds the literal, or NULL.
+#endif
 
 } mrbc_string;
 
@@ -53,6 +69,19 @@ typedef struct RString {
 mrbc_value mrbc_string_new(struct VM *vm, const void *src, int len);
 mrbc_value mrbc_string_new_cstr(struct VM *vm, const char *src);
 mrbc_value mrbc_string_new_alloc(struct VM *vm, void *buf, int len);
+#if MRBC_USE_STRING_COW
+mrbc_value mrbc_string_new_literal(struct VM *vm, const void *src, int len);
+int mrbc_string_make_writable(mrbc_value *str);
+int mrbc_string_reserve(mrbc_value *str, int len);
+#else
+#define mrbc_string_new_literal(vm,src,len)	mrbc_string_new(vm, src, len)
+#define mrbc_string_make_writable(str)		0
+#endif
+#if MRBC_USE_STRING_COW && MRBC_USE_HOT_RELOAD
+void mrbc_string_keep_irep(mrbc_value *str, struct IREP *irep);
+#else
+#define mrbc_string_keep_irep(str,irep)		((void)0)
+#endif
 void mrbc_string_delete(mrbc_value *str);
 void mrbc_string_clear(mrbc_value *str);
 void mrbc_string_clear_vm_id(mrbc_value *str);
@@ -97,6 +126,35 @@ static inline char * mrbc_string_cstr(const mrbc_value *v)
   return (char*)v->string->data;
 }
 
+//================================================================
+/*! get hash value
+
+  Same as mrbc_calc_hash( mrbc_string_cstr(str) ).
+*/
+static inline uint16_t mrbc_string_hash(const mrbc_value *str)
+{
+#if MRBC_USE_STRING_HASH_CACHE
+  if( str->string->hash == 0 ) {
+    str->string->hash = mrbc_calc_hash( mrbc_string_cstr(str) );
+  }
+  return str->string->hash;
+#else
+  return mrbc_calc_hash( mrbc_string_cstr(str) );
+#endif
+}
+
+//================================================================
+/*! discard the cached hash value
+
+  Call this after modifying string contents.
+*/
+static inline void mrbc_string_clear_hash(mrbc_value *str)
+{
+#if MRBC_USE_STRING_HASH_CACHE
+  str->string->hash = 0;
+#endif
+}
+
 
 #ifdef __cplusplus
 }
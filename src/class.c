@@ -13,6 +13,7 @@
 */
 
 /***** Feature test switches ************************************************/
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_OBJECT
 /***** System headers *******************************************************/
 #include "vm_config.h"
 #include <stdint.h>
@@ -28,29 +29,191 @@
 #include "keyvalue.h"
 #include "global.h"
 #include "console.h"
+#include "hal_selector.h"
+#include "gc.h"
+#include "rrt0.h"
+#include "snapshot.h"
 
 
 /***** Constant values ******************************************************/
+#if MRBC_METHOD_CACHE_SIZE & (MRBC_METHOD_CACHE_SIZE - 1)
+#error "MRBC_METHOD_CACHE_SIZE must be a power of 2."
+#endif
+
+
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
+#if MRBC_METHOD_CACHE_SIZE
+static MRBC_CONTEXT_LOCAL mrbc_method_cache method_cache[MRBC_METHOD_CACHE_SIZE];
+#if defined(MRBC_DEBUG)
+static MRBC_CONTEXT_LOCAL uint32_t method_cache_hit, method_cache_miss;
+#endif
+#endif
+
 /***** Global variables *****************************************************/
 // Builtin class table.
-mrbc_class *mrbc_class_tbl[MRBC_TT_MAXVAL+1];
-mrbc_class *mrbc_class_object;
-mrbc_class *mrbc_class_math;
-mrbc_class *mrbc_class_exception;
-mrbc_class *mrbc_class_standarderror;
-mrbc_class *mrbc_class_runtimeerror;
-mrbc_class *mrbc_class_zerodivisionerror;
-mrbc_class *mrbc_class_argumenterror;
-mrbc_class *mrbc_class_indexerror;
-mrbc_class *mrbc_class_typeerror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_tbl[MRBC_TT_MAXVAL+1];
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_object;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_math;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_packedarray;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_exception;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_standarderror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_runtimeerror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_zerodivisionerror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_argumenterror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_indexerror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_typeerror;
+MRBC_CONTEXT_LOCAL mrbc_class *mrbc_class_queue;
+
+// Incremented whenever a method is (re)defined, to expire method caches.
+MRBC_CONTEXT_LOCAL uint32_t mrbc_method_epoch;
 
 
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
+#if MRBC_METHOD_TABLE_MIN > 0
+//================================================================
+/*! (re)build the sorted method table of the class.
+
+  @param  cls	target class.
+
+  <pre>
+  method_link has the newest definition first, so the first one of the
+  same name is taken. With fewer methods than MRBC_METHOD_TABLE_MIN,
+  or ENOMEM, the table is not made and method_link is searched.
+  </pre>
+*/
+static void build_method_table( mrbc_class *cls )
+{
+  mrbc_method *method;
+  int n = 0;
+
+  for( method = cls->method_link; method != 0; method = method->next ) {
+    n++;
+  }
+  if( n < MRBC_METHOD_TABLE_MIN || n > UINT16_MAX ) goto NO_TABLE;
+
+  int size = sizeof(mrbc_method *) * n;
+  mrbc_method **tbl = cls->method_table ?
+			mrbc_raw_realloc( cls->method_table, size ) :
+			mrbc_raw_alloc( size );
+  if( !tbl ) goto NO_TABLE;	// ENOMEM
+  cls->method_table = tbl;
+
+  // insertion sort by sym_id.
+  int n_tbl = 0;
+  for( method = cls->method_link; method != 0; method = method->next ) {
+    int i = n_tbl;
+    while( i > 0 && tbl[i-1]->sym_id > method->sym_id ) i--;
+    if( i > 0 && tbl[i-1]->sym_id == method->sym_id ) continue;
+
+    memmove( &tbl[i+1], &tbl[i], sizeof(mrbc_method *) * (n_tbl - i) );
+    tbl[i] = method;
+    n_tbl++;
+  }
+  cls->n_method_table = n_tbl;
+  return;
+
+ NO_TABLE:
+  if( cls->method_table ) mrbc_raw_free( cls->method_table );
+  cls->method_table = 0;
+  cls->n_method_table = n;
+}
+
+
+//================================================================
+/*! binary search the method table.
+
+  @param  cls		target class, that has the method table.
+  @param  sym_id	symbol id.
+  @return		pointer to method or NULL.
+*/
+static mrbc_method * find_method_table( const mrbc_class *cls, mrbc_sym sym_id )
+{
+  mrbc_method **tbl = cls->method_table;
+  int left = 0;
+  int right = cls->n_method_table;
+
+  while( left < right ) {
+    int mid = (left + right) / 2;
+    if( tbl[mid]->sym_id < sym_id ) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+
+  if( right < cls->n_method_table && tbl[right]->sym_id == sym_id ) {
+    return tbl[right];
+  }
+  return 0;
+}
+#endif
+
+
+//================================================================
+/*! search method in class hierarchy
+
+  @param  method	pointer to mrbc_method to return values.
+  @param  cls		search class.
+  @param  sym_id	symbol id.
+  @return		pointer to method or NULL.
+*/
+static mrbc_method * search_method( mrbc_method *r_method, mrbc_class *cls, mrbc_sym sym_id )
+{
+  mrbc_method *method;
+
+  do {
+#if MRBC_METHOD_TABLE_MIN > 0
+    if( cls->n_method_table == 0 ) build_method_table( cls );
+    if( cls->method_table ) {
+      method = find_method_table( cls, sym_id );
+      if( method ) goto FOUND;
+    } else
+#endif
+    for( method = cls->method_link; method != 0; method = method->next ) {
+      if( method->sym_id == sym_id ) goto FOUND;
+    }
+
+    struct RBuiltinClass *c = (struct RBuiltinClass *)cls;
+    int right = c->num_builtin_method;
+    if( right == 0 ) goto NEXT;
+    int left = 0;
+
+    while( left < right ) {
+      int mid = (left + right) / 2;
+      if( c->method_symbols[mid] < sym_id ) {
+	left = mid + 1;
+      } else {
+	right = mid;
+      }
+    }
+
+    if( right < c->num_builtin_method && c->method_symbols[right] == sym_id ) {
+      *r_method = (mrbc_method){
+	.type = 'M',
+	.c_func = 2,
+	.sym_id = sym_id,
+	.func = c->method_functions[right],
+	.cls = cls };
+      return r_method;
+    }
+
+  NEXT:
+    cls = cls->super;
+  } while( cls != 0 );
+
+  return 0;
+
+ FOUND:
+  *r_method = *method;
+  r_method->cls = cls;
+  return r_method;
+}
+
+
 /***** Global functions *****************************************************/
 //================================================================
 /*! define class
@@ -63,12 +226,16 @@ mrbc_class *mrbc_class_typeerror;
 mrbc_class * mrbc_define_class(struct VM *vm, const char *name, mrbc_class *super)
 {
   mrbc_sym sym_id = str_to_symid(name);
+  hal_lock();
   mrbc_object *obj = mrbc_get_const( sym_id );
 
   // create a new class?
   if( obj == NULL ) {
     mrbc_class *cls = mrbc_raw_alloc_no_free( sizeof(mrbc_class) );
-    if( !cls ) return cls;	// ENOMEM
+    if( !cls ) {
+      hal_unlock();
+      return cls;	// ENOMEM
+    }
 
     cls->sym_id = sym_id;
     cls->num_builtin_method = 0;
@@ -77,11 +244,19 @@ mrbc_class * mrbc_define_class(struct VM *vm, const char *name, mrbc_class *supe
 #endif
     cls->super = (super == NULL) ? mrbc_class_object : super;
     cls->method_link = 0;
+    cls->ivar_syms = 0;
+    cls->n_ivar = 0;
+#if MRBC_METHOD_TABLE_MIN > 0
+    cls->n_method_table = 0;
+    cls->method_table = 0;
+#endif
 
     // register to global constant.
     mrbc_set_const( sym_id, &(mrb_value){.tt = MRBC_TT_CLASS, .cls = cls} );
+    hal_unlock();
     return cls;
   }
+  hal_unlock();
 
   // already
   assert( obj->tt == MRBC_TT_CLASS );
@@ -112,6 +287,12 @@ mrbc_class * mrbc_define_builtin_class(const char *name, mrbc_class *super, cons
 #endif
   cls->super = super;
   cls->method_link = 0;
+  cls->ivar_syms = 0;
+  cls->n_ivar = 0;
+#if MRBC_METHOD_TABLE_MIN > 0
+  cls->n_method_table = 0;
+  cls->method_table = 0;
+#endif
   cls->method_symbols = method_symbols;
   cls->method_functions = method_functions;
 
@@ -140,8 +321,14 @@ void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_f
   method->c_func = 1;
   method->sym_id = str_to_symid( name );
   method->func = cfunc;
+  hal_lock();
   method->next = cls->method_link;
   cls->method_link = method;
+#if MRBC_METHOD_TABLE_MIN > 0
+  cls->n_method_table = 0;
+#endif
+  mrbc_method_epoch++;
+  hal_unlock();
 }
 
 
@@ -159,14 +346,20 @@ mrbc_value mrbc_instance_new(struct VM *vm, mrbc_class *cls, int size)
   v.instance = (mrbc_instance *)mrbc_alloc(vm, sizeof(mrbc_instance) + size);
   if( v.instance == NULL ) return v;	// ENOMEM
 
-  if( mrbc_kv_init_handle(vm, &v.instance->ivar, 0) != 0 ) {
-    mrbc_raw_free(v.instance);
-    v.instance = NULL;
-    return v;
-  }
-
   MRBC_INIT_OBJECT_HEADER( v.instance, "IN" );
   v.instance->cls = cls;
+  v.instance->n_ivar = 0;
+  v.instance->ivar = NULL;
+
+  // allocate slots already known by the class.
+  if( cls->n_ivar ) {
+    mrbc_value *ivar = mrbc_alloc(vm, sizeof(mrbc_value) * cls->n_ivar);
+    if( ivar ) {
+      memset( ivar, 0, sizeof(mrbc_value) * cls->n_ivar );
+      v.instance->ivar = ivar;
+      v.instance->n_ivar = cls->n_ivar;
+    }
+  }
 
   return v;
 }
@@ -179,8 +372,36 @@ mrbc_value mrbc_instance_new(struct VM *vm, mrbc_class *cls, int size)
 */
 void mrbc_instance_delete(mrbc_value *v)
 {
-  mrbc_kv_delete_data( &v->instance->ivar );
-  mrbc_raw_free( v->instance );
+  mrbc_instance *h = v->instance;
+
+  mrbc_gc_forget(v);
+
+  // the values moved into the Queue.
+  if( h->cls == mrbc_class_queue ) mrbc_queue_clear( (mrbc_queue *)h->data );
+
+  if( h->ivar ) {
+    int i;
+    for( i = 0; i < h->n_ivar; i++ ) {
+      mrbc_decref( &h->ivar[i] );
+    }
+    mrbc_raw_free( h->ivar );
+  }
+  mrbc_raw_free( h );
+}
+
+
+//================================================================
+/*! clear vm_id of the instance, not of the instance variables.
+  (see mrbc_clear_vm_id)
+
+  @param  v	pointer to target value
+*/
+void mrbc_instance_clear_vm_id(mrbc_value *v)
+{
+  mrbc_instance *h = v->instance;
+
+  mrbc_set_vm_id( h, 0 );
+  if( h->ivar ) mrbc_set_vm_id( h->ivar, 0 );
 }
 
 
@@ -193,8 +414,12 @@ void mrbc_instance_delete(mrbc_value *v)
 */
 void mrbc_instance_setiv(mrbc_object *obj, mrbc_sym sym_id, mrbc_value *v)
 {
-  mrbc_incref(v);
-  mrbc_kv_set( &obj->instance->ivar, sym_id, v );
+  if( obj->tt != MRBC_TT_OBJECT ) return;
+
+  int slot = mrbc_class_ivar_slot( obj->instance->cls, sym_id, 1 );
+  if( slot < 0 ) return;	// ENOMEM
+
+  mrbc_instance_setiv_slot( obj, slot, v );
 }
 
 
@@ -207,11 +432,174 @@ void mrbc_instance_setiv(mrbc_object *obj, mrbc_sym sym_id, mrbc_value *v)
 */
 mrbc_value mrbc_instance_getiv(mrbc_object *obj, mrbc_sym sym_id)
 {
-  mrbc_value *v = mrbc_kv_get( &obj->instance->ivar, sym_id );
-  if( !v ) return mrbc_nil_value();
+  if( obj->tt != MRBC_TT_OBJECT ) return mrbc_nil_value();
+
+  int slot = mrbc_class_ivar_slot( obj->instance->cls, sym_id, 0 );
+  if( slot < 0 ) return mrbc_nil_value();
+
+  return mrbc_instance_getiv_slot( obj, slot );
+}
+
+
+//================================================================
+/*! find instance variable slot in the class shape
+
+  Slots are only appended, so a found slot number stays valid
+  and can be cached by the caller.
+
+  @param  cls		pointer to class.
+  @param  sym_id	instance variable name. (without '@')
+  @param  flag_add	add a new slot if not found.
+  @return		slot number or -1 if not found.
+*/
+int mrbc_class_ivar_slot(mrbc_class *cls, mrbc_sym sym_id, int flag_add)
+{
+  int i;
+  hal_lock();
+  for( i = 0; i < cls->n_ivar; i++ ) {
+    if( cls->ivar_syms[i] == sym_id ) goto DONE;
+  }
+  if( !flag_add ) goto NOT_FOUND;
+
+  if( cls->n_ivar == UINT8_MAX ) {
+    console_printf("Too many instance variables in %s\n",
+		   symid_to_str(cls->sym_id));
+    goto NOT_FOUND;
+  }
+
+  // classes are never released, so the shape is neither.
+  int size = sizeof(mrbc_sym) * (cls->n_ivar + 1);
+  mrbc_sym *syms = cls->ivar_syms ? mrbc_raw_realloc( cls->ivar_syms, size ) :
+				    mrbc_raw_alloc( size );
+  if( !syms ) goto NOT_FOUND;	// ENOMEM
+
+  syms[i] = sym_id;
+  cls->ivar_syms = syms;
+  cls->n_ivar++;
+
+ DONE:
+  hal_unlock();
+  return i;
+
+ NOT_FOUND:
+  hal_unlock();
+  return -1;
+}
+
+
+//================================================================
+/*! instance variable setter by slot number
+
+  @param  obj		pointer to target.
+  @param  slot		slot number returned by mrbc_class_ivar_slot().
+  @param  v		pointer to value.
+*/
+void mrbc_instance_setiv_slot(mrbc_object *obj, int slot, mrbc_value *v)
+{
+  mrbc_instance *h = obj->instance;
+
+  if( slot >= h->n_ivar ) {
+    // grow up to the current shape size.
+    int n = h->cls->n_ivar;
+    int size = sizeof(mrbc_value) * n;
+    mrbc_value *ivar;
+    if( h->ivar ) {
+      ivar = mrbc_raw_realloc( h->ivar, size );
+    } else {
+      ivar = mrbc_raw_alloc( size );
+      if( ivar ) mrbc_set_vm_id( ivar, mrbc_get_vm_id(h) );
+    }
+    if( !ivar ) return;		// ENOMEM
+
+    memset( ivar + h->n_ivar, 0, sizeof(mrbc_value) * (n - h->n_ivar) );
+    h->ivar = ivar;
+    h->n_ivar = n;
+  }
 
   mrbc_incref(v);
-  return *v;
+  mrbc_decref(&h->ivar[slot]);
+  h->ivar[slot] = *v;
+}
+
+
+//================================================================
+/*! instance variable getter by slot number
+
+  @param  obj		pointer to target.
+  @param  slot		slot number returned by mrbc_class_ivar_slot().
+  @return		value.
+*/
+mrbc_value mrbc_instance_getiv_slot(mrbc_object *obj, int slot)
+{
+  mrbc_instance *h = obj->instance;
+
+  if( slot >= h->n_ivar || h->ivar[slot].tt == MRBC_TT_EMPTY ) {
+    return mrbc_nil_value();
+  }
+
+  mrbc_incref( &h->ivar[slot] );
+  return h->ivar[slot];
+}
+
+
+//================================================================
+/*! copy all instance variables
+
+  @param  dst		pointer to destination. (same class as src)
+  @param  src		pointer to source.
+*/
+void mrbc_instance_dup_ivar(mrbc_object *dst, const mrbc_object *src)
+{
+  int i;
+  for( i = 0; i < src->instance->n_ivar; i++ ) {
+    if( src->instance->ivar[i].tt == MRBC_TT_EMPTY ) continue;
+    mrbc_instance_setiv_slot( dst, i, &src->instance->ivar[i] );
+  }
+}
+
+
+//================================================================
+/*! initialize the proc object.
+
+  @param  vm		Pointer to VM.
+  @param  proc		Pointer to the proc object.
+  @param  irep		Pointer to IREP.
+*/
+static void proc_init(struct VM *vm, mrbc_proc *proc, void *irep)
+{
+  MRBC_INIT_OBJECT_HEADER( proc, "PR" );
+  proc->callinfo = vm->callinfo_tail;
+
+  if(vm->current_regs[0].tt == MRBC_TT_PROC) {
+    proc->callinfo_self = vm->current_regs[0].proc->callinfo_self;
+    proc->upper = vm->current_regs[0].proc;
+    mrbc_incref( &vm->current_regs[0] );
+  } else {
+    proc->callinfo_self = vm->callinfo_tail;
+    proc->upper = NULL;
+  }
+
+  // the frame makes it closed when returns. (see mrbc_proc_close_frame)
+  proc->flag_env_held = 0;
+  proc->env = vm->current_regs;
+  proc->n_regs = vm->pc_irep->nregs;
+  proc->n_locals = vm->pc_irep->nlocals;
+  if( vm->callinfo_tail ) {
+    proc->flag_closed = 0;
+    proc->next = vm->callinfo_tail->procs;
+    vm->callinfo_tail->procs = proc;
+  } else {
+    // top level. vm->regs are alive until the VM ends.
+    proc->flag_closed = 1;
+    proc->closed_env = NULL;
+  }
+
+  proc->irep = irep;
+#if MRBC_USE_HOT_RELOAD
+  hal_lock();
+  MRBC_IREP_ADD_REF( proc->irep, 1 );
+  hal_unlock();
+#endif
 }
 
 
@@ -229,18 +617,226 @@ mrbc_value mrbc_proc_new(struct VM *vm, void *irep)
   val.proc = (mrbc_proc *)mrbc_alloc(vm, sizeof(mrbc_proc));
   if( !val.proc ) return val;	// ENOMEM
 
-  MRBC_INIT_OBJECT_HEADER( val.proc, "PR" );
-  val.proc->callinfo = vm->callinfo_tail;
+  proc_init( vm, val.proc, irep );
+#if MRBC_BLOCK_POOL_SIZE > 0
+  val.proc->flag_pooled = 0;
+#endif
 
-  if(vm->current_regs[0].tt == MRBC_TT_PROC) {
-    val.proc->callinfo_self = vm->current_regs[0].proc->callinfo_self;
-  } else {
-    val.proc->callinfo_self = vm->callinfo_tail;
+  return val;
+}
+
+
+#if MRBC_BLOCK_POOL_SIZE > 0
+//================================================================
+/*! proc constructor for the block passed to a method.
+
+  @param  vm		Pointer to VM.
+  @param  irep		Pointer to IREP.
+  @return		mrbc_value of Proc object.
+
+  The proc is taken from the block pool of the VM, if it has a free one.
+  Such a block is released when the method returns in most cases,
+  so the pool is used as a stack. If the method keeps the block,
+  it holds the entry until released as usual.
+*/
+mrbc_value mrbc_proc_new_block(struct VM *vm, void *irep)
+{
+  int i;
+  for( i = 0; i < MRBC_BLOCK_POOL_SIZE; i++ ) {
+    mrbc_proc *proc = &vm->block_pool[i];
+    if( proc->irep != NULL ) continue;
+
+    mrbc_value val = {.tt = MRBC_TT_PROC, .proc = proc};
+    proc_init( vm, proc, irep );
+    proc->flag_pooled = 1;
+    return val;
   }
 
-  val.proc->irep = irep;
+  return mrbc_proc_new( vm, irep );
+}
+#endif
+
 
-  return val;
+//================================================================
+/*! check the env has the proc in its local variables.
+
+  @param  env	pointer to the env.
+  @param  proc	pointer to the proc.
+  @return	result
+*/
+static int env_has(const mrbc_env *env, const mrbc_proc *proc)
+{
+  int i;
+  for( i = 1; i < env->n_locals; i++ ) {
+    if( env->locals[i].tt == MRBC_TT_PROC && env->locals[i].proc == proc ) return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! count the procs that only the env keeps.
+
+  @param  env	pointer to the env.
+  @return	number of procs.
+*/
+static int env_n_held(const mrbc_env *env)
+{
+  int n = 0;
+  int i;
+  for( i = 1; i < env->n_locals; i++ ) {
+    if( !mrbc_env_is_own( env, &env->locals[i] ) ) continue;
+    if( env->locals[i].proc->ref_count != 1 ) continue;	// referred from out.
+    if( mrbc_env_is_counted( env, i ) ) n++;
+  }
+  return n;
+}
+
+
+//================================================================
+/*! keep the released proc, if the other procs of the env are alive.
+
+  They may get it from the local variable.
+
+  @param  proc	pointer to the proc, its counter is zero.
+  @return	1 if kept.
+*/
+static int env_keep_proc(mrbc_proc *proc)
+{
+  mrbc_env *env = proc->closed_env;
+
+  if( !env_has( env, proc ) ) return 0;
+  if( env->ref_count - 1 <= env_n_held( env ) ) return 0;
+
+  proc->ref_count = 1;
+  proc->flag_env_held = 1;
+  return 1;
+}
+
+
+#if MRBC_USE_DEFERRED_FREE
+//================================================================
+/*! take the proc out of the free queue.
+
+  @param  proc	pointer to the proc.
+*/
+static void proc_unqueue(mrbc_proc *proc)
+{
+  int i;
+  for( i = 0; i < mrbc_free_queue_n; i++ ) {
+    if( mrbc_free_queue[i].proc == proc ) {
+      mrbc_free_queue[i] = mrbc_free_queue[--mrbc_free_queue_n];
+      return;
+    }
+  }
+}
+#endif
+
+
+//================================================================
+/*! check the local variable of the env is a counted reference.
+
+  @param  env	pointer to the env.
+  @param  i	index of the local variable.
+  @return	result
+*/
+int mrbc_env_is_counted(const mrbc_env *env, int i)
+{
+  const mrbc_value *v = &env->locals[i];
+  if( !mrbc_env_is_own( env, v ) ) return 1;
+  if( !v->proc->flag_env_held ) return 0;
+
+  // counted once, at the first one.
+  int j;
+  for( j = 1; j < i; j++ ) {
+    if( env->locals[j].tt == MRBC_TT_PROC && env->locals[j].proc == v->proc ) return 0;
+  }
+  return 1;
+}
+
+
+//================================================================
+/*! take a reference of the local variable of the env. (OP_GETUPVAR)
+
+  @param  env	pointer to the env.
+  @param  v	pointer to the value in env->locals.
+*/
+void mrbc_env_incref(mrbc_env *env, mrbc_value *v)
+{
+  if( mrbc_env_is_own( env, v ) ) {
+    mrbc_proc *proc = v->proc;
+    if( proc->flag_env_held ) {
+      proc->flag_env_held = 0;	// take over the reference of the env.
+      return;
+    }
+#if MRBC_USE_DEFERRED_FREE
+    if( proc->ref_count == 0 ) {
+      proc_unqueue( proc );	// released, but not deleted yet.
+      proc->ref_count = 1;
+      return;
+    }
+#endif
+  }
+
+  mrbc_incref( v );
+}
+
+
+//================================================================
+/*! store into the local variable of the env. (OP_SETUPVAR)
+
+  @param  env	pointer to the env.
+  @param  dst	pointer to the value in env->locals.
+  @param  src	pointer to the value to store.
+*/
+void mrbc_env_set(mrbc_env *env, mrbc_value *dst, mrbc_value *src)
+{
+  mrbc_value old = *dst;
+
+  if( !mrbc_env_is_own( env, src ) ) mrbc_incref( src );
+  *dst = *src;
+
+  if( !mrbc_env_is_own( env, &old ) ) {
+    mrbc_decref( &old );
+    return;
+  }
+  if( !old.proc->flag_env_held || env_has( env, old.proc ) ) return;
+
+  old.proc->flag_env_held = 0;
+  mrbc_decref( &old );
+}
+
+
+//================================================================
+/*! drop all references of the local variables of the env.
+
+  @param  env	pointer to the env.
+*/
+void mrbc_env_clear(mrbc_env *env)
+{
+  int i, j;
+
+  for( i = 0; i < env->n_locals; i++ ) {
+    mrbc_value *v = &env->locals[i];
+    if( !mrbc_env_is_own( env, v ) ) {
+      mrbc_decref( v );
+      mrbc_set_nil( v );
+      continue;
+    }
+
+    mrbc_value own = *v;
+    for( j = i; j < env->n_locals; j++ ) {
+      if( env->locals[j].tt == MRBC_TT_PROC && env->locals[j].proc == own.proc ) {
+	mrbc_set_nil( &env->locals[j] );
+      }
+    }
+    if( own.proc->flag_env_held ) {
+      own.proc->flag_env_held = 0;
+      own.proc->closed_env = NULL;
+      env->ref_count--;
+      mrbc_decref( &own );
+    }
+  }
 }
 
 
@@ -251,10 +847,131 @@ mrbc_value mrbc_proc_new(struct VM *vm, void *irep)
 */
 void mrbc_proc_delete(mrbc_value *val)
 {
+  mrbc_proc *proc = val->proc;
+
+  mrbc_gc_forget(val);
+
+  if( !proc->flag_closed ) {
+    // unlink from the frame.
+    mrbc_proc **pp = &proc->callinfo->procs;
+    while( *pp != proc ) {
+      pp = &(*pp)->next;
+    }
+    *pp = proc->next;
+
+  } else if( proc->closed_env ) {
+    if( env_keep_proc( proc ) ) return;
+
+    // free it, if only the env keeps the rest.
+    mrbc_env *env = proc->closed_env;
+    if( --env->ref_count <= env_n_held( env ) ) {
+      mrbc_env_clear( env );
+      mrbc_raw_free( env );
+    }
+  }
+
+  if( proc->upper ) {
+    mrbc_value upper = {.tt = MRBC_TT_PROC, .proc = proc->upper};
+    mrbc_decref( &upper );
+  }
+
+#if MRBC_USE_HOT_RELOAD
+  hal_lock();
+  MRBC_IREP_ADD_REF( val->proc->irep, -1 );
+  hal_unlock();
+#endif
+#if MRBC_BLOCK_POOL_SIZE > 0
+  if( val->proc->flag_pooled ) {
+    val->proc->irep = NULL;	// free entry.
+    return;
+  }
+#endif
   mrbc_raw_free(val->proc);
 }
 
 
+//================================================================
+/*! check the proc is referred to from out of the registers of the frame.
+
+  @param  proc	pointer to the proc, not closed yet.
+  @return	result
+*/
+static int proc_is_escaped(const mrbc_proc *proc)
+{
+  int n_refs = 0;
+  int i;
+
+  // R0 holds self or the return value here.
+  for( i = 1; i < proc->n_regs; i++ ) {
+    if( proc->env[i].tt == MRBC_TT_PROC && proc->env[i].proc == proc ) n_refs++;
+  }
+  return proc->ref_count > n_refs;
+}
+
+
+//================================================================
+/*! detach the procs from the returning frame.
+
+  @param  vm		Pointer to VM.
+  @param  callinfo	callinfo of the frame.
+
+  <pre>
+  When a proc is referred to from out of the registers of the frame
+  (escaped), the local variables are copied to an env, shared by the
+  escaped procs and the procs in the local variables. So the upvars are
+  still valid after the registers are reused. The other procs are
+  released with the registers.
+  The env does not count the procs of the frame. (see mrbc_env_is_own)
+  </pre>
+*/
+void mrbc_proc_close_frame(struct VM *vm, struct CALLINFO *callinfo)
+{
+  mrbc_proc *procs = callinfo->procs;
+  mrbc_proc *proc;
+  mrbc_env *env = NULL;
+  int i;
+
+  callinfo->procs = NULL;
+
+  for( proc = procs; proc != NULL; proc = proc->next ) {
+    if( proc_is_escaped( proc ) ) break;
+  }
+  if( proc ) {
+    int n = proc->n_locals ? proc->n_locals : 1;
+    env = mrbc_alloc( vm, sizeof(mrbc_env) + sizeof(mrbc_value) * n );
+    // if ENOMEM, upvars are left in the registers.
+  }
+  if( env ) {
+    MRBC_INIT_OBJECT_HEADER( env, "EN" );
+    env->ref_count = 0;
+    env->n_locals = proc->n_locals ? proc->n_locals : 1;
+    env->locals[0] = mrbc_nil_value();
+    for( i = 1; i < env->n_locals; i++ ) {
+      mrbc_value *v = &env->locals[i];
+      *v = proc->env[i];
+      if( v->tt == MRBC_TT_PROC && !v->proc->flag_closed &&
+	  v->proc->callinfo == callinfo ) continue;	// not counted.
+      mrbc_incref( v );
+    }
+  }
+
+  for( proc = procs; proc != NULL; ) {
+    mrbc_proc *next = proc->next;
+
+    int flag_share = env && (proc_is_escaped( proc ) || env_has( env, proc ));
+    proc->flag_closed = 1;
+    proc->closed_env = NULL;
+    if( flag_share ) {
+      env->ref_count++;
+      proc->closed_env = env;
+      proc->env = env->locals;
+    }
+
+    proc = next;
+  }
+}
+
+
 //================================================================
 /*! Check the class is the class of object.
 
@@ -284,48 +1001,88 @@ int mrbc_obj_is_kind_of( const mrbc_value *obj, const mrb_class *cls )
 */
 mrbc_method * mrbc_find_method( mrbc_method *r_method, mrbc_class *cls, mrbc_sym sym_id )
 {
-  do {
-    mrbc_method *method;
-    for( method = cls->method_link; method != 0; method = method->next ) {
-      if( method->sym_id == sym_id ) {
-	*r_method = *method;
-	r_method->cls = cls;
-	return r_method;
-      }
-    }
+  hal_lock();
 
-    struct RBuiltinClass *c = (struct RBuiltinClass *)cls;
-    int right = c->num_builtin_method;
-    if( right == 0 ) goto NEXT;
-    int left = 0;
+#if MRBC_METHOD_CACHE_SIZE
+  int idx = (((uintptr_t)cls >> 3) ^ sym_id) & (MRBC_METHOD_CACHE_SIZE - 1);
+  mrbc_method_cache *entry = &method_cache[idx];
 
-    while( left < right ) {
-      int mid = (left + right) / 2;
-      if( c->method_symbols[mid] < sym_id ) {
-	left = mid + 1;
-      } else {
-	right = mid;
-      }
-    }
+  if( entry->cls == cls && entry->method.sym_id == sym_id &&
+      entry->epoch == mrbc_method_epoch ) {
+#if defined(MRBC_DEBUG)
+    method_cache_hit++;
+#endif
+    *r_method = entry->method;
+    goto DONE;
+  }
+#if defined(MRBC_DEBUG)
+  method_cache_miss++;
+#endif
 
-    if( c->method_symbols[right] == sym_id ) {
-      *r_method = (mrbc_method){
-	.type = 'M',
-	.c_func = 2,
-	.sym_id = sym_id,
-	.func = c->method_functions[right],
-	.cls = cls };
-      return r_method;
-    }
+  if( search_method( r_method, cls, sym_id ) == 0 ) {
+    r_method = 0;
+    goto DONE;
+  }
 
-  NEXT:
-    cls = cls->super;
-  } while( cls != 0 );
+  entry->cls = cls;
+  entry->epoch = mrbc_method_epoch;
+  entry->method = *r_method;
 
-  return 0;
+ DONE:
+#else
+  r_method = search_method( r_method, cls, sym_id );
+#endif
+  hal_unlock();
+  return r_method;
 }
 
 
+#if defined(MRBC_DEBUG)
+//================================================================
+/*! statistics of global method cache
+
+  @param  hit	returns number of cache hit.
+  @param  miss	returns number of cache miss.
+*/
+void mrbc_method_cache_statistics( int *hit, int *miss )
+{
+#if MRBC_METHOD_CACHE_SIZE
+  *hit = method_cache_hit;
+  *miss = method_cache_miss;
+#else
+  *hit = 0;
+  *miss = 0;
+#endif
+}
+#endif
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the class table. (see snapshot.c)
+*/
+void mrbc_snapshot_class(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_tbl );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_object );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_math );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_packedarray );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_exception );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_standarderror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_runtimeerror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_zerodivisionerror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_argumenterror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_indexerror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_typeerror );
+  MRBC_SNAPSHOT_VAR( s, mrbc_class_queue );
+  MRBC_SNAPSHOT_VAR( s, mrbc_method_epoch );
+
+  // method_cache[] is not saved.
+  if( s->mode == MRBC_SNAPSHOT_MODE_RESTORE ) mrbc_method_epoch++;
+}
+#endif
+
+
 //================================================================
 /*! get class by name
 
@@ -42,6 +42,12 @@ typedef struct RClass {
 #endif
   struct RClass *super;		//!< pointer to super class.
   struct RMethod *method_link;	//!< pointer to method link.
+  mrbc_sym *ivar_syms;		//!< instance variable names in slot order.
+  uint8_t n_ivar;		//!< # of instance variable slots.
+#if MRBC_METHOD_TABLE_MIN > 0
+  uint16_t n_method_table;	//!< # of method_table, or 0 to be rebuilt.
+  struct RMethod **method_table;	//!< method_link sorted by sym_id.
+#endif
 } mrbc_class;
 typedef struct RClass mrb_class;
 
@@ -53,6 +59,12 @@ struct RBuiltinClass {
 #endif
   struct RClass *super;		//!< pointer to super class.
   struct RMethod *method_link;	//!< pointer to method link.
+  mrbc_sym *ivar_syms;		//!< instance variable names in slot order.
+  uint8_t n_ivar;		//!< # of instance variable slots.
+#if MRBC_METHOD_TABLE_MIN > 0
+  uint16_t n_method_table;	//!< # of method_table, or 0 to be rebuilt.
+  struct RMethod **method_table;	//!< method_link sorted by sym_id.
+#endif
 
   const mrbc_sym *method_symbols;	//!< built-in method sym-id table.
   const mrbc_func_t *method_functions;	//!< built-in method function table.
@@ -61,28 +73,63 @@ struct RBuiltinClass {
 
 //================================================================
 /*! mruby/c instance object.
+
+  Instance variables are stored in the slot order of the class
+  (cls->ivar_syms), so the names are shared by all instances.
 */
 typedef struct RInstance {
   MRBC_OBJECT_HEADER;
 
   struct RClass *cls;
-  struct RKeyValueHandle ivar;
+  uint8_t n_ivar;		//!< # of allocated ivar slots.
+  mrbc_value *ivar;		//!< instance variables or NULL.
   uint8_t data[];
 
 } mrbc_instance;
 typedef struct RInstance mrb_instance;
 
 
+//================================================================
+/*! local variables of a returned frame, shared by its procs.
+
+  ref_count of the header is the number of procs.
+  A local variable that holds a proc of the frame is not counted, so
+  that they make no cycle. When such a proc is released while the other
+  procs are alive, the env keeps it, and counts it once.
+  (see mrbc_env_is_own)
+*/
+typedef struct RProcEnv {
+  MRBC_OBJECT_HEADER;
+  uint16_t n_locals;
+  mrbc_value locals[];
+
+} mrbc_env;
+
+
 //================================================================
 /*! mruby/c proc object.
 */
 typedef struct RProc {
   MRBC_OBJECT_HEADER;
+#if MRBC_BLOCK_POOL_SIZE > 0
+  uint8_t flag_pooled;		//!< in block_pool of the VM.
+#endif
+  uint8_t flag_closed;		//!< the frame returned.
+  uint8_t flag_env_held;	//!< kept only by closed_env.
+  uint16_t n_regs;		//!< nregs of the frame.
+  uint16_t n_locals;		//!< nlocals of the frame.
 
   struct CALLINFO *callinfo;
   struct CALLINFO *callinfo_self;
   struct IREP *irep;
 
+  mrbc_value *env;		//!< registers of the frame, for upvars.
+  struct RProc *upper;		//!< R0 of the frame, if it is a proc.
+  union {
+    struct RProc *next;		//!< next proc of the frame, while it runs.
+    mrbc_env *closed_env;	//!< env copied when the frame returned.
+  };
+
 } mrbc_proc;
 typedef struct RProc mrb_proc;
 
@@ -106,7 +153,7 @@ typedef struct RMethod {
 
 
 /***** Global variables *****************************************************/
-extern struct RClass *mrbc_class_tbl[];
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_tbl[];
 #define mrbc_class_nil		mrbc_class_tbl[ MRBC_TT_NIL ]
 #define mrbc_class_false	mrbc_class_tbl[ MRBC_TT_FALSE ]
 #define mrbc_class_true		mrbc_class_tbl[ MRBC_TT_TRUE ]
@@ -118,15 +165,18 @@ extern struct RClass *mrbc_class_tbl[];
 #define mrbc_class_string	mrbc_class_tbl[ MRBC_TT_STRING ]
 #define mrbc_class_range	mrbc_class_tbl[ MRBC_TT_RANGE ]
 #define mrbc_class_hash		mrbc_class_tbl[ MRBC_TT_HASH ]
-extern struct RClass *mrbc_class_object;
-extern struct RClass *mrbc_class_math;
-extern struct RClass *mrbc_class_exception;
-extern struct RClass *mrbc_class_standarderror;
-extern struct RClass *mrbc_class_runtimeerror;
-extern struct RClass *mrbc_class_zerodivisionerror;
-extern struct RClass *mrbc_class_argumenterror;
-extern struct RClass *mrbc_class_indexerror;
-extern struct RClass *mrbc_class_typeerror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_object;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_math;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_packedarray;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_exception;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_standarderror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_runtimeerror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_zerodivisionerror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_argumenterror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_indexerror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_typeerror;
+extern MRBC_CONTEXT_LOCAL struct RClass *mrbc_class_queue;
+extern MRBC_CONTEXT_LOCAL uint32_t mrbc_method_epoch;
 
 
 /***** Function prototypes **************************************************/
@@ -135,13 +185,27 @@ mrbc_class *mrbc_define_builtin_class(const char *name, mrbc_class *super, const
 void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_func_t cfunc);
 mrbc_value mrbc_instance_new(struct VM *vm, mrbc_class *cls, int size);
 void mrbc_instance_delete(mrbc_value *v);
+void mrbc_instance_clear_vm_id(mrbc_value *v);
 void mrbc_instance_setiv(mrbc_object *obj, mrbc_sym sym_id, mrbc_value *v);
 mrbc_value mrbc_instance_getiv(mrbc_object *obj, mrbc_sym sym_id);
+int mrbc_class_ivar_slot(mrbc_class *cls, mrbc_sym sym_id, int flag_add);
+void mrbc_instance_setiv_slot(mrbc_object *obj, int slot, mrbc_value *v);
+mrbc_value mrbc_instance_getiv_slot(mrbc_object *obj, int slot);
+void mrbc_instance_dup_ivar(mrbc_object *dst, const mrbc_object *src);
 mrbc_value mrbc_proc_new(struct VM *vm, void *irep);
+#if MRBC_BLOCK_POOL_SIZE > 0
+mrbc_value mrbc_proc_new_block(struct VM *vm, void *irep);
+#endif
 void mrbc_proc_delete(mrbc_value *val);
+void mrbc_proc_close_frame(struct VM *vm, struct CALLINFO *callinfo);
+int mrbc_env_is_counted(const mrbc_env *env, int i);
+void mrbc_env_incref(mrbc_env *env, mrbc_value *v);
+void mrbc_env_set(mrbc_env *env, mrbc_value *dst, mrbc_value *src);
+void mrbc_env_clear(mrbc_env *env);
 int mrbc_obj_is_kind_of(const mrbc_value *obj, const mrb_class *cls);
 mrbc_method *mrbc_find_method(mrbc_method *r_method, mrbc_class *cls, mrbc_sym sym_id);
 mrbc_class *mrbc_get_class_by_name(const char *name);
+void mrbc_method_cache_statistics(int *hit, int *miss);
 mrbc_value mrbc_send(struct VM *vm, mrbc_value *v, int reg_ofs, mrbc_value *recv, const char *method_name, int argc, ...);
 void c_ineffect(struct VM *vm, mrbc_value v[], int argc);
 
@@ -169,6 +233,22 @@ static inline mrbc_class *find_class_by_object(const mrbc_object *obj)
 }
 
 
+//================================================================
+/*! check the value is a proc of the frame of the env.
+
+  The env does not count its reference to such a proc.
+
+  @param  env	pointer to the env.
+  @param  v	pointer to the value in env->locals.
+  @return	result
+*/
+static inline int mrbc_env_is_own(const mrbc_env *env, const mrbc_value *v)
+{
+  return v->tt == MRBC_TT_PROC && v->proc->flag_closed &&
+    v->proc->closed_env == env;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -42,11 +42,284 @@
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
+static const char digit_chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+#if MRBC_CONSOLE_BUFFER_SIZE > 0
+//! output ring buffer. empty if rp == wp.
+static MRBC_CONTEXT_LOCAL char console_buf[MRBC_CONSOLE_BUFFER_SIZE];
+static MRBC_CONTEXT_LOCAL volatile uint16_t console_wp;	//!< write point.
+static MRBC_CONTEXT_LOCAL volatile uint16_t console_rp;	//!< read point. (moved by the HAL)
+static MRBC_CONTEXT_LOCAL volatile uint8_t console_draining;	//!< in mrbc_console_drain().
+#endif
+
+
 /***** Global variables *****************************************************/
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
+
+#if MRBC_CONSOLE_BUFFER_SIZE > 0
+//================================================================
+/*! write into the output buffer.
+
+  If the buffer is full, flush it by hal_write(), or with
+  MRBC_CONSOLE_HAL_DRAIN, wait for the HAL to take the data, with the
+  lock released. So the caller must not hold hal_lock().
+
+  @param  buf	pointer of buffer.
+  @param  n	output byte length.
+*/
+static void console_write(const void *buf, int n)
+{
+  const char *s = buf;
+
+  hal_lock();
+  while( n > 0 ) {
+    int rp = console_rp;
+    int wp = console_wp;
+    int room = (rp <= wp) ? MRBC_CONSOLE_BUFFER_SIZE - wp - (rp == 0) :
+			    rp - wp - 1;
+    if( room == 0 ) {
+      // the drain on the other core may need the lock.
+      hal_unlock();
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+      hal_console_start();
+      while( console_rp == rp ) {
+	// wait for the interrupt.
+      }
+#else
+      mrbc_console_drain();
+#endif
+      hal_lock();
+      continue;
+    }
+
+    if( room > n ) room = n;
+    memcpy( console_buf + wp, s, room );
+    wp += room;
+    if( wp == MRBC_CONSOLE_BUFFER_SIZE ) wp = 0;
+    console_wp = wp;
+    s += room;
+    n -= room;
+  }
+  hal_unlock();
+
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+  hal_console_start();
+#endif
+}
+#else
+#define console_write(buf, n)	hal_write(1, buf, n)
+#endif
+
+
+//================================================================
+/*! convert unsigned integer to digits, backward from the tail
+
+  @param  p	end of the buffer.
+  @param  v	value.
+  @param  base	n base. (2..36)
+  @return	pointer to the first digit.
+*/
+static char *format_uint_rev( char *p, mrbc_uint v, int base )
+{
+  // decimal, two digits at a time.
+  if( base == 10 ) {
+    while( v >= 100 ) {
+      const char *d = digit_pairs + (v % 100) * 2;
+      v /= 100;
+      *--p = d[1];
+      *--p = d[0];
+    }
+    if( v >= 10 ) {
+      *--p = digit_pairs[v * 2 + 1];
+      *--p = digit_pairs[v * 2];
+    } else {
+      *--p = '0' + v;
+    }
+    return p;
+  }
+
+  // power of two, by shift and mask.
+  if( (base & (base - 1)) == 0 ) {
+    int bit = 1;
+    while( (1 << bit) != base ) bit++;
+
+    do {
+      *--p = digit_chars[v & (base - 1)];
+      v >>= bit;
+    } while( v != 0 );
+    return p;
+  }
+
+  do {
+    *--p = digit_chars[v % base];
+    v /= base;
+  } while( v != 0 );
+  return p;
+}
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! convert float to string same as "%g", without snprintf
+
+  @param  buf	output buffer.
+  @param  value	value.
+  @return	string length or -1 if not handled.
+  @note	handles only fixed notation (1e-4 <= |value| < 999999.5), and
+	returns -1 if the 7th digit is too close to rounding tie.
+*/
+static int format_float_g( char *buf, double value )
+{
+  static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+  static const double lower[] = {
+    1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5 };
+
+  double a = (value < 0) ? -value : value;
+  if( !(a >= 1e-4 && a < 999999.5) ) return -1;	// also NaN.
+
+  // scale to 6 digits integer. (100000 <= n <= 999999)
+  int e = 5;
+  while( e > -4 && a < lower[e + 4] ) e--;
+  double scaled = a * pow10[5 - e];	// exact power of ten.
+  uint32_t n = (uint32_t)scaled;
+  double frac = scaled - n;
+
+  if( frac > 0.4999999 && frac < 0.5000001 ) return -1;
+  if( frac > 0.5 ) n++;
+  if( n == 1000000 ) {
+    n = 100000;
+    e++;
+  }
+  if( n < 100000 || n > 999999 || e > 5 ) return -1;
+
+  char dig[6];
+  int i;
+  for( i = 4; i >= 0; i -= 2 ) {
+    const char *d = digit_pairs + (n % 100) * 2;
+    n /= 100;
+    dig[i] = d[0];
+    dig[i+1] = d[1];
+  }
+  int n_dig = 6;
+  while( dig[n_dig-1] == '0' ) n_dig--;
+
+  char *p = buf;
+  if( value < 0 ) *p++ = '-';
+  if( e >= 0 ) {
+    for( i = 0; i <= e; i++ ) *p++ = dig[i];
+    if( i < n_dig ) {
+      *p++ = '.';
+      for( ; i < n_dig; i++ ) *p++ = dig[i];
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for( i = -1; i > e; i-- ) *p++ = '0';
+    for( i = 0; i < n_dig; i++ ) *p++ = dig[i];
+  }
+  *p = '\0';
+
+  return p - buf;
+}
+#endif
+
+
 /***** Global functions *****************************************************/
 
+#if MRBC_CONSOLE_BUFFER_SIZE > 0
+//================================================================
+/*! get the data to send, for the HAL.
+
+  The HAL calls it from hal_console_start() or the interrupt, and sends
+  the data by DMA or interrupt, then calls mrbc_console_consume().
+
+  @param  data	returns pointer to the data.
+  @return	byte length of the data in a row, or 0 if empty.
+*/
+int mrbc_console_peek(const char **data)
+{
+  int wp = console_wp;
+  int rp = console_rp;
+
+  *data = console_buf + rp;
+  return (rp <= wp) ? wp - rp : MRBC_CONSOLE_BUFFER_SIZE - rp;
+}
+
+
+//================================================================
+/*! release the data that has been sent.
+
+  @param  n	byte length, not more than mrbc_console_peek() returned.
+*/
+void mrbc_console_consume(int n)
+{
+  int rp = console_rp + n;
+  if( rp >= MRBC_CONSOLE_BUFFER_SIZE ) rp -= MRBC_CONSOLE_BUFFER_SIZE;
+  console_rp = rp;
+}
+
+
+//================================================================
+/*! write out the data in the output buffer by hal_write().
+
+  The default of hal_console_start(), for the HAL that has no DMA or
+  interrupt to send the data. hal_write() is called with the lock
+  released, and only one drains at a time. If the other one is
+  draining, leaves the data to it.
+*/
+void mrbc_console_drain(void)
+{
+  const char *data;
+  int n;
+
+  hal_lock();
+  if( console_draining ) {
+    hal_unlock();
+    return;
+  }
+  console_draining = 1;
+
+  while( (n = mrbc_console_peek( &data )) > 0 ) {
+    hal_unlock();
+    hal_write(1, data, n);
+    hal_lock();
+    mrbc_console_consume( n );
+  }
+
+  console_draining = 0;
+  hal_unlock();
+}
+
+
+//================================================================
+/*! write out all the data in the output buffer.
+
+  The scheduler calls it when idle, and mrbc_vm_end() calls it.
+  With MRBC_CONSOLE_HAL_DRAIN, waits for the HAL to take the data.
+*/
+void mrbc_console_flush(void)
+{
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+  if( console_rp == console_wp ) return;
+  hal_console_start();
+  while( console_rp != console_wp ) {
+    // wait for the interrupt.
+  }
+
+#else
+  mrbc_console_drain();
+#endif
+}
+#endif
+
+
 //================================================================
 /*! output a character
 
@@ -57,13 +330,13 @@ void console_putchar(char c)
 #if defined(MRBC_CONVERT_CRLF)
   static const char CRLF[2] = "\r\n";
   if( c == '\n' ) {
-    hal_write(1, CRLF, 2);
+    console_write(CRLF, 2);
   } else {
-    hal_write(1, &c, 1);
+    console_write(&c, 1);
   }
 
 #else
-    hal_write(1, &c, 1);
+    console_write(&c, 1);
 #endif
 }
 
@@ -84,17 +357,17 @@ void console_nprint(const char *str, int size)
 
   for( i = 0; i < size; i++ ) {
     if( *p1++ == '\n' ) {
-      hal_write(1, p2, p1 - p2 - 1);
-      hal_write(1, CRLF, 2);
+      console_write(p2, p1 - p2 - 1);
+      console_write(CRLF, 2);
       p2 = p1;
     }
   }
   if( p1 != p2 ) {
-    hal_write(1, p2, p1 - p2);
+    console_write(p2, p1 - p2);
   }
 
 #else
-  hal_write(1, str, size);
+  console_write(str, size);
 #endif
 }
 
@@ -179,6 +452,49 @@ void console_printf(const char *fstr, ...)
 
 
 
+//================================================================
+/*! parse a format directive.
+
+  @param  fstr	directive after '%'. (e.g. "05d")
+  @param  fmt	parsed directive.
+  @return	pointer to after the directive.
+*/
+static const char * parse_format( const char *fstr, struct RPrintfFormat *fmt )
+{
+  int ch;
+  *fmt = (struct RPrintfFormat){0};
+
+  // parse format - '%' [flag] [width] [.precision] type
+  //   e.g. "%05d"
+  while( (ch = *fstr) ) {
+    switch( ch ) {
+    case '+': fmt->flag_plus = 1; break;
+    case ' ': fmt->flag_space = 1; break;
+    case '-': fmt->flag_minus = 1; break;
+    case '0': fmt->flag_zero = 1; break;
+    default : goto PARSE_WIDTH;
+    }
+    fstr++;
+  }
+
+ PARSE_WIDTH:
+  while( (void)(ch = *fstr - '0'), (0 <= ch && ch <= 9)) {	// isdigit()
+    fmt->width = fmt->width * 10 + ch;
+    fstr++;
+  }
+  if( *fstr == '.' ) {
+    fstr++;
+    while( (void)(ch = *fstr - '0'), (0 <= ch && ch <= 9)) {
+      fmt->precision = fmt->precision * 10 + ch;
+      fstr++;
+    }
+  }
+  if( *fstr ) fmt->type = *fstr++;
+
+  return fstr;
+}
+
+
 //================================================================
 /*! sprintf subcontract function
 
@@ -199,43 +515,56 @@ int mrbc_printf_main( mrbc_printf *pf )
       if( *pf->fstr == '%' ) {	// is "%%"
 	pf->fstr++;
       } else {
-	goto PARSE_FLAG;
+	pf->fstr = parse_format( pf->fstr, &pf->fmt );
+	return 1;
       }
     }
     *pf->p++ = ch;
   }
   return -(ch != '\0');
+}
 
 
- PARSE_FLAG:
-  // parse format - '%' [flag] [width] [.precision] type
-  //   e.g. "%05d"
-  while( (ch = *pf->fstr) ) {
-    switch( ch ) {
-    case '+': pf->fmt.flag_plus = 1; break;
-    case ' ': pf->fmt.flag_space = 1; break;
-    case '-': pf->fmt.flag_minus = 1; break;
-    case '0': pf->fmt.flag_zero = 1; break;
-    default : goto PARSE_WIDTH;
-    }
-    pf->fstr++;
-  }
+//================================================================
+/*! split the format string into directives, to format it repeatedly.
 
- PARSE_WIDTH:
-  while( (void)(ch = *pf->fstr - '0'), (0 <= ch && ch <= 9)) {	// isdigit()
-    pf->fmt.width = pf->fmt.width * 10 + ch;
-    pf->fstr++;
-  }
-  if( *pf->fstr == '.' ) {
-    pf->fstr++;
-    while( (void)(ch = *pf->fstr - '0'), (0 <= ch && ch <= 9)) {
-      pf->fmt.precision = pf->fmt.precision * 10 + ch;
-      pf->fstr++;
+  Each item is a literal part and the directive after it.
+  The literal ends at the first '%' of "%%", and the last item has
+  no directive. (fmt.type == 0)
+
+  @param  fstr	format string.
+  @param  item	array of parsed items.
+  @param  n	size of the array.
+  @return	number of items or -1 if the array is too short.
+*/
+int mrbc_printf_compile( const char *fstr, mrbc_printf_item *item, int n )
+{
+  const char *p = fstr;
+  int i;
+
+  for( i = 0; i < n; i++ ) {
+    const char *lit = p;
+    while( *p != '\0' && *p != '%' ) p++;
+
+    item[i].lit_ofs = lit - fstr;
+    item[i].fmt = (struct RPrintfFormat){0};
+    if( *p == '\0' ) {
+      item[i].lit_len = p - lit;
+      item[i].fmt_end = p - fstr;
+      return i + 1;
     }
+    if( p[1] == '%' ) {		// is "%%"
+      item[i].lit_len = p + 1 - lit;
+      p += 2;
+    } else {
+      item[i].lit_len = p - lit;
+      p = parse_format( p + 1, &item[i].fmt );
+      if( item[i].fmt.type == 0 ) return -1;	// '%' at the end.
+    }
+    item[i].fmt_end = p - fstr;
   }
-  if( *pf->fstr ) pf->fmt.type = *pf->fstr++;
 
-  return 1;
+  return -1;
 }
 
 
@@ -337,12 +666,12 @@ int mrbc_printf_bstr( mrbc_printf *pf, const char *str, int len, int pad )
 int mrbc_printf_int( mrbc_printf *pf, mrbc_int value, int base )
 {
   int sign = 0;
-  mrbc_int v = value;
+  mrbc_uint v = value;
   char *pf_p_ini_val = pf->p;
 
   if( value < 0 ) {
     sign = '-';
-    v = -value;
+    v = -v;
   } else if( pf->fmt.flag_plus ) {
     sign = '+';
   } else if( pf->fmt.flag_space ) {
@@ -356,13 +685,7 @@ int mrbc_printf_int( mrbc_printf *pf, mrbc_int value, int base )
 
   // create string to temporary buffer
   char buf[sizeof(mrbc_int) * 8];
-  char *p = buf + sizeof(buf);
-
-  do {
-    int ch = v % base;
-    *--p = ch + ((ch < 10)? '0' : 'a' - 10);
-    v /= base;
-  } while( v != 0 );
+  char *p = format_uint_rev( buf + sizeof(buf), v, base );
 
   int dig_width = buf + sizeof(buf) - p;
 
@@ -491,6 +814,12 @@ int mrbc_printf_float( mrbc_printf *pf, double value )
   while( (*--p2 = *--p1) != '%' )
     ;
 
+  if( strcmp( p2, "%g" ) == 0 ) {
+    char buf[MRBC_FORMAT_FLOAT_BUFSIZE];
+    int len = mrbc_format_float( buf, value );
+    return mrbc_printf_bstr( pf, buf, len, ' ' );
+  }
+
   snprintf( pf->p, (pf->buf_end - pf->p + 1), p2, value );
 
   while( *pf->p != '\0' )
@@ -502,6 +831,56 @@ int mrbc_printf_float( mrbc_printf *pf, double value )
 
 
 
+//================================================================
+/*! convert integer to string
+
+  @param  buf	output buffer. (MRBC_FORMAT_INT_BUFSIZE bytes)
+  @param  value	value.
+  @param  base	n base. (2..36)
+  @return	string length.
+*/
+int mrbc_format_int( char *buf, mrbc_int value, int base )
+{
+  char tmp[sizeof(mrbc_int) * 8];
+  char *p0 = buf;
+  mrbc_uint v = value;
+
+  if( value < 0 ) {
+    *buf++ = '-';
+    v = -v;
+  }
+
+  char *p = format_uint_rev( tmp + sizeof(tmp), v, base );
+  int len = tmp + sizeof(tmp) - p;
+  memcpy( buf, p, len );
+  buf[len] = '\0';
+
+  return buf + len - p0;
+}
+
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! convert float to string, same as "%g"
+
+  @param  buf	output buffer. (MRBC_FORMAT_FLOAT_BUFSIZE bytes)
+  @param  value	value.
+  @return	string length.
+*/
+int mrbc_format_float( char *buf, double value )
+{
+  int len = format_float_g( buf, value );
+  if( len < 0 ) {
+    len = snprintf( buf, MRBC_FORMAT_FLOAT_BUFSIZE, "%g", value );
+  }
+
+  return len;
+}
+#endif
+
+
+
 //================================================================
 /*! sprintf subcontract function for pointer '%p'
 
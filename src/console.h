@@ -31,6 +31,11 @@ extern "C" {
 #include "value.h"
 
 /***** Constant values ******************************************************/
+//! buffer size for mrbc_format_int(), sign + base 2 digits + '\0'.
+#define MRBC_FORMAT_INT_BUFSIZE (sizeof(mrbc_int) * 8 + 2)
+//! buffer size for mrbc_format_float(), such as "-1.23457e-308".
+#define MRBC_FORMAT_FLOAT_BUFSIZE 16
+
 /***** Macros ***************************************************************/
 #define mrb_p(vm, v)	mrbc_p(&v)
 
@@ -55,18 +60,39 @@ typedef struct RPrintf {
   struct RPrintfFormat fmt;
 } mrbc_printf;
 
+//================================================================
+/*! parsed format string. (see mrbc_printf_compile)
+*/
+typedef struct RPrintfItem {
+  uint16_t lit_ofs;		//!< literal part offset in the format string.
+  uint16_t lit_len;		//!< literal part length.
+  uint16_t fmt_end;		//!< offset after the directive.
+  struct RPrintfFormat fmt;	//!< directive, or type 0 if none.
+} mrbc_printf_item;
+
 
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
 void console_putchar(char c);
 void console_nprint(const char *str, int size);
 void console_printf(const char *fstr, ...);
+#if MRBC_CONSOLE_BUFFER_SIZE > 0
+int mrbc_console_peek(const char **data);
+void mrbc_console_consume(int n);
+void mrbc_console_drain(void);
+void mrbc_console_flush(void);
+#else
+#define mrbc_console_flush()	((void)0)
+#endif
 int mrbc_printf_main(mrbc_printf *pf);
+int mrbc_printf_compile(const char *fstr, mrbc_printf_item *item, int n);
 int mrbc_printf_char(mrbc_printf *pf, int ch);
 int mrbc_printf_bstr(mrbc_printf *pf, const char *str, int len, int pad);
 int mrbc_printf_int(mrbc_printf *pf, mrbc_int value, int base);
 int mrbc_printf_bit(mrbc_printf *pf, mrbc_int value, int bit);
 int mrbc_printf_float(mrbc_printf *pf, double value);
+int mrbc_format_int(char *buf, mrbc_int value, int base);
+int mrbc_format_float(char *buf, double value);
 int mrbc_printf_pointer(mrbc_printf *pf, void *pointer);
 void mrbc_printf_replace_buffer(mrbc_printf *pf, char *buf, int size);
 int mrbc_p_sub(const mrbc_value *v);
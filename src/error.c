@@ -36,6 +36,7 @@ void mrbc_raiseX(mrbc_vm *vm, mrbc_error_code err, char *msg)
 {
   vm->exc = mrbc_class_runtimeerror;
   vm->exc_message = mrbc_nil_value();
+  MRBC_TRACE( vm, MRBC_TRACE_RAISE, vm->exc->sym_id );
   if( vm->exception_tail == NULL ) return;
 }
 
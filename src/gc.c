@@ -0,0 +1,369 @@
+/*! @file
+  @brief
+  mruby/c cycle collector.
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Trial deletion (synchronous cycle collection of Bacon and Rajan)
+  on top of the reference counter.
+
+  1. mrbc_decref() that leaves the counter not zero makes the object
+     a possible root (PURPLE), and puts it in the root buffer.
+  2. mrbc_gc_collect() takes some roots, and subtracts the references
+     inside the subgraph from them (GRAY). Objects whose counter is
+     still not zero are referenced from outside, so the counters of
+     them and their descendants are restored (BLACK). The rest are
+     garbage cycles (WHITE).
+  3. The counters of the garbage are restored too, and each garbage
+     root drops its own references with the standard mrbc_decref(),
+     so that the cycle is broken and released in the usual way.
+
+  The references counted by ref_count are only followed. A proc refers
+  to its upper proc, and the local variables of its returned frame
+  (mrbc_env). The env is shared by the procs of the frame, so that it
+  is traced as a node that the procs refer to. It does not count the
+  procs of the frame, except the ones it keeps.
+  Call mrbc_gc_collect() while no VM is running.
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if MRBC_USE_CYCLE_COLLECTOR
+#include "value.h"
+#include "alloc.h"
+#include "vm.h"
+#include "class.h"
+#include "c_array.h"
+#include "c_hash.h"
+#include "c_range.h"
+#include "gc.h"
+#include "snapshot.h"
+
+
+/***** Constant values ******************************************************/
+// number of roots that processed at once.
+#define GC_BATCH_SIZE 8
+
+
+/***** Macros ***************************************************************/
+#define COLOR(v)	((v)->obj->gc_flag & MRBC_GC_COLOR_MASK)
+#define SET_COLOR(v,c)	((v)->obj->gc_flag = ((v)->obj->gc_flag & ~MRBC_GC_COLOR_MASK) | (c))
+#define IS_COUNTED(v)	((v)->tt >= MRBC_TT_INC_DEC_THRESHOLD)
+
+// pseudo type of mrbc_env, in this file only.
+#define GC_TT_ENV	(MRBC_TT_MAXVAL + 1)
+
+
+/***** Local variables ******************************************************/
+static MRBC_CONTEXT_LOCAL mrbc_value gc_roots[MRBC_GC_ROOT_BUFFER_SIZE];
+static MRBC_CONTEXT_LOCAL int gc_n_roots;
+
+
+/***** Local functions ******************************************************/
+//================================================================
+/*! get the i-th counted reference of the object.
+
+  @param  v	pointer to target object.
+  @param  i	index.
+  @param  buf	buffer for the reference that is not a mrbc_value.
+  @return	pointer to the reference, or NULL if out of range.
+*/
+static mrbc_value * child_of(mrbc_value *v, int i, mrbc_value *buf)
+{
+  if( v->tt == GC_TT_ENV ) {
+    mrbc_env *env = (mrbc_env *)v->obj;
+    if( i >= env->n_locals ) return NULL;
+    if( mrbc_env_is_counted( env, i ) ) return &env->locals[i];
+    buf->tt = MRBC_TT_NIL;	// the proc of the frame, not counted.
+    return buf;
+  }
+
+  switch( v->tt ) {
+  case MRBC_TT_OBJECT:
+    if( v->instance->ivar == NULL || i >= v->instance->n_ivar ) break;
+    return &v->instance->ivar[i];
+
+  case MRBC_TT_ARRAY:
+  case MRBC_TT_HASH:
+#if MRBC_USE_SHARED_SLICE
+    if( v->array->shared ) break;	// the slice does not own them.
+#endif
+    if( i >= v->array->n_stored ) break;
+    return &v->array->data[i];
+
+  case MRBC_TT_RANGE:
+    if( i == 0 ) return &v->range->first;
+    if( i == 1 ) return &v->range->last;
+    break;
+
+  case MRBC_TT_PROC:
+    if( v->proc->upper ) {
+      if( i == 0 ) {
+	buf->tt = MRBC_TT_PROC;
+	buf->proc = v->proc->upper;
+	return buf;
+      }
+      i--;
+    }
+    if( i == 0 && v->proc->flag_closed && v->proc->closed_env ) {
+      buf->tt = GC_TT_ENV;
+      buf->obj = (struct RBasic *)v->proc->closed_env;
+      return buf;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  return NULL;
+}
+
+
+//================================================================
+/*! subtract the internal references. (GRAY)
+*/
+static void mark_gray(mrbc_value *v)
+{
+  if( COLOR(v) == MRBC_GC_GRAY ) return;
+  SET_COLOR(v, MRBC_GC_GRAY);
+
+  mrbc_value *c, buf;
+  int i;
+  for( i = 0; (c = child_of(v, i, &buf)) != NULL; i++ ) {
+    if( !IS_COUNTED(c) ) continue;
+    c->obj->ref_count--;
+    mark_gray(c);
+  }
+}
+
+
+//================================================================
+/*! restore the references. (BLACK)
+*/
+static void scan_black(mrbc_value *v)
+{
+  SET_COLOR(v, MRBC_GC_BLACK);
+
+  mrbc_value *c, buf;
+  int i;
+  for( i = 0; (c = child_of(v, i, &buf)) != NULL; i++ ) {
+    if( !IS_COUNTED(c) ) continue;
+    c->obj->ref_count++;
+    if( COLOR(c) != MRBC_GC_BLACK ) scan_black(c);
+  }
+}
+
+
+//================================================================
+/*! find out the garbage. (WHITE)
+*/
+static void scan(mrbc_value *v)
+{
+  if( COLOR(v) != MRBC_GC_GRAY ) return;
+
+  if( v->obj->ref_count != 0 ) {
+    scan_black(v);
+    return;
+  }
+
+  SET_COLOR(v, MRBC_GC_WHITE);
+
+  mrbc_value *c, buf;
+  int i;
+  for( i = 0; (c = child_of(v, i, &buf)) != NULL; i++ ) {
+    if( IS_COUNTED(c) ) scan(c);
+  }
+}
+
+
+//================================================================
+/*! drop all references of the object.
+*/
+static void clear_children(mrbc_value *v)
+{
+  switch( v->tt ) {
+  case MRBC_TT_OBJECT: {
+    mrbc_value *c;
+    int i;
+    for( i = 0; (c = child_of(v, i, NULL)) != NULL; i++ ) {
+      mrbc_decref_empty( c );
+    }
+  } break;
+
+  case MRBC_TT_PROC: {
+    mrbc_proc *proc = v->proc;
+    // the env is garbage too, and the proc holds it here.
+    if( proc->flag_closed && proc->closed_env ) {
+      mrbc_env_clear( proc->closed_env );
+    }
+    if( proc->upper ) {
+      mrbc_value upper = {.tt = MRBC_TT_PROC, .proc = proc->upper};
+      proc->upper = NULL;
+      mrbc_decref( &upper );
+    }
+  } break;
+
+  case MRBC_TT_ARRAY:
+    mrbc_array_clear( v );
+    break;
+
+  case MRBC_TT_HASH:
+    mrbc_hash_clear( v );
+    break;
+
+  case MRBC_TT_RANGE:
+    mrbc_decref( &v->range->first );
+    mrbc_decref( &v->range->last );
+    mrbc_set_nil( &v->range->first );
+    mrbc_set_nil( &v->range->last );
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+/***** Global functions *****************************************************/
+//================================================================
+/*! add the object to the root buffer. (called by mrbc_decref)
+
+  @param  v	pointer to target object.
+*/
+void mrbc_gc_possible_root(mrbc_value *v)
+{
+  switch( v->tt ) {
+  case MRBC_TT_PROC:
+    if( !v->proc->upper && !(v->proc->flag_closed && v->proc->closed_env) ) return;
+    break;
+  case MRBC_TT_STRING:
+    return;		// never be a member of cycle.
+  case MRBC_TT_RANGE:
+    if( !IS_COUNTED(&v->range->first) && !IS_COUNTED(&v->range->last) ) return;
+    break;
+  default:
+    break;
+  }
+
+  SET_COLOR(v, MRBC_GC_PURPLE);
+  if( v->obj->gc_flag & MRBC_GC_BUFFERED ) return;
+  if( gc_n_roots >= MRBC_GC_ROOT_BUFFER_SIZE ) return;	// overflow.
+
+  v->obj->gc_flag |= MRBC_GC_BUFFERED;
+  gc_roots[gc_n_roots++] = *v;
+}
+
+
+//================================================================
+/*! remove the object from the root buffer.
+
+  @param  v	pointer to target object.
+*/
+void mrbc_gc_forget_root(const mrbc_value *v)
+{
+  int i;
+  for( i = 0; i < gc_n_roots; i++ ) {
+    if( gc_roots[i].obj == v->obj ) {
+      gc_roots[i] = gc_roots[--gc_n_roots];
+      break;
+    }
+  }
+  v->obj->gc_flag &= ~MRBC_GC_BUFFERED;
+}
+
+
+//================================================================
+/*! remove the objects of the VM from the root buffer. (before free all)
+
+  @param  vm	pointer to VM.
+*/
+void mrbc_gc_forget_vm(const struct VM *vm)
+{
+  int i = 0;
+  while( i < gc_n_roots ) {
+    if( mrbc_get_vm_id( gc_roots[i].obj ) == vm->vm_id ) {
+      gc_roots[i] = gc_roots[--gc_n_roots];
+    } else {
+      i++;
+    }
+  }
+}
+
+
+//================================================================
+/*! collect garbage cycles.
+
+  @param  max_roots	maximum number of roots to be processed.
+  @return		number of broken cycles.
+*/
+int mrbc_gc_collect(int max_roots)
+{
+  int n_broken = 0;
+
+  while( max_roots > 0 && gc_n_roots > 0 ) {
+    mrbc_value roots[GC_BATCH_SIZE];
+    uint8_t flag_white[GC_BATCH_SIZE];
+    int n = 0;
+    int i;
+
+    // take the possible roots.
+    while( n < GC_BATCH_SIZE && max_roots > 0 && gc_n_roots > 0 ) {
+      mrbc_value *v = &gc_roots[--gc_n_roots];
+      max_roots--;
+      v->obj->gc_flag &= ~MRBC_GC_BUFFERED;
+      if( COLOR(v) == MRBC_GC_PURPLE ) roots[n++] = *v;
+    }
+
+    for( i = 0; i < n; i++ ) {
+      if( COLOR(&roots[i]) == MRBC_GC_PURPLE ) mark_gray( &roots[i] );
+    }
+    for( i = 0; i < n; i++ ) {
+      scan( &roots[i] );
+    }
+
+    // restore the counters of garbage, and hold the garbage roots.
+    for( i = 0; i < n; i++ ) {
+      flag_white[i] = (COLOR(&roots[i]) == MRBC_GC_WHITE);
+    }
+    for( i = 0; i < n; i++ ) {
+      if( !flag_white[i] ) continue;
+      if( COLOR(&roots[i]) != MRBC_GC_BLACK ) scan_black( &roots[i] );
+      mrbc_incref( &roots[i] );
+    }
+
+    // break the cycles.
+    for( i = 0; i < n; i++ ) {
+      if( !flag_white[i] ) continue;
+      clear_children( &roots[i] );
+      n_broken++;
+    }
+    for( i = 0; i < n; i++ ) {
+      if( flag_white[i] ) mrbc_decref( &roots[i] );
+    }
+  }
+
+  return n_broken;
+}
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the root buffer. (see snapshot.c)
+*/
+void mrbc_snapshot_gc(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, gc_roots );
+  MRBC_SNAPSHOT_VAR( s, gc_n_roots );
+}
+#endif
+
+#endif	// MRBC_USE_CYCLE_COLLECTOR
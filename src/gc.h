@@ -0,0 +1,60 @@
+/*! @file
+  @brief
+  mruby/c cycle collector.
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_GC_H_
+#define MRBC_SRC_GC_H_
+
+#include "vm_config.h"
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct VM;
+
+#if MRBC_USE_CYCLE_COLLECTOR
+// gc_flag in the object header.
+#define MRBC_GC_COLOR_MASK	0x03
+#define MRBC_GC_BLACK		0x00	//!< in use or free.
+#define MRBC_GC_GRAY		0x01	//!< possible member of cycle.
+#define MRBC_GC_WHITE		0x02	//!< member of garbage cycle.
+#define MRBC_GC_PURPLE		0x03	//!< possible root of cycle.
+#define MRBC_GC_BUFFERED	0x04	//!< in the root buffer.
+
+int mrbc_gc_collect(int max_roots);
+void mrbc_gc_forget_root(const mrbc_value *v);
+void mrbc_gc_forget_vm(const struct VM *vm);
+
+
+//================================================================
+/*! remove the object from the root buffer, before delete it.
+
+  @param  v	pointer to target object.
+*/
+static inline void mrbc_gc_forget(const mrbc_value *v)
+{
+  if( v->obj->gc_flag & MRBC_GC_BUFFERED ) mrbc_gc_forget_root(v);
+}
+
+#else
+#define mrbc_gc_collect(max_roots)	0
+#define mrbc_gc_forget(v)		((void)0)
+#define mrbc_gc_forget_vm(vm)		((void)0)
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -18,10 +18,19 @@
 #include "class.h"
 #include "symbol.h"
 #include "console.h"
+#include "hal_selector.h"
+#include "snapshot.h"
 
 
-static mrbc_kv_handle handle_const;	//!< for global(Object) constants.
-static mrbc_kv_handle handle_global;	//!< for global variables.
+static MRBC_CONTEXT_LOCAL mrbc_kv_handle handle_const;	//!< for global(Object) constants.
+static MRBC_CONTEXT_LOCAL mrbc_kv_handle handle_global;	//!< for global variables.
+
+// changed when a constant is set, or a global variable is added, that
+// is, when the slots returned by the getters may move.
+MRBC_CONTEXT_LOCAL uint32_t mrbc_const_epoch = MRBC_GLOBAL_EPOCH_BIT;
+MRBC_CONTEXT_LOCAL uint32_t mrbc_global_epoch = MRBC_GLOBAL_EPOCH_BIT;
+
+#define BUMP_EPOCH(epoch) ((epoch) = ((epoch) + 1) | MRBC_GLOBAL_EPOCH_BIT)
 
 
 //================================================================
@@ -31,7 +40,29 @@ void mrbc_init_global(void)
 {
   mrbc_kv_init_handle( 0, &handle_const, 25 );
   mrbc_kv_init_handle( 0, &handle_global, 0 );
+  BUMP_EPOCH( mrbc_const_epoch );
+  BUMP_EPOCH( mrbc_global_epoch );
+}
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the const and global table. (see snapshot.c)
+*/
+void mrbc_snapshot_global(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, handle_const );
+  MRBC_SNAPSHOT_VAR( s, handle_global );
+  MRBC_SNAPSHOT_VAR( s, mrbc_const_epoch );
+  MRBC_SNAPSHOT_VAR( s, mrbc_global_epoch );
+
+  // the cached slots in the ireps may be of the previous run.
+  if( s->mode == MRBC_SNAPSHOT_MODE_RESTORE ) {
+    BUMP_EPOCH( mrbc_const_epoch );
+    BUMP_EPOCH( mrbc_global_epoch );
+  }
 }
+#endif
 
 
 //================================================================
@@ -43,11 +74,16 @@ void mrbc_init_global(void)
 */
 int mrbc_set_const( mrbc_sym sym_id, mrbc_value *v )
 {
+  hal_lock();
   if( mrbc_kv_get( &handle_const, sym_id ) != NULL ) {
     console_printf( "warning: already initialized constant.\n" );
   }
 
-  return mrbc_kv_set( &handle_const, sym_id, v );
+  int ret = mrbc_kv_set( &handle_const, sym_id, v );
+  BUMP_EPOCH( mrbc_const_epoch );
+  hal_unlock();
+
+  return ret;
 }
 
 
@@ -85,10 +121,16 @@ int mrbc_set_class_const( mrbc_class *cls, mrbc_sym sym_id, mrbc_value *v )
 
   @param  sym_id	symbol ID.
   @return		pointer to mrbc_value or NULL.
+
+  (note) On multi-core, hold hal_lock() while using the value.
 */
 mrbc_value * mrbc_get_const( mrbc_sym sym_id )
 {
-  return mrbc_kv_get( &handle_const, sym_id );
+  hal_lock();
+  mrbc_value *v = mrbc_kv_get( &handle_const, sym_id );
+  hal_unlock();
+
+  return v;
 }
 
 
@@ -118,7 +160,9 @@ mrbc_value * mrbc_get_class_const( mrbc_class *cls, mrbc_sym sym_id )
   id = mrbc_search_symid(buf);
   if( id < 0 ) return NULL;
 
+  hal_lock();
   mrbc_value *v = mrbc_kv_get( &handle_const, id );
+  hal_unlock();
 
   return v;
 }
@@ -133,7 +177,13 @@ mrbc_value * mrbc_get_class_const( mrbc_class *cls, mrbc_sym sym_id )
 */
 int mrbc_set_global( mrbc_sym sym_id, mrbc_value *v )
 {
-  return mrbc_kv_set( &handle_global, sym_id, v );
+  hal_lock();
+  int n = mrbc_kv_size( &handle_global );
+  int ret = mrbc_kv_set( &handle_global, sym_id, v );
+  if( mrbc_kv_size( &handle_global ) != n ) BUMP_EPOCH( mrbc_global_epoch );
+  hal_unlock();
+
+  return ret;
 }
 
 
@@ -142,10 +192,16 @@ int mrbc_set_global( mrbc_sym sym_id, mrbc_value *v )
 
   @param  sym_id	symbol ID.
   @return		pointer to mrbc_value or NULL.
+
+  (note) On multi-core, hold hal_lock() while using the value.
 */
 mrbc_value * mrbc_get_global( mrbc_sym sym_id )
 {
-  return mrbc_kv_get( &handle_global, sym_id );
+  hal_lock();
+  mrbc_value *v = mrbc_kv_get( &handle_global, sym_id );
+  hal_unlock();
+
+  return v;
 }
 
 
@@ -157,15 +213,17 @@ void mrbc_global_clear_vm_id(void)
   int i;
   mrbc_kv *p;
 
+  hal_lock();
   p = handle_const.data;
   for( i = 0; i < mrbc_kv_size(&handle_const); i++, p++ ) {
-    mrbc_clear_vm_id( &p->value );
+    mrbc_clear_vm_id( &p->value, 0 );
   }
 
   p = handle_global.data;
   for( i = 0; i < mrbc_kv_size(&handle_global); i++, p++ ) {
-    mrbc_clear_vm_id( &p->value );
+    mrbc_clear_vm_id( &p->value, 0 );
   }
+  hal_unlock();
 }
 
 
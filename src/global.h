@@ -21,6 +21,12 @@
 extern "C" {
 #endif
 
+//! top bit of mrbc_const_epoch and mrbc_global_epoch, always set.
+#define MRBC_GLOBAL_EPOCH_BIT 0x80000000
+
+extern MRBC_CONTEXT_LOCAL uint32_t mrbc_const_epoch;
+extern MRBC_CONTEXT_LOCAL uint32_t mrbc_global_epoch;
+
 void mrbc_init_global(void);
 int mrbc_set_const(mrbc_sym sym_id, mrbc_value *v);
 int mrbc_set_class_const(mrbc_class *cls, mrbc_sym sym_id, mrbc_value *v);
@@ -101,6 +101,8 @@ void hal_enable_irq(void)
 /*!@brief
   disable interrupt
 
+  The spinlock is shared by both cores and can be nested,
+  so that it works with MRBC_SMP_CORES 2.
 */
 void hal_disable_irq(void)
 {
@@ -108,4 +110,35 @@ void hal_disable_irq(void)
 }
 
 
+//================================================================
+/*!@brief
+  idle the CPU with the tick stopped. (tickless idle)
+
+  @param  ticks	maximum ticks to sleep, or 0 if no wakeup time.
+  @return	elapsed ticks.
+*/
+uint32_t hal_idle_cpu_ticks(uint32_t ticks)
+{
+  static TickType_t rest;	// fraction of the previous idle.
+  TickType_t delay;
+
+  if( ticks == 0 ) {
+    delay = 1000 / portTICK_PERIOD_MS;
+  } else {
+    delay = ticks * MRBC_TICK_UNIT / portTICK_PERIOD_MS;
+  }
+  if( delay == 0 ) delay = 1;	// Note: argument of vTaskDelay() should be 1+
+
+  timer_pause(TIMER_GROUP_0, TIMER_0);		// stop the tick.
+  TickType_t t0 = xTaskGetTickCount();
+  vTaskDelay(delay);
+  TickType_t elapsed = (xTaskGetTickCount() - t0) * portTICK_PERIOD_MS + rest;
+  timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0x00000000ULL);
+  timer_start(TIMER_GROUP_0, TIMER_0);		// restart the tick.
+
+  rest = elapsed % MRBC_TICK_UNIT;
+  return elapsed / MRBC_TICK_UNIT;
+}
+
+
 #endif /* ifndef MRBC_NO_TIMER */
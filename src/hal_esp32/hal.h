@@ -20,9 +20,11 @@ extern "C" {
 
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
+#include <stdint.h>
 #include <unistd.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "xtensa/hal.h"
 
 
 /***** Local headers ********************************************************/
@@ -58,8 +60,14 @@ void mrbc_tick(void);
 void hal_init(void);
 void hal_enable_irq(void);
 void hal_disable_irq(void);
+#if MRBC_SMP_CORES > 1
+# define hal_lock()        hal_disable_irq()
+# define hal_unlock()      hal_enable_irq()
+# define hal_core_id()     xPortGetCoreID()
+#endif
                            // Note: argument of vTaskDelay() should be 1+
 # define hal_idle_cpu()    vTaskDelay(MRBC_TICK_UNIT / portTICK_PERIOD_MS)
+uint32_t hal_idle_cpu_ticks(uint32_t ticks);
 
 #else // MRBC_NO_TIMER
 # define hal_init()        ((void)0)
@@ -71,6 +79,14 @@ void hal_disable_irq(void);
 
 #endif
 
+// CCOUNT register, for MRBC_USE_OPCODE_STATS.
+#define hal_cycle_count()  xthal_get_ccount()
+
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+// no DMA or interrupt sends the console buffer. write it out at once.
+# define hal_console_start() mrbc_console_drain()
+#endif
+
 
 /***** Inline functions *****************************************************/
 
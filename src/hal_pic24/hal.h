@@ -51,6 +51,8 @@ extern "C" {
 # define hal_enable_irq()  __builtin_disi(0x0000)
 # define hal_disable_irq() __builtin_disi(0x3fff)
 # define hal_idle_cpu()    Idle()
+                           // no one-shot timer. idle with the tick running.
+# define hal_idle_cpu_ticks(ticks) (hal_idle_cpu(), 0)
 
 #else // MRBC_NO_TIMER
 # define hal_init()        ((void)0)
@@ -66,6 +68,10 @@ extern "C" {
 /***** Function prototypes **************************************************/
 int hal_write(int fd, const void *buf, int nbytes);
 int hal_flush(int fd);
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+// no DMA or interrupt sends the console buffer. write it out at once.
+# define hal_console_start() mrbc_console_drain()
+#endif
 
 
 /***** Inline functions *****************************************************/
@@ -14,10 +14,15 @@
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
 #include <signal.h>
+#include <time.h>
 #include <sys/time.h>
+#if MRBC_SMP_CORES > 1
+#include <pthread.h>
+#endif
 
 
 /***** Local headers ********************************************************/
+#include "../vm_config.h"
 #include "hal.h"
 
 
@@ -27,8 +32,16 @@
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
 #ifndef MRBC_NO_TIMER
+#if MRBC_SMP_CORES > 1
+static sigset_t sigset_;
+static __thread sigset_t sigset2_;
+static __thread int irq_nest_, lock_nest_;
+static pthread_mutex_t irq_lock_ = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER;
+#else
 static sigset_t sigset_, sigset2_;
 #endif
+#endif
 
 
 /***** Global variables *****************************************************/
@@ -88,7 +101,13 @@ void hal_init(void)
 */
 void hal_enable_irq(void)
 {
+#if MRBC_SMP_CORES > 1
+  if( --irq_nest_ != 0 ) return;
+  pthread_mutex_unlock(&irq_lock_);
+  pthread_sigmask(SIG_SETMASK, &sigset2_, 0);
+#else
   sigprocmask(SIG_SETMASK, &sigset2_, 0);
+#endif
 }
 
 
@@ -99,7 +118,95 @@ void hal_enable_irq(void)
 */
 void hal_disable_irq(void)
 {
+#if MRBC_SMP_CORES > 1
+  // block the signal in this thread, and exclude the other threads.
+  if( irq_nest_ == 0 ) {
+    pthread_sigmask(SIG_BLOCK, &sigset_, &sigset2_);
+    pthread_mutex_lock(&irq_lock_);
+  }
+  irq_nest_++;
+#else
   sigprocmask(SIG_BLOCK, &sigset_, &sigset2_);
+#endif
+}
+
+
+#if MRBC_SMP_CORES > 1
+//================================================================
+/*!@brief
+  lock the shared tables
+
+  The signal handler does not use them, so that the signal is not blocked.
+*/
+void hal_lock(void)
+{
+  if( lock_nest_++ == 0 ) pthread_mutex_lock(&lock_);
+}
+
+
+//================================================================
+/*!@brief
+  unlock the shared tables
+
+*/
+void hal_unlock(void)
+{
+  if( --lock_nest_ == 0 ) pthread_mutex_unlock(&lock_);
+}
+
+
+//================================================================
+/*!@brief
+  get the core number of the calling thread
+
+  Threads are numbered in the order of the first call.
+  @return	core number. (MRBC_SMP_CORES or more for extra threads)
+*/
+int hal_core_id(void)
+{
+  static int n_threads;
+  static __thread int core_id_ = -1;
+
+  if( core_id_ < 0 ) core_id_ = __atomic_fetch_add(&n_threads, 1, __ATOMIC_RELAXED);
+  return core_id_;
+}
+#endif
+
+
+//================================================================
+/*!@brief
+  idle the CPU with the tick stopped. (tickless idle)
+
+  @param  ticks	maximum ticks to sleep, or 0 to sleep until any signal.
+  @return	elapsed ticks.
+*/
+uint32_t hal_idle_cpu_ticks(uint32_t ticks)
+{
+  static const struct itimerval stop;
+  static long rest_ns;		// fraction of the previous idle.
+  struct itimerval tval;
+  struct timespec t0, t1;
+
+  setitimer(ITIMER_REAL, &stop, &tval);		// stop the tick.
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  if( ticks == 0 ) {
+    pause();
+  } else {
+    long ms = (long)ticks * MRBC_TICK_UNIT;
+    struct timespec req = { ms / 1000, (ms % 1000) * 1000000 };
+    nanosleep(&req, 0);		// maybe interrupt by signal
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  setitimer(ITIMER_REAL, &tval, 0);		// restart the tick.
+
+  long ns = (t1.tv_sec - t0.tv_sec) * 1000000000L +
+            (t1.tv_nsec - t0.tv_nsec) + rest_ns;
+  const long tick_ns = MRBC_TICK_UNIT * 1000000L;
+  rest_ns = ns % tick_ns;
+
+  return ns / tick_ns;
 }
 
 
@@ -20,7 +20,9 @@ extern "C" {
 
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
+#include <stdint.h>
 #include <unistd.h>
+#include <time.h>
 
 
 /***** Local headers ********************************************************/
@@ -56,7 +58,16 @@ void mrbc_tick(void);
 void hal_init(void);
 void hal_enable_irq(void);
 void hal_disable_irq(void);
+#if MRBC_SMP_CORES > 1
+void hal_lock(void);
+void hal_unlock(void);
+int hal_core_id(void);
+  // the signal wakes up only one of the threads.
+# define hal_idle_cpu()    usleep(MRBC_TICK_UNIT * 1000)
+#else
 # define hal_idle_cpu()    sleep(1) // maybe interrupt by SIGINT
+#endif
+uint32_t hal_idle_cpu_ticks(uint32_t ticks);
 
 #else // MRBC_NO_TIMER
 # define hal_init()        ((void)0)
@@ -66,6 +77,11 @@ void hal_disable_irq(void);
 
 #endif
 
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+// no DMA or interrupt sends the console buffer. write it out at once.
+# define hal_console_start() mrbc_console_drain()
+#endif
+
 
 /***** Inline functions *****************************************************/
 
@@ -95,6 +111,26 @@ inline static int hal_flush(int fd)
 }
 
 
+//================================================================
+/*!@brief
+  Read the cycle counter (for MRBC_USE_OPCODE_STATS)
+
+  @return  cycles, or nanoseconds on other than x86.
+*/
+inline static uint32_t hal_cycle_count(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  uint32_t lo, hi;
+  __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return lo;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000000u + (uint32_t)ts.tv_nsec;
+#endif
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,6 +47,8 @@ extern "C" {
 # define hal_disable_irq() CyGlobalIntDisable
 # define hal_idle_cpu()    CyPmAltAct(PM_SLEEP_TIME_NONE, \
                                       PM_SLEEP_SRC_CTW | PM_SLEEP_SRC_PICU)
+                           // no one-shot timer. idle with the tick running.
+# define hal_idle_cpu_ticks(ticks) (hal_idle_cpu(), 0)
 
 #else // MRBC_NO_TIMER
 # define hal_init()        ((void)0)
@@ -56,12 +58,20 @@ extern "C" {
 
 #endif
 
+// DWT CYCCNT of Cortex-M3, for MRBC_USE_OPCODE_STATS.
+//  enable it before use:  CoreDebug DEMCR |= TRCENA;  DWT CTRL |= CYCCNTENA;
+#define hal_cycle_count()  (*(volatile uint32_t *)0xE0001004)
+
 
 /***** Typedefs *************************************************************/
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
 int hal_write(int fd, const void *buf, int nbytes);
 int hal_flush(int fd);
+#if defined(MRBC_CONSOLE_HAL_DRAIN)
+// no DMA or interrupt sends the console buffer. write it out at once.
+# define hal_console_start() mrbc_console_drain()
+#endif
 
 
 /***** Inline functions *****************************************************/
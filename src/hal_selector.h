@@ -15,6 +15,8 @@
   </pre>
 */
 
+#include "vm_config.h"
+
 #if defined(MRBC_USE_HAL_USER_RESERVED)
 #include "hal_user_reserved/hal.h"
 #elif defined(MRBC_USE_HAL_PSOC5LP)
@@ -26,3 +28,16 @@
 #else
 #include "hal_posix/hal.h"
 #endif /* MRBC_USE_HAL_xxx */
+
+
+/* Lock for the tables shared by all VMs. (symbols, globals, memory pool..)
+   With MRBC_SMP_CORES > 1, the HAL has to provide hal_lock() and
+   hal_unlock() that exclude the other cores and can be nested, and
+   hal_disable_irq() has to exclude the other cores too.
+   hal_core_id() returns the number of the calling core. (0 origin)
+*/
+#if MRBC_SMP_CORES <= 1
+# define hal_lock()	((void)0)
+# define hal_unlock()	((void)0)
+# define hal_core_id()	0
+#endif
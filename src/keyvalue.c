@@ -11,6 +11,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_KV
 #include "vm_config.h"
 #include <stdlib.h>
 #include <string.h>
@@ -141,7 +142,7 @@ void mrbc_kv_clear_vm_id(mrbc_kv_handle *kvh)
   mrbc_kv *p1 = kvh->data;
   const mrbc_kv *p2 = p1 + kvh->n_stored;
   while( p1 < p2 ) {
-    mrbc_clear_vm_id(&p1->value);
+    mrbc_clear_vm_id(&p1->value, 0);
     p1++;
   }
 }
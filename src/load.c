@@ -11,6 +11,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_IREP
 #include "vm_config.h"
 #include <stdlib.h>
 #include <stdint.h>
@@ -19,15 +20,93 @@
 
 #include "vm.h"
 #include "load.h"
+#include "opcode.h"
 #include "value.h"
 #include "alloc.h"
+#include "symbol.h"
 #include "console.h"
+#include "hal_selector.h"
+#include "snapshot.h"
 
 //
 // This is a dummy code for raise
 //
 #define mrbc_raise(vm,err,msg) console_printf("<raise> %s:%d\n", __FILE__, __LINE__);
 
+// the inline method cache in shared ireps is not locked between cores.
+#if MRBC_SMP_CORES > 1 && MRBC_USE_INLINE_METHOD_CACHE
+#define IREP_CACHE_SIZE 0
+#else
+#define IREP_CACHE_SIZE MRBC_IREP_CACHE_SIZE
+#endif
+
+
+#if IREP_CACHE_SIZE > 0
+//================================================================
+/*! irep cache entry.
+*/
+typedef struct IREP_CACHE {
+  const uint8_t *mrb;		//!< bytecode, or NULL if not used.
+  uint16_t crc;			//!< CRC in the RITE header.
+  uint8_t ref_count;		//!< number of VMs.
+  mrbc_irep *irep;
+} IREP_CACHE;
+
+static MRBC_CONTEXT_LOCAL IREP_CACHE irep_cache[IREP_CACHE_SIZE];
+
+
+//================================================================
+/*! find the loaded irep of the bytecode, and count up.
+
+  @param  ptr	pointer to bytecode.
+  @return	pointer to irep, or NULL.
+*/
+static mrbc_irep * irep_cache_get(const uint8_t *ptr)
+{
+  mrbc_irep *irep = NULL;
+  uint16_t crc = bin_to_uint16(ptr + 8);
+  int i;
+
+  hal_lock();
+  for( i = 0; i < IREP_CACHE_SIZE; i++ ) {
+    IREP_CACHE *c = &irep_cache[i];
+    if( c->mrb == ptr && c->crc == crc ) {
+      c->ref_count++;
+      irep = c->irep;
+      break;
+    }
+  }
+  hal_unlock();
+
+  return irep;
+}
+
+
+//================================================================
+/*! add the loaded irep to the cache, if there is room.
+
+  @param  ptr	pointer to bytecode.
+  @param  irep	pointer to irep.
+*/
+static void irep_cache_add(const uint8_t *ptr, mrbc_irep *irep)
+{
+  int i;
+
+  hal_lock();
+  for( i = 0; i < IREP_CACHE_SIZE; i++ ) {
+    IREP_CACHE *c = &irep_cache[i];
+    if( c->mrb == NULL ) {
+      c->mrb = ptr;
+      c->crc = bin_to_uint16(ptr + 8);
+      c->ref_count = 1;
+      c->irep = irep;
+      break;
+    }
+  }
+  hal_unlock();
+}
+#endif
+
 
 
 //================================================================
@@ -75,11 +154,525 @@ static int load_header(struct VM *vm, const uint8_t **pos)
 
 
 
+#if MRBC_USE_SUPERINSTRUCTION || MRBC_USE_BYTECODE_VERIFIER || MRBC_USE_RESCUE_TABLE
+/* operand format of each opcode.
+   0:Z  1:B  2:BB  3:BBB  4:BS  5:S  6:W
+*/
+static const uint8_t op_format[] = {
+  // 0x00
+  0, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  // 0x10
+  1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3,
+  // 0x20
+  3, 5, 4, 4, 4, 5, 1, 2, 1, 1, 1, 1, 2, 2, 3, 3,
+  // 0x30
+  0, 2, 4, 6, 2, 0, 2, 1, 1, 1, 4, 1, 2, 1, 2, 1,
+  // 0x40
+  1, 1, 1, 1, 1, 1, 2, 3, 1, 1, 1, 3, 3, 3, 1, 2,
+  // 0x50
+  1, 2, 2, 1, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 1,
+  // 0x60
+  1, 1, 3, 1, 0, 0, 0, 0, 0,
+};
+
+
+//================================================================
+/*! get the instruction length.
+
+  @param  p	pointer to the instruction.
+  @param  ext	EXT flag set by preceding OP_EXTn. (1:a, 2:b, 3:both)
+  @return	instruction length in bytes, or 0 if unknown opcode.
+*/
+static int instruction_length( const uint8_t *p, int ext )
+{
+  static const uint8_t length[] = { 1, 2, 3, 4, 4, 3, 4 };
+
+  if( *p >= sizeof(op_format) ) return 0;
+
+  int fmt = op_format[*p];
+  int len = length[fmt];
+  if( (ext & 1) && fmt >= 1 && fmt <= 4 ) len++;	// a is 16bit.
+  if( (ext & 2) && fmt >= 2 && fmt <= 3 ) len++;	// b is 16bit.
+
+  return len;
+}
+#endif
+
+
+#if MRBC_USE_SUPERINSTRUCTION
+//================================================================
+/*! rewrite opcode pairs into superinstructions.
+
+  @param  irep	target irep.
+
+  <pre>
+  e.g.)  OP_LT a ; OP_JMPNOT a b  ->  OP_LT_JMPNOT a ; OP_JMPNOT a b
+
+  Only the first opcode byte is replaced, and the second instruction is
+  left as it is. So, a jump to the second instruction is still valid.
+  If anything is rewritten, the code is copied to RAM, unless it is there.
+  </pre>
+*/
+static void rewrite_superinstructions( mrbc_irep *irep )
+{
+  const uint8_t *code = irep->code;
+  const uint8_t *end = code + irep->ilen;
+  const uint8_t *p = code;
+  uint8_t *ram_code = irep->flag_code_in_ram ? irep->code : NULL;
+  int ext = 0;
+
+  while( p < end ) {
+    int len = instruction_length( p, ext );
+    if( len == 0 ) break;			// unknown opcode.
+
+    int fused = 0;
+    if( ext == 0 && p + len + 3 < end && p[len+1] == p[1] ) {
+      int jmpnot = (p[len] == OP_JMPNOT);
+      if( jmpnot || p[len] == OP_JMPIF ) {
+	switch( *p ) {
+	case OP_EQ: fused = OP_EQ_JMPIF + jmpnot; break;
+	case OP_LT: fused = OP_LT_JMPIF + jmpnot; break;
+	case OP_LE: fused = OP_LE_JMPIF + jmpnot; break;
+	case OP_GT: fused = OP_GT_JMPIF + jmpnot; break;
+	case OP_GE: fused = OP_GE_JMPIF + jmpnot; break;
+	}
+      }
+    }
+
+    if( fused ) {
+      if( !ram_code ) {
+	ram_code = mrbc_alloc(0, irep->ilen);
+	if( !ram_code ) return;		// ENOMEM. leave it original.
+	memcpy( ram_code, code, irep->ilen );
+      }
+      ram_code[ p - code ] = fused;
+    }
+
+    switch( *p ) {
+    case OP_EXT1: ext = 1; break;
+    case OP_EXT2: ext = 2; break;
+    case OP_EXT3: ext = 3; break;
+    default:      ext = 0; break;
+    }
+    p += len;
+  }
+
+  if( ram_code ) {
+    irep->code = ram_code;
+    irep->flag_code_in_ram = 1;
+  }
+}
+#endif
+
+
+#if MRBC_USE_RESCUE_TABLE
+//================================================================
+/*! make the rescue table from OP_ONERR.
+
+  @param  irep	target irep.
+  @return	zero if no error.
+
+  <pre>
+  mrbc compiles begin/rescue as below, and the range is (begin, target].
+
+    begin:  OP_ONERR target
+	    ... (body)
+	    OP_JMP noexc
+    target: ... (rescue clauses)
+    noexc:  OP_POPERR 1
+
+  Nested ranges come later than the outer one.
+  </pre>
+*/
+static int make_rescue_table( mrbc_irep *irep )
+{
+  const uint8_t *code = irep->code;
+  const uint8_t *end = code + irep->ilen;
+  const uint8_t *p;
+  int ext = 0;
+  int n = 0;
+
+  for( p = code; p < end; ) {
+    int len = instruction_length( p, ext );
+    if( len == 0 ) break;			// unknown opcode.
+    if( *p == OP_ONERR ) n++;
+    switch( *p ) {
+    case OP_EXT1: ext = 1; break;
+    case OP_EXT2: ext = 2; break;
+    case OP_EXT3: ext = 3; break;
+    default:      ext = 0; break;
+    }
+    p += len;
+  }
+  if( n == 0 ) return 0;
+
+  irep->rescue_table = (mrbc_rescue_range *)mrbc_alloc(0, sizeof(mrbc_rescue_range) * n);
+  if( !irep->rescue_table ) return -1;	// ENOMEM
+
+  for( p = code, ext = 0; irep->rescue_len < n; ) {
+    int len = instruction_length( p, ext );
+    if( *p == OP_ONERR ) {
+      mrbc_rescue_range *r = &irep->rescue_table[irep->rescue_len++];
+      r->begin = p + len - code;
+      r->target = bin_to_uint16( p + 1 );
+    }
+    switch( *p ) {
+    case OP_EXT1: ext = 1; break;
+    case OP_EXT2: ext = 2; break;
+    case OP_EXT3: ext = 3; break;
+    default:      ext = 0; break;
+    }
+    p += len;
+  }
+
+  return 0;
+}
+#endif
+
+
+#if MRBC_USE_BYTECODE_VERIFIER
+//================================================================
+/*! calculate CRC. (same as mruby)
+
+  @param  crc	CRC of the preceding data, or 0.
+  @param  p	pointer to data.
+  @param  size	size of data.
+  @return	CRC-16-CCITT
+*/
+static uint16_t calc_crc_16_ccitt( uint16_t crc, const uint8_t *p, uint32_t size )
+{
+  uint32_t crcwk = (uint32_t)crc << 8;
+
+  while( size-- > 0 ) {
+    crcwk |= *p++;
+    int i;
+    for( i = 0; i < 8; i++ ) {
+      crcwk <<= 1;
+      if( crcwk & 0x01000000 ) crcwk ^= 0x01102100;
+    }
+  }
+
+  return crcwk >> 8;
+}
+
+
+//================================================================
+/*! verify the byte code of one irep.
+
+  @param  irep	irep header values. (code, ilen, nregs, plen, slen, rlen)
+  @return	zero if no error.
+*/
+static int verify_code( const mrbc_irep *irep )
+{
+  const uint8_t *code = irep->code;
+  const uint8_t *end = code + irep->ilen;
+  const uint8_t *p;
+  int ext = 0;
+  int ret = -1;
+
+  // bitmap of the head of instructions, for jump targets.
+  uint8_t *head = mrbc_alloc(0, irep->ilen / 8 + 1);
+  if( !head ) return -1;	// ENOMEM
+  memset( head, 0, irep->ilen / 8 + 1 );
+
+  for( p = code; p < end; ) {
+    int len = instruction_length( p, ext );
+    if( len == 0 || p + len > end ) goto DONE;	// unknown or truncated.
+    if( ext == 0 ) head[(p - code) / 8] |= 1 << ((p - code) % 8);
+
+    switch( *p ) {
+    case OP_EXT1: ext = 1; break;
+    case OP_EXT2: ext = 2; break;
+    case OP_EXT3: ext = 3; break;
+    default:      ext = 0; break;
+    }
+    p += len;
+  }
+  if( ext ) goto DONE;
+
+  for( p = code; p < end; ) {
+    int len = instruction_length( p, ext );
+
+    // decode operands.
+    const uint8_t *q = p + 1;
+    int fmt = op_format[*p];
+    uint32_t a = 0, b = 0, c = 0;
+    switch( fmt ) {
+    case 1: case 2: case 3: case 4:
+      if( ext & 1 ) { a = bin_to_uint16(q); q += 2; } else { a = *q++; }
+      if( fmt == 2 || fmt == 3 ) {
+	if( ext & 2 ) { b = bin_to_uint16(q); q += 2; } else { b = *q++; }
+      }
+      if( fmt == 3 ) c = *q;
+      if( fmt == 4 ) b = bin_to_uint16(q);
+      break;
+    case 5: a = bin_to_uint16(q); break;
+    case 6: a = (uint32_t)q[0] << 16 | q[1] << 8 | q[2]; break;
+    }
+
+    // operands to check. (-1: not used)
+    int32_t reg = -1, reg2 = -1, sym = -1, sym2 = -1;
+    int32_t pool = -1, child = -1, jmp = -1;
+
+    switch( *p ) {
+    case OP_NOP: case OP_CALL: case OP_KEYEND: case OP_STOP:
+    case OP_ABORT: case OP_ENTER: case OP_POPERR: case OP_EPOP:
+    case OP_DEBUG:
+      break;
+
+    case OP_EXT1: case OP_EXT2: case OP_EXT3:
+      if( ext ) goto DONE;	// EXT after EXT.
+      break;
+
+    case OP_LOADI__1: case OP_LOADI_0: case OP_LOADI_1: case OP_LOADI_2:
+    case OP_LOADI_3: case OP_LOADI_4: case OP_LOADI_5: case OP_LOADI_6:
+    case OP_LOADI_7: case OP_LOADI: case OP_LOADINEG: case OP_LOADNIL:
+    case OP_LOADSELF: case OP_LOADT: case OP_LOADF: case OP_GETUPVAR:
+    case OP_SETUPVAR: case OP_EXCEPT: case OP_RAISE: case OP_RETURN:
+    case OP_RETURN_BLK: case OP_BREAK: case OP_BLKPUSH: case OP_ADDI:
+    case OP_SUBI: case OP_ARYDUP: case OP_INTERN: case OP_OCLASS:
+    case OP_SCLASS: case OP_TCLASS:
+      reg = a;
+      break;
+
+    case OP_MOVE: case OP_RESCUE: case OP_AREF: case OP_ASET:
+      reg = a; reg2 = b;
+      break;
+
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_EQ:
+    case OP_LT: case OP_LE: case OP_GT: case OP_GE: case OP_ARYCAT:
+    case OP_ARYPUSH: case OP_STRCAT: case OP_HASHCAT: case OP_RANGE_INC:
+    case OP_RANGE_EXC: case OP_ARGARY:
+      reg = a + 1;
+      break;
+
+    case OP_LOADL: case OP_STRING:
+      reg = a; pool = b;
+      break;
+
+    case OP_ERR:
+      pool = a;
+      break;
+
+    case OP_LOADSYM: case OP_GETGV: case OP_SETGV: case OP_GETSV:
+    case OP_SETSV: case OP_GETIV: case OP_SETIV: case OP_GETCV:
+    case OP_SETCV: case OP_GETCONST: case OP_SETCONST: case OP_GETMCNST:
+    case OP_KEY_P: case OP_KARG:
+      reg = a; sym = b;
+      break;
+
+    case OP_SETMCNST: case OP_CLASS: case OP_MODULE: case OP_DEF:
+      reg = a + 1; sym = b;
+      break;
+
+    case OP_ALIAS:
+      sym = a; sym2 = b;
+      break;
+
+    case OP_UNDEF:
+      sym = a;
+      break;
+
+    case OP_JMP: case OP_ONERR:
+      jmp = a;
+      break;
+
+    case OP_JMPIF: case OP_JMPNOT: case OP_JMPNIL:
+      reg = a; jmp = b;
+      break;
+
+    case OP_EPUSH:
+      child = a;
+      break;
+
+    case OP_LAMBDA: case OP_BLOCK: case OP_METHOD: case OP_EXEC:
+      reg = a; child = b;
+      break;
+
+    case OP_SENDV: case OP_SENDVB:
+      reg = a + 2; sym = b;
+      break;
+
+    case OP_SEND: case OP_SENDB:
+      // c == 127 (CALL_MAXARGS in mruby) means arguments in an Array.
+      reg = a + (c >= 127 ? 1 : c) + 1; sym = b;
+      break;
+
+    case OP_SUPER:
+      reg = a + (b >= 127 ? 1 : b) + 1;
+      break;
+
+    case OP_ARRAY:
+      reg = a + (b ? b - 1 : 0);
+      break;
+
+    case OP_ARRAY2:
+      reg = a; reg2 = b + (c ? c - 1 : 0);
+      break;
+
+    case OP_APOST:
+      reg = a + c;
+      break;
+
+    case OP_HASH:
+      reg = a + (b ? b * 2 - 1 : 0);
+      break;
+
+    case OP_HASHADD:
+      reg = a + b * 2;
+      break;
+
+    default:
+      goto DONE;	// not for the byte code.
+    }
+
+    if( reg >= irep->nregs || reg2 >= irep->nregs ) goto DONE;
+    if( sym >= irep->slen || sym2 >= irep->slen ) goto DONE;
+    if( pool >= irep->plen ) goto DONE;
+    if( child >= irep->rlen ) goto DONE;
+    if( jmp >= irep->ilen || (jmp >= 0 && !(head[jmp / 8] & (1 << (jmp % 8)))) ) goto DONE;
+
+    switch( *p ) {
+    case OP_EXT1: ext = 1; break;
+    case OP_EXT2: ext = 2; break;
+    case OP_EXT3: ext = 3; break;
+    default:      ext = 0; break;
+    }
+    p += len;
+  }
+  ret = 0;
+
+ DONE:
+  mrbc_free(0, head);
+  return ret;
+}
+
+
+//================================================================
+/*! verify one irep record and its children.
+
+  @param  pos	A pointer of pointer of irep record.
+  @param  end	end of the IREP section.
+  @param  align	address of the bytecode & 3, for padding.
+  @return	zero if no error.
+*/
+static int verify_irep( const uint8_t **pos, const uint8_t *end, int align )
+{
+  const uint8_t *p = *pos;
+  mrbc_irep irep;
+
+#define NEED(n) if( end - p < (int32_t)(n) ) return -1
+  NEED(14);
+  p += 4;					// record size
+  irep.nlocals = bin_to_uint16(p);	p += 2;
+  irep.nregs = bin_to_uint16(p);	p += 2;
+  irep.rlen = bin_to_uint16(p);		p += 2;
+  uint32_t ilen = bin_to_uint32(p);	p += 4;
+  if( irep.nregs > MAX_REGS_SIZE || irep.nlocals > irep.nregs ) return -1;
+
+  p += (align - (uintptr_t)p) & 0x03;	// padding
+  NEED(ilen);
+  if( ilen > 0xffff ) return -1;
+  irep.ilen = ilen;
+  irep.code = (uint8_t *)p;
+  p += ilen;
+
+  // POOL BLOCK
+  NEED(4);
+  uint32_t n = bin_to_uint32(p);	p += 4;
+  if( n > 0xffff ) return -1;
+  irep.plen = n;
+  while( n-- > 0 ) {
+    NEED(3);
+    int tt = *p;
+    int size = bin_to_uint16(p + 1);	p += 3;
+    NEED(size);
+    switch( tt ) {
+#if MRBC_USE_STRING
+    case 0: break;	// IREP_TT_STRING
+#endif
+    case 1: break;	// IREP_TT_FIXNUM
+#if MRBC_USE_FLOAT
+    case 2: break;	// IREP_TT_FLOAT
+#endif
+    default: return -1;
+    }
+    p += size;
+  }
+
+  // SYMS BLOCK
+  NEED(4);
+  n = bin_to_uint32(p);			p += 4;
+  if( n > 0xffff ) return -1;
+  irep.slen = n;
+  while( n-- > 0 ) {
+    NEED(2);
+    int size = bin_to_uint16(p);	p += 2;
+    NEED(size + 1);
+    if( p[size] != '\0' ) return -1;
+    p += size + 1;
+  }
+#undef NEED
+
+  if( verify_code( &irep ) != 0 ) return -1;
+
+  int i;
+  for( i = 0; i < irep.rlen; i++ ) {
+    if( verify_irep( &p, end, align ) != 0 ) return -1;
+  }
+
+  *pos = p;
+  return 0;
+}
+
+
+//================================================================
+/*! verify the whole bytecode.
+
+  @param  ptr	Pointer to bytecode.
+  @return	zero if no error.
+*/
+static int verify_mrb( const uint8_t *ptr )
+{
+  uint32_t size = bin_to_uint32(ptr + 10);
+  if( size < 22 ) return -1;
+  if( calc_crc_16_ccitt( 0, ptr + 10, size - 10 ) != bin_to_uint16(ptr + 8) ) return -1;
+
+  const uint8_t *end = ptr + size;
+  const uint8_t *p = ptr + 22;
+  int align = (uintptr_t)ptr & 0x03;
+  int n_irep = 0;
+
+  while( end - p >= 8 ) {
+    uint32_t section_size = bin_to_uint32(p + 4);
+    if( section_size < 8 || section_size > end - p ) return -1;
+
+    if( memcmp(p, "IREP", 4) == 0 ) {
+      const uint8_t *q = p + 12;
+      if( section_size < 12 || n_irep++ ) return -1;
+      if( memcmp(p + 8, "0002", 4) != 0 ) return -1;	// rite version
+      if( verify_irep( &q, p + section_size, align ) != 0 ) return -1;
+    }
+    else if( memcmp(p, "END\0", 4) == 0 ) {
+      return n_irep ? 0 : -1;
+    }
+    else if( memcmp(p, "LVAR", 4) != 0 ) {
+      return -1;		// mrbc_load_mrb() can't skip it.
+    }
+    p += section_size;
+  }
+
+  return -1;
+}
+#endif
+
+
 //================================================================
 /*! read one irep section.
 
   @param  vm    A pointer of VM.
   @param  pos	A pointer of pointer of IREP section.
+  @param  align	address of the bytecode & 3, for padding.
   @return       Pointer of allocated mrbc_irep or NULL
 
   <pre>
@@ -104,7 +697,7 @@ static int load_header(struct VM *vm, const uint8_t **pos)
      ...	symbol data
   </pre>
 */
-static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
+static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos, int align)
 {
   const uint8_t *p = *pos + 4;			// skip record size
 
@@ -122,7 +715,7 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
   irep->ilen = bin_to_uint32(p);	p += 4;
 
   // padding
-  p += (vm->mrb - p) & 0x03;
+  p += (align - (uintptr_t)p) & 0x03;
 
   // allocate memory for child irep's pointers
   if( irep->rlen ) {
@@ -140,9 +733,10 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
   // POOL BLOCK
   irep->plen = bin_to_uint32(p);	p += 4;
   if( irep->plen ) {
-    irep->pools = (mrbc_object**)mrbc_alloc(0, sizeof(void*) * irep->plen);
+    // (note) all literals are held in one array, strings refer to the bytecode.
+    irep->pools = (mrbc_object*)mrbc_alloc(0, sizeof(mrbc_object) * irep->plen);
     if(irep->pools == NULL ) {
-      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);	// ENOMEM
       return NULL;
     }
   }
@@ -151,11 +745,7 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
   for( i = 0; i < irep->plen; i++ ) {
     int tt = *p++;
     int obj_size = bin_to_uint16(p);	p += 2;
-    mrbc_object *obj = mrbc_alloc(0, sizeof(mrbc_object));
-    if( obj == NULL ) {
-      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
-      return NULL;
-    }
+    mrbc_object *obj = &irep->pools[i];
     switch( tt ) {
 #if MRBC_USE_STRING
     case 0: { // IREP_TT_STRING
@@ -176,31 +766,104 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
       memcpy(buf, p, obj_size);
       buf[obj_size] = '\0';
       obj->tt = MRBC_TT_FLOAT;
-      obj->d = atof(buf);
+      obj->d = mrbc_atof(buf);
     } break;
 #endif
     default:
       assert(!"Unknown tt");
     }
 
-    irep->pools[i] = obj;
     p += obj_size;
   }
 
   // SYMS BLOCK
   irep->ptr_to_sym = (uint8_t*)p;
-  int slen = bin_to_uint32(p);		p += 4;
-  while( --slen >= 0 ) {
+  irep->slen = bin_to_uint32(p);	p += 4;
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  if( irep->slen ) {
+    irep->sym_ids = (mrbc_sym *)mrbc_alloc(0, sizeof(mrbc_sym) * irep->slen);
+    if( irep->sym_ids == NULL ) {
+      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+      return NULL;
+    }
+  }
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( irep->slen ) {
+    int size = sizeof(mrbc_method_cache) * irep->slen;
+    irep->method_cache = (mrbc_method_cache *)mrbc_alloc(0, size);
+    if( irep->method_cache == NULL ) {
+      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+      return NULL;
+    }
+    memset( irep->method_cache, 0, size );
+  }
+#endif
+  for( i = 0; i < irep->slen; i++ ) {
     int s = bin_to_uint16(p);		p += 2;
+#if MRBC_USE_IREP_SYMBOL_TABLE && MRBC_USE_HOT_RELOAD
+    // copy the new name, the old bytecode may be released by the reload.
+    mrbc_value sym = mrbc_symbol_new( vm, (const char *)p );
+    if( sym.tt != MRBC_TT_SYMBOL || sym.i < 0 ) {
+      mrbc_raise(vm, E_BYTECODE_ERROR, NULL);	// ENOMEM
+      return NULL;
+    }
+    irep->sym_ids[i] = sym.i;
+#elif MRBC_USE_IREP_SYMBOL_TABLE
+    irep->sym_ids[i] = str_to_symid( (const char *)p );
+#endif
     p += s+1;
   }
 
+#if MRBC_USE_RESCUE_TABLE
+  if( make_rescue_table( irep ) != 0 ) {
+    mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+    return NULL;
+  }
+#endif
+#if MRBC_USE_SUPERINSTRUCTION
+  rewrite_superinstructions( irep );
+#endif
+
   *pos = p;
   return irep;
 }
 
 
 
+#if MRBC_USE_LAZY_IREP_LOAD
+//================================================================
+/*! skip one irep and its children, without loading.
+
+  @param  p	pointer to irep record.
+  @param  align	address of the bytecode & 3, for padding.
+  @return	pointer to the next irep record.
+*/
+static const uint8_t * skip_irep(const uint8_t *p, int align)
+{
+  p += 8;					// record size, nlocals, nregs
+  int rlen = bin_to_uint16(p);		p += 2;
+  int ilen = bin_to_uint32(p);		p += 4;
+  p += (align - (uintptr_t)p) & 0x03;	// padding
+  p += ilen;
+
+  int n = bin_to_uint32(p);		p += 4;
+  while( --n >= 0 ) {
+    p += 3 + bin_to_uint16(p + 1);		// type, length, data
+  }
+  n = bin_to_uint32(p);			p += 4;
+  while( --n >= 0 ) {
+    p += 2 + bin_to_uint16(p) + 1;	// length, symbol, '\0'
+  }
+
+  while( --rlen >= 0 ) {
+    p = skip_irep(p, align);
+  }
+  return p;
+}
+#endif
+
+
 //================================================================
 /*! read all irep section.
 
@@ -210,13 +873,26 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
 */
 static mrbc_irep * load_irep_0(struct VM *vm, const uint8_t **pos)
 {
-  mrbc_irep *irep = load_irep_1(vm, pos);
+  int align = (uintptr_t)vm->mrb & 0x03;
+  mrbc_irep *irep = load_irep_1(vm, pos, align);
   if( !irep ) return NULL;
 
+#if MRBC_USE_LAZY_IREP_LOAD
+  irep->reps_pos = *pos;
+  irep->mrb_align = align;
+  if( irep->rlen ) memset( irep->reps, 0, sizeof(mrbc_irep *) * irep->rlen );
+
+  // skip the child ireps.
+  int i;
+  for( i = 0; i < irep->rlen; i++ ) {
+    *pos = skip_irep( *pos, align );
+  }
+#else
   int i;
   for( i = 0; i < irep->rlen; i++ ) {
     irep->reps[i] = load_irep_0(vm, pos);
   }
+#endif
 
   return irep;
 }
@@ -276,19 +952,68 @@ static int load_lvar(struct VM *vm, const uint8_t **pos)
 }
 
 
+//================================================================
+/*! Load the pre-linked image.
+
+  @param  vm    Pointer to VM.
+  @param  image	Pointer to image.
+  @return int	zero if no error.
+
+  No memory is allocated. The image is shared by all VMs that load it,
+  and is never released.
+*/
+int mrbc_load_prelinked(struct VM *vm, const mrbc_prelinked_image *image)
+{
+  if( memcmp(image->ident, MRBC_PRELINK_IDENT, 8) != 0 ) {
+    mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+    return -1;
+  }
+
+  // symbol IDs may differ from the last boot, so resolve every time.
+  int i;
+  for( i = 0; i < image->n_symbols; i++ ) {
+    mrbc_sym sym_id = str_to_symid( image->symbols[i].name );
+    if( sym_id < 0 ) return -1;
+    *image->symbols[i].sym_id = sym_id;
+  }
+
+  vm->mrb = (const uint8_t *)image;
+  vm->irep = (mrbc_irep *)image->irep;
+  vm->flag_shared_irep = 1;
+
+  return 0;
+}
+
+
 //================================================================
 /*! Load the VM bytecode.
 
   @param  vm    Pointer to VM.
-  @param  ptr	Pointer to bytecode.
+  @param  ptr	Pointer to bytecode, or pre-linked image.
 
 */
 int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr)
 {
   int ret = -1;
+
+  if( memcmp(ptr, MRBC_PRELINK_IDENT, 8) == 0 ) {
+    return mrbc_load_prelinked(vm, (const mrbc_prelinked_image *)ptr);
+  }
+
   vm->mrb = ptr;
 
+#if IREP_CACHE_SIZE > 0
+  vm->irep = irep_cache_get(ptr);
+  if( vm->irep ) return 0;
+#endif
+
   ret = load_header(vm, &ptr);
+#if MRBC_USE_BYTECODE_VERIFIER
+  if( ret == 0 && verify_mrb( vm->mrb ) != 0 ) {
+    mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+    ret = -1;
+  }
+#endif
   while( ret == 0 ) {
     if( memcmp(ptr, "IREP", 4) == 0 ) {
       ret = load_irep(vm, &ptr);
@@ -301,5 +1026,405 @@ int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr)
     }
   }
 
+#if IREP_CACHE_SIZE > 0
+  if( ret == 0 ) irep_cache_add(vm->mrb, vm->irep);
+#endif
+
   return ret;
 }
+
+
+#if MRBC_USE_STREAM_LOADER
+#if !MRBC_USE_IREP_SYMBOL_TABLE
+#error "MRBC_USE_STREAM_LOADER needs MRBC_USE_IREP_SYMBOL_TABLE."
+#endif
+//================================================================
+/*! bytecode stream.
+*/
+typedef struct LOAD_STREAM {
+  mrbc_load_read_func read;
+  void *user;
+  uint32_t offset;		//!< # of bytes read.
+#if MRBC_USE_BYTECODE_VERIFIER
+  uint16_t crc;			//!< CRC of the bytes after the CRC field.
+#endif
+} LOAD_STREAM;
+
+
+//================================================================
+/*! read bytes from the stream.
+
+  @param  s	pointer to the stream.
+  @param  buf	buffer.
+  @param  size	# of bytes to read.
+  @return	zero if no error.
+*/
+static int stream_read( LOAD_STREAM *s, void *buf, uint32_t size )
+{
+  if( size == 0 ) return 0;
+  if( s->read( s->user, buf, size ) != (int)size ) return -1;
+
+#if MRBC_USE_BYTECODE_VERIFIER
+  // CRC covers the bytes from offset 10 to the end.
+  uint32_t skip = (s->offset < 10) ? 10 - s->offset : 0;
+  if( skip < size ) {
+    s->crc = calc_crc_16_ccitt( s->crc, (uint8_t *)buf + skip, size - skip );
+  }
+#endif
+  s->offset += size;
+
+  return 0;
+}
+
+
+//================================================================
+/*! skip bytes of the stream.
+
+  @param  s	pointer to the stream.
+  @param  size	# of bytes to skip.
+  @return	zero if no error.
+*/
+static int stream_skip( LOAD_STREAM *s, uint32_t size )
+{
+  uint8_t buf[16];
+
+  while( size > 0 ) {
+    uint32_t n = (size < sizeof(buf)) ? size : sizeof(buf);
+    if( stream_read( s, buf, n ) != 0 ) return -1;
+    size -= n;
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! read one irep and its children from the stream.
+
+  @param  vm	pointer to VM.
+  @param  s	pointer to the stream.
+  @return	pointer to allocated mrbc_irep, or NULL if error.
+
+  The structure is the same as load_irep_1(). Only code, string literals
+  and symbol names not yet known are kept in RAM.
+*/
+static mrbc_irep * load_irep_stream( struct VM *vm, LOAD_STREAM *s )
+{
+  uint8_t buf[14];
+  int i, n;
+
+  // record size, nlocals, nregs, rlen, ilen
+  if( stream_read( s, buf, 14 ) != 0 ) return NULL;
+  uint32_t ilen = bin_to_uint32(buf + 10);
+  if( ilen > 0xffff ) return NULL;
+
+  mrbc_irep *irep = mrbc_irep_alloc(0);
+  if( irep == NULL ) return NULL;	// ENOMEM
+  irep->nlocals = bin_to_uint16(buf + 4);
+  irep->nregs = bin_to_uint16(buf + 6);
+  int rlen = bin_to_uint16(buf + 8);
+
+  // padding
+  if( stream_skip( s, (0 - s->offset) & 0x03 ) != 0 ) goto ERROR;
+
+  // ISEQ (code) BLOCK
+  irep->code = mrbc_alloc(0, ilen);
+  if( irep->code == NULL ) goto ERROR;	// ENOMEM
+  irep->flag_code_in_ram = 1;
+  irep->ilen = ilen;
+  if( stream_read( s, irep->code, ilen ) != 0 ) goto ERROR;
+
+  // POOL BLOCK
+  if( stream_read( s, buf, 4 ) != 0 ) goto ERROR;
+  n = bin_to_uint32(buf);
+  if( n > 0xffff ) goto ERROR;
+  if( n ) {
+    irep->pools = (mrbc_object*)mrbc_alloc(0, sizeof(mrbc_object) * n);
+    if( irep->pools == NULL ) goto ERROR;	// ENOMEM
+    memset( irep->pools, 0, sizeof(mrbc_object) * n );
+    irep->plen = n;
+    irep->flag_str_in_ram = 1;
+  }
+
+  for( i = 0; i < n; i++ ) {
+    if( stream_read( s, buf, 3 ) != 0 ) goto ERROR;
+    int tt = buf[0];
+    int obj_size = bin_to_uint16(buf + 1);
+    mrbc_object *obj = &irep->pools[i];
+
+    switch( tt ) {
+#if MRBC_USE_STRING
+    case 0: { // IREP_TT_STRING
+      // keep the length at str - 2, same as in the bytecode.
+      uint8_t *str = mrbc_alloc(0, 2 + obj_size);
+      if( str == NULL ) goto ERROR;		// ENOMEM
+      memcpy( str, buf + 1, 2 );
+      obj->tt = MRBC_TT_STRING;
+      obj->str = (char *)str + 2;
+      if( stream_read( s, str + 2, obj_size ) != 0 ) goto ERROR;
+    } break;
+#endif
+    case 1: // IREP_TT_FIXNUM
+#if MRBC_USE_FLOAT
+    case 2: // IREP_TT_FLOAT
+#endif
+    {
+      char num[obj_size+1];
+      if( stream_read( s, num, obj_size ) != 0 ) goto ERROR;
+      num[obj_size] = '\0';
+#if MRBC_USE_FLOAT
+      if( tt == 2 ) {
+	obj->tt = MRBC_TT_FLOAT;
+	obj->d = mrbc_atof(num);
+	break;
+      }
+#endif
+      obj->tt = MRBC_TT_FIXNUM;
+      obj->i = atol(num);
+    } break;
+
+    default:
+      goto ERROR;
+    }
+  }
+
+  // SYMS BLOCK
+  if( stream_read( s, buf, 4 ) != 0 ) goto ERROR;
+  n = bin_to_uint32(buf);
+  if( n > 0xffff ) goto ERROR;
+  if( n ) {
+    irep->sym_ids = (mrbc_sym *)mrbc_alloc(0, sizeof(mrbc_sym) * n);
+    if( irep->sym_ids == NULL ) goto ERROR;	// ENOMEM
+#if MRBC_USE_INLINE_METHOD_CACHE
+    int size = sizeof(mrbc_method_cache) * n;
+    irep->method_cache = (mrbc_method_cache *)mrbc_alloc(0, size);
+    if( irep->method_cache == NULL ) {
+      mrbc_raw_free( irep->sym_ids );
+      goto ERROR;				// ENOMEM
+    }
+    memset( irep->method_cache, 0, size );
+#endif
+    irep->slen = n;
+  }
+
+  for( i = 0; i < n; i++ ) {
+    if( stream_read( s, buf, 2 ) != 0 ) goto ERROR;
+    int len = bin_to_uint16(buf);
+
+    // the symbol table copies the name if it is new.
+    char *name = mrbc_alloc(0, len + 1);
+    if( name == NULL ) goto ERROR;		// ENOMEM
+    mrbc_value sym = mrbc_nil_value();
+    if( stream_read( s, name, len + 1 ) == 0 && name[len] == '\0' ) {
+      sym = mrbc_symbol_new( vm, name );
+    }
+    mrbc_raw_free( name );
+    if( sym.tt != MRBC_TT_SYMBOL || sym.i < 0 ) goto ERROR;
+    irep->sym_ids[i] = sym.i;
+  }
+
+  // child ireps
+  if( rlen ) {
+    irep->reps = (mrbc_irep **)mrbc_alloc(0, sizeof(mrbc_irep *) * rlen);
+    if( irep->reps == NULL ) goto ERROR;	// ENOMEM
+    memset( irep->reps, 0, sizeof(mrbc_irep *) * rlen );
+    irep->rlen = rlen;
+  }
+
+#if MRBC_USE_BYTECODE_VERIFIER
+  if( irep->nregs > MAX_REGS_SIZE || irep->nlocals > irep->nregs ) goto ERROR;
+  if( verify_code( irep ) != 0 ) goto ERROR;
+#endif
+#if MRBC_USE_RESCUE_TABLE
+  if( make_rescue_table( irep ) != 0 ) goto ERROR;	// ENOMEM
+#endif
+#if MRBC_USE_SUPERINSTRUCTION
+  rewrite_superinstructions( irep );
+#endif
+
+  for( i = 0; i < rlen; i++ ) {
+    irep->reps[i] = load_irep_stream( vm, s );
+    if( irep->reps[i] == NULL ) goto ERROR;
+  }
+
+  return irep;
+
+ ERROR:
+  mrbc_irep_free( irep );
+  return NULL;
+}
+
+
+//================================================================
+/*! Load the VM bytecode through a read callback.
+
+  @param  vm	Pointer to VM.
+  @param  read	read function. It must fill buf with size bytes,
+		and return the number of bytes read.
+  @param  user	given to read() as is.
+  @return int	zero if no error.
+
+  <pre>
+  The bytecode is read once from the beginning to the end, so data on
+  storage that is not memory-mapped (serial, SPI flash, file) can be
+  loaded without keeping the whole .mrb in RAM.
+
+  RAM usage:
+   Resident, freed with the VM:
+     mrbc_irep, ISEQ, pool objects with string literals, symbol ID table
+     (and method cache) per irep, plus the names of new symbols.
+     ISEQ and string literals are copies here, instead of pointers to
+     the bytecode made by mrbc_load_mrb().
+   Temporary, during the load only:
+     the longest symbol name + 1 bytes of heap, a number literal on the
+     stack, and a stack frame of load_irep_stream() per nesting level.
+  The bytecode is not cached, so each call loads a new copy.
+  </pre>
+*/
+int mrbc_load_mrb_stream(struct VM *vm, mrbc_load_read_func read, void *user)
+{
+  LOAD_STREAM s = { .read = read, .user = user };
+  uint8_t buf[22];
+  const uint8_t *p = buf;
+
+  vm->mrb = NULL;
+  vm->irep = NULL;
+
+  if( stream_read( &s, buf, 22 ) != 0 ) goto ERROR;
+  if( load_header( vm, &p ) != 0 ) return -1;
+#if MRBC_USE_BYTECODE_VERIFIER
+  uint16_t crc = bin_to_uint16(buf + 8);
+  uint32_t size = bin_to_uint32(buf + 10);
+#endif
+
+  while( 1 ) {
+    if( stream_read( &s, buf, 8 ) != 0 ) goto ERROR;
+    uint32_t section_end = s.offset - 8 + bin_to_uint32(buf + 4);
+    if( section_end < s.offset ) goto ERROR;
+
+    if( memcmp(buf, "IREP", 4) == 0 ) {
+      if( vm->irep ) goto ERROR;
+      if( stream_read( &s, buf, 4 ) != 0 ) goto ERROR;
+      if( memcmp(buf, "0002", 4) != 0 ) goto ERROR;	// rite version
+      vm->irep = load_irep_stream( vm, &s );
+      if( vm->irep == NULL ) goto ERROR;
+    }
+    else if( memcmp(buf, "END\0", 4) == 0 ) {
+      break;
+    }
+
+    // skip the rest of the section, e.g. LVAR.
+    if( section_end < s.offset ) goto ERROR;
+    if( stream_skip( &s, section_end - s.offset ) != 0 ) goto ERROR;
+  }
+  if( vm->irep == NULL ) goto ERROR;
+
+#if MRBC_USE_BYTECODE_VERIFIER
+  if( s.offset != size || s.crc != crc ) goto ERROR;
+#endif
+
+  return 0;
+
+ ERROR:
+  mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+  if( vm->irep ) mrbc_irep_free( vm->irep );
+  vm->irep = NULL;
+  return -1;
+}
+#endif
+
+
+#if MRBC_USE_LAZY_IREP_LOAD
+//================================================================
+/*! load the n-th child irep, on first use.
+
+  @param  irep	parent irep.
+  @param  n	index of the child.
+  @return	pointer to the child, or NULL if ENOMEM.
+*/
+mrbc_irep * mrbc_load_irep_child(mrbc_irep *irep, int n)
+{
+  const uint8_t *p = irep->reps_pos;
+  int i;
+  for( i = 0; i < n; i++ ) {
+    p = skip_irep( p, irep->mrb_align );
+  }
+
+  mrbc_irep *child = load_irep_1( NULL, &p, irep->mrb_align );
+  if( child == NULL ) return NULL;		// ENOMEM
+  child->reps_pos = p;
+  child->mrb_align = irep->mrb_align;
+  if( child->rlen ) memset( child->reps, 0, sizeof(mrbc_irep *) * child->rlen );
+
+  // another core may have loaded it.
+  hal_lock();
+  if( irep->reps[n] == NULL ) {
+    irep->reps[n] = child;
+    child = NULL;
+  }
+  hal_unlock();
+  if( child ) mrbc_irep_free( child );
+
+  return irep->reps[n];
+}
+#endif
+
+
+//================================================================
+/*! forget all cached ireps. (their memory is released with the pool)
+*/
+void mrbc_cleanup_load(void)
+{
+#if IREP_CACHE_SIZE > 0
+  memset( irep_cache, 0, sizeof(irep_cache) );
+#endif
+}
+
+
+//================================================================
+/*! release the irep tree made by mrbc_load_mrb().
+
+  @param  irep	pointer to the top irep.
+
+  @retval 0	freed.
+  @retval 1	still used by the other VM.
+
+  The shared irep is freed when the last VM releases it.
+*/
+int mrbc_release_irep(mrbc_irep *irep)
+{
+#if IREP_CACHE_SIZE > 0
+  int i;
+
+  hal_lock();
+  for( i = 0; i < IREP_CACHE_SIZE; i++ ) {
+    IREP_CACHE *c = &irep_cache[i];
+    if( c->mrb != NULL && c->irep == irep ) {
+      if( --c->ref_count == 0 ) {
+        c->mrb = NULL;
+      } else {
+        irep = NULL;		// still used.
+      }
+      break;
+    }
+  }
+  hal_unlock();
+  if( irep == NULL ) return 1;
+#endif
+
+  mrbc_irep_free( irep );
+  return 0;
+}
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the irep cache. (see snapshot.c)
+*/
+void mrbc_snapshot_load(mrbc_snapshot *s)
+{
+#if IREP_CACHE_SIZE > 0
+  MRBC_SNAPSHOT_VAR( s, irep_cache );
+#endif
+}
+#endif
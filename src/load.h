@@ -15,13 +15,59 @@
 #define MRBC_SRC_LOAD_H_
 
 #include <stdint.h>
+#include "value.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct VM;
+struct IREP;
+
+// identifier of the pre-linked image.
+#define MRBC_PRELINK_IDENT	"MRBCPL01"
+
+
+//================================================================
+/*!@brief
+  Symbol to be resolved when the pre-linked image is loaded.
+*/
+typedef struct PRELINK_SYMBOL {
+  const char *name;		//!< symbol name.
+  mrbc_sym *sym_id;		//!< slot in the irep symbol ID table.
+} mrbc_prelink_symbol;
+
+
+//================================================================
+/*!@brief
+  Pre-linked image, made by support/make_prelinked_image.rb.
+
+  The irep tree is built at compile time, so it can be used directly
+  from flash. Only the symbols that are not built-in are resolved at load.
+*/
+typedef struct PRELINKED_IMAGE {
+  char ident[8];		//!< MRBC_PRELINK_IDENT
+  const struct IREP *irep;	//!< top irep.
+  uint16_t n_symbols;		//!< # of symbols to be resolved.
+  const mrbc_prelink_symbol *symbols;
+} mrbc_prelinked_image;
+
+
+//================================================================
+/*!@brief
+  read function for mrbc_load_mrb_stream().
+
+  Fill buf with size bytes, and return the number of bytes read.
+*/
+typedef int (*mrbc_load_read_func)(void *user, uint8_t *buf, int size);
+
+
 int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr);
+int mrbc_load_mrb_stream(struct VM *vm, mrbc_load_read_func read, void *user);
+int mrbc_load_prelinked(struct VM *vm, const mrbc_prelinked_image *image);
+struct IREP *mrbc_load_irep_child(struct IREP *irep, int n);
+int mrbc_release_irep(struct IREP *irep);
+void mrbc_cleanup_load(void);
 
 
 #ifdef __cplusplus
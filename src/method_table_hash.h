@@ -9,6 +9,12 @@ struct RClass *mrbc_init_class_hash(struct VM *vm)
     MRBC_SYMID_count,
     MRBC_SYMID_delete,
     MRBC_SYMID_dup,
+#if MRBC_USE_NATIVE_ITERATOR
+    MRBC_SYMID_each_key,
+#endif
+#if MRBC_USE_NATIVE_ITERATOR
+    MRBC_SYMID_each_value,
+#endif
     MRBC_SYMID_empty_Q,
     MRBC_SYMID_has_key_Q,
     MRBC_SYMID_has_value_Q,
@@ -35,6 +41,12 @@ struct RClass *mrbc_init_class_hash(struct VM *vm)
     c_hash_size,
     c_hash_delete,
     c_hash_dup,
+#if MRBC_USE_NATIVE_ITERATOR
+    c_hash_each_key,
+#endif
+#if MRBC_USE_NATIVE_ITERATOR
+    c_hash_each_value,
+#endif
     c_hash_empty,
     c_hash_has_key,
     c_hash_has_value,
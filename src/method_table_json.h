@@ -0,0 +1,15 @@
+/* Auto generated by make_method_table.rb */
+#include "symbol_builtin.h"
+struct RClass *mrbc_init_class_json(struct VM *vm)
+{
+  static const mrbc_sym method_symbols[] = {
+    MRBC_SYMID_generate,
+    MRBC_SYMID_parse,
+  };
+  static const mrbc_func_t method_functions[] = {
+    c_json_generate,
+    c_json_parse,
+  };
+
+  return mrbc_define_builtin_class("JSON", mrbc_class_object, method_symbols, method_functions, sizeof(method_symbols)/sizeof(mrbc_sym) );
+}
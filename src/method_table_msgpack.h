@@ -0,0 +1,15 @@
+/* Auto generated by make_method_table.rb */
+#include "symbol_builtin.h"
+struct RClass *mrbc_init_class_msgpack(struct VM *vm)
+{
+  static const mrbc_sym method_symbols[] = {
+    MRBC_SYMID_pack,
+    MRBC_SYMID_unpack,
+  };
+  static const mrbc_func_t method_functions[] = {
+    c_msgpack_pack,
+    c_msgpack_unpack,
+  };
+
+  return mrbc_define_builtin_class("MessagePack", mrbc_class_object, method_symbols, method_functions, sizeof(method_symbols)/sizeof(mrbc_sym) );
+}
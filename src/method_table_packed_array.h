@@ -0,0 +1,45 @@
+/* Auto generated by make_method_table.rb */
+#include "symbol_builtin.h"
+struct RClass *mrbc_init_class_packed_array(struct VM *vm)
+{
+  static const mrbc_sym method_symbols[] = {
+    MRBC_SYMID_BLL_BLR,
+    MRBC_SYMID_BLL_BLR_EQ,
+    MRBC_SYMID_dup,
+    MRBC_SYMID_fill,
+    MRBC_SYMID_from,
+    MRBC_SYMID_length,
+    MRBC_SYMID_max,
+    MRBC_SYMID_mean,
+    MRBC_SYMID_min,
+    MRBC_SYMID_minmax,
+    MRBC_SYMID_moving_average,
+    MRBC_SYMID_new,
+    MRBC_SYMID_scale,
+    MRBC_SYMID_size,
+    MRBC_SYMID_sum,
+    MRBC_SYMID_to_a,
+    MRBC_SYMID_type,
+  };
+  static const mrbc_func_t method_functions[] = {
+    c_packed_array_get,
+    c_packed_array_set,
+    c_packed_array_dup,
+    c_packed_array_fill,
+    c_packed_array_from,
+    c_packed_array_size,
+    c_packed_array_max,
+    c_packed_array_mean,
+    c_packed_array_min,
+    c_packed_array_minmax,
+    c_packed_array_moving_average,
+    c_packed_array_new,
+    c_packed_array_scale,
+    c_packed_array_size,
+    c_packed_array_sum,
+    c_packed_array_to_a,
+    c_packed_array_type,
+  };
+
+  return mrbc_define_builtin_class("PackedArray", mrbc_class_object, method_symbols, method_functions, sizeof(method_symbols)/sizeof(mrbc_sym) );
+}
@@ -0,0 +1,1020 @@
+/* Auto generated by make_prelinked_image.rb from mrblib.mrb */
+#include "vm.h"
+#include "load.h"
+#include "symbol_builtin.h"
+
+
+/* irep 22 */
+static const uint8_t prelink_code_22[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x23,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x3a,0x03,0x00,0x00,0x2e,0x03,0x01,0x01,0x01,0x03,0x02,0x3c,0x03,0x01,
+  0x01,0x02,0x03,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x02,0x00,0x42,0x03,0x22,0x03,
+  0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_22[] = {
+  0x00,0x00,0x00,0x03,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_22[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_22[3];
+#endif
+static const mrbc_irep prelink_irep_22 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 54,
+  .plen = 0,
+  .slen = 3,
+  .code = (uint8_t *)prelink_code_22,
+  .ptr_to_sym = (uint8_t *)prelink_syms_22,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_22,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_22,
+#endif
+};
+
+/* irep 21 */
+static const uint8_t prelink_code_21[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x27,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x2e,0x04,0x01,0x00,0x3a,0x03,0x00,0x00,0x2e,0x03,0x02,0x01,0x01,0x03,
+  0x02,0x3c,0x03,0x01,0x01,0x02,0x03,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x03,0x00,
+  0x42,0x03,0x22,0x03,0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_21[] = {
+  0x00,0x00,0x00,0x04,0x00,0x02,0x5b,0x5d,0x00,0x00,0x03,0x6f,0x72,0x64,0x00,0x00,
+  0x04,0x63,0x61,0x6c,0x6c,0x00,0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_21[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_ord,
+  MRBC_SYMID_call,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_21[4];
+#endif
+static const mrbc_irep prelink_irep_21 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 58,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_21,
+  .ptr_to_sym = (uint8_t *)prelink_syms_21,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_21,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_21,
+#endif
+};
+
+/* irep 20 */
+static const uint8_t prelink_code_20[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x61,0x01,0x56,0x02,0x01,0x5d,0x01,0x01,
+  0x0e,0x01,0x01,0x37,0x01,
+};
+static const uint8_t prelink_syms_20[] = {
+  0x00,0x00,0x00,0x02,0x00,0x09,0x65,0x61,0x63,0x68,0x5f,0x62,0x79,0x74,0x65,0x00,
+  0x00,0x09,0x65,0x61,0x63,0x68,0x5f,0x63,0x68,0x61,0x72,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_20[] = {
+  MRBC_SYMID_each_byte,
+  MRBC_SYMID_each_char,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_20[2];
+#endif
+static mrbc_irep * const prelink_reps_20[] = {
+  (mrbc_irep *)&prelink_irep_21,
+  (mrbc_irep *)&prelink_irep_22,
+};
+static const mrbc_irep prelink_irep_20 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 2,
+  .ilen = 21,
+  .plen = 0,
+  .slen = 2,
+  .code = (uint8_t *)prelink_code_20,
+  .ptr_to_sym = (uint8_t *)prelink_syms_20,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_20,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_20,
+#endif
+  .reps = (struct IREP **)prelink_reps_20,
+};
+
+/* irep 19 */
+static const uint8_t prelink_code_19[] = {
+  0x33,0x00,0x00,0x00,0x10,0x04,0x2e,0x04,0x00,0x00,0x01,0x02,0x04,0x10,0x04,0x2e,
+  0x04,0x01,0x00,0x22,0x04,0x00,0x20,0x01,0x04,0x02,0x3c,0x04,0x01,0x01,0x02,0x04,
+  0x10,0x04,0x2e,0x04,0x02,0x00,0x01,0x03,0x04,0x21,0x00,0x40,0x01,0x05,0x03,0x3a,
+  0x04,0x00,0x00,0x2e,0x04,0x03,0x01,0x01,0x04,0x03,0x3c,0x04,0x01,0x01,0x03,0x04,
+  0x01,0x04,0x03,0x01,0x05,0x02,0x42,0x04,0x22,0x04,0x00,0x2c,0x10,0x04,0x37,0x04,
+};
+static const uint8_t prelink_syms_19[] = {
+  0x00,0x00,0x00,0x04,0x00,0x04,0x6c,0x61,0x73,0x74,0x00,0x00,0x0c,0x65,0x78,0x63,
+  0x6c,0x75,0x64,0x65,0x5f,0x65,0x6e,0x64,0x3f,0x00,0x00,0x05,0x66,0x69,0x72,0x73,
+  0x74,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_19[] = {
+  MRBC_SYMID_last,
+  MRBC_SYMID_exclude_end_Q,
+  MRBC_SYMID_first,
+  MRBC_SYMID_call,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_19[4];
+#endif
+static const mrbc_irep prelink_irep_19 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 4,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 80,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_19,
+  .ptr_to_sym = (uint8_t *)prelink_syms_19,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_19,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_19,
+#endif
+};
+
+/* irep 18 */
+static const uint8_t prelink_code_18[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x0e,0x01,0x00,0x37,0x01,
+};
+static const uint8_t prelink_syms_18[] = {
+  0x00,0x00,0x00,0x01,0x00,0x04,0x65,0x61,0x63,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_18[] = {
+  MRBC_SYMID_each,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_18[1];
+#endif
+static mrbc_irep * const prelink_reps_18[] = {
+  (mrbc_irep *)&prelink_irep_19,
+};
+static const mrbc_irep prelink_irep_18 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 1,
+  .ilen = 13,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_18,
+  .ptr_to_sym = (uint8_t *)prelink_syms_18,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_18,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_18,
+#endif
+  .reps = (struct IREP **)prelink_reps_18,
+};
+
+/* irep 17 */
+static const uint8_t prelink_code_17[] = {
+  0x33,0x00,0x00,0x00,0x21,0x00,0x0f,0x3a,0x02,0x00,0x00,0x2e,0x02,0x00,0x00,0x11,
+  0x02,0x22,0x02,0x00,0x07,0x0f,0x02,0x37,0x02,
+};
+static const uint8_t prelink_syms_17[] = {
+  0x00,0x00,0x00,0x01,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_17[] = {
+  MRBC_SYMID_call,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_17[1];
+#endif
+static const mrbc_irep prelink_irep_17 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 2,
+  .nregs = 4,
+  .rlen = 0,
+  .ilen = 25,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_17,
+  .ptr_to_sym = (uint8_t *)prelink_syms_17,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_17,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_17,
+#endif
+};
+
+/* irep 16 */
+static const uint8_t prelink_code_16[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x0e,0x01,0x00,0x37,0x01,
+};
+static const uint8_t prelink_syms_16[] = {
+  0x00,0x00,0x00,0x01,0x00,0x04,0x6c,0x6f,0x6f,0x70,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_16[] = {
+  MRBC_SYMID_loop,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_16[1];
+#endif
+static mrbc_irep * const prelink_reps_16[] = {
+  (mrbc_irep *)&prelink_irep_17,
+};
+static const mrbc_irep prelink_irep_16 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 1,
+  .ilen = 13,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_16,
+  .ptr_to_sym = (uint8_t *)prelink_syms_16,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_16,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_16,
+#endif
+  .reps = (struct IREP **)prelink_reps_16,
+};
+
+/* irep 15 */
+static const uint8_t prelink_code_15[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x1d,0x01,0x04,0x02,0x3a,0x03,0x00,0x00,
+  0x2e,0x03,0x00,0x01,0x01,0x03,0x02,0x3c,0x03,0x01,0x01,0x02,0x03,0x01,0x03,0x02,
+  0x10,0x04,0x42,0x03,0x22,0x03,0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_15[] = {
+  0x00,0x00,0x00,0x01,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_15[] = {
+  MRBC_SYMID_call,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_15[1];
+#endif
+static const mrbc_irep prelink_irep_15 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 6,
+  .rlen = 0,
+  .ilen = 44,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_15,
+  .ptr_to_sym = (uint8_t *)prelink_syms_15,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_15,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_15,
+#endif
+};
+
+/* irep 14 */
+static const uint8_t prelink_code_14[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x0e,0x01,0x00,0x37,0x01,
+};
+static const uint8_t prelink_syms_14[] = {
+  0x00,0x00,0x00,0x01,0x00,0x05,0x74,0x69,0x6d,0x65,0x73,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_14[] = {
+  MRBC_SYMID_times,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_14[1];
+#endif
+static mrbc_irep * const prelink_reps_14[] = {
+  (mrbc_irep *)&prelink_irep_15,
+};
+static const mrbc_irep prelink_irep_14 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 1,
+  .ilen = 13,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_14,
+  .ptr_to_sym = (uint8_t *)prelink_syms_14,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_14,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_14,
+#endif
+  .reps = (struct IREP **)prelink_reps_14,
+};
+
+/* irep 13 */
+static const uint8_t prelink_code_13[] = {
+  0x33,0x00,0x00,0x00,0x10,0x06,0x2e,0x06,0x00,0x00,0x01,0x02,0x06,0x10,0x06,0x2e,
+  0x06,0x01,0x00,0x01,0x03,0x06,0x06,0x04,0x21,0x00,0x45,0x01,0x06,0x02,0x01,0x07,
+  0x04,0x2e,0x06,0x02,0x01,0x01,0x05,0x06,0x01,0x07,0x05,0x10,0x08,0x01,0x09,0x05,
+  0x2e,0x08,0x02,0x01,0x3a,0x06,0x00,0x00,0x2e,0x06,0x03,0x02,0x01,0x06,0x04,0x3c,
+  0x06,0x01,0x01,0x04,0x06,0x01,0x06,0x04,0x01,0x07,0x03,0x42,0x06,0x22,0x06,0x00,
+  0x1b,0x10,0x06,0x37,0x06,
+};
+static const uint8_t prelink_syms_13[] = {
+  0x00,0x00,0x00,0x04,0x00,0x04,0x6b,0x65,0x79,0x73,0x00,0x00,0x06,0x6c,0x65,0x6e,
+  0x67,0x74,0x68,0x00,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_13[] = {
+  MRBC_SYMID_keys,
+  MRBC_SYMID_length,
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_13[4];
+#endif
+static const mrbc_irep prelink_irep_13 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 6,
+  .nregs = 11,
+  .rlen = 0,
+  .ilen = 85,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_13,
+  .ptr_to_sym = (uint8_t *)prelink_syms_13,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_13,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_13,
+#endif
+};
+
+/* irep 12 */
+static const uint8_t prelink_code_12[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x0e,0x01,0x00,0x37,0x01,
+};
+static const uint8_t prelink_syms_12[] = {
+  0x00,0x00,0x00,0x01,0x00,0x04,0x65,0x61,0x63,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_12[] = {
+  MRBC_SYMID_each,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_12[1];
+#endif
+static mrbc_irep * const prelink_reps_12[] = {
+  (mrbc_irep *)&prelink_irep_13,
+};
+static const mrbc_irep prelink_irep_12 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 1,
+  .ilen = 13,
+  .plen = 0,
+  .slen = 1,
+  .code = (uint8_t *)prelink_code_12,
+  .ptr_to_sym = (uint8_t *)prelink_syms_12,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_12,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_12,
+#endif
+  .reps = (struct IREP **)prelink_reps_12,
+};
+
+/* irep 11 */
+static const uint8_t prelink_code_11[] = {
+  0x33,0x00,0x00,0x01,0x10,0x02,0x2e,0x02,0x00,0x00,0x01,0x03,0x01,0x2f,0x02,0x01,
+  0x00,0x37,0x02,
+};
+static const uint8_t prelink_syms_11[] = {
+  0x00,0x00,0x00,0x02,0x00,0x03,0x64,0x75,0x70,0x00,0x00,0x05,0x73,0x6f,0x72,0x74,
+  0x21,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_11[] = {
+  MRBC_SYMID_dup,
+  MRBC_SYMID_sort_EXC,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_11[2];
+#endif
+static const mrbc_irep prelink_irep_11 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 2,
+  .nregs = 4,
+  .rlen = 0,
+  .ilen = 19,
+  .plen = 0,
+  .slen = 2,
+  .code = (uint8_t *)prelink_code_11,
+  .ptr_to_sym = (uint8_t *)prelink_syms_11,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_11,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_11,
+#endif
+};
+
+/* irep 10 */
+static const uint8_t prelink_code_10[] = {
+  0x33,0x00,0x00,0x01,0x10,0x07,0x2e,0x07,0x00,0x00,0x3e,0x07,0x01,0x01,0x02,0x07,
+  0x06,0x03,0x21,0x00,0xa0,0x01,0x07,0x03,0x01,0x04,0x07,0x21,0x00,0x8b,0x01,0x07,
+  0x04,0x3c,0x07,0x01,0x01,0x04,0x07,0x10,0x07,0x01,0x08,0x03,0x2e,0x07,0x01,0x01,
+  0x01,0x05,0x07,0x10,0x07,0x01,0x08,0x04,0x2e,0x07,0x01,0x01,0x01,0x06,0x07,0x23,
+  0x01,0x00,0x5e,0x01,0x07,0x01,0x01,0x08,0x05,0x01,0x09,0x06,0x2e,0x07,0x02,0x02,
+  0x06,0x08,0x43,0x07,0x23,0x07,0x00,0x5b,0x21,0x00,0x1b,0x21,0x00,0x6d,0x01,0x07,
+  0x05,0x01,0x08,0x06,0x43,0x07,0x23,0x07,0x00,0x6d,0x21,0x00,0x1b,0x01,0x07,0x06,
+  0x10,0x08,0x01,0x09,0x03,0x01,0x0a,0x07,0x2e,0x08,0x03,0x02,0x01,0x07,0x05,0x10,
+  0x08,0x01,0x09,0x04,0x01,0x0a,0x07,0x2e,0x08,0x03,0x02,0x01,0x07,0x04,0x01,0x08,
+  0x02,0x42,0x07,0x22,0x07,0x00,0x1e,0x01,0x07,0x03,0x3c,0x07,0x01,0x01,0x03,0x07,
+  0x01,0x07,0x03,0x01,0x08,0x02,0x42,0x07,0x22,0x07,0x00,0x15,0x10,0x07,0x37,0x07,
+};
+static const uint8_t prelink_syms_10[] = {
+  0x00,0x00,0x00,0x04,0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,0x00,0x02,0x5b,
+  0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,0x00,0x03,0x5b,0x5d,0x3d,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_10[] = {
+  MRBC_SYMID_length,
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_BLL_BLR_EQ,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_10[4];
+#endif
+static const mrbc_irep prelink_irep_10 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 7,
+  .nregs = 12,
+  .rlen = 0,
+  .ilen = 176,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_10,
+  .ptr_to_sym = (uint8_t *)prelink_syms_10,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_10,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_10,
+#endif
+};
+
+/* irep 9 */
+static const uint8_t prelink_code_9[] = {
+  0x33,0x00,0x00,0x01,0x10,0x02,0x2e,0x02,0x00,0x00,0x01,0x03,0x01,0x2f,0x02,0x01,
+  0x00,0x37,0x02,
+};
+static const uint8_t prelink_syms_9[] = {
+  0x00,0x00,0x00,0x02,0x00,0x03,0x64,0x75,0x70,0x00,0x00,0x09,0x64,0x65,0x6c,0x65,
+  0x74,0x65,0x5f,0x69,0x66,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_9[] = {
+  MRBC_SYMID_dup,
+  MRBC_SYMID_delete_if,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_9[2];
+#endif
+static const mrbc_irep prelink_irep_9 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 2,
+  .nregs = 4,
+  .rlen = 0,
+  .ilen = 19,
+  .plen = 0,
+  .slen = 2,
+  .code = (uint8_t *)prelink_code_9,
+  .ptr_to_sym = (uint8_t *)prelink_syms_9,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_9,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_9,
+#endif
+};
+
+/* irep 8 */
+static const uint8_t prelink_code_8[] = {
+  0x33,0x00,0x00,0x01,0x10,0x03,0x2e,0x03,0x00,0x00,0x01,0x02,0x03,0x10,0x03,0x01,
+  0x04,0x01,0x2f,0x03,0x01,0x00,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x00,0x00,0x41,
+  0x03,0x23,0x03,0x00,0x2a,0x0f,0x03,0x21,0x00,0x2c,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_8[] = {
+  0x00,0x00,0x00,0x02,0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,0x00,0x09,0x64,
+  0x65,0x6c,0x65,0x74,0x65,0x5f,0x69,0x66,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_8[] = {
+  MRBC_SYMID_length,
+  MRBC_SYMID_delete_if,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_8[2];
+#endif
+static const mrbc_irep prelink_irep_8 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 6,
+  .rlen = 0,
+  .ilen = 46,
+  .plen = 0,
+  .slen = 2,
+  .code = (uint8_t *)prelink_code_8,
+  .ptr_to_sym = (uint8_t *)prelink_syms_8,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_8,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_8,
+#endif
+};
+
+/* irep 7 */
+static const uint8_t prelink_code_7[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x26,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x01,0x05,0x02,0x3a,0x03,0x00,0x00,0x2e,0x03,0x01,0x02,0x01,0x03,0x02,
+  0x3c,0x03,0x01,0x01,0x02,0x03,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x02,0x00,0x42,
+  0x03,0x22,0x03,0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_7[] = {
+  0x00,0x00,0x00,0x03,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_7[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_7[3];
+#endif
+static const mrbc_irep prelink_irep_7 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 57,
+  .plen = 0,
+  .slen = 3,
+  .code = (uint8_t *)prelink_code_7,
+  .ptr_to_sym = (uint8_t *)prelink_syms_7,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_7,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_7,
+#endif
+};
+
+/* irep 6 */
+static const uint8_t prelink_code_6[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x1d,0x01,0x04,0x02,0x3a,0x03,0x00,0x00,
+  0x2e,0x03,0x00,0x01,0x01,0x03,0x02,0x3c,0x03,0x01,0x01,0x02,0x03,0x01,0x03,0x02,
+  0x10,0x04,0x2e,0x04,0x01,0x00,0x42,0x03,0x22,0x03,0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_6[] = {
+  0x00,0x00,0x00,0x02,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,0x00,0x06,0x6c,0x65,0x6e,
+  0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_6[] = {
+  MRBC_SYMID_call,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_6[2];
+#endif
+static const mrbc_irep prelink_irep_6 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 6,
+  .rlen = 0,
+  .ilen = 48,
+  .plen = 0,
+  .slen = 2,
+  .code = (uint8_t *)prelink_code_6,
+  .ptr_to_sym = (uint8_t *)prelink_syms_6,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_6,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_6,
+#endif
+};
+
+/* irep 5 */
+static const uint8_t prelink_code_5[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x23,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x3a,0x03,0x00,0x00,0x2e,0x03,0x01,0x01,0x01,0x03,0x02,0x3c,0x03,0x01,
+  0x01,0x02,0x03,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x02,0x00,0x42,0x03,0x22,0x03,
+  0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_5[] = {
+  0x00,0x00,0x00,0x03,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_5[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_5[3];
+#endif
+static const mrbc_irep prelink_irep_5 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 54,
+  .plen = 0,
+  .slen = 3,
+  .code = (uint8_t *)prelink_code_5,
+  .ptr_to_sym = (uint8_t *)prelink_syms_5,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_5,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_5,
+#endif
+};
+
+/* irep 4 */
+static const uint8_t prelink_code_4[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x33,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x3a,0x03,0x00,0x00,0x2e,0x03,0x01,0x01,0x23,0x03,0x00,0x2a,0x10,0x03,
+  0x01,0x04,0x02,0x2e,0x03,0x02,0x01,0x21,0x00,0x33,0x01,0x03,0x02,0x3c,0x03,0x01,
+  0x01,0x02,0x03,0x01,0x03,0x02,0x10,0x04,0x2e,0x04,0x03,0x00,0x42,0x03,0x22,0x03,
+  0x00,0x09,0x10,0x03,0x37,0x03,
+};
+static const uint8_t prelink_syms_4[] = {
+  0x00,0x00,0x00,0x04,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x09,0x64,0x65,0x6c,0x65,0x74,0x65,0x5f,0x61,0x74,0x00,0x00,0x06,0x6c,0x65,
+  0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_4[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_delete_at,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_4[4];
+#endif
+static const mrbc_irep prelink_irep_4 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 7,
+  .rlen = 0,
+  .ilen = 70,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_4,
+  .ptr_to_sym = (uint8_t *)prelink_syms_4,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_4,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_4,
+#endif
+};
+
+/* irep 3 */
+static const uint8_t prelink_code_3[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x21,0x00,0x2f,0x10,0x04,0x01,0x05,0x02,0x2e,0x04,
+  0x00,0x01,0x3a,0x03,0x00,0x00,0x2e,0x03,0x01,0x01,0x10,0x04,0x01,0x05,0x02,0x01,
+  0x06,0x03,0x2e,0x04,0x02,0x02,0x01,0x03,0x02,0x3c,0x03,0x01,0x01,0x02,0x03,0x01,
+  0x03,0x02,0x10,0x04,0x2e,0x04,0x03,0x00,0x42,0x03,0x22,0x03,0x00,0x09,0x10,0x03,
+  0x37,0x03,
+};
+static const uint8_t prelink_syms_3[] = {
+  0x00,0x00,0x00,0x04,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x03,0x5b,0x5d,0x3d,0x00,0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_3[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_BLL_BLR_EQ,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_3[4];
+#endif
+static const mrbc_irep prelink_irep_3 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 3,
+  .nregs = 8,
+  .rlen = 0,
+  .ilen = 66,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_3,
+  .ptr_to_sym = (uint8_t *)prelink_syms_3,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_3,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_3,
+#endif
+};
+
+/* irep 2 */
+static const uint8_t prelink_code_2[] = {
+  0x33,0x00,0x00,0x00,0x06,0x02,0x46,0x04,0x00,0x01,0x03,0x04,0x21,0x00,0x36,0x10,
+  0x05,0x01,0x06,0x02,0x2e,0x05,0x00,0x01,0x3a,0x04,0x00,0x00,0x2e,0x04,0x01,0x01,
+  0x01,0x05,0x03,0x01,0x06,0x02,0x01,0x07,0x04,0x2e,0x05,0x02,0x02,0x01,0x04,0x02,
+  0x3c,0x04,0x01,0x01,0x02,0x04,0x01,0x04,0x02,0x10,0x05,0x2e,0x05,0x03,0x00,0x42,
+  0x04,0x22,0x04,0x00,0x0f,0x37,0x03,
+};
+static const uint8_t prelink_syms_2[] = {
+  0x00,0x00,0x00,0x04,0x00,0x02,0x5b,0x5d,0x00,0x00,0x04,0x63,0x61,0x6c,0x6c,0x00,
+  0x00,0x03,0x5b,0x5d,0x3d,0x00,0x00,0x06,0x6c,0x65,0x6e,0x67,0x74,0x68,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_2[] = {
+  MRBC_SYMID_BLL_BLR,
+  MRBC_SYMID_call,
+  MRBC_SYMID_BLL_BLR_EQ,
+  MRBC_SYMID_length,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_2[4];
+#endif
+static const mrbc_irep prelink_irep_2 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 4,
+  .nregs = 9,
+  .rlen = 0,
+  .ilen = 71,
+  .plen = 0,
+  .slen = 4,
+  .code = (uint8_t *)prelink_code_2,
+  .ptr_to_sym = (uint8_t *)prelink_syms_2,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_2,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_2,
+#endif
+};
+
+/* irep 1 */
+static const uint8_t prelink_code_1[] = {
+  0x61,0x01,0x56,0x02,0x00,0x5d,0x01,0x00,0x5e,0x01,0x00,0x61,0x01,0x56,0x02,0x01,
+  0x5d,0x01,0x02,0x5e,0x03,0x02,0x61,0x01,0x56,0x02,0x02,0x5d,0x01,0x04,0x61,0x01,
+  0x56,0x02,0x03,0x5d,0x01,0x05,0x61,0x01,0x56,0x02,0x04,0x5d,0x01,0x06,0x61,0x01,
+  0x56,0x02,0x05,0x5d,0x01,0x07,0x61,0x01,0x56,0x02,0x06,0x5d,0x01,0x08,0x61,0x01,
+  0x56,0x02,0x07,0x5d,0x01,0x09,0x61,0x01,0x56,0x02,0x08,0x5d,0x01,0x0a,0x61,0x01,
+  0x56,0x02,0x09,0x5d,0x01,0x0b,0x0e,0x01,0x0b,0x37,0x01,
+};
+static const uint8_t prelink_syms_1[] = {
+  0x00,0x00,0x00,0x0c,0x00,0x07,0x63,0x6f,0x6c,0x6c,0x65,0x63,0x74,0x00,0x00,0x03,
+  0x6d,0x61,0x70,0x00,0x00,0x08,0x63,0x6f,0x6c,0x6c,0x65,0x63,0x74,0x21,0x00,0x00,
+  0x04,0x6d,0x61,0x70,0x21,0x00,0x00,0x09,0x64,0x65,0x6c,0x65,0x74,0x65,0x5f,0x69,
+  0x66,0x00,0x00,0x04,0x65,0x61,0x63,0x68,0x00,0x00,0x0a,0x65,0x61,0x63,0x68,0x5f,
+  0x69,0x6e,0x64,0x65,0x78,0x00,0x00,0x0f,0x65,0x61,0x63,0x68,0x5f,0x77,0x69,0x74,
+  0x68,0x5f,0x69,0x6e,0x64,0x65,0x78,0x00,0x00,0x07,0x72,0x65,0x6a,0x65,0x63,0x74,
+  0x21,0x00,0x00,0x06,0x72,0x65,0x6a,0x65,0x63,0x74,0x00,0x00,0x05,0x73,0x6f,0x72,
+  0x74,0x21,0x00,0x00,0x04,0x73,0x6f,0x72,0x74,0x00,
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_1[] = {
+  MRBC_SYMID_collect,
+  MRBC_SYMID_map,
+  MRBC_SYMID_collect_EXC,
+  MRBC_SYMID_map_EXC,
+  MRBC_SYMID_delete_if,
+  MRBC_SYMID_each,
+  MRBC_SYMID_each_index,
+  MRBC_SYMID_each_with_index,
+  MRBC_SYMID_reject_EXC,
+  MRBC_SYMID_reject,
+  MRBC_SYMID_sort_EXC,
+  MRBC_SYMID_sort,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_1[12];
+#endif
+static mrbc_irep * const prelink_reps_1[] = {
+  (mrbc_irep *)&prelink_irep_2,
+  (mrbc_irep *)&prelink_irep_3,
+  (mrbc_irep *)&prelink_irep_4,
+  (mrbc_irep *)&prelink_irep_5,
+  (mrbc_irep *)&prelink_irep_6,
+  (mrbc_irep *)&prelink_irep_7,
+  (mrbc_irep *)&prelink_irep_8,
+  (mrbc_irep *)&prelink_irep_9,
+  (mrbc_irep *)&prelink_irep_10,
+  (mrbc_irep *)&prelink_irep_11,
+};
+static const mrbc_irep prelink_irep_1 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 10,
+  .ilen = 91,
+  .plen = 0,
+  .slen = 12,
+  .code = (uint8_t *)prelink_code_1,
+  .ptr_to_sym = (uint8_t *)prelink_syms_1,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_1,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_1,
+#endif
+  .reps = (struct IREP **)prelink_reps_1,
+};
+
+/* irep 0 */
+static const uint8_t prelink_code_0[] = {
+  0x0f,0x01,0x0f,0x02,0x5a,0x01,0x00,0x5c,0x01,0x00,0x4f,0x01,0x00,0x1c,0x01,0x01,
+  0x4f,0x01,0x01,0x1c,0x01,0x02,0x0f,0x01,0x0f,0x02,0x5a,0x01,0x03,0x5c,0x01,0x01,
+  0x0f,0x01,0x0f,0x02,0x5a,0x01,0x04,0x5c,0x01,0x02,0x0f,0x01,0x0f,0x02,0x5a,0x01,
+  0x05,0x5c,0x01,0x03,0x0f,0x01,0x0f,0x02,0x5a,0x01,0x06,0x5c,0x01,0x04,0x0f,0x01,
+  0x0f,0x02,0x5a,0x01,0x07,0x5c,0x01,0x05,0x37,0x01,0x67,
+};
+static const uint8_t prelink_syms_0[] = {
+  0x00,0x00,0x00,0x08,0x00,0x05,0x41,0x72,0x72,0x61,0x79,0x00,0x00,0x0c,0x52,0x55,
+  0x42,0x59,0x5f,0x56,0x45,0x52,0x53,0x49,0x4f,0x4e,0x00,0x00,0x0e,0x4d,0x52,0x55,
+  0x42,0x59,0x43,0x5f,0x56,0x45,0x52,0x53,0x49,0x4f,0x4e,0x00,0x00,0x04,0x48,0x61,
+  0x73,0x68,0x00,0x00,0x06,0x46,0x69,0x78,0x6e,0x75,0x6d,0x00,0x00,0x06,0x4f,0x62,
+  0x6a,0x65,0x63,0x74,0x00,0x00,0x05,0x52,0x61,0x6e,0x67,0x65,0x00,0x00,0x06,0x53,
+  0x74,0x72,0x69,0x6e,0x67,0x00,
+};
+#if MRBC_USE_STRING
+static const uint8_t prelink_str_0_0[] = {
+  0x00,0x03,0x31,0x2e,0x39,0x00,
+};
+static const uint8_t prelink_str_0_1[] = {
+  0x00,0x03,0x32,0x2e,0x31,0x00,
+};
+#endif
+static const mrbc_object prelink_pool_0[] = {
+#if MRBC_USE_STRING
+  {.tt = MRBC_TT_STRING, .str = (const char *)prelink_str_0_0 + 2},
+#else
+  {.tt = MRBC_TT_NIL},	// OP_STRING is not supported.
+#endif
+#if MRBC_USE_STRING
+  {.tt = MRBC_TT_STRING, .str = (const char *)prelink_str_0_1 + 2},
+#else
+  {.tt = MRBC_TT_NIL},	// OP_STRING is not supported.
+#endif
+};
+#if MRBC_USE_IREP_SYMBOL_TABLE
+static const mrbc_sym prelink_symid_0[] = {
+  MRBC_SYMID_Array,
+  MRBC_SYMID_RUBY_VERSION,
+  MRBC_SYMID_MRUBYC_VERSION,
+  MRBC_SYMID_Hash,
+  MRBC_SYMID_Fixnum,
+  MRBC_SYMID_Object,
+  MRBC_SYMID_Range,
+  MRBC_SYMID_String,
+};
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+static mrbc_method_cache prelink_mcache_0[8];
+#endif
+static mrbc_irep * const prelink_reps_0[] = {
+  (mrbc_irep *)&prelink_irep_1,
+  (mrbc_irep *)&prelink_irep_12,
+  (mrbc_irep *)&prelink_irep_14,
+  (mrbc_irep *)&prelink_irep_16,
+  (mrbc_irep *)&prelink_irep_18,
+  (mrbc_irep *)&prelink_irep_20,
+};
+static const mrbc_irep prelink_irep_0 = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nlocals = 1,
+  .nregs = 3,
+  .rlen = 6,
+  .ilen = 75,
+  .plen = 2,
+  .slen = 8,
+  .code = (uint8_t *)prelink_code_0,
+  .pools = (mrbc_object *)prelink_pool_0,
+  .ptr_to_sym = (uint8_t *)prelink_syms_0,
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  .sym_ids = (mrbc_sym *)prelink_symid_0,
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  .method_cache = prelink_mcache_0,
+#endif
+  .reps = (struct IREP **)prelink_reps_0,
+};
+
+const mrbc_prelinked_image mrblib_image = {
+  .ident = MRBC_PRELINK_IDENT,
+  .irep = &prelink_irep_0,
+};
@@ -31,6 +31,10 @@
 #include "c_numeric.h"
 #include "c_range.h"
 #include "c_string.h"
+#include "c_packed_array.h"
+#include "c_serialize.h"
+#include "gc.h"
+#include "snapshot.h"
 
 #include "load.h"
 #include "console.h"
@@ -163,6 +163,23 @@ enum OPCODE {
   OP_STOP	= 0x67,	//!< Z    stop VM
 
   OP_ABORT	= 0x68, // only for mruby/c, TODO: remove
+
+  // superinstructions. (only for mruby/c)
+  //  These are not emitted by the compiler, but rewritten from the pair
+  //  of opcodes at load time. see MRBC_USE_SUPERINSTRUCTION.
+  OP_EQ_JMPIF	= 0x69,	//!< B(BS) R(a) = R(a)==R(a+1); if R(a) pc=b
+  OP_EQ_JMPNOT	= 0x6a,	//!< B(BS) R(a) = R(a)==R(a+1); if !R(a) pc=b
+  OP_LT_JMPIF	= 0x6b,	//!< B(BS) R(a) = R(a)<R(a+1); if R(a) pc=b
+  OP_LT_JMPNOT	= 0x6c,	//!< B(BS) R(a) = R(a)<R(a+1); if !R(a) pc=b
+  OP_LE_JMPIF	= 0x6d,	//!< B(BS) R(a) = R(a)<=R(a+1); if R(a) pc=b
+  OP_LE_JMPNOT	= 0x6e,	//!< B(BS) R(a) = R(a)<=R(a+1); if !R(a) pc=b
+  OP_GT_JMPIF	= 0x6f,	//!< B(BS) R(a) = R(a)>R(a+1); if R(a) pc=b
+  OP_GT_JMPNOT	= 0x70,	//!< B(BS) R(a) = R(a)>R(a+1); if !R(a) pc=b
+  OP_GE_JMPIF	= 0x71,	//!< B(BS) R(a) = R(a)>=R(a+1); if R(a) pc=b
+  OP_GE_JMPNOT	= 0x72,	//!< B(BS) R(a) = R(a)>=R(a+1); if !R(a) pc=b
+
+  // native iterator step. (only for mruby/c, see MRBC_USE_NATIVE_ITERATOR)
+  OP_NATIVE_ITER = 0x73, //!< Z    yield the next element, or fall through
 };
 
 //================================================================
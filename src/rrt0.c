@@ -11,6 +11,7 @@
 */
 
 /***** Feature test switches ************************************************/
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_VM
 /***** System headers *******************************************************/
 #include "vm_config.h"
 #include <stddef.h>
@@ -29,7 +30,10 @@
 #include "vm.h"
 #include "console.h"
 #include "rrt0.h"
+#include "gc.h"
+#include "c_hash.h"
 #include "hal_selector.h"
+#include "snapshot.h"
 
 
 /***** Macros ***************************************************************/
@@ -38,23 +42,168 @@
 #endif
 
 #define VM2TCB(p) ((mrbc_tcb *)((uint8_t *)p - offsetof(mrbc_tcb, vm)))
+#define READY_QUEUE_LEVEL(pri) ((pri) / (256 / MRBC_READY_QUEUE_LEVELS))
+
+#if MRBC_READY_QUEUE_LEVELS < 1 || MRBC_READY_QUEUE_LEVELS > 32 || \
+    (256 % MRBC_READY_QUEUE_LEVELS) != 0
+#error "MRBC_READY_QUEUE_LEVELS must be 1, 2, 4, 8, 16 or 32."
+#endif
+
+#if MRBC_SMP_CORES > 1
+#define TCB_CORE(p) ((p)->core)
+#if defined(MRBC_NO_TIMER) || defined(MRBC_TICKLESS)
+#error "MRBC_SMP_CORES needs the timer, and can't use MRBC_TICKLESS."
+#endif
+#else
+#define TCB_CORE(p) 0
+#endif
 #define MRBC_MUTEX_TRACE(...) ((void)0)
 
+#if MRBC_USE_THREAD_CONTEXT && (MRBC_SMP_CORES > 1 || !defined(MRBC_NO_TIMER))
+#error "MRBC_USE_THREAD_CONTEXT needs MRBC_NO_TIMER, and can't be used with MRBC_SMP_CORES."
+#endif
+
+#if MRBC_NUM_EVENTS > 256
+#error "MRBC_NUM_EVENTS must be 256 or less."
+#endif
+
+#if MRBC_USE_TASK_STATS
+#define STATS_SET_READY(p) ((p)->ready_tick = tick_)
+#else
+#define STATS_SET_READY(p) ((void)0)
+#endif
+
 
 /***** Typedefs *************************************************************/
+#if MRBC_NUM_EVENTS > 0
+//================================================
+/*!@brief
+  Interrupt event, signaled while no task waits for it.
+*/
+typedef struct REvent {
+  uint16_t n_pending;	//!< # of signals not received yet.
+  mrbc_int param;	//!< parameter of the last signal.
+} mrbc_event;
+#endif
+
+#if MRBC_USE_HOT_RELOAD
+//================================================
+/*!@brief
+  Old irep tree replaced by the hot reload, to be freed.
+*/
+typedef struct RRetiredIrep {
+  mrbc_irep *irep;
+  mrbc_tcb *tcb;		//!< reloaded task.
+  const uint8_t *vm_code;	//!< old byte code, or NULL if from a stream.
+} mrbc_retired_irep;
+#endif
+
+
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
-static mrbc_tcb *q_dormant_;
-static mrbc_tcb *q_ready_;
-static mrbc_tcb *q_waiting_;
-static mrbc_tcb *q_suspended_;
-static volatile uint32_t tick_;
+static MRBC_CONTEXT_LOCAL mrbc_tcb *q_dormant_;
+static MRBC_CONTEXT_LOCAL mrbc_tcb *q_ready_[MRBC_SMP_CORES][MRBC_READY_QUEUE_LEVELS];
+static MRBC_CONTEXT_LOCAL uint32_t q_ready_map_[MRBC_SMP_CORES];	//!< bit n is set if q_ready_[][n] is not empty.
+static MRBC_CONTEXT_LOCAL mrbc_tcb *running_tcb_[MRBC_SMP_CORES];
+static MRBC_CONTEXT_LOCAL mrbc_tcb *q_waiting_;
+static MRBC_CONTEXT_LOCAL mrbc_tcb *q_sleeping_;
+static MRBC_CONTEXT_LOCAL mrbc_tcb *q_suspended_;
+static MRBC_CONTEXT_LOCAL volatile uint32_t tick_;
+#if MRBC_USE_HOT_RELOAD
+static MRBC_CONTEXT_LOCAL mrbc_retired_irep retired_irep_[MRBC_HOT_RELOAD_MAX_RETIRED];
+static MRBC_CONTEXT_LOCAL int n_retired_irep_;
+static MRBC_CONTEXT_LOCAL mrbc_reload_release_func reload_release_func_;
+#endif
+#if MRBC_USE_TASK_STATS
+static MRBC_CONTEXT_LOCAL uint32_t latency_hist_[MRBC_LATENCY_HIST_SIZE];
+#endif
+#if MRBC_NUM_EVENTS > 0
+static MRBC_CONTEXT_LOCAL mrbc_event events_[MRBC_NUM_EVENTS];
+static MRBC_CONTEXT_LOCAL uint32_t event_max_latency_;	//!< by MRBC_EVENT_CLOCK.
+#endif
+#if MRBC_PROFILER_INTERVAL > 0
+static MRBC_CONTEXT_LOCAL mrbc_profile_sample prof_buf_[MRBC_PROFILER_SAMPLES];
+static MRBC_CONTEXT_LOCAL uint16_t prof_wp_;		//!< write point.
+static MRBC_CONTEXT_LOCAL uint16_t prof_n_;		//!< # of samples in prof_buf_.
+static MRBC_CONTEXT_LOCAL uint16_t prof_countdown_;	//!< ticks to the next sample, or 0 if stopped.
+static MRBC_CONTEXT_LOCAL uint32_t prof_dropped_;		//!< # of samples overwritten.
+#endif
 
 
 /***** Global variables *****************************************************/
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
 
+//================================================================
+/*! Find the lowest set bit.
+
+  @param        x	non zero value.
+  @return       bit number.
+ */
+static inline int lowest_bit(uint32_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctz(x);
+#else
+  static const uint8_t debruijn[32] = {
+     0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+    31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9 };
+  return debruijn[((x & -x) * 0x077CB531U) >> 27];
+#endif
+}
+
+
+//================================================================
+/*! Get the queue that the task should be in.
+
+  @param        Pointer of target TCB
+  @return       Pointer to the top of queue.
+ */
+static mrbc_tcb ** q_of_task(const mrbc_tcb *p_tcb)
+{
+  switch( p_tcb->state ) {
+  case TASKSTATE_DORMANT:	return &q_dormant_;
+  case TASKSTATE_READY:
+  case TASKSTATE_RUNNING:
+    return &q_ready_[TCB_CORE(p_tcb)][READY_QUEUE_LEVEL(p_tcb->priority_preemption)];
+  case TASKSTATE_WAITING:
+    return (p_tcb->reason == TASKREASON_SLEEP) ? &q_sleeping_ : &q_waiting_;
+  case TASKSTATE_SUSPENDED:	return &q_suspended_;
+  default:
+    assert(!"Wrong task state.");
+    return NULL;
+  }
+}
+
+
+//================================================================
+/*! Get the top of ready queue.
+
+  @param        core	core number.
+  @return       Pointer of the highest priority ready TCB, or NULL.
+ */
+static inline mrbc_tcb * q_ready_top(int core)
+{
+  if( q_ready_map_[core] == 0 ) return NULL;
+  return q_ready_[core][ lowest_bit(q_ready_map_[core]) ];
+}
+
+
+//================================================================
+/*! Check all queues are empty, except the dormant.
+
+  @return       1 if empty.
+ */
+static int q_is_all_empty(void)
+{
+  int i;
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    if( q_ready_map_[i] != 0 ) return 0;
+  }
+  return q_waiting_ == NULL && q_sleeping_ == NULL && q_suspended_ == NULL;
+}
+
+
 //================================================================
 /*! Insert to task queue
 
@@ -64,45 +213,63 @@ static volatile uint32_t tick_;
   TCBはフリーの状態でなければならない。（別なQueueに入っていてはならない）
   Queueはpriority_preemption順にソート済みとなる。
   挿入するTCBとQueueに同じpriority_preemption値がある場合は、同値の最後に挿入される。
+  スリープ中のタスクは、起床時刻(wakeup_tick)順のQueueに入れる。
+
+  Queueは双方向リストで、先頭のprevは末尾を指す。
+  末尾から挿入位置を探すので、同じ優先度のタスクばかりならO(1)となる。
+  readyキューは優先度毎に分割し、空でないキューをビットマップで管理する。
 
  */
 static void q_insert_task(mrbc_tcb *p_tcb)
 {
-  mrbc_tcb **pp_q;
+  mrbc_tcb **pp_q = q_of_task(p_tcb);
+  if( pp_q == NULL ) return;
+  mrbc_tcb *top = *pp_q;
 
-  switch( p_tcb->state ) {
-  case TASKSTATE_DORMANT: pp_q   = &q_dormant_; break;
-  case TASKSTATE_READY:
-  case TASKSTATE_RUNNING: pp_q   = &q_ready_; break;
-  case TASKSTATE_WAITING: pp_q   = &q_waiting_; break;
-  case TASKSTATE_SUSPENDED: pp_q = &q_suspended_; break;
-  default:
-    assert(!"Wrong task state.");
-    return;
+  if( p_tcb->state & TASKSTATE_READY ) {
+    q_ready_map_[TCB_CORE(p_tcb)] |=
+      1UL << READY_QUEUE_LEVEL(p_tcb->priority_preemption);
   }
 
-  // case insert on top.
-  if((*pp_q == NULL) ||
-     (p_tcb->priority_preemption < (*pp_q)->priority_preemption)) {
-    p_tcb->next = *pp_q;
-    *pp_q       = p_tcb;
-    assert(p_tcb->next != p_tcb);
+  // case empty queue.
+  if( top == NULL ) {
+    p_tcb->next = NULL;
+    p_tcb->prev = p_tcb;
+    *pp_q = p_tcb;
     return;
   }
 
-  // find insert point in sorted linked list.
-  mrbc_tcb *p = *pp_q;
-  while( 1 ) {
-    if((p->next == NULL) ||
-       (p_tcb->priority_preemption < p->next->priority_preemption)) {
-      p_tcb->next = p->next;
-      p->next     = p_tcb;
-      assert(p->next != p);
-      return;
+  // find insert point from the tail.
+  mrbc_tcb *p = top->prev;
+  if( pp_q == &q_sleeping_ ) {
+    // tickのオーバーフローを考慮し、差分で比較する。
+    while( (int32_t)(p->wakeup_tick - p_tcb->wakeup_tick) > 0 ) {
+      if( p == top ) goto INSERT_TOP;
+      p = p->prev;
+    }
+  } else {
+    while( p->priority_preemption > p_tcb->priority_preemption ) {
+      if( p == top ) goto INSERT_TOP;
+      p = p->prev;
     }
+  }
 
-    p = p->next;
+  // insert after p.
+  p_tcb->next = p->next;
+  p_tcb->prev = p;
+  if( p->next ) {
+    p->next->prev = p_tcb;
+  } else {
+    top->prev = p_tcb;			// new tail.
   }
+  p->next = p_tcb;
+  return;
+
+ INSERT_TOP:
+  p_tcb->next = top;
+  p_tcb->prev = top->prev;
+  top->prev   = p_tcb;
+  *pp_q = p_tcb;
 }
 
 
@@ -116,37 +283,377 @@ static void q_insert_task(mrbc_tcb *p_tcb)
  */
 static void q_delete_task(mrbc_tcb *p_tcb)
 {
-  mrbc_tcb **pp_q;
+  if( p_tcb->prev == NULL ) return;	// not in queue.
 
-  switch( p_tcb->state ) {
-  case TASKSTATE_DORMANT: pp_q   = &q_dormant_; break;
-  case TASKSTATE_READY:
-  case TASKSTATE_RUNNING: pp_q   = &q_ready_; break;
-  case TASKSTATE_WAITING: pp_q   = &q_waiting_; break;
-  case TASKSTATE_SUSPENDED: pp_q = &q_suspended_; break;
-  default:
-    assert(!"Wrong task state.");
-    return;
+  mrbc_tcb **pp_q = q_of_task(p_tcb);
+  if( pp_q == NULL ) return;
+  mrbc_tcb *top = *pp_q;
+
+  if( p_tcb == top ) {
+    *pp_q = p_tcb->next;
+    if( p_tcb->next ) p_tcb->next->prev = p_tcb->prev;
+  } else {
+    p_tcb->prev->next = p_tcb->next;
+    if( p_tcb->next ) {
+      p_tcb->next->prev = p_tcb->prev;
+    } else {
+      top->prev = p_tcb->prev;		// new tail.
+    }
   }
+  p_tcb->next = NULL;
+  p_tcb->prev = NULL;
 
-  if( *pp_q == NULL ) return;
-  if( *pp_q == p_tcb ) {
-    *pp_q       = p_tcb->next;
-    p_tcb->next = NULL;
-    return;
+  if( (p_tcb->state & TASKSTATE_READY) && *pp_q == NULL ) {
+    q_ready_map_[TCB_CORE(p_tcb)] &=
+      ~(1UL << READY_QUEUE_LEVEL(p_tcb->priority_preemption));
   }
+}
+
+
+//================================================================
+/*! Request the running task to give up the CPU.
+
+  @param        Pointer of TCB that became ready.
+
+  指定タスクが入ったreadyキューのコアで、実行中のタスクに切り替えを要求する。
+  割り込み禁止状態で呼ぶこと。
+ */
+static inline void preempt_running_task(const mrbc_tcb *p_tcb)
+{
+  mrbc_tcb *running = running_tcb_[TCB_CORE(p_tcb)];
+  if( running != NULL ) running->vm.flag_preemption = 1;
+}
+
+
+#if MRBC_SMP_CORES > 1
+//================================================================
+/*! Steal a ready task from the other cores.
+
+  @param        core	core number of the thief.
+  @return       Pointer of stolen TCB, or NULL.
 
-  mrbc_tcb *p = *pp_q;
-  while( p ) {
-    if( p->next == p_tcb ) {
-      p->next     = p_tcb->next;
-      p_tcb->next = NULL;
-      return;
+  他のコアのreadyキューから、実行中でない最も優先度の高いタスクを
+  自コアのreadyキューへ移す。
+  割り込み禁止状態で呼ぶこと。
+ */
+static mrbc_tcb * q_steal_task(int core)
+{
+  mrbc_tcb *found = NULL;
+  int i;
+
+  for( i = 1; i < MRBC_SMP_CORES; i++ ) {
+    int victim = (core + i) % MRBC_SMP_CORES;
+    uint32_t map = q_ready_map_[victim];
+
+    while( map != 0 ) {
+      mrbc_tcb *p = q_ready_[victim][ lowest_bit(map) ];
+      if( p == running_tcb_[victim] ) p = p->next;
+      if( p != NULL ) {
+        if( found == NULL ||
+            p->priority_preemption < found->priority_preemption ) found = p;
+        break;
+      }
+      map &= map - 1;
     }
+  }
+  if( found == NULL ) return NULL;
 
-    p = p->next;
+  q_delete_task(found);
+  found->core = core;
+  q_insert_task(found);
+
+  return found;
+}
+#endif
+
+
+//================================================================
+/*! Check the wakeup time of the top of sleeping queue has come.
+
+  @return       1 if it has come.
+
+  割り込み禁止状態で呼ぶこと。
+ */
+static inline int q_sleeping_top_is_due(void)
+{
+  return q_sleeping_ != NULL &&
+	 (int32_t)(tick_ - q_sleeping_->wakeup_tick) >= 0;
+}
+
+
+//================================================================
+/*! Wakeup the task at the top of sleeping queue.
+
+  割り込み禁止状態で呼ぶこと。
+ */
+static void q_wakeup_sleeping_top(void)
+{
+  mrbc_tcb *tcb = q_sleeping_;
+  q_delete_task(tcb);
+  tcb->state     = TASKSTATE_READY;
+  tcb->timeslice = MRBC_TIMESLICE_TICK_COUNT;
+  STATS_SET_READY(tcb);
+  q_insert_task(tcb);
+  preempt_running_task(tcb);
+}
+
+
+#if !MRBC_USE_REALTIME
+//================================================================
+/*! Wakeup the tasks whose wakeup time has come.
+
+  起床時刻順のスリープキューから、起床時刻を過ぎたタスクを起こす。
+  割り込み禁止状態で呼ぶこと。
+ */
+static void q_wakeup_sleeping_tasks(void)
+{
+  while( q_sleeping_top_is_due() ) {
+    q_wakeup_sleeping_top();
+  }
+}
+
+#else
+//================================================================
+/*! Wakeup the tasks whose wakeup time has come, one by one.
+
+  q_wakeup_sleeping_tasks()と同じだが、１タスク毎に割り込みを許可する。
+  割り込み禁止時間が、起床するタスク数に依らず一定となる。
+  スケジューラから、割り込み許可状態で呼ぶこと。
+ */
+static void wakeup_sleeping_tasks(void)
+{
+  while( 1 ) {
+    hal_disable_irq();
+    int flag_due = q_sleeping_top_is_due();
+    if( flag_due ) q_wakeup_sleeping_top();
+    hal_enable_irq();
+    if( !flag_due ) return;
+  }
+}
+#endif
+
+
+//================================================================
+/*! Change the priority_preemption of the task.
+
+  @param        p_tcb		Pointer of target TCB
+  @param        priority	new priority_preemption.
+
+  タスクを入っているQueueの正しい位置へ移す。
+  割り込み禁止状態で呼ぶこと。
+ */
+static void q_change_priority_preemption(mrbc_tcb *p_tcb, int priority)
+{
+  if( p_tcb->priority_preemption == priority ) return;
+
+  q_delete_task(p_tcb);
+  p_tcb->priority_preemption = priority;
+  q_insert_task(p_tcb);
+}
+
+
+//================================================================
+/*! Get the priority that the task should run.
+
+  @param        p_tcb	Pointer of target TCB
+  @return       own priority, or the highest one of the tasks waiting
+                for the mutexes that it holds. (priority inheritance)
+
+  待ちキューは優先度順なので、最初に見つかったタスクの優先度を使う。
+  割り込み禁止状態で呼ぶこと。
+ */
+static int inherited_priority(const mrbc_tcb *p_tcb)
+{
+  const mrbc_tcb *p;
+  for( p = q_waiting_; p != NULL; p = p->next ) {
+    if( p->priority_preemption >= p_tcb->priority ) break;
+    if( p->reason == TASKREASON_MUTEX && p->mutex->tcb == p_tcb ) {
+      return p->priority_preemption;
+    }
+  }
+
+  return p_tcb->priority;
+}
+
+
+//================================================================
+/*! Send the value to the queue.
+
+  @param        queue	pointer to the queue.
+  @param        value	pointer to the value.
+  @retval       0	sent.
+  @retval       1	the queue is full.
+
+  受信待ちのタスクがあれば、値を直接渡して起こす。
+  割り込み禁止状態で呼ぶこと。
+ */
+static int queue_send(mrbc_queue *queue, const mrbc_value *value)
+{
+  mrbc_tcb *tcb;
+  for( tcb = q_waiting_; tcb != NULL; tcb = tcb->next ) {
+    if( tcb->reason == TASKREASON_QUEUE && tcb->queue == queue ) {
+      *tcb->queue_value = *value;
+      q_delete_task(tcb);
+      tcb->state = TASKSTATE_READY;
+      STATS_SET_READY(tcb);
+      q_insert_task(tcb);
+      preempt_running_task(tcb);
+      return 0;
+    }
+  }
+
+  if( queue->n_stored >= queue->size ) return 1;
+
+  int tail = queue->head + queue->n_stored;
+  if( tail >= queue->size ) tail -= queue->size;
+  queue->data[tail] = *value;
+  queue->n_stored++;
+
+  return 0;
+}
+
+
+#if MRBC_NUM_EVENTS > 0
+//================================================================
+/*! Signal the event.
+
+  @param        event_no	event number.
+  @param        param		parameter for the handler.
+  @retval       0	the handler task is woken.
+  @retval       1	no task waits. the signal is kept pending.
+  @retval       -1	wrong event number.
+
+  待っているタスクを最高優先度でreadyにし、実行中のタスクに切り替えを
+  要求する。次の命令の境界で、ハンドラのタスクに切り替わる。
+  割り込み禁止状態で呼ぶこと。
+ */
+static int event_signal(int event_no, mrbc_int param)
+{
+  if( event_no < 0 || event_no >= MRBC_NUM_EVENTS ) return -1;
+
+  mrbc_tcb *tcb;
+  for( tcb = q_waiting_; tcb != NULL; tcb = tcb->next ) {
+    if( tcb->reason == TASKREASON_EVENT && tcb->event_no == event_no ) {
+      *tcb->event_value = mrbc_fixnum_value( param );
+      q_delete_task(tcb);
+      tcb->state = TASKSTATE_READY;
+      tcb->priority_preemption = 0;	// until it waits again.
+      tcb->flag_event_run = 1;
+      tcb->event_clock = MRBC_EVENT_CLOCK();
+      STATS_SET_READY(tcb);
+      q_insert_task(tcb);
+      preempt_running_task(tcb);
+      return 0;
+    }
+  }
+
+  mrbc_event *ev = &events_[event_no];
+  ev->param = param;
+  if( ev->n_pending != UINT16_MAX ) ev->n_pending++;
+
+  return 1;
+}
+
+
+//================================================================
+/*! Count the latency of the event handler that begins to run.
+
+  @param        p_tcb	Pointer of target TCB
+
+  割り込み禁止状態で呼ぶこと。
+ */
+static void event_begin_run(mrbc_tcb *p_tcb)
+{
+  uint32_t latency = MRBC_EVENT_CLOCK() - p_tcb->event_clock;
+  if( event_max_latency_ < latency ) event_max_latency_ = latency;
+  p_tcb->flag_event_run = 0;
+}
+#endif
+
+
+#if MRBC_PROFILER_INTERVAL > 0
+//================================================================
+/*! Record a profiler sample of the running VM.
+
+  @param  vm	pointer to the VM.
+
+  mrbc_tick() から、割り込み禁止状態で呼ぶこと。
+ */
+static void profiler_sample(const mrbc_vm *vm)
+{
+  const mrbc_irep *irep = vm->pc_irep;
+  mrbc_profile_sample *s = &prof_buf_[prof_wp_];
+
+  // the VM may be in the middle of switching irep and inst.
+  int inst = vm->inst - irep->code;
+  if( inst < 0 || inst > irep->ilen ) inst = 0xffff;
+
+  s->irep = irep;
+  s->inst = inst;
+  s->method_id = vm->callinfo_tail ? vm->callinfo_tail->method_id : 0;
+  s->vm_id = vm->vm_id;
+
+  if( ++prof_wp_ == MRBC_PROFILER_SAMPLES ) prof_wp_ = 0;
+  if( prof_n_ < MRBC_PROFILER_SAMPLES ) {
+    prof_n_++;
+  } else {
+    prof_dropped_++;
+  }
+}
+#endif
+
+
+#if MRBC_USE_TASK_STATS
+//================================================================
+/*! Count the latency of the task that begins to run.
+
+  @param        p_tcb	Pointer of target TCB
+
+  割り込み禁止状態で呼ぶこと。
+ */
+static void stats_begin_run(mrbc_tcb *p_tcb)
+{
+  uint32_t latency = tick_ - p_tcb->ready_tick;
+  if( p_tcb->stats.max_latency < latency ) p_tcb->stats.max_latency = latency;
+
+  int bin = 0;
+  while( latency != 0 && bin < MRBC_LATENCY_HIST_SIZE - 1 ) {
+    latency >>= 1;
+    bin++;
+  }
+  latency_hist_[bin]++;
+}
+#endif
+
+
+#if defined(MRBC_TICKLESS) && !defined(MRBC_NO_TIMER)
+//================================================================
+/*! Idle until the nearest wakeup time, with the tick stopped.
+
+  実行可能なタスクが無い時に呼ばれ、tickを止めて最も近い起床時刻まで
+  CPUを休止させる。経過したtick数だけtick_を進める。
+ */
+static void tickless_idle(void)
+{
+  hal_disable_irq();
+  uint32_t ticks = 0;		// 0: no wakeup time.
+  if( q_sleeping_ != NULL ) {
+    int32_t diff = (int32_t)(q_sleeping_->wakeup_tick - tick_);
+    ticks = (diff > 0) ? diff : 1;
   }
+  hal_enable_irq();
+
+  uint32_t elapsed = hal_idle_cpu_ticks(ticks);
+  if( elapsed == 0 ) return;
+
+  hal_disable_irq();
+  tick_ += elapsed;
+#if !MRBC_USE_REALTIME
+  q_wakeup_sleeping_tasks();		// else, by the scheduler.
+#endif
+  hal_enable_irq();
 }
+#endif
 
 
 //================================================================
@@ -315,59 +822,424 @@ static void c_mutex_trylock(mrbc_vm *vm, mrbc_value v[], int argc)
 
 
 //================================================================
-/*! vm tick
+/*! queue constructor method
+
+  Queue.new(size = 8)
 */
-static void c_vm_tick(mrbc_vm *vm, mrbc_value v[], int argc)
+static void c_queue_new(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  SET_INT_RETURN(tick_);
-}
-
+  int size = (argc >= 1 && v[1].tt == MRBC_TT_FIXNUM) ? GET_INT_ARG(1) : 8;
 
+  *v = mrbc_queue_new(vm, size);
+}
 
-/***** Global functions *****************************************************/
 
 //================================================================
-/*! Tick timer interrupt handler.
+/*! queue push method
 
+  Returns false if the queue is full.
+  The object should not be modified by the sender after the push.
 */
-void mrbc_tick(void)
+static void c_queue_push(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  mrbc_tcb *tcb;
-  int flag_preemption = 0;
+  mrbc_incref( &v[1] );
+  int r = mrbc_queue_send( mrbc_queue_ptr(v), &v[1] );
+  if( r != 0 ) mrbc_decref( &v[1] );
+
+  // a Proc refers to the frame of the VM.
+  if( r == 2 ) console_print( "TypeError\n" );	// raise?
+  SET_BOOL_RETURN( r == 0 );
+}
+
+
+//================================================================
+/*! queue pop method
+
+  Waits for a value if the queue is empty.
+*/
+static void c_queue_pop(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_queue *queue = mrbc_queue_ptr(v);
+  mrbc_value self = v[0];
+
+  // the value is stored in v[0] now, or when it arrives.
+  mrbc_set_nil( &v[0] );
+  mrbc_queue_receive( queue, &v[0], VM2TCB(vm) );
+  mrbc_decref( &self );
+}
+
+
+//================================================================
+/*! queue size method
+
+*/
+static void c_queue_size(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( mrbc_queue_ptr(v)->n_stored );
+}
+
+
+//================================================================
+/*! queue empty? method
+
+*/
+static void c_queue_empty(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_BOOL_RETURN( mrbc_queue_ptr(v)->n_stored == 0 );
+}
+
+
+#if MRBC_NUM_EVENTS > 0
+//================================================================
+/*! wait for the interrupt event
+
+  wait_event(n)  returns the parameter of the signal.
+*/
+static void c_wait_event(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc != 1 || v[1].tt != MRBC_TT_FIXNUM ) {
+    console_print( "ArgumentError\n" );	// raise?
+    SET_NIL_RETURN();
+    return;
+  }
+
+  int event_no = GET_INT_ARG(1);
+  mrbc_value self = v[0];
+
+  // the parameter is stored in v[0] now, or when it is signaled.
+  mrbc_set_nil( &v[0] );
+  if( mrbc_event_wait( event_no, &v[0], VM2TCB(vm) ) < 0 ) {
+    console_print( "ArgumentError\n" );
+  }
+  mrbc_decref( &self );
+}
+#endif
+
+
+#if MRBC_USE_REALTIME
+//================================================================
+/*! make the task periodic
+
+  set_period( period_ms, deadline_ms = period_ms )
+*/
+static void c_set_period(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || v[1].tt != MRBC_TT_FIXNUM ||
+      (argc >= 2 && v[2].tt != MRBC_TT_FIXNUM) ) {
+    console_print( "ArgumentError\n" );	// raise?
+    return;
+  }
+
+  mrbc_set_period( VM2TCB(vm), GET_INT_ARG(1), argc >= 2 ? GET_INT_ARG(2) : 0 );
+}
+
+
+//================================================================
+/*! end the job, and wait for the next period
+
+  wait_period -> true if the job met the deadline, or false.
+  nil if the task is not periodic.
+*/
+static void c_wait_period(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  int ret = mrbc_wait_period( VM2TCB(vm) );
+
+  if( ret < 0 ) {
+    SET_NIL_RETURN();
+  } else {
+    SET_BOOL_RETURN( ret == 0 );
+  }
+}
+#endif
+
+
+#if MRBC_USE_TASK_STATS
+//================================================================
+/*! task statistics
+
+  VM.task_stats(tcb = current task)
+*/
+static void c_vm_task_stats(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_tcb *tcb = VM2TCB(vm);
+  if( argc >= 1 && v[1].tt == MRBC_TT_HANDLE ) tcb = (mrbc_tcb *)v[1].handle;
+
+  mrbc_task_stats stats;
+  mrbc_get_task_stats(tcb, &stats);
+
+  static const char * const names[] = { "run_ticks", "n_ops",
+	"n_preemptions", "mutex_wait_ticks", "max_latency" };
+  const uint32_t values[] = { stats.run_ticks, stats.n_ops,
+	stats.n_preemptions, stats.mutex_wait_ticks, stats.max_latency };
+
+  const int n = sizeof(names) / sizeof(names[0]);
+  mrbc_value ret = mrbc_hash_new(vm, n);
+  if( ret.hash == NULL ) return;	// ENOMEM
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    mrbc_value key = mrbc_symbol_value( str_to_symid(names[i]) );
+    mrbc_value val = mrbc_fixnum_value( values[i] );
+    mrbc_hash_set( &ret, &key, &val );
+  }
+
+  SET_RETURN( ret );
+}
+#endif
+
+
+//================================================================
+/*! vm tick
+*/
+static void c_vm_tick(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN(tick_);
+}
+
+
+
+#if MRBC_USE_HOT_RELOAD
+//================================================================
+/*! check the irep is in the tree.
+
+  @param  tree	top of irep tree.
+  @param  irep	target irep.
+  @retval 1	found.
+*/
+static int irep_tree_has(const mrbc_irep *tree, const mrbc_irep *irep)
+{
+  if( tree == irep ) return 1;
+
+  int i;
+  for( i = 0; i < tree->rlen; i++ ) {
+    if( tree->reps[i] == NULL ) continue;	// not loaded.
+    if( irep_tree_has( tree->reps[i], irep ) ) return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! check whether the irep tree is referred by Proc objects or methods.
+
+  @param  tree	top of irep tree.
+  @retval 1	referred.
+*/
+static int irep_tree_referred(const mrbc_irep *tree)
+{
+  if( tree->n_refs != 0 ) return 1;
+
+  int i;
+  for( i = 0; i < tree->rlen; i++ ) {
+    if( tree->reps[i] == NULL ) continue;	// not loaded.
+    if( irep_tree_referred( tree->reps[i] ) ) return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! check whether the task uses the irep tree.
+
+  @param  tcb	target task.
+  @param  tree	top of irep tree.
+  @retval 1	used.
+*/
+static int task_uses_irep(const mrbc_tcb *tcb, const mrbc_irep *tree)
+{
+  const mrbc_vm *vm = &tcb->vm;
+
+  if( vm->irep && irep_tree_has( tree, vm->irep ) ) return 1;
+  if( tcb->state == TASKSTATE_DORMANT ) return 0;	// no frames.
+
+  if( irep_tree_has( tree, vm->pc_irep ) ) return 1;
+  const mrbc_callinfo *ci;
+  for( ci = vm->callinfo_tail; ci != NULL; ci = ci->prev ) {
+    if( irep_tree_has( tree, ci->pc_irep ) ) return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! check whether the old irep tree is still used.
+
+  @param  tree	top of irep tree.
+  @retval 1	used by Proc objects, methods or tasks.
+
+  割り込み禁止状態で、どのコアもタスクを実行していない時に呼ぶこと。
+*/
+static int irep_tree_in_use(const mrbc_irep *tree)
+{
+  if( irep_tree_referred( tree ) ) return 1;
+
+  mrbc_tcb *queues[4 + MRBC_SMP_CORES * MRBC_READY_QUEUE_LEVELS];
+  int n = 0;
+  queues[n++] = q_dormant_;
+  queues[n++] = q_waiting_;
+  queues[n++] = q_sleeping_;
+  queues[n++] = q_suspended_;
+  int i, j;
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    for( j = 0; j < MRBC_READY_QUEUE_LEVELS; j++ ) {
+      queues[n++] = q_ready_[i][j];
+    }
+  }
+
+  for( i = 0; i < n; i++ ) {
+    const mrbc_tcb *tcb;
+    for( tcb = queues[i]; tcb != NULL; tcb = tcb->next ) {
+      if( task_uses_irep( tcb, tree ) ) return 1;
+    }
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! free the old irep trees that are no longer used.
+*/
+static void free_retired_ireps(void)
+{
+  mrbc_retired_irep unused[MRBC_HOT_RELOAD_MAX_RETIRED];
+  int n_unused = 0;
+  int i;
+
+  hal_disable_irq();
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    if( running_tcb_[i] != NULL ) break;
+  }
+  if( i == MRBC_SMP_CORES ) {
+    for( i = 0; i < n_retired_irep_; ) {
+      if( irep_tree_in_use( retired_irep_[i].irep ) ) {
+	i++;
+	continue;
+      }
+      unused[n_unused++] = retired_irep_[i];
+      retired_irep_[i] = retired_irep_[--n_retired_irep_];
+    }
+  }
+  hal_enable_irq();
+
+  if( n_unused == 0 ) return;
+
+  // the cache may hold the address of freed literal.
+  mrbc_sprintf_cache_clear();
+
+  for( i = 0; i < n_unused; i++ ) {
+    if( mrbc_release_irep( unused[i].irep ) != 0 ) continue;	// still used.
+    if( reload_release_func_ ) {
+      reload_release_func_( unused[i].tcb, unused[i].vm_code );
+    }
+  }
+}
+
+
+//================================================================
+/*! replace the irep of the task by the new byte code.
+
+  @param  tcb		target task, not running or at a task switch.
+  @param  vm_code	pointer of new VM byte code.
+  @retval int		zero / no error.
+*/
+static int swap_irep(mrbc_tcb *tcb, const uint8_t *vm_code)
+{
+  mrbc_vm *vm = &tcb->vm;
+  mrbc_irep *old_irep = vm->irep;
+  const uint8_t *old_mrb = vm->mrb;
+
+  if( mrbc_load_mrb( vm, vm_code ) != 0 ) {
+    console_printf("Error: Illegal bytecode.\n");
+    vm->irep = old_irep;
+    vm->mrb = old_mrb;
+    return -1;
+  }
+
+  // 旧irepは、誰も参照しなくなってから解放する。
+  if( old_irep && !vm->flag_shared_irep ) {
+    hal_disable_irq();
+    if( n_retired_irep_ < MRBC_HOT_RELOAD_MAX_RETIRED ) {
+      mrbc_retired_irep *r = &retired_irep_[n_retired_irep_++];
+      r->irep = old_irep;
+      r->tcb = tcb;
+      r->vm_code = old_mrb;
+    }	// else, never freed.
+    hal_enable_irq();
+  }
+  vm->flag_shared_irep = 0;
+
+  if( tcb->state != TASKSTATE_DORMANT ) mrbc_vm_restart( vm );
 
+  return 0;
+}
+#endif
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! Tick timer interrupt handler.
+
+*/
+void mrbc_tick(void)
+{
+#if MRBC_SMP_CORES > 1
+  hal_disable_irq();		// exclude the other cores.
+#endif
   tick_++;
 
   // 実行中タスクのタイムスライス値を減らす
-  tcb = q_ready_;
-  if((tcb != NULL) &&
-     (tcb->state == TASKSTATE_RUNNING) &&
-     (tcb->timeslice > 0)) {
-    tcb->timeslice--;
-    if( tcb->timeslice == 0 ) tcb->vm.flag_preemption = 1;
+  int i;
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    mrbc_tcb *tcb = running_tcb_[i];
+    if((tcb != NULL) &&
+       (tcb->state == TASKSTATE_RUNNING) &&
+       (tcb->timeslice > 0)) {
+      tcb->timeslice--;
+      if( tcb->timeslice == 0 ) tcb->vm.flag_preemption = 1;
+    }
+#if MRBC_USE_TASK_STATS
+    if( tcb != NULL ) tcb->stats.run_ticks++;
+#endif
   }
 
-  // 待ちタスクキューから、ウェイクアップすべきタスクを探す
-  tcb = q_waiting_;
-  while( tcb != NULL ) {
-    mrbc_tcb *t = tcb;
-    tcb = tcb->next;
-
-    if( t->reason == TASKREASON_SLEEP && t->wakeup_tick == tick_ ) {
-      q_delete_task(t);
-      t->state     = TASKSTATE_READY;
-      t->timeslice = MRBC_TIMESLICE_TICK_COUNT;
-      q_insert_task(t);
-      flag_preemption = 1;
+#if MRBC_PROFILER_INTERVAL > 0
+  if( prof_countdown_ != 0 && --prof_countdown_ == 0 ) {
+    prof_countdown_ = MRBC_PROFILER_INTERVAL;
+    for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+      mrbc_tcb *tcb = running_tcb_[i];
+      if( tcb != NULL && tcb->state == TASKSTATE_RUNNING ) {
+	profiler_sample( &tcb->vm );
+      }
     }
   }
+#endif
 
-  if( flag_preemption ) {
-    tcb = q_ready_;
-    while( tcb != NULL ) {
-      if( tcb->state == TASKSTATE_RUNNING ) tcb->vm.flag_preemption = 1;
-      tcb = tcb->next;
+  // 起床時刻を過ぎたタスクを起こす
+#if MRBC_USE_REALTIME
+  // スケジューラに起こさせる。(see wakeup_sleeping_tasks)
+  if( q_sleeping_top_is_due() ) {
+    for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+      if( running_tcb_[i] != NULL ) running_tcb_[i]->vm.flag_preemption = 1;
     }
   }
+#else
+  q_wakeup_sleeping_tasks();
+#endif
+#if MRBC_SMP_CORES > 1
+  hal_enable_irq();
+#endif
+}
+
+
+//================================================================
+/*! get the tick count.
+
+  @return	ticks since mrbc_init().
+*/
+uint32_t mrbc_get_tick(void)
+{
+  return tick_;
 }
 
 
@@ -393,6 +1265,13 @@ void mrbc_init(uint8_t *ptr, unsigned int size)
   mrbc_define_method(0, mrbc_class_object, "suspend_task",    c_suspend_task);
   mrbc_define_method(0, mrbc_class_object, "resume_task",     c_resume_task);
   mrbc_define_method(0, mrbc_class_object, "get_tcb",	      c_get_tcb);
+#if MRBC_NUM_EVENTS > 0
+  mrbc_define_method(0, mrbc_class_object, "wait_event",      c_wait_event);
+#endif
+#if MRBC_USE_REALTIME
+  mrbc_define_method(0, mrbc_class_object, "set_period",      c_set_period);
+  mrbc_define_method(0, mrbc_class_object, "wait_period",     c_wait_period);
+#endif
 
 
   mrbc_class *c_mutex;
@@ -402,9 +1281,20 @@ void mrbc_init(uint8_t *ptr, unsigned int size)
   mrbc_define_method(0, c_mutex, "unlock", c_mutex_unlock);
   mrbc_define_method(0, c_mutex, "try_lock", c_mutex_trylock);
 
+  mrbc_class_queue = mrbc_define_class(0, "Queue", mrbc_class_object);
+  mrbc_define_method(0, mrbc_class_queue, "new", c_queue_new);
+  mrbc_define_method(0, mrbc_class_queue, "push", c_queue_push);
+  mrbc_define_method(0, mrbc_class_queue, "<<", c_queue_push);
+  mrbc_define_method(0, mrbc_class_queue, "pop", c_queue_pop);
+  mrbc_define_method(0, mrbc_class_queue, "size", c_queue_size);
+  mrbc_define_method(0, mrbc_class_queue, "empty?", c_queue_empty);
+
   mrbc_class *c_vm;
   c_vm = mrbc_define_class(0, "VM", mrbc_class_object);
   mrbc_define_method(0, c_vm, "tick", c_vm_tick);
+#if MRBC_USE_TASK_STATS
+  mrbc_define_method(0, c_vm, "task_stats", c_vm_task_stats);
+#endif
 }
 
 
@@ -419,12 +1309,57 @@ void mrbc_cleanup(void)
   mrbc_cleanup_alloc();
 
   q_dormant_ = 0;
-  q_ready_ = 0;
+  memset( q_ready_, 0, sizeof(q_ready_) );
+  memset( q_ready_map_, 0, sizeof(q_ready_map_) );
+  memset( running_tcb_, 0, sizeof(running_tcb_) );
+#if MRBC_USE_TASK_STATS
+  memset( latency_hist_, 0, sizeof(latency_hist_) );
+#endif
+#if MRBC_NUM_EVENTS > 0
+  memset( events_, 0, sizeof(events_) );
+  event_max_latency_ = 0;
+#endif
   q_waiting_ = 0;
+  q_sleeping_ = 0;
   q_suspended_ = 0;
 }
 
 
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the task queues. (see snapshot.c)
+
+  The interrupt events and the profiler are not saved.
+*/
+void mrbc_snapshot_task(mrbc_snapshot *s)
+{
+  // a running task has its state in the C stack.
+  int i;
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    if( s->mode != MRBC_SNAPSHOT_MODE_RESTORE && running_tcb_[i] ) {
+      s->flag_error = 1;
+    }
+  }
+
+  MRBC_SNAPSHOT_VAR( s, q_dormant_ );
+  MRBC_SNAPSHOT_VAR( s, q_ready_ );
+  MRBC_SNAPSHOT_VAR( s, q_ready_map_ );
+  MRBC_SNAPSHOT_VAR( s, running_tcb_ );
+  MRBC_SNAPSHOT_VAR( s, q_waiting_ );
+  MRBC_SNAPSHOT_VAR( s, q_sleeping_ );
+  MRBC_SNAPSHOT_VAR( s, q_suspended_ );
+  mrbc_snapshot_var( s, (void *)&tick_, sizeof(tick_) );
+#if MRBC_USE_HOT_RELOAD
+  MRBC_SNAPSHOT_VAR( s, retired_irep_ );
+  MRBC_SNAPSHOT_VAR( s, n_retired_irep_ );
+#endif
+#if MRBC_USE_TASK_STATS
+  MRBC_SNAPSHOT_VAR( s, latency_hist_ );
+#endif
+}
+#endif
+
+
 //================================================================
 /*! dinamic initializer of mrbc_tcb
 
@@ -439,15 +1374,18 @@ void mrbc_init_tcb(mrbc_tcb *tcb)
 
 
 //================================================================
-/*! specify running VM code.
+/*! create a task. (body of mrbc_create_task and the like)
 
-  @param        vm_code pointer of VM byte code.
+  @param        vm_code pointer of VM byte code, or NULL.
+  @param        base	task that has the irep to share, or NULL.
+  @param        read	read function of the stream loader, or NULL.
+  @param        user	argument of read().
   @param        tcb	Task control block with parameter, or NULL.
   @retval       Pointer of mrbc_tcb.
   @retval       NULL is error.
-
 */
-mrbc_tcb* mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb)
+static mrbc_tcb * create_task(const uint8_t *vm_code, const mrbc_tcb *base,
+			      mrbc_load_read_func read, void *user, mrbc_tcb *tcb)
 {
   // allocate Task Control Block
   if( tcb == NULL ) {
@@ -465,7 +1403,19 @@ mrbc_tcb* mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb)
     return NULL;
   }
 
-  if( mrbc_load_mrb(&tcb->vm, vm_code) != 0 ) {
+  int ret = 0;
+  if( base ) {
+    tcb->vm.mrb = base->vm.mrb;
+    tcb->vm.irep = base->vm.irep;
+    tcb->vm.flag_shared_irep = 1;
+  } else if( vm_code ) {
+    ret = mrbc_load_mrb(&tcb->vm, vm_code);
+  } else {
+#if MRBC_USE_STREAM_LOADER
+    ret = mrbc_load_mrb_stream(&tcb->vm, read, user);
+#endif
+  }
+  if( ret != 0 ) {
     console_printf("Error: Illegal bytecode.\n");
     mrbc_vm_close( &tcb->vm );
     return NULL;
@@ -475,6 +1425,7 @@ mrbc_tcb* mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb)
   }
 
   hal_disable_irq();
+  STATS_SET_READY(tcb);
   q_insert_task(tcb);
   hal_enable_irq();
 
@@ -482,6 +1433,59 @@ mrbc_tcb* mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb)
 }
 
 
+//================================================================
+/*! specify running VM code.
+
+  @param        vm_code pointer of VM byte code.
+  @param        tcb	Task control block with parameter, or NULL.
+  @retval       Pointer of mrbc_tcb.
+  @retval       NULL is error.
+
+*/
+mrbc_tcb* mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb)
+{
+  return create_task(vm_code, NULL, NULL, NULL, tcb);
+}
+
+
+//================================================================
+/*! create a task that runs the same code as the base task.
+
+  @param        base	task made by mrbc_create_task().
+  @param        tcb	Task control block with parameter, or NULL.
+  @retval       Pointer of mrbc_tcb.
+  @retval       NULL is error.
+
+  バイトコードを読み直さず、baseのirepを共有する。
+  baseのVMは、共有するタスクより先に閉じないこと。
+  (note) 共有するirepのインラインメソッドキャッシュは排他しないので、
+         MRBC_SMP_CORES > 1 では MRBC_USE_INLINE_METHOD_CACHE 0 とすること。
+*/
+mrbc_tcb* mrbc_create_task_shared(const mrbc_tcb *base, mrbc_tcb *tcb)
+{
+  return create_task(NULL, base, NULL, NULL, tcb);
+}
+
+
+#if MRBC_USE_STREAM_LOADER
+//================================================================
+/*! create a task, loading the byte code through a read callback.
+
+  @param        read	read function. see mrbc_load_mrb_stream().
+  @param        user	argument of read().
+  @param        tcb	Task control block with parameter, or NULL.
+  @retval       Pointer of mrbc_tcb.
+  @retval       NULL is error.
+
+  バイトコード全体をRAMに置かずに、シリアルやSPIフラッシュ等から読み込む。
+*/
+mrbc_tcb* mrbc_create_task_stream(mrbc_load_read_func read, void *user, mrbc_tcb *tcb)
+{
+  return create_task(NULL, NULL, read, user, tcb);
+}
+#endif
+
+
 //================================================================
 /*! Start execution of dormant task.
 
@@ -496,16 +1500,11 @@ int mrbc_start_task(mrbc_tcb *tcb)
   mrbc_vm_begin(&tcb->vm);
 
   hal_disable_irq();
-
-  mrbc_tcb *t = q_ready_;
-  while( t != NULL ) {
-    if( t->state == TASKSTATE_RUNNING ) t->vm.flag_preemption = 1;
-    t = t->next;
-  }
-
   q_delete_task(tcb);
   tcb->state = TASKSTATE_READY;
+  STATS_SET_READY(tcb);
   q_insert_task(tcb);
+  preempt_running_task(tcb);
   hal_enable_irq();
 
   return 0;
@@ -517,33 +1516,105 @@ int mrbc_start_task(mrbc_tcb *tcb)
 
 */
 int mrbc_run(void)
+{
+  return mrbc_run_core(0);
+}
+
+
+//================================================================
+/*! execute on the core.
+
+  @param  core	core number. (0 .. MRBC_SMP_CORES-1)
+
+  各コア(スレッド)で呼び出す。タスクの生成後に呼ぶこと。
+  自コアのreadyキューが空の時は、他のコアからタスクを奪って実行する。
+*/
+int mrbc_run_core(int core)
 {
   while( 1 ) {
-    mrbc_tcb *tcb = q_ready_;
+#if MRBC_USE_REALTIME
+    wakeup_sleeping_tasks();
+#endif
+    hal_disable_irq();
+    mrbc_tcb *tcb = q_ready_top(core);
+#if MRBC_SMP_CORES > 1
+    if( tcb == NULL ) tcb = q_steal_task(core);
+#endif
+    if( tcb != NULL ) {
+      tcb->state = TASKSTATE_RUNNING;
+      running_tcb_[core] = tcb;
+#if MRBC_USE_TASK_STATS
+      stats_begin_run(tcb);
+#endif
+#if MRBC_NUM_EVENTS > 0
+      if( tcb->flag_event_run ) event_begin_run(tcb);
+#endif
+    }
+    hal_enable_irq();
+
     if( tcb == NULL ) {
       // 実行すべきタスクなし
+#if MRBC_SMP_CORES > 1 && MRBC_SCHEDULER_EXIT
+      hal_disable_irq();
+      int flag_exit = q_is_all_empty();
+      hal_enable_irq();
+      if( flag_exit ) return 0;
+#endif
+      mrbc_drain_free_queue( -1 );
+#if MRBC_USE_CYCLE_COLLECTOR
+      mrbc_gc_collect( MRBC_GC_ROOTS_PER_RUN );
+#endif
+#if defined(MRBC_ALLOC_COMPACT)
+      mrbc_alloc_compact( MRBC_ALLOC_COMPACT_STEPS );
+#endif
+#if !defined(MRBC_CONSOLE_HAL_DRAIN)
+      mrbc_console_flush();
+#endif
+#if defined(MRBC_TICKLESS) && !defined(MRBC_NO_TIMER)
+      tickless_idle();
+#else
       hal_idle_cpu();
+#endif
       continue;
     }
 
     // 実行開始
-    tcb->state = TASKSTATE_RUNNING;
     int res = 0;
 
+#if MRBC_USE_HOT_RELOAD
+    // タスク切り替えの直後なので、ここでバイトコードを差し替える。
+    if( tcb->reload_code ) {
+      hal_disable_irq();
+      const uint8_t *vm_code = tcb->reload_code;
+      tcb->reload_code = NULL;
+      hal_enable_irq();
+      swap_irep( tcb, vm_code );
+    }
+#endif
+
+    MRBC_TRACE( &tcb->vm, MRBC_TRACE_RUN, 0 );
 #ifndef MRBC_NO_TIMER
     tcb->vm.flag_preemption = 0;
     res = mrbc_vm_run(&tcb->vm);
 
 #else
     while( tcb->timeslice > 0 ) {
-      tcb->vm.flag_preemption = 1;
+      tcb->vm.flag_preemption = 0;
+      tcb->vm.op_budget = MRBC_NO_TIMER_OP_BUDGET;
       res = mrbc_vm_run(&tcb->vm);
-      tcb->timeslice--;
+      if( tcb->timeslice > 0 ) tcb->timeslice--;	// 0 by relinquish.
       if( res < 0 ) break;
       if( tcb->state != TASKSTATE_RUNNING ) break;
     }
     mrbc_tick();
 #endif /* ifndef MRBC_NO_TIMER */
+    MRBC_TRACE( &tcb->vm, MRBC_TRACE_STOP, 0 );
+    hal_disable_irq();
+    running_tcb_[core] = NULL;
+    hal_enable_irq();
+#if MRBC_USE_HOT_RELOAD
+    if( n_retired_irep_ ) free_retired_ireps();
+#endif
 
     // タスク終了？
     if( res < 0 ) {
@@ -555,8 +1626,7 @@ int mrbc_run(void)
       mrbc_vm_end(&tcb->vm);
 
 #if MRBC_SCHEDULER_EXIT
-      if( q_ready_ == NULL && q_waiting_ == NULL &&
-          q_suspended_ == NULL ) return 0;
+      if( q_is_all_empty() ) return 0;
 #endif
       continue;
     }
@@ -565,6 +1635,10 @@ int mrbc_run(void)
     hal_disable_irq();
     if( tcb->state == TASKSTATE_RUNNING ) {
       tcb->state = TASKSTATE_READY;
+      STATS_SET_READY(tcb);
+#if MRBC_USE_TASK_STATS
+      tcb->stats.n_preemptions++;
+#endif
 
       // タイムスライス終了？
       if( tcb->timeslice == 0 ) {
@@ -579,6 +1653,87 @@ int mrbc_run(void)
 }
 
 
+//================================================================
+/*! Restart the task from the beginning.
+
+  @param	tcb	Task control block.
+  @retval	int	zero / no error.
+
+  irepを読み直さずに、レジスタとcallinfoを初期化して再実行する。
+  実行中のタスク自身は再起動できない。
+  保持しているmutexは解放されない。
+*/
+int mrbc_restart_task(mrbc_tcb *tcb)
+{
+  hal_disable_irq();
+  if( tcb->state == TASKSTATE_RUNNING ) {
+    hal_enable_irq();
+    return -1;
+  }
+  int flag_begun = (tcb->state != TASKSTATE_DORMANT);
+  q_delete_task(tcb);
+  tcb->state = TASKSTATE_DORMANT;
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+  if( flag_begun ) mrbc_vm_end(&tcb->vm);
+
+  return mrbc_start_task(tcb);
+}
+
+
+#if MRBC_USE_HOT_RELOAD
+//================================================================
+/*! Replace the byte code of the task, keeping its objects.
+
+  @param	tcb	Task control block.
+  @param	vm_code	pointer of new VM byte code.
+  @retval	int	zero / no error.
+
+  タスクが次に実行される時(relinquish, sleep, タイムスライス終了等の
+  タスク切り替えの後)に新しいバイトコードを読み込み、レジスタとcallinfoを
+  初期化してトップレベルから実行し直す。休止中のタスクは、すぐに差し替える。
+  オブジェクト、グローバル変数、定数、クラスはそのまま残り、同名のメソッドは
+  新しいコードで再定義される。
+  旧irepは、どのタスク、Procオブジェクト、メソッド、文字列リテラルから作った
+  Stringオブジェクトからも参照されなくなった時点で解放される。
+  mrbc_load_mrb()で読んだirepはバイトコードを直接参照するので、それまで
+  旧バイトコードを上書きしないこと。
+  解放した時には、mrbc_set_reload_release_func()で登録した関数を、
+  タスクと旧バイトコード(ストリームから読んだ場合はNULL)を引数にして呼ぶ。
+  その後は、旧バイトコードのバッファを再利用してよい。
+  (note) 保持しているmutexは解放されない。
+         mrbc_create_task_shared()で作ったタスクは、旧コードのまま動き続ける。
+         同じバイトコードを他のタスクも読んでいる時(irepキャッシュ)と、
+         MRBC_HOT_RELOAD_MAX_RETIRED個を超えて差し替えた時は、旧irepは
+         解放されず、関数も呼ばれない。
+*/
+int mrbc_reload_task(mrbc_tcb *tcb, const uint8_t *vm_code)
+{
+  hal_disable_irq();
+  if( tcb->state != TASKSTATE_DORMANT ) {
+    tcb->reload_code = vm_code;
+    hal_enable_irq();
+    return 0;
+  }
+  hal_enable_irq();
+
+  return swap_irep( tcb, vm_code );
+}
+
+
+//================================================================
+/*! Set the function called when the old byte code is released.
+
+  @param	func	function, or NULL. (see mrbc_reload_task)
+*/
+void mrbc_set_reload_release_func(mrbc_reload_release_func func)
+{
+  reload_release_func_ = func;
+}
+#endif
+
+
 //================================================================
 /*! 実行一時停止
 
@@ -616,8 +1771,12 @@ void mrbc_relinquish(mrbc_tcb *tcb)
 */
 void mrbc_change_priority(mrbc_tcb *tcb, int priority)
 {
+  hal_disable_irq();
+  q_delete_task(tcb);
   tcb->priority            = (uint8_t)priority;
-  tcb->priority_preemption = (uint8_t)priority;
+  tcb->priority_preemption = (uint8_t)inherited_priority(tcb);
+  q_insert_task(tcb);
+  hal_enable_irq();
   tcb->timeslice           = 0;
   tcb->vm.flag_preemption = 1;
 }
@@ -646,18 +1805,87 @@ void mrbc_suspend_task(mrbc_tcb *tcb)
 void mrbc_resume_task(mrbc_tcb *tcb)
 {
   hal_disable_irq();
+  q_delete_task(tcb);
+  tcb->state = TASKSTATE_READY;
+  STATS_SET_READY(tcb);
+  q_insert_task(tcb);
+  preempt_running_task(tcb);
+  hal_enable_irq();
+}
+
+
+#if MRBC_USE_REALTIME
+//================================================================
+/*! make the task periodic.
+
+  The current job of the task is released now, and the next ones
+  every period. The task ends each job by mrbc_wait_period().
+
+  @param  tcb		Task control block.
+  @param  period_ms	period, or 0 to make the task not periodic.
+  @param  deadline_ms	deadline from the release, or 0 for the period.
+*/
+void mrbc_set_period(mrbc_tcb *tcb, uint32_t period_ms, uint32_t deadline_ms)
+{
+  if( deadline_ms == 0 ) deadline_ms = period_ms;
+
+  hal_disable_irq();
+  tcb->period       = (period_ms + MRBC_TICK_UNIT - 1) / MRBC_TICK_UNIT;
+  tcb->deadline     = (deadline_ms + MRBC_TICK_UNIT - 1) / MRBC_TICK_UNIT;
+  tcb->release_tick = tick_;
+  tcb->n_overruns   = 0;
+  tcb->n_skipped    = 0;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! end the job of the periodic task, and sleep until the next release.
+
+  If the job ended after the deadline, it is counted in n_overruns,
+  and MRBC_DEADLINE_MISS_HOOK(tcb) is called.
+  If the next release time has passed too, the task skips the periods
+  that it overran, and keeps the phase, instead of running the late
+  jobs in a burst. They are counted in n_skipped.
+
+  @param  tcb	Task control block.
+  @retval 0	the job met the deadline.
+  @retval 1	the job missed the deadline.
+  @retval -1	the task is not periodic.
+*/
+int mrbc_wait_period(mrbc_tcb *tcb)
+{
+  if( tcb->period == 0 ) return -1;
 
-  mrbc_tcb *t = q_ready_;
-  while( t != NULL ) {
-    if( t->state == TASKSTATE_RUNNING ) t->vm.flag_preemption = 1;
-    t = t->next;
+  hal_disable_irq();
+  int flag_miss = (int32_t)(tick_ - tcb->release_tick) > (int32_t)tcb->deadline;
+  if( flag_miss ) tcb->n_overruns++;
+
+  tcb->release_tick += tcb->period;
+  int32_t late = (int32_t)(tick_ - tcb->release_tick);
+  if( late > 0 ) {
+    uint32_t n = (late + tcb->period - 1) / tcb->period;
+    tcb->release_tick += n * tcb->period;
+    tcb->n_skipped += n;
   }
 
   q_delete_task(tcb);
-  tcb->state = TASKSTATE_READY;
+  tcb->timeslice   = 0;
+  tcb->state       = TASKSTATE_WAITING;
+  tcb->reason      = TASKREASON_SLEEP;
+  tcb->wakeup_tick = tcb->release_tick;
   q_insert_task(tcb);
   hal_enable_irq();
+
+  tcb->vm.flag_preemption = 1;
+
+#if defined(MRBC_DEADLINE_MISS_HOOK)
+  if( flag_miss ) MRBC_DEADLINE_MISS_HOOK(tcb);
+#endif
+
+  return flag_miss;
 }
+#endif
 
 
 //================================================================
@@ -681,6 +1909,8 @@ mrbc_mutex * mrbc_mutex_init( mrbc_mutex *mutex )
 //================================================================
 /*! mutex lock
 
+  If the mutex is locked, the owner inherits the priority of the caller
+  until it unlocks, so that middle priority tasks can not delay it.
 */
 int mrbc_mutex_lock( mrbc_mutex *mutex, mrbc_tcb *tcb )
 {
@@ -710,9 +1940,25 @@ int mrbc_mutex_lock( mrbc_mutex *mutex, mrbc_tcb *tcb )
   tcb->state  = TASKSTATE_WAITING;
   tcb->reason = TASKREASON_MUTEX;
   tcb->mutex = mutex;
+#if MRBC_USE_TASK_STATS
+  tcb->wait_tick = tick_;
+#endif
   q_insert_task(tcb);
   tcb->vm.flag_preemption = 1;
 
+  // priority inheritance. (follow the owners waiting for other mutexes)
+  mrbc_tcb *owner = mutex->tcb;
+  while( owner->priority_preemption > tcb->priority_preemption ) {
+    q_change_priority_preemption(owner, tcb->priority_preemption);
+    if( owner->state & TASKSTATE_READY ) {
+      preempt_running_task(owner);
+      break;
+    }
+    if( owner->state != TASKSTATE_WAITING ||
+        owner->reason != TASKREASON_MUTEX ) break;
+    owner = owner->mutex->tcb;
+  }
+
  DONE:
   hal_enable_irq();
 
@@ -733,6 +1979,7 @@ int mrbc_mutex_unlock( mrbc_mutex *mutex, mrbc_tcb *tcb )
   if( mutex->tcb != tcb ) return 2;
 
   // wakeup ONE waiting task.
+  mrbc_tcb *owner = tcb;
   int flag_preemption = 0;
   hal_disable_irq();
   tcb = q_waiting_;
@@ -742,6 +1989,10 @@ int mrbc_mutex_unlock( mrbc_mutex *mutex, mrbc_tcb *tcb )
       mutex->tcb = tcb;
       q_delete_task(tcb);
       tcb->state = TASKSTATE_READY;
+      STATS_SET_READY(tcb);
+#if MRBC_USE_TASK_STATS
+      tcb->stats.mutex_wait_ticks += tick_ - tcb->wait_tick;
+#endif
       q_insert_task(tcb);
       flag_preemption = 1;
       break;
@@ -750,11 +2001,7 @@ int mrbc_mutex_unlock( mrbc_mutex *mutex, mrbc_tcb *tcb )
   }
 
   if( flag_preemption ) {
-    tcb = q_ready_;
-    while( tcb != NULL ) {
-      if( tcb->state == TASKSTATE_RUNNING ) tcb->vm.flag_preemption = 1;
-      tcb = tcb->next;
-    }
+    preempt_running_task(tcb);
   }
   else {
     // unlock mutex
@@ -762,6 +2009,13 @@ int mrbc_mutex_unlock( mrbc_mutex *mutex, mrbc_tcb *tcb )
     mutex->lock = 0;
   }
 
+  // restore the priority, but keep the one inherited by other mutexes.
+  int priority = inherited_priority(owner);
+  if( owner->priority_preemption != priority ) {
+    q_change_priority_preemption(owner, priority);
+    owner->vm.flag_preemption = 1;
+  }
+
   hal_enable_irq();
 
   return 0;
@@ -796,6 +2050,416 @@ int mrbc_mutex_trylock( mrbc_mutex *mutex, mrbc_tcb *tcb )
 
 
 
+//================================================================
+/*! queue initialize
+
+  @param  queue	pointer to the queue.
+  @param  buf	buffer for size values.
+  @param  size	capacity.
+  @return	pointer to the queue.
+*/
+mrbc_queue * mrbc_queue_init( mrbc_queue *queue, mrbc_value *buf, int size )
+{
+  queue->size = size;
+  queue->head = 0;
+  queue->n_stored = 0;
+  queue->data = buf;
+
+  return queue;
+}
+
+
+//================================================================
+/*! make a Queue object.
+
+  @param  vm	pointer to VM, or NULL for the object shared by all VMs.
+  @param  size	capacity.
+  @return	Queue object, or nil if ENOMEM.
+
+  C code gets the queue by mrbc_queue_ptr(), to send from ISR.
+*/
+mrbc_value mrbc_queue_new( struct VM *vm, int size )
+{
+  if( size < 1 ) size = 1;
+  if( size > UINT16_MAX ) size = UINT16_MAX;
+
+  mrbc_value v = mrbc_instance_new(vm, mrbc_class_queue,
+			sizeof(mrbc_queue) + sizeof(mrbc_value) * size);
+  if( !v.instance ) return mrbc_nil_value();	// ENOMEM
+
+  mrbc_queue *queue = mrbc_queue_ptr(&v);
+  mrbc_queue_init( queue, (mrbc_value *)(queue + 1), size );
+
+  return v;
+}
+
+
+//================================================================
+/*! queue send
+
+  @param  queue	pointer to the queue.
+  @param  value	value. the reference is moved into the queue if sent.
+  @retval 0	sent.
+  @retval 1	the queue is full.
+  @retval 2	refused. the value refers to a Proc.
+  @retval -1	ENOMEM.
+
+  The vm_id of the objects is cleared here, out of the interrupt
+  disabled section, by walking only the sent value. A Proc refers to
+  the frame of its VM, so that it can't be sent, even in a container.
+*/
+int mrbc_queue_send( mrbc_queue *queue, mrbc_value *value )
+{
+  if( value->tt >= MRBC_TT_INC_DEC_THRESHOLD ) {
+    int r = mrbc_clear_vm_id( value, 1 );
+    if( r != 0 ) return r < 0 ? r : 2;
+  }
+
+  hal_disable_irq();
+  int ret = queue_send( queue, value );
+  hal_enable_irq();
+
+  return ret;
+}
+
+
+//================================================================
+/*! queue send from ISR
+
+  @param  queue	pointer to the queue.
+  @param  value	value that is not reference counted.
+		(nil, true, false, Fixnum, Float, Symbol and handles)
+  @retval 0	sent.
+  @retval 1	the queue is full.
+
+  割り込みハンドラから呼ぶ。待っているタスクは、すぐに起こされる。
+*/
+int mrbc_queue_send_from_isr( mrbc_queue *queue, const mrbc_value *value )
+{
+#if MRBC_SMP_CORES > 1
+  hal_disable_irq();		// exclude the other cores.
+#endif
+  int ret = queue_send( queue, value );
+#if MRBC_SMP_CORES > 1
+  hal_enable_irq();
+#endif
+
+  return ret;
+}
+
+
+//================================================================
+/*! queue receive
+
+  @param  queue	pointer to the queue.
+  @param  value	pointer to the place to store the value.
+  @param  tcb	task to wait, or NULL not to wait.
+  @retval 0	received.
+  @retval 1	the queue is empty.
+
+  If the queue is empty and tcb is given, the task goes WAITING and
+  the value is stored in *value when it is sent.
+*/
+int mrbc_queue_receive( mrbc_queue *queue, mrbc_value *value, mrbc_tcb *tcb )
+{
+  int ret = 0;
+  hal_disable_irq();
+
+  if( queue->n_stored != 0 ) {
+    *value = queue->data[queue->head];
+    if( ++queue->head >= queue->size ) queue->head = 0;
+    queue->n_stored--;
+    goto DONE;
+  }
+
+  ret = 1;
+  if( tcb == NULL ) goto DONE;
+
+  // To WAITING state.
+  q_delete_task(tcb);
+  tcb->state  = TASKSTATE_WAITING;
+  tcb->reason = TASKREASON_QUEUE;
+  tcb->queue  = queue;
+  tcb->queue_value = value;
+  q_insert_task(tcb);
+  tcb->vm.flag_preemption = 1;
+
+ DONE:
+  hal_enable_irq();
+
+  return ret;
+}
+
+
+//================================================================
+/*! release the values in the queue.
+
+  @param  queue	pointer to the queue.
+*/
+void mrbc_queue_clear( mrbc_queue *queue )
+{
+  while( queue->n_stored != 0 ) {
+    mrbc_decref( &queue->data[queue->head] );
+    if( ++queue->head >= queue->size ) queue->head = 0;
+    queue->n_stored--;
+  }
+}
+
+
+#if MRBC_NUM_EVENTS > 0
+//================================================================
+/*! signal the interrupt event
+
+  @param  event_no	event number. (0 .. MRBC_NUM_EVENTS-1)
+  @param  param		parameter for the handler.
+  @retval 0	the handler task is woken.
+  @retval 1	no task waits. the signal is kept pending.
+  @retval -1	wrong event number.
+*/
+int mrbc_event_signal( int event_no, mrbc_int param )
+{
+  hal_disable_irq();
+  int ret = event_signal( event_no, param );
+  hal_enable_irq();
+
+  return ret;
+}
+
+
+//================================================================
+/*! signal the interrupt event from ISR
+
+  @param  event_no	event number. (0 .. MRBC_NUM_EVENTS-1)
+  @param  param		parameter for the handler.
+  @retval 0	the handler task is woken.
+  @retval 1	no task waits. the signal is kept pending.
+  @retval -1	wrong event number.
+
+  <pre>
+  割り込みハンドラから呼ぶ。待っているタスクは最高優先度(0)でreadyになり、
+  実行中のタスクの現在の命令が終わると実行される。
+  ハンドラのタスクが処理中の間の信号は、回数と最後のparamだけを保持する。
+  </pre>
+*/
+int mrbc_event_signal_from_isr( int event_no, mrbc_int param )
+{
+#if MRBC_SMP_CORES > 1
+  hal_disable_irq();		// exclude the other cores.
+#endif
+  int ret = event_signal( event_no, param );
+#if MRBC_SMP_CORES > 1
+  hal_enable_irq();
+#endif
+
+  return ret;
+}
+
+
+//================================================================
+/*! wait for the interrupt event
+
+  @param  event_no	event number. (0 .. MRBC_NUM_EVENTS-1)
+  @param  value		pointer to the place to store the parameter.
+  @param  tcb		task to wait, or NULL not to wait.
+  @retval 0	received a pending signal.
+  @retval 1	no signal is pending.
+  @retval -1	wrong event number.
+
+  <pre>
+  With a pending signal, the task keeps the top priority to handle it.
+  Otherwise it gets back its own priority, goes WAITING as the handler
+  of the event, and the parameter is stored in *value when signaled.
+  </pre>
+*/
+int mrbc_event_wait( int event_no, mrbc_value *value, mrbc_tcb *tcb )
+{
+  if( event_no < 0 || event_no >= MRBC_NUM_EVENTS ) return -1;
+
+  int ret = 0;
+  mrbc_event *ev = &events_[event_no];
+  hal_disable_irq();
+
+  if( ev->n_pending != 0 ) {
+    *value = mrbc_fixnum_value( ev->param );
+    ev->n_pending--;
+    if( tcb ) q_change_priority_preemption( tcb, 0 );
+    goto DONE;
+  }
+
+  ret = 1;
+  if( tcb == NULL ) goto DONE;
+
+  // To WAITING state.
+  q_delete_task(tcb);
+  tcb->priority_preemption = inherited_priority(tcb);
+  tcb->state    = TASKSTATE_WAITING;
+  tcb->reason   = TASKREASON_EVENT;
+  tcb->event_no = event_no;
+  tcb->event_value = value;
+  q_insert_task(tcb);
+  tcb->vm.flag_preemption = 1;
+
+ DONE:
+  hal_enable_irq();
+
+  return ret;
+}
+
+
+//================================================================
+/*! get the worst latency of the event handlers.
+
+  @return	by MRBC_EVENT_CLOCK, from the signal to the handler task
+		begins to run.
+*/
+uint32_t mrbc_event_max_latency( void )
+{
+  return event_max_latency_;
+}
+#endif
+
+
+
+#if MRBC_USE_TASK_STATS
+//================================================================
+/*! get the statistics of the task.
+
+  @param  tcb	pointer to the task.
+  @param  stats	returns the statistics.
+*/
+void mrbc_get_task_stats( const mrbc_tcb *tcb, mrbc_task_stats *stats )
+{
+  hal_disable_irq();
+  *stats = tcb->stats;
+  stats->n_ops = tcb->vm.n_ops;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! get the histogram of ready-to-running latency of all tasks.
+
+  @param  hist	returns the counts. (see MRBC_LATENCY_HIST_SIZE)
+*/
+void mrbc_get_latency_histogram( uint32_t hist[MRBC_LATENCY_HIST_SIZE] )
+{
+  hal_disable_irq();
+  memcpy( hist, latency_hist_, sizeof(latency_hist_) );
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! clear the statistics of the task.
+
+  @param  tcb	pointer to the task, or NULL for the latency histogram.
+*/
+void mrbc_clear_task_stats( mrbc_tcb *tcb )
+{
+  hal_disable_irq();
+  if( tcb ) {
+    memset( &tcb->stats, 0, sizeof(tcb->stats) );
+    tcb->vm.n_ops = 0;
+  } else {
+    memset( latency_hist_, 0, sizeof(latency_hist_) );
+  }
+  hal_enable_irq();
+}
+#endif
+
+
+#if MRBC_PROFILER_INTERVAL > 0
+//================================================================
+/*! start the sampling profiler, after clearing the samples.
+*/
+void mrbc_profiler_start(void)
+{
+  hal_disable_irq();
+  prof_wp_ = 0;
+  prof_n_ = 0;
+  prof_dropped_ = 0;
+  prof_countdown_ = MRBC_PROFILER_INTERVAL;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! stop the sampling profiler. the samples are kept.
+*/
+void mrbc_profiler_stop(void)
+{
+  hal_disable_irq();
+  prof_countdown_ = 0;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! take the samples, the oldest first.
+
+  @param  buf		buffer for the samples.
+  @param  size		size of buf, in samples.
+  @param  n_dropped	returns # of samples lost because the ring buffer
+			was full, or NULL.
+  @return		# of samples stored in buf.
+*/
+int mrbc_profiler_read(mrbc_profile_sample *buf, int size, uint32_t *n_dropped)
+{
+  int n = 0;
+
+  hal_disable_irq();
+  int rp = prof_wp_ - prof_n_;
+  if( rp < 0 ) rp += MRBC_PROFILER_SAMPLES;
+  while( n < size && prof_n_ > 0 ) {
+    buf[n++] = prof_buf_[rp];
+    if( ++rp == MRBC_PROFILER_SAMPLES ) rp = 0;
+    prof_n_--;
+  }
+  if( n_dropped ) *n_dropped = prof_dropped_;
+  prof_dropped_ = 0;
+  hal_enable_irq();
+
+  return n;
+}
+
+
+//================================================================
+/*! print and clear the samples, for support/fold_profile.rb.
+
+  <pre>
+  # mrbc profile: interval=<ticks> dropped=<n>
+  <vm_id> <irep address> <offset> <method name>
+  ...
+  </pre>
+*/
+void mrbc_profiler_dump(void)
+{
+  mrbc_profile_sample buf[16];
+  uint32_t n_dropped;
+  int n;
+
+  n = mrbc_profiler_read( buf, 0, &n_dropped );
+  console_printf("# mrbc profile: interval=%d dropped=%d\n",
+		 MRBC_PROFILER_INTERVAL, n_dropped);
+
+  while( (n = mrbc_profiler_read( buf, 16, NULL )) > 0 ) {
+    int i;
+    for( i = 0; i < n; i++ ) {
+      const char *name;
+      switch( buf[i].method_id ) {
+      case 0:		name = "<main>";	break;
+      case 0x7fff:	name = "<rescue>";	break;
+      case 0x7ffe:	name = "<ensure>";	break;
+      default:		name = symid_to_str( buf[i].method_id );
+      }
+      console_printf("%d %p %d %s\n", buf[i].vm_id, buf[i].irep,
+		     buf[i].inst, name ? name : "?");
+    }
+  }
+}
+#endif
+
+
 
 #ifdef MRBC_DEBUG
 
@@ -832,7 +2496,7 @@ void pq(mrbc_tcb *p_tcb)
   while( p != NULL ) {
     console_printf(" st:%c%c%c%c  ",
                    (p->state & TASKSTATE_SUSPENDED)?'S':'-',
-                   (p->state & TASKSTATE_WAITING)?("sm"[p->reason]):'-',
+                   (p->state & TASKSTATE_WAITING)?("smq"[p->reason]):'-',
                    (p->state &(TASKSTATE_RUNNING & ~TASKSTATE_READY))?'R':'-',
                    (p->state & TASKSTATE_READY)?'r':'-' );
     p = p->next;
@@ -845,14 +2509,67 @@ void pq(mrbc_tcb *p_tcb)
     p = p->next;
   }
   console_printf("\n");
+
+#if MRBC_USE_TASK_STATS
+  // run ticks, opcodes, preemptions, mutex wait ticks and max latency.
+  p = p_tcb;
+  while( p != NULL ) {
+    console_printf(" run:%4d ", p->stats.run_ticks);
+    p = p->next;
+  }
+  console_printf("\n");
+
+  p = p_tcb;
+  while( p != NULL ) {
+    console_printf(" op:%5d ", p->vm.n_ops);
+    p = p->next;
+  }
+  console_printf("\n");
+
+  p = p_tcb;
+  while( p != NULL ) {
+    console_printf(" prmp:%3d ", p->stats.n_preemptions);
+    p = p->next;
+  }
+  console_printf("\n");
+
+  p = p_tcb;
+  while( p != NULL ) {
+    console_printf(" mtxw:%3d ", p->stats.mutex_wait_ticks);
+    p = p->next;
+  }
+  console_printf("\n");
+
+  p = p_tcb;
+  while( p != NULL ) {
+    console_printf(" lat:%4d ", p->stats.max_latency);
+    p = p->next;
+  }
+  console_printf("\n");
+#endif
 }
 
 
 void pqall(void)
 {
 //  console_printf("<<<<< DORMANT >>>>>\n");	pq(q_dormant_);
-  console_printf("<<<<< READY >>>>>\n");	pq(q_ready_);
+  console_printf("<<<<< READY >>>>>\n");
+  int i, j;
+  for( i = 0; i < MRBC_SMP_CORES; i++ ) {
+    for( j = 0; j < MRBC_READY_QUEUE_LEVELS; j++ ) {
+      if( q_ready_[i][j] ) pq(q_ready_[i][j]);
+    }
+  }
   console_printf("<<<<< WAITING >>>>>\n");	pq(q_waiting_);
+  console_printf("<<<<< SLEEPING >>>>>\n");	pq(q_sleeping_);
   console_printf("<<<<< SUSPENDED >>>>>\n");	pq(q_suspended_);
+
+#if MRBC_USE_TASK_STATS
+  console_printf("<<<<< LATENCY >>>>>\n");
+  for( i = 0; i < MRBC_LATENCY_HIST_SIZE; i++ ) {
+    console_printf(" %d", latency_hist_[i]);
+  }
+  console_printf("\n");
+#endif
 }
 #endif
@@ -23,6 +23,7 @@ extern "C" {
 
 /***** Local headers ********************************************************/
 #include "vm.h"
+#include "load.h"
 
 /***** Constant values ******************************************************/
 
@@ -41,13 +42,45 @@ enum MrbcTaskState {
 enum MrbcTaskReason {
   TASKREASON_SLEEP = 0x00,
   TASKREASON_MUTEX = 0x01,
+  TASKREASON_QUEUE = 0x02,
+  TASKREASON_EVENT = 0x03,
 };
 
 
+// number of latency histogram bins.
+//  bin 0 counts 0 tick, bin n counts 2^(n-1) .. 2^n-1 ticks,
+//  and the last bin counts the rest.
+#define MRBC_LATENCY_HIST_SIZE 8
+
+
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 
+//================================================
+/*!@brief
+  Task statistics (MRBC_USE_TASK_STATS)
+*/
+typedef struct RTaskStats {
+  uint32_t run_ticks;		//!< ticks while running.
+  uint32_t n_ops;		//!< number of executed opcodes.
+  uint32_t n_preemptions;	//!< times switched out while runnable.
+  uint32_t mutex_wait_ticks;	//!< ticks waited for mutexes.
+  uint32_t max_latency;		//!< worst ticks from ready to running.
+} mrbc_task_stats;
+
+//================================================
+/*!@brief
+  Profiler sample (MRBC_PROFILER_INTERVAL)
+*/
+typedef struct RProfileSample {
+  const struct IREP *irep;	//!< running irep.
+  uint16_t inst;		//!< byte offset of the instruction in irep.
+  mrbc_sym method_id;		//!< running method, or 0 at the top level.
+  uint8_t vm_id;		//!< VM of the task.
+} mrbc_profile_sample;
+
 struct RMutex;
+struct RQueue;
 
 //================================================
 /*!@brief
@@ -55,21 +88,64 @@ struct RMutex;
 */
 typedef struct RTcb {
   struct RTcb *next;
+  struct RTcb *prev;	//!< previous TCB, or the tail if on top of queue.
   uint8_t priority;
   uint8_t priority_preemption;
   uint8_t timeslice;
   uint8_t state;	//!< enum MrbcTaskState
-  uint8_t reason;	//!< SLEEP, MUTEX
+  uint8_t reason;	//!< SLEEP, MUTEX, QUEUE, EVENT
+#if MRBC_SMP_CORES > 1
+  uint8_t core;		//!< core number of the ready queue.
+#endif
+
+#if MRBC_USE_TASK_STATS
+  mrbc_task_stats stats;
+  uint32_t ready_tick;	//!< tick when became ready.
+  uint32_t wait_tick;	//!< tick when began to wait for the mutex.
+#endif
+#if MRBC_NUM_EVENTS > 0
+  uint8_t flag_event_run;	//!< woken by the event, and not run yet.
+  uint32_t event_clock;		//!< MRBC_EVENT_CLOCK() at the signal.
+#endif
 
   union {
     uint32_t wakeup_tick;
     struct RMutex *mutex;
+    struct {
+      struct RQueue *queue;
+      mrbc_value *queue_value;	//!< where the received value is stored.
+    };
+    struct {
+      uint8_t event_no;
+      mrbc_value *event_value;	//!< where the parameter is stored.
+    };
   };
+#if MRBC_USE_REALTIME
+  uint32_t period;		//!< ticks, or 0 if not periodic.
+  uint32_t deadline;		//!< ticks from the release.
+  uint32_t release_tick;	//!< release time of the current job.
+  uint32_t n_overruns;		//!< # of jobs ended after the deadline.
+  uint32_t n_skipped;		//!< # of releases skipped by the overruns.
+#endif
+#if MRBC_USE_HOT_RELOAD
+  const uint8_t *reload_code;	//!< byte code to be swapped in, or NULL.
+#endif
   struct VM vm;
 } mrbc_tcb;
 
 
 
+#if MRBC_USE_HOT_RELOAD
+//================================================
+/*!@brief
+  called when the old byte code is released. (see mrbc_reload_task)
+
+  vm_code is NULL if the old code was loaded from a stream.
+*/
+typedef void (*mrbc_reload_release_func)(mrbc_tcb *tcb, const uint8_t *vm_code);
+#endif
+
+
 //================================================
 /*!@brief
   Mutex
@@ -82,15 +158,43 @@ typedef struct RMutex {
 #define MRBC_MUTEX_INITIALIZER { 0 }
 
 
+//================================================
+/*!@brief
+  Queue
+
+  Ring buffer of values.
+  A reference counted value is moved in with its reference, and the
+  vm_id of its objects is cleared, so that it is passed to another
+  task without a copy, and outlives the sender's VM.
+*/
+typedef struct RQueue {
+  uint16_t size;	//!< capacity.
+  uint16_t head;	//!< index of the oldest value.
+  uint16_t n_stored;
+  mrbc_value *data;
+} mrbc_queue;
+
+
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
 void mrbc_tick(void);
+uint32_t mrbc_get_tick(void);
 void mrbc_init(uint8_t *ptr, unsigned int size);
 void mrbc_cleanup(void);
 void mrbc_init_tcb(mrbc_tcb *tcb);
 mrbc_tcb *mrbc_create_task(const uint8_t *vm_code, mrbc_tcb *tcb);
+mrbc_tcb *mrbc_create_task_shared(const mrbc_tcb *base, mrbc_tcb *tcb);
+#if MRBC_USE_STREAM_LOADER
+mrbc_tcb *mrbc_create_task_stream(mrbc_load_read_func read, void *user, mrbc_tcb *tcb);
+#endif
 int mrbc_start_task(mrbc_tcb *tcb);
+int mrbc_restart_task(mrbc_tcb *tcb);
+#if MRBC_USE_HOT_RELOAD
+int mrbc_reload_task(mrbc_tcb *tcb, const uint8_t *vm_code);
+void mrbc_set_reload_release_func(mrbc_reload_release_func func);
+#endif
 int mrbc_run(void);
+int mrbc_run_core(int core);
 void mrbc_sleep_ms(mrbc_tcb *tcb, uint32_t ms);
 void mrbc_relinquish(mrbc_tcb *tcb);
 void mrbc_change_priority(mrbc_tcb *tcb, int priority);
@@ -100,10 +204,48 @@ mrbc_mutex *mrbc_mutex_init(mrbc_mutex *mutex);
 int mrbc_mutex_lock(mrbc_mutex *mutex, mrbc_tcb *tcb);
 int mrbc_mutex_unlock(mrbc_mutex *mutex, mrbc_tcb *tcb);
 int mrbc_mutex_trylock(mrbc_mutex *mutex, mrbc_tcb *tcb);
+mrbc_queue *mrbc_queue_init(mrbc_queue *queue, mrbc_value *buf, int size);
+mrbc_value mrbc_queue_new(struct VM *vm, int size);
+int mrbc_queue_send(mrbc_queue *queue, mrbc_value *value);
+int mrbc_queue_send_from_isr(mrbc_queue *queue, const mrbc_value *value);
+int mrbc_queue_receive(mrbc_queue *queue, mrbc_value *value, mrbc_tcb *tcb);
+void mrbc_queue_clear(mrbc_queue *queue);
+#if MRBC_NUM_EVENTS > 0
+int mrbc_event_signal(int event_no, mrbc_int param);
+int mrbc_event_signal_from_isr(int event_no, mrbc_int param);
+int mrbc_event_wait(int event_no, mrbc_value *value, mrbc_tcb *tcb);
+uint32_t mrbc_event_max_latency(void);
+#endif
+#if MRBC_USE_TASK_STATS
+void mrbc_get_task_stats(const mrbc_tcb *tcb, mrbc_task_stats *stats);
+void mrbc_get_latency_histogram(uint32_t hist[MRBC_LATENCY_HIST_SIZE]);
+void mrbc_clear_task_stats(mrbc_tcb *tcb);
+#endif
+#if MRBC_USE_REALTIME
+void mrbc_set_period(mrbc_tcb *tcb, uint32_t period_ms, uint32_t deadline_ms);
+int mrbc_wait_period(mrbc_tcb *tcb);
+#endif
+#if MRBC_PROFILER_INTERVAL > 0
+void mrbc_profiler_start(void);
+void mrbc_profiler_stop(void);
+int mrbc_profiler_read(mrbc_profile_sample *buf, int size, uint32_t *n_dropped);
+void mrbc_profiler_dump(void);
+#endif
 
 
 /***** Inline functions *****************************************************/
 
+//================================================================
+/*! get the queue of Queue object.
+
+  @param  v	pointer to the value made by mrbc_queue_new().
+  @return	pointer to the queue.
+*/
+static inline mrbc_queue *mrbc_queue_ptr(const mrbc_value *v)
+{
+  return (mrbc_queue *)v->instance->data;
+}
+
 
 #ifdef __cplusplus
 }
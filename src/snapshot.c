@@ -0,0 +1,308 @@
+/*! @file
+  @brief
+  mruby/c heap snapshot for warm start.
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The image is the static variables of each module (symbol table,
+  globals, class pointers, task queues and so on), followed by the
+  used part of the main memory pool, that is, its top up to the last
+  free block, and the end of the pool.
+
+  +---------+-------------------------+---------------+------+
+  | header  | static variables        | top of pool   | end  |
+  +---------+-------------------------+---------------+------+
+
+  If the pool is restored to another address, every pointer sized
+  word that points into the old pool is moved by the difference.
+  This is a conservative relocation; an Integer that happens to
+  have the value of an address in the old pool is moved too.
+  The bytecode and the ROM data must be at the same address in the
+  same build, so that the image is refused if the build differs.
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <string.h>
+#include <stdint.h>
+
+#if MRBC_USE_SNAPSHOT
+#include "c_object.h"
+#include "hal_selector.h"
+#include "snapshot.h"
+
+#if defined(MRBC_ALLOC_LIBC)
+#error "MRBC_USE_SNAPSHOT needs the memory pool of mruby/c. (MRBC_ALLOC_LIBC)"
+#endif
+
+
+/***** Constant values ******************************************************/
+#define SNAPSHOT_VERSION 1
+
+// alignment of the pointers searched by relocate().
+#define RELOCATE_ALIGN (sizeof(void *) < 4 ? sizeof(void *) : 4)
+
+
+/***** Macros ***************************************************************/
+//! identifies the build, by the address of a function.
+#define SNAPSHOT_SIGNATURE ((uintptr_t)&mrbc_snapshot_restore)
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*!@brief
+  header of the image.
+*/
+typedef struct SNAPSHOT_HEADER {
+  char magic[4];		//!< "MRBS"
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t size;		//!< total bytes including this header.
+  uint32_t vars_size;		//!< bytes of the static variables.
+  uint32_t pool_size;		//!< bytes of the main memory pool.
+  uint32_t pool_head;		//!< bytes saved from the top of the pool.
+  uint32_t pool_tail;		//!< bytes saved from the end of the pool.
+  uint32_t checksum;		//!< of the following bytes.
+  uintptr_t pool;		//!< address of the main memory pool.
+  uintptr_t signature;		//!< SNAPSHOT_SIGNATURE
+} SNAPSHOT_HEADER;
+
+
+/***** Local functions ******************************************************/
+//================================================================
+/*! traverse the static variables of all modules.
+*/
+static void snapshot_vars(mrbc_snapshot *s)
+{
+  mrbc_snapshot_alloc( s );
+  mrbc_snapshot_symbol( s );
+  mrbc_snapshot_global( s );
+  mrbc_snapshot_class( s );
+#if MRBC_USE_DEFERRED_FREE
+  mrbc_snapshot_value( s );
+#endif
+  mrbc_snapshot_vm( s );
+  mrbc_snapshot_load( s );
+#if MRBC_RANGE_POOL_SIZE > 0
+  mrbc_snapshot_range( s );
+#endif
+#if MRBC_USE_CYCLE_COLLECTOR
+  mrbc_snapshot_gc( s );
+#endif
+  mrbc_snapshot_task( s );
+}
+
+
+//================================================================
+/*! FNV-1a hash, by 32-bit words.
+*/
+static uint32_t calc_checksum(const uint8_t *p, uint32_t size)
+{
+  uint32_t hash = 2166136261u;
+  uint32_t w;
+
+  for( ; size >= 4; size -= 4, p += 4 ) {
+    memcpy( &w, p, 4 );
+    hash = (hash ^ w) * 16777619u;
+  }
+  while( size-- > 0 ) {
+    hash = (hash ^ *p++) * 16777619u;
+  }
+  return hash;
+}
+
+
+//================================================================
+/*! move the pointers into the old pool.
+
+  The blocks in the pool are aligned to 4 bytes only, so that the
+  pointers in them may be unaligned on 64-bit targets.
+
+  @param  s	pointer to the traversal state.
+  @param  ptr	pointer to the restored area.
+  @param  size	size of the area.
+*/
+static void relocate(const mrbc_snapshot *s, void *ptr, unsigned int size)
+{
+  uint8_t *p = (uint8_t *)(((uintptr_t)ptr + RELOCATE_ALIGN - 1) & ~(uintptr_t)(RELOCATE_ALIGN - 1));
+  uint8_t *p_end = (uint8_t *)ptr + size;
+
+  while( p + sizeof(uintptr_t) <= p_end ) {
+    uintptr_t addr;
+    memcpy( &addr, p, sizeof(uintptr_t) );
+    if( s->old_pool <= addr && addr <= s->old_pool + s->pool_size ) {
+      addr += s->delta;
+      memcpy( p, &addr, sizeof(uintptr_t) );
+      p += sizeof(uintptr_t);
+    } else {
+      p += RELOCATE_ALIGN;
+    }
+  }
+}
+
+
+/***** Global functions *****************************************************/
+//================================================================
+/*! save or restore a static variable.
+
+  @param  s	pointer to the traversal state.
+  @param  var	pointer to the variable.
+  @param  size	size of the variable.
+*/
+void mrbc_snapshot_var(mrbc_snapshot *s, void *var, unsigned int size)
+{
+  switch( s->mode ) {
+  case MRBC_SNAPSHOT_MODE_SAVE:
+    memcpy( s->p, var, size );
+    s->p += size;
+    break;
+
+  case MRBC_SNAPSHOT_MODE_RESTORE:
+    memcpy( var, s->p, size );
+    s->p += size;
+    if( s->delta != 0 ) relocate( s, var, size );
+    break;
+  }
+
+  s->size += size;
+}
+
+
+//================================================================
+/*! size of the image.
+
+  @return	bytes, or -1 if the state can't be saved.
+*/
+int mrbc_snapshot_size(void)
+{
+  mrbc_snapshot s = { .mode = MRBC_SNAPSHOT_MODE_SIZE };
+
+  snapshot_vars( &s );
+  if( s.flag_error ) return -1;
+
+  return sizeof(SNAPSHOT_HEADER) + s.size + s.pool_head + s.pool_tail;
+}
+
+
+//================================================================
+/*! save the state to the image.
+
+  Call it while no task is running, e.g. after the initialization
+  tasks ended, or before mrbc_run().
+
+  @param  buf	pointer to the buffer, in retained RAM or flash.
+  @param  size	size of the buffer.
+  @return	bytes written, or -1 if error.
+*/
+int mrbc_snapshot_save(void *buf, unsigned int size)
+{
+  int total = mrbc_snapshot_size();
+  if( total < 0 || (unsigned int)total > size ) return -1;
+
+  SNAPSHOT_HEADER h = {
+    .magic = {'M','R','B','S'},
+    .version = SNAPSHOT_VERSION,
+    .header_size = sizeof(SNAPSHOT_HEADER),
+    .size = total,
+    .signature = SNAPSHOT_SIGNATURE,
+  };
+  mrbc_snapshot s = {
+    .mode = MRBC_SNAPSHOT_MODE_SAVE,
+    .p = (uint8_t *)buf + sizeof(SNAPSHOT_HEADER),
+  };
+
+  hal_lock();
+  snapshot_vars( &s );
+  memcpy( s.p, (void *)s.old_pool, s.pool_head );
+  memcpy( s.p + s.pool_head,
+	  (void *)(s.old_pool + s.pool_size - s.pool_tail), s.pool_tail );
+  hal_unlock();
+
+  h.vars_size = s.size;
+  h.pool_size = s.pool_size;
+  h.pool_head = s.pool_head;
+  h.pool_tail = s.pool_tail;
+  h.pool = s.old_pool;
+  h.checksum = calc_checksum( (uint8_t *)buf + sizeof(SNAPSHOT_HEADER),
+			      total - sizeof(SNAPSHOT_HEADER) );
+  memcpy( buf, &h, sizeof(SNAPSHOT_HEADER) );
+
+  return total;
+}
+
+
+//================================================================
+/*! restore the state from the image, instead of mrbc_init().
+
+  If it fails, nothing is changed, and call mrbc_init() to cold start.
+  The tasks in the image are resumed by mrbc_run().
+
+  @param  ptr		pointer to the memory pool.
+  @param  size		size of the pool, the same as the saved one.
+  @param  buf		pointer to the image.
+  @param  buf_size	size of the image buffer.
+  @retval 0		No error.
+  @retval -1		Invalid image.
+*/
+int mrbc_snapshot_restore(void *ptr, unsigned int size, const void *buf, unsigned int buf_size)
+{
+  SNAPSHOT_HEADER h;
+
+  if( buf_size < sizeof(SNAPSHOT_HEADER) ) return -1;
+  memcpy( &h, buf, sizeof(SNAPSHOT_HEADER) );
+
+  if( memcmp( h.magic, "MRBS", 4 ) != 0 ||
+      h.version != SNAPSHOT_VERSION ||
+      h.header_size != sizeof(SNAPSHOT_HEADER) ||
+      h.signature != SNAPSHOT_SIGNATURE ||
+      h.pool_size != size ||
+      h.size > buf_size ||
+      h.pool_head > h.pool_size || h.pool_tail > h.pool_size ||
+      h.size != sizeof(SNAPSHOT_HEADER) + h.vars_size + h.pool_head + h.pool_tail ) {
+    return -1;
+  }
+
+  // the layout of the static variables must be the same.
+  mrbc_snapshot s = { .mode = MRBC_SNAPSHOT_MODE_SIZE };
+  snapshot_vars( &s );
+  if( s.size != h.vars_size ) return -1;
+
+  const uint8_t *image = (const uint8_t *)buf + sizeof(SNAPSHOT_HEADER);
+  if( calc_checksum( image, h.size - sizeof(SNAPSHOT_HEADER) ) != h.checksum ) {
+    return -1;
+  }
+
+  // keep the alignment of the blocks, and the old pool range must
+  // not wrap around.
+  intptr_t delta = (intptr_t)((uintptr_t)ptr - h.pool);
+  if( (delta & 7) != 0 || h.pool + h.pool_size < h.pool ) return -1;
+
+  hal_init();
+
+  s = (mrbc_snapshot){
+    .mode = MRBC_SNAPSHOT_MODE_RESTORE,
+    .p = (uint8_t *)image,
+    .pool_size = h.pool_size,
+    .old_pool = h.pool,
+    .delta = delta,
+  };
+  snapshot_vars( &s );
+  uint8_t *tail = (uint8_t *)ptr + h.pool_size - h.pool_tail;
+  memcpy( ptr, s.p, h.pool_head );
+  memcpy( tail, s.p + h.pool_head, h.pool_tail );
+  if( delta != 0 ) {
+    relocate( &s, ptr, h.pool_head );
+    relocate( &s, tail, h.pool_tail );
+  }
+
+  mrbc_sprintf_cache_clear();
+
+  return 0;
+}
+
+#endif	// MRBC_USE_SNAPSHOT
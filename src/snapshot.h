@@ -0,0 +1,71 @@
+/*! @file
+  @brief
+  mruby/c heap snapshot for warm start.
+
+  <pre>
+  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_SNAPSHOT_H_
+#define MRBC_SRC_SNAPSHOT_H_
+
+#include "vm_config.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*!@brief
+  traversal state of the static variables. (see MRBC_SNAPSHOT_VAR)
+*/
+typedef struct RSnapshot {
+  uint8_t mode;			//!< MRBC_SNAPSHOT_MODE_*
+  uint8_t flag_error;		//!< the state can't be saved.
+  uint8_t *p;			//!< read or write point in the image.
+  uint32_t size;		//!< total bytes, counted in every mode.
+  uint32_t pool_size;		//!< size of the main memory pool.
+  uint32_t pool_head;		//!< bytes saved from the top of the pool.
+  uint32_t pool_tail;		//!< bytes saved from the end of the pool.
+  uintptr_t old_pool;		//!< address of the main pool at the save.
+  intptr_t delta;		//!< address difference of the main pool.
+} mrbc_snapshot;
+
+#define MRBC_SNAPSHOT_MODE_SIZE		0
+#define MRBC_SNAPSHOT_MODE_SAVE		1
+#define MRBC_SNAPSHOT_MODE_RESTORE	2
+
+//! save or restore a static variable.
+#define MRBC_SNAPSHOT_VAR(s,var)	mrbc_snapshot_var((s), &(var), sizeof(var))
+
+
+int mrbc_snapshot_size(void);
+int mrbc_snapshot_save(void *buf, unsigned int size);
+int mrbc_snapshot_restore(void *ptr, unsigned int size, const void *buf, unsigned int buf_size);
+void mrbc_snapshot_var(mrbc_snapshot *s, void *var, unsigned int size);
+
+// the static variables of each module.
+void mrbc_snapshot_alloc(mrbc_snapshot *s);
+void mrbc_snapshot_symbol(mrbc_snapshot *s);
+void mrbc_snapshot_global(mrbc_snapshot *s);
+void mrbc_snapshot_class(mrbc_snapshot *s);
+void mrbc_snapshot_value(mrbc_snapshot *s);
+void mrbc_snapshot_vm(mrbc_snapshot *s);
+void mrbc_snapshot_load(mrbc_snapshot *s);
+void mrbc_snapshot_range(mrbc_snapshot *s);
+void mrbc_snapshot_gc(mrbc_snapshot *s);
+void mrbc_snapshot_task(mrbc_snapshot *s);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
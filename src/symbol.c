@@ -12,6 +12,7 @@
 */
 
 /***** Feature test switches ************************************************/
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_SYMBOL
 /***** System headers *******************************************************/
 #include "vm_config.h"
 #include <stdint.h>
@@ -29,10 +30,12 @@
 #include "c_string.h"
 #include "c_array.h"
 #include "console.h"
+#include "hal_selector.h"
+#include "snapshot.h"
 
 /***** Constant values ******************************************************/
-#if !defined(MRBC_SYMBOL_SEARCH_LINER) && !defined(MRBC_SYMBOL_SEARCH_BTREE)
-#define MRBC_SYMBOL_SEARCH_BTREE
+#if MAX_SYMBOLS_COUNT > 32767 - 256
+#error "MAX_SYMBOLS_COUNT is too large. (mrbc_sym is int16_t)"
 #endif
 
 #if MAX_SYMBOLS_COUNT <= UCHAR_MAX
@@ -43,15 +46,20 @@
 
 #define OFFSET_BUILTIN_SYMBOL 256
 
+// hash table size. power of 2 and at least twice as MAX_SYMBOLS_COUNT.
+#define ROUNDUP_POW2(n) ((((n)-1) | ((n)-1) >> 1 | ((n)-1) >> 2 | \
+			  ((n)-1) >> 4 | ((n)-1) >> 8) + 1)
+#define SYM_TABLE_SIZE	ROUNDUP_POW2(MAX_SYMBOLS_COUNT * 2)
+
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+#define SYM_INDEX_INIT_SIZE 32
+#endif
+
 
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 struct SYM_INDEX {
-  uint16_t hash;	//!< hash value, returned by calc_hash().
-#ifdef MRBC_SYMBOL_SEARCH_BTREE
-  MRBC_SYMBOL_TABLE_INDEX_TYPE left;
-  MRBC_SYMBOL_TABLE_INDEX_TYPE right;
-#endif
+  uint16_t hash;	//!< hash value, returned by mrbc_calc_hash().
   const char *cstr;	//!< point to the symbol string.
 };
 
@@ -59,8 +67,23 @@ struct SYM_INDEX {
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
 
-static struct SYM_INDEX sym_index[MAX_SYMBOLS_COUNT];
-static int sym_index_pos;	// point to the last(free) sym_index array.
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+static MRBC_CONTEXT_LOCAL struct SYM_INDEX *sym_index;
+static MRBC_CONTEXT_LOCAL MRBC_SYMBOL_TABLE_INDEX_TYPE *sym_table;
+static MRBC_CONTEXT_LOCAL int sym_index_size;
+static MRBC_CONTEXT_LOCAL int sym_table_size;
+#else
+static MRBC_CONTEXT_LOCAL struct SYM_INDEX sym_index[MAX_SYMBOLS_COUNT];
+static MRBC_CONTEXT_LOCAL MRBC_SYMBOL_TABLE_INDEX_TYPE sym_table[SYM_TABLE_SIZE];
+#define sym_table_size SYM_TABLE_SIZE
+#endif
+static MRBC_CONTEXT_LOCAL int sym_index_pos;	// point to the last(free) sym_index array.
+
+// (note)
+//  sym_index[] holds symbols in registration order, so symbol id is
+//  the index + OFFSET_BUILTIN_SYMBOL.
+//  sym_table[] is an open addressing hash table of (index + 1),
+//  and 0 means an empty slot.
 
 #define MRBC_DEFINE_SYMBOL_TABLE
 #include "symbol_builtin.h"	// built-in symbol table.
@@ -71,23 +94,6 @@ static int sym_index_pos;	// point to the last(free) sym_index array.
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
 
-//================================================================
-/*! Calculate hash value.
-
-  @param  str		Target string.
-  @return uint16_t	Hash value.
-*/
-static inline uint16_t calc_hash(const char *str)
-{
-  uint16_t h = 0;
-
-  while( *str != '\0' ) {
-    h = h * 17 + *str++;
-  }
-  return h;
-}
-
-
 //================================================================
 /*! search built-in symbol table
 
@@ -135,33 +141,79 @@ static int search_builtin_symbol( const char *str )
 */
 static int search_index( uint16_t hash, const char *str )
 {
-#ifdef MRBC_SYMBOL_SEARCH_LINER
-  int i;
-  for( i = 0; i < sym_index_pos; i++ ) {
-    if( sym_index[i].hash == hash && strcmp(str, sym_index[i].cstr) == 0 ) {
-      return i;
+  if( sym_index_pos == 0 ) return -1;
+
+  int mask = sym_table_size - 1;
+  int i = hash & mask;
+  int idx;
+
+  while( (idx = sym_table[i]) != 0 ) {
+    idx--;
+    if( sym_index[idx].hash == hash && strcmp(str, sym_index[idx].cstr) == 0 ) {
+      return idx;
     }
+    i = (i + 1) & mask;
   }
   return -1;
-#endif
+}
 
-#ifdef MRBC_SYMBOL_SEARCH_BTREE
-  int i = 0;
-  do {
-    if( sym_index[i].hash == hash && strcmp(str, sym_index[i].cstr) == 0 ) {
-      return i;
-    }
-    if( hash < sym_index[i].hash ) {
-      i = sym_index[i].left;
-    } else {
-      i = sym_index[i].right;
-    }
-  } while( i != 0 );
-  return -1;
-#endif
+
+//================================================================
+/*! insert into hash table
+
+  @param  idx	index of sym_index.
+*/
+static void insert_table( int idx )
+{
+  int mask = sym_table_size - 1;
+  int i = sym_index[idx].hash & mask;
+
+  while( sym_table[i] != 0 ) {
+    i = (i + 1) & mask;
+  }
+  sym_table[i] = idx + 1;
 }
 
 
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+//================================================================
+/*! expand index and hash table
+
+  @return	0 if no error.
+*/
+static int expand_table( void )
+{
+  int size = sym_index_size ? sym_index_size * 2 : SYM_INDEX_INIT_SIZE;
+  if( size > MAX_SYMBOLS_COUNT ) size = MAX_SYMBOLS_COUNT;
+
+  struct SYM_INDEX *index = sym_index ?
+    mrbc_raw_realloc( sym_index, sizeof(struct SYM_INDEX) * size ) :
+    mrbc_raw_alloc( sizeof(struct SYM_INDEX) * size );
+  if( !index ) return -1;	// ENOMEM
+  sym_index = index;
+
+  int table_size = 16;
+  while( table_size < size * 2 ) table_size <<= 1;
+  MRBC_SYMBOL_TABLE_INDEX_TYPE *table =
+    mrbc_raw_alloc( sizeof(MRBC_SYMBOL_TABLE_INDEX_TYPE) * table_size );
+  if( !table ) return -1;	// ENOMEM
+
+  if( sym_table ) mrbc_raw_free( sym_table );
+  sym_table = table;
+  sym_table_size = table_size;
+  sym_index_size = size;
+  memset( sym_table, 0, sizeof(MRBC_SYMBOL_TABLE_INDEX_TYPE) * table_size );
+
+  int i;
+  for( i = 0; i < sym_index_pos; i++ ) {
+    insert_table( i );
+  }
+
+  return 0;
+}
+#endif
+
+
 //================================================================
 /*! add to index table
 
@@ -177,33 +229,19 @@ static int add_index( uint16_t hash, const char *str )
     return -1;
   }
 
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+  if( sym_index_pos >= sym_index_size && expand_table() != 0 ) {
+    console_printf( "Can't expand symbol table for '%s'\n", str );
+    return -1;
+  }
+#endif
+
   int idx = sym_index_pos++;
 
   // append table.
   sym_index[idx].hash = hash;
   sym_index[idx].cstr = str;
-
-#ifdef MRBC_SYMBOL_SEARCH_BTREE
-  int i = 0;
-
-  while( 1 ) {
-    if( hash < sym_index[i].hash ) {
-      // left side
-      if( sym_index[i].left == 0 ) {	// left is empty?
-        sym_index[i].left = idx;
-        break;
-      }
-      i = sym_index[i].left;
-    } else {
-      // right side
-      if( sym_index[i].right == 0 ) {	// right is empty?
-        sym_index[i].right = idx;
-        break;
-      }
-      i = sym_index[i].right;
-    }
-  }
-#endif
+  insert_table( idx );
 
   return idx;
 }
@@ -216,11 +254,38 @@ static int add_index( uint16_t hash, const char *str )
 */
 void mrbc_cleanup_symbol(void)
 {
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+  if( sym_index ) mrbc_raw_free( sym_index );
+  if( sym_table ) mrbc_raw_free( sym_table );
+  sym_index = NULL;
+  sym_table = NULL;
+  sym_index_size = 0;
+  sym_table_size = 0;
+#else
   memset(sym_index, 0, sizeof(sym_index));
+  memset(sym_table, 0, sizeof(sym_table));
+#endif
   sym_index_pos = 0;
 }
 
 
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the symbol table. (see snapshot.c)
+*/
+void mrbc_snapshot_symbol(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, sym_index );
+  MRBC_SNAPSHOT_VAR( s, sym_table );
+#if MRBC_USE_SYMBOL_TABLE_GROWTH
+  MRBC_SNAPSHOT_VAR( s, sym_index_size );
+  MRBC_SNAPSHOT_VAR( s, sym_table_size );
+#endif
+  MRBC_SNAPSHOT_VAR( s, sym_index_pos );
+}
+#endif
+
+
 //================================================================
 /*! Convert string to symbol value.
 
@@ -232,9 +297,11 @@ mrbc_sym mrbc_str_to_symid(const char *str)
   mrbc_sym sym_id = search_builtin_symbol(str);
   if( sym_id >= 0 ) return sym_id;
 
-  uint16_t h = calc_hash(str);
+  uint16_t h = mrbc_calc_hash(str);
+  hal_lock();
   sym_id = search_index(h, str);
   if( sym_id < 0 ) sym_id = add_index( h, str );
+  hal_unlock();
   if( sym_id < 0 ) return sym_id;
 
   return sym_id + OFFSET_BUILTIN_SYMBOL;
@@ -256,9 +323,13 @@ const char * mrbc_symid_to_str(mrbc_sym sym_id)
 
   sym_id -= OFFSET_BUILTIN_SYMBOL;
   if( sym_id < 0 ) return NULL;
-  if( sym_id >= sym_index_pos ) return NULL;
 
-  return sym_index[sym_id].cstr;
+  const char *ret = NULL;
+  hal_lock();
+  if( sym_id < sym_index_pos ) ret = sym_index[sym_id].cstr;
+  hal_unlock();
+
+  return ret;
 }
 
 
@@ -273,8 +344,10 @@ mrbc_sym mrbc_search_symid( const char *str )
   mrbc_sym sym_id = search_builtin_symbol(str);
   if( sym_id >= 0 ) return sym_id;
 
-  uint16_t h = calc_hash(str);
+  uint16_t h = mrbc_calc_hash(str);
+  hal_lock();
   sym_id = search_index(h, str);
+  hal_unlock();
   if( sym_id < 0 ) return sym_id;
 
   return sym_id + OFFSET_BUILTIN_SYMBOL;
@@ -290,18 +363,44 @@ mrbc_sym mrbc_search_symid( const char *str )
 */
 mrbc_value mrbc_symbol_new(struct VM *vm, const char *str)
 {
-  mrbc_sym sym_id = mrbc_search_symid( str );
+  return mrbc_symbol_new_with_hash( vm, str, mrbc_calc_hash(str) );
+}
+
+
+//================================================================
+/*! constructor with precalculated hash value
+
+  @param  vm	pointer to VM.
+  @param  str	String
+  @param  hash	hash value of str, returned by mrbc_calc_hash().
+  @return 	symbol object
+*/
+mrbc_value mrbc_symbol_new_with_hash(struct VM *vm, const char *str, uint16_t hash)
+{
+  mrbc_sym sym_id = search_builtin_symbol(str);
   if( sym_id >= 0 ) goto DONE;
 
+  hal_lock();
+  sym_id = search_index(hash, str);
+  if( sym_id >= 0 ) {
+    sym_id += OFFSET_BUILTIN_SYMBOL;
+    goto UNLOCK;
+  }
+
   // create symbol object dynamically.
   int size = strlen(str) + 1;
   char *buf = mrbc_raw_alloc_no_free(size);
-  if( buf == NULL ) return mrbc_nil_value();	// ENOMEM raise?
+  if( buf == NULL ) {
+    hal_unlock();
+    return mrbc_nil_value();	// ENOMEM raise?
+  }
 
   memcpy(buf, str, size);
-  sym_id = add_index( calc_hash(buf), buf );
+  sym_id = add_index( hash, buf );
   if( sym_id >= 0 ) sym_id += OFFSET_BUILTIN_SYMBOL;
 
+ UNLOCK:
+  hal_unlock();
  DONE:
   return mrbc_symbol_value( sym_id );
 }
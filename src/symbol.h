@@ -33,11 +33,28 @@ mrbc_sym mrbc_str_to_symid(const char *str);
 const char *mrbc_symid_to_str(mrbc_sym sym_id);
 mrbc_sym mrbc_search_symid(const char *str);
 mrbc_value mrbc_symbol_new(struct VM *vm, const char *str);
+mrbc_value mrbc_symbol_new_with_hash(struct VM *vm, const char *str, uint16_t hash);
 void mrbc_symbol_statistics(int *total_used);
 
 
 /***** Inline functions *****************************************************/
 
+//================================================================
+/*! Calculate hash value.
+
+  @param  str		Target string.
+  @return uint16_t	Hash value.
+*/
+static inline uint16_t mrbc_calc_hash(const char *str)
+{
+  uint16_t h = 0;
+
+  while( *str != '\0' ) {
+    h = h * 17 + *str++;
+  }
+  return h;
+}
+
 //================================================================
 /*! get c-language string (char *)
 */
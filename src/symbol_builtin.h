@@ -25,10 +25,13 @@ static const char *builtin_symbols[] = {
   "Float",
   "Hash",
   "IndexError",
+  "JSON",
   "MRUBYC_VERSION",
   "Math",
+  "MessagePack",
   "NilClass",
   "Object",
+  "PackedArray",
   "Proc",
   "RUBY_VERSION",
   "Range",
@@ -76,6 +79,8 @@ static const char *builtin_symbols[] = {
   "each_byte",
   "each_char",
   "each_index",
+  "each_key",
+  "each_value",
   "each_with_index",
   "empty?",
   "end_with?",
@@ -83,7 +88,12 @@ static const char *builtin_symbols[] = {
   "erfc",
   "exclude_end?",
   "exp",
+  "fill",
   "first",
+  "float32",
+  "float64",
+  "from",
+  "generate",
   "getbyte",
   "has_key?",
   "has_value?",
@@ -95,6 +105,9 @@ static const char *builtin_symbols[] = {
   "inspect",
   "instance_methods",
   "instance_variables",
+  "int16",
+  "int32",
+  "int8",
   "intern",
   "is_a?",
   "join",
@@ -113,17 +126,21 @@ static const char *builtin_symbols[] = {
   "map",
   "map!",
   "max",
+  "mean",
   "memory_statistics",
   "merge",
   "merge!",
   "message",
   "min",
   "minmax",
+  "moving_average",
   "new",
   "nil?",
   "object_id",
   "ord",
   "p",
+  "pack",
+  "parse",
   "pop",
   "print",
   "printf",
@@ -134,6 +151,7 @@ static const char *builtin_symbols[] = {
   "reject!",
   "rstrip",
   "rstrip!",
+  "scale",
   "shift",
   "sin",
   "sinh",
@@ -147,6 +165,7 @@ static const char *builtin_symbols[] = {
   "start_with?",
   "strip",
   "strip!",
+  "sum",
   "tan",
   "tanh",
   "times",
@@ -158,6 +177,8 @@ static const char *builtin_symbols[] = {
   "to_sym",
   "tr",
   "tr!",
+  "type",
+  "unpack",
   "unshift",
   "values",
   "|",
@@ -187,142 +208,163 @@ enum {
   MRBC_SYMID_Float = 18,
   MRBC_SYMID_Hash = 19,
   MRBC_SYMID_IndexError = 20,
-  MRBC_SYMID_MRUBYC_VERSION = 21,
-  MRBC_SYMID_Math = 22,
-  MRBC_SYMID_NilClass = 23,
-  MRBC_SYMID_Object = 24,
-  MRBC_SYMID_Proc = 25,
-  MRBC_SYMID_RUBY_VERSION = 26,
-  MRBC_SYMID_Range = 27,
-  MRBC_SYMID_RuntimeError = 28,
-  MRBC_SYMID_StandardError = 29,
-  MRBC_SYMID_String = 30,
-  MRBC_SYMID_Symbol = 31,
-  MRBC_SYMID_TrueClass = 32,
-  MRBC_SYMID_TypeError = 33,
-  MRBC_SYMID_ZeroDivisionError = 34,
-  MRBC_SYMID_BLL_BLR = 35,
-  MRBC_SYMID_BLL_BLR_EQ = 36,
-  MRBC_SYMID_HAT = 37,
-  MRBC_SYMID_abs = 38,
-  MRBC_SYMID_acos = 39,
-  MRBC_SYMID_acosh = 40,
-  MRBC_SYMID_all_symbols = 41,
-  MRBC_SYMID_asin = 42,
-  MRBC_SYMID_asinh = 43,
-  MRBC_SYMID_at = 44,
-  MRBC_SYMID_atan = 45,
-  MRBC_SYMID_atan2 = 46,
-  MRBC_SYMID_atanh = 47,
-  MRBC_SYMID_attr_accessor = 48,
-  MRBC_SYMID_attr_reader = 49,
-  MRBC_SYMID_b = 50,
-  MRBC_SYMID_block_given_Q = 51,
-  MRBC_SYMID_call = 52,
-  MRBC_SYMID_cbrt = 53,
-  MRBC_SYMID_chomp = 54,
-  MRBC_SYMID_chomp_EXC = 55,
-  MRBC_SYMID_chr = 56,
-  MRBC_SYMID_class = 57,
-  MRBC_SYMID_clear = 58,
-  MRBC_SYMID_collect = 59,
-  MRBC_SYMID_collect_EXC = 60,
-  MRBC_SYMID_cos = 61,
-  MRBC_SYMID_cosh = 62,
-  MRBC_SYMID_count = 63,
-  MRBC_SYMID_delete = 64,
-  MRBC_SYMID_delete_at = 65,
-  MRBC_SYMID_delete_if = 66,
-  MRBC_SYMID_dup = 67,
-  MRBC_SYMID_each = 68,
-  MRBC_SYMID_each_byte = 69,
-  MRBC_SYMID_each_char = 70,
-  MRBC_SYMID_each_index = 71,
-  MRBC_SYMID_each_with_index = 72,
-  MRBC_SYMID_empty_Q = 73,
-  MRBC_SYMID_end_with_Q = 74,
-  MRBC_SYMID_erf = 75,
-  MRBC_SYMID_erfc = 76,
-  MRBC_SYMID_exclude_end_Q = 77,
-  MRBC_SYMID_exp = 78,
-  MRBC_SYMID_first = 79,
-  MRBC_SYMID_getbyte = 80,
-  MRBC_SYMID_has_key_Q = 81,
-  MRBC_SYMID_has_value_Q = 82,
-  MRBC_SYMID_hypot = 83,
-  MRBC_SYMID_id2name = 84,
-  MRBC_SYMID_include_Q = 85,
-  MRBC_SYMID_index = 86,
-  MRBC_SYMID_initialize = 87,
-  MRBC_SYMID_inspect = 88,
-  MRBC_SYMID_instance_methods = 89,
-  MRBC_SYMID_instance_variables = 90,
-  MRBC_SYMID_intern = 91,
-  MRBC_SYMID_is_a_Q = 92,
-  MRBC_SYMID_join = 93,
-  MRBC_SYMID_key = 94,
-  MRBC_SYMID_keys = 95,
-  MRBC_SYMID_kind_of_Q = 96,
-  MRBC_SYMID_last = 97,
-  MRBC_SYMID_ldexp = 98,
-  MRBC_SYMID_length = 99,
-  MRBC_SYMID_log = 100,
-  MRBC_SYMID_log10 = 101,
-  MRBC_SYMID_log2 = 102,
-  MRBC_SYMID_loop = 103,
-  MRBC_SYMID_lstrip = 104,
-  MRBC_SYMID_lstrip_EXC = 105,
-  MRBC_SYMID_map = 106,
-  MRBC_SYMID_map_EXC = 107,
-  MRBC_SYMID_max = 108,
-  MRBC_SYMID_memory_statistics = 109,
-  MRBC_SYMID_merge = 110,
-  MRBC_SYMID_merge_EXC = 111,
-  MRBC_SYMID_message = 112,
-  MRBC_SYMID_min = 113,
-  MRBC_SYMID_minmax = 114,
-  MRBC_SYMID_new = 115,
-  MRBC_SYMID_nil_Q = 116,
-  MRBC_SYMID_object_id = 117,
-  MRBC_SYMID_ord = 118,
-  MRBC_SYMID_p = 119,
-  MRBC_SYMID_pop = 120,
-  MRBC_SYMID_print = 121,
-  MRBC_SYMID_printf = 122,
-  MRBC_SYMID_push = 123,
-  MRBC_SYMID_puts = 124,
-  MRBC_SYMID_raise = 125,
-  MRBC_SYMID_reject = 126,
-  MRBC_SYMID_reject_EXC = 127,
-  MRBC_SYMID_rstrip = 128,
-  MRBC_SYMID_rstrip_EXC = 129,
-  MRBC_SYMID_shift = 130,
-  MRBC_SYMID_sin = 131,
-  MRBC_SYMID_sinh = 132,
-  MRBC_SYMID_size = 133,
-  MRBC_SYMID_slice_EXC = 134,
-  MRBC_SYMID_sort = 135,
-  MRBC_SYMID_sort_EXC = 136,
-  MRBC_SYMID_split = 137,
-  MRBC_SYMID_sprintf = 138,
-  MRBC_SYMID_sqrt = 139,
-  MRBC_SYMID_start_with_Q = 140,
-  MRBC_SYMID_strip = 141,
-  MRBC_SYMID_strip_EXC = 142,
-  MRBC_SYMID_tan = 143,
-  MRBC_SYMID_tanh = 144,
-  MRBC_SYMID_times = 145,
-  MRBC_SYMID_to_a = 146,
-  MRBC_SYMID_to_f = 147,
-  MRBC_SYMID_to_h = 148,
-  MRBC_SYMID_to_i = 149,
-  MRBC_SYMID_to_s = 150,
-  MRBC_SYMID_to_sym = 151,
-  MRBC_SYMID_tr = 152,
-  MRBC_SYMID_tr_EXC = 153,
-  MRBC_SYMID_unshift = 154,
-  MRBC_SYMID_values = 155,
-  MRBC_SYMID_OR = 156,
-  MRBC_SYMID_TILDE = 157,
+  MRBC_SYMID_JSON = 21,
+  MRBC_SYMID_MRUBYC_VERSION = 22,
+  MRBC_SYMID_Math = 23,
+  MRBC_SYMID_MessagePack = 24,
+  MRBC_SYMID_NilClass = 25,
+  MRBC_SYMID_Object = 26,
+  MRBC_SYMID_PackedArray = 27,
+  MRBC_SYMID_Proc = 28,
+  MRBC_SYMID_RUBY_VERSION = 29,
+  MRBC_SYMID_Range = 30,
+  MRBC_SYMID_RuntimeError = 31,
+  MRBC_SYMID_StandardError = 32,
+  MRBC_SYMID_String = 33,
+  MRBC_SYMID_Symbol = 34,
+  MRBC_SYMID_TrueClass = 35,
+  MRBC_SYMID_TypeError = 36,
+  MRBC_SYMID_ZeroDivisionError = 37,
+  MRBC_SYMID_BLL_BLR = 38,
+  MRBC_SYMID_BLL_BLR_EQ = 39,
+  MRBC_SYMID_HAT = 40,
+  MRBC_SYMID_abs = 41,
+  MRBC_SYMID_acos = 42,
+  MRBC_SYMID_acosh = 43,
+  MRBC_SYMID_all_symbols = 44,
+  MRBC_SYMID_asin = 45,
+  MRBC_SYMID_asinh = 46,
+  MRBC_SYMID_at = 47,
+  MRBC_SYMID_atan = 48,
+  MRBC_SYMID_atan2 = 49,
+  MRBC_SYMID_atanh = 50,
+  MRBC_SYMID_attr_accessor = 51,
+  MRBC_SYMID_attr_reader = 52,
+  MRBC_SYMID_b = 53,
+  MRBC_SYMID_block_given_Q = 54,
+  MRBC_SYMID_call = 55,
+  MRBC_SYMID_cbrt = 56,
+  MRBC_SYMID_chomp = 57,
+  MRBC_SYMID_chomp_EXC = 58,
+  MRBC_SYMID_chr = 59,
+  MRBC_SYMID_class = 60,
+  MRBC_SYMID_clear = 61,
+  MRBC_SYMID_collect = 62,
+  MRBC_SYMID_collect_EXC = 63,
+  MRBC_SYMID_cos = 64,
+  MRBC_SYMID_cosh = 65,
+  MRBC_SYMID_count = 66,
+  MRBC_SYMID_delete = 67,
+  MRBC_SYMID_delete_at = 68,
+  MRBC_SYMID_delete_if = 69,
+  MRBC_SYMID_dup = 70,
+  MRBC_SYMID_each = 71,
+  MRBC_SYMID_each_byte = 72,
+  MRBC_SYMID_each_char = 73,
+  MRBC_SYMID_each_index = 74,
+  MRBC_SYMID_each_key = 75,
+  MRBC_SYMID_each_value = 76,
+  MRBC_SYMID_each_with_index = 77,
+  MRBC_SYMID_empty_Q = 78,
+  MRBC_SYMID_end_with_Q = 79,
+  MRBC_SYMID_erf = 80,
+  MRBC_SYMID_erfc = 81,
+  MRBC_SYMID_exclude_end_Q = 82,
+  MRBC_SYMID_exp = 83,
+  MRBC_SYMID_fill = 84,
+  MRBC_SYMID_first = 85,
+  MRBC_SYMID_float32 = 86,
+  MRBC_SYMID_float64 = 87,
+  MRBC_SYMID_from = 88,
+  MRBC_SYMID_generate = 89,
+  MRBC_SYMID_getbyte = 90,
+  MRBC_SYMID_has_key_Q = 91,
+  MRBC_SYMID_has_value_Q = 92,
+  MRBC_SYMID_hypot = 93,
+  MRBC_SYMID_id2name = 94,
+  MRBC_SYMID_include_Q = 95,
+  MRBC_SYMID_index = 96,
+  MRBC_SYMID_initialize = 97,
+  MRBC_SYMID_inspect = 98,
+  MRBC_SYMID_instance_methods = 99,
+  MRBC_SYMID_instance_variables = 100,
+  MRBC_SYMID_int16 = 101,
+  MRBC_SYMID_int32 = 102,
+  MRBC_SYMID_int8 = 103,
+  MRBC_SYMID_intern = 104,
+  MRBC_SYMID_is_a_Q = 105,
+  MRBC_SYMID_join = 106,
+  MRBC_SYMID_key = 107,
+  MRBC_SYMID_keys = 108,
+  MRBC_SYMID_kind_of_Q = 109,
+  MRBC_SYMID_last = 110,
+  MRBC_SYMID_ldexp = 111,
+  MRBC_SYMID_length = 112,
+  MRBC_SYMID_log = 113,
+  MRBC_SYMID_log10 = 114,
+  MRBC_SYMID_log2 = 115,
+  MRBC_SYMID_loop = 116,
+  MRBC_SYMID_lstrip = 117,
+  MRBC_SYMID_lstrip_EXC = 118,
+  MRBC_SYMID_map = 119,
+  MRBC_SYMID_map_EXC = 120,
+  MRBC_SYMID_max = 121,
+  MRBC_SYMID_mean = 122,
+  MRBC_SYMID_memory_statistics = 123,
+  MRBC_SYMID_merge = 124,
+  MRBC_SYMID_merge_EXC = 125,
+  MRBC_SYMID_message = 126,
+  MRBC_SYMID_min = 127,
+  MRBC_SYMID_minmax = 128,
+  MRBC_SYMID_moving_average = 129,
+  MRBC_SYMID_new = 130,
+  MRBC_SYMID_nil_Q = 131,
+  MRBC_SYMID_object_id = 132,
+  MRBC_SYMID_ord = 133,
+  MRBC_SYMID_p = 134,
+  MRBC_SYMID_pack = 135,
+  MRBC_SYMID_parse = 136,
+  MRBC_SYMID_pop = 137,
+  MRBC_SYMID_print = 138,
+  MRBC_SYMID_printf = 139,
+  MRBC_SYMID_push = 140,
+  MRBC_SYMID_puts = 141,
+  MRBC_SYMID_raise = 142,
+  MRBC_SYMID_reject = 143,
+  MRBC_SYMID_reject_EXC = 144,
+  MRBC_SYMID_rstrip = 145,
+  MRBC_SYMID_rstrip_EXC = 146,
+  MRBC_SYMID_scale = 147,
+  MRBC_SYMID_shift = 148,
+  MRBC_SYMID_sin = 149,
+  MRBC_SYMID_sinh = 150,
+  MRBC_SYMID_size = 151,
+  MRBC_SYMID_slice_EXC = 152,
+  MRBC_SYMID_sort = 153,
+  MRBC_SYMID_sort_EXC = 154,
+  MRBC_SYMID_split = 155,
+  MRBC_SYMID_sprintf = 156,
+  MRBC_SYMID_sqrt = 157,
+  MRBC_SYMID_start_with_Q = 158,
+  MRBC_SYMID_strip = 159,
+  MRBC_SYMID_strip_EXC = 160,
+  MRBC_SYMID_sum = 161,
+  MRBC_SYMID_tan = 162,
+  MRBC_SYMID_tanh = 163,
+  MRBC_SYMID_times = 164,
+  MRBC_SYMID_to_a = 165,
+  MRBC_SYMID_to_f = 166,
+  MRBC_SYMID_to_h = 167,
+  MRBC_SYMID_to_i = 168,
+  MRBC_SYMID_to_s = 169,
+  MRBC_SYMID_to_sym = 170,
+  MRBC_SYMID_tr = 171,
+  MRBC_SYMID_tr_EXC = 172,
+  MRBC_SYMID_type = 173,
+  MRBC_SYMID_unpack = 174,
+  MRBC_SYMID_unshift = 175,
+  MRBC_SYMID_values = 176,
+  MRBC_SYMID_OR = 177,
+  MRBC_SYMID_TILDE = 178,
 };
 #endif
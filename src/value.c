@@ -16,19 +16,32 @@
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
 #include "vm_config.h"
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#if MRBC_USE_FLOAT
+#include <stdlib.h>
+#endif
 
 /***** Local headers ********************************************************/
 #include "value.h"
+#include "alloc.h"
 #include "class.h"
 #include "c_string.h"
 #include "c_range.h"
 #include "c_array.h"
 #include "c_hash.h"
+#include "snapshot.h"
 
 
 /***** Constant values ******************************************************/
+#if MRBC_USE_REALTIME && !MRBC_USE_DEFERRED_FREE
+#error "MRBC_USE_REALTIME needs MRBC_USE_DEFERRED_FREE."
+#endif
+
+// initial size of the visited list of mrbc_clear_vm_id().
+#define CLEAR_VM_ID_LIST_SIZE 8
+
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
@@ -52,11 +65,135 @@ void (* const mrbc_delfunc[])(mrbc_value *) = {
   mrbc_hash_delete,
 };
 
+#if MRBC_USE_DEFERRED_FREE
+//! objects whose counter reached zero, waiting to be deleted.
+MRBC_CONTEXT_LOCAL mrbc_value mrbc_free_queue[MRBC_FREE_QUEUE_SIZE];
+MRBC_CONTEXT_LOCAL int mrbc_free_queue_n;
+#endif
+
 
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
+//================================================================
+/*! the object has references to the other objects.
+*/
+static int is_container(const mrbc_value *v)
+{
+  switch( v->tt ) {
+  case MRBC_TT_OBJECT:
+  case MRBC_TT_ARRAY:
+  case MRBC_TT_RANGE:
+  case MRBC_TT_HASH:
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+
+//================================================================
+/*! get the i-th reference of the container.
+
+  @param  v	pointer to the container.
+  @param  i	index.
+  @param  buf	buffer for the reference that is not a mrbc_value.
+  @return	pointer to the reference, or NULL if out of range.
+*/
+static mrbc_value * child_of(mrbc_value *v, int i, mrbc_value *buf)
+{
+  switch( v->tt ) {
+  case MRBC_TT_OBJECT:
+    if( v->instance->ivar == NULL || i >= v->instance->n_ivar ) break;
+    return &v->instance->ivar[i];
+
+  case MRBC_TT_ARRAY:
+  case MRBC_TT_HASH:
+#if MRBC_USE_SHARED_SLICE
+    // the owner has the data of the slice.
+    if( v->array->shared ) {
+      if( i != 0 ) break;
+      buf->tt = v->tt;
+      buf->array = v->array->shared;
+      return buf;
+    }
+#endif
+    if( i >= v->array->n_stored ) break;
+    return &v->array->data[i];
+
+  case MRBC_TT_RANGE:
+    if( i == 0 ) return &v->range->first;
+    if( i == 1 ) return &v->range->last;
+    break;
+
+  default:
+    break;
+  }
+
+  return NULL;
+}
+
+
+//================================================================
+/*! clear vm_id of the object only.
+*/
+static void clear_vm_id_of(mrbc_value *v)
+{
+  switch( v->tt ) {
+  case MRBC_TT_OBJECT:	mrbc_instance_clear_vm_id(v);	break;
+  case MRBC_TT_ARRAY:	mrbc_array_clear_vm_id(v);	break;
+#if MRBC_USE_STRING
+  case MRBC_TT_STRING:	mrbc_string_clear_vm_id(v);	break;
+#endif
+  case MRBC_TT_RANGE:	mrbc_range_clear_vm_id(v);	break;
+  case MRBC_TT_HASH:	mrbc_hash_clear_vm_id(v);	break;
+
+  default:
+    // Nothing
+    break;
+  }
+}
+
+
 /***** Global functions *****************************************************/
 
+#if MRBC_USE_DEFERRED_FREE
+//================================================================
+/*! delete the objects in the free queue.
+
+  The children released by a deletion are queued again, and
+  deleted in the same call as long as max_objects allows.
+
+  @param  max_objects	maximum number of objects, or -1 to empty the queue.
+  @return		number of deleted objects.
+*/
+int mrbc_drain_free_queue(int max_objects)
+{
+  int n = 0;
+
+  while( mrbc_free_queue_n > 0 && n != max_objects ) {
+    mrbc_value v = mrbc_free_queue[--mrbc_free_queue_n];
+    (*mrbc_delfunc[ v.tt - MRBC_TT_INC_DEC_THRESHOLD ])(&v);
+    n++;
+  }
+
+  return n;
+}
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the free queue. (see snapshot.c)
+*/
+void mrbc_snapshot_value(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, mrbc_free_queue );
+  MRBC_SNAPSHOT_VAR( s, mrbc_free_queue_n );
+}
+#endif
+#endif
+
+
 //================================================================
 /*! compare two mrbc_values
 
@@ -145,24 +282,74 @@ int mrbc_compare(const mrbc_value *v1, const mrbc_value *v2)
 
 
 //================================================================
-/*! clear vm id
-
-  @param   v     Pointer to target mrbc_value
+/*! clear vm id of the object, and the objects that it refers to.
+
+  @param  v		Pointer to target mrbc_value
+  @param  flag_no_proc	refuse the value that refers to a Proc.
+  @retval 0		No error.
+  @retval 1		refused. It refers to a Proc.
+  @retval -1		ENOMEM.
+
+  The containers are listed first, and the list is the visited mark,
+  so that a reference cycle or a shared object stops the walk.
+  Nothing is changed unless it returns 0. The list is searched
+  linearly, so that it costs the square of the number of containers.
 */
-void mrbc_clear_vm_id(mrbc_value *v)
+int mrbc_clear_vm_id(mrbc_value *v, int flag_no_proc)
 {
-  switch( mrbc_type(*v) ) {
-  case MRBC_TT_ARRAY:	mrbc_array_clear_vm_id(v);	break;
-#if MRBC_USE_STRING
-  case MRBC_TT_STRING:	mrbc_string_clear_vm_id(v);	break;
-#endif
-  case MRBC_TT_RANGE:	mrbc_range_clear_vm_id(v);	break;
-  case MRBC_TT_HASH:	mrbc_hash_clear_vm_id(v);	break;
+  if( v->tt == MRBC_TT_PROC ) return flag_no_proc;
+  if( !is_container(v) ) {
+    clear_vm_id_of(v);
+    return 0;
+  }
 
-  default:
-    // Nothing
-    break;
+  int size = CLEAR_VM_ID_LIST_SIZE;
+  mrbc_value *list = mrbc_raw_alloc( sizeof(mrbc_value) * size );
+  if( !list ) return -1;	// ENOMEM
+
+  mrbc_value buf, *c;
+  int n = 1, ret = 0;
+  int i, j, k;
+
+  // list the containers.
+  list[0] = *v;
+  for( i = 0; i < n; i++ ) {
+    for( j = 0; (c = child_of(&list[i], j, &buf)) != NULL; j++ ) {
+      if( c->tt == MRBC_TT_PROC && flag_no_proc ) {
+	ret = 1;
+	goto DONE;
+      }
+      if( !is_container(c) ) continue;
+
+      for( k = 0; k < n; k++ ) {
+	if( list[k].obj == c->obj ) break;
+      }
+      if( k < n ) continue;	// visited.
+
+      if( n == size ) {
+	mrbc_value *p = mrbc_raw_realloc( list, sizeof(mrbc_value) * size * 2 );
+	if( !p ) {
+	  ret = -1;		// ENOMEM
+	  goto DONE;
+	}
+	list = p;
+	size *= 2;
+      }
+      list[n++] = *c;
+    }
   }
+
+  // clear them, and their leaves.
+  for( i = 0; i < n; i++ ) {
+    clear_vm_id_of( &list[i] );
+    for( j = 0; (c = child_of(&list[i], j, &buf)) != NULL; j++ ) {
+      if( !is_container(c) ) clear_vm_id_of( c );
+    }
+  }
+
+ DONE:
+  mrbc_raw_free( list );
+  return ret;
 }
 
 
@@ -175,7 +362,7 @@ void mrbc_clear_vm_id(mrbc_value *v)
 */
 mrbc_int mrbc_atoi( const char *s, int base )
 {
-  int ret = 0;
+  mrbc_uint ret = 0;
   int sign = 0;
 
  REDO:
@@ -192,27 +379,134 @@ mrbc_int mrbc_atoi( const char *s, int base )
     goto REDO;
   }
 
-  int ch;
-  while( (ch = *s++) != '\0' ) {
-    int n;
-
-    if( 'a' <= ch ) {
-      n = ch - 'a' + 10;
-    } else
-    if( 'A' <= ch ) {
-      n = ch - 'A' + 10;
-    } else
-    if( '0' <= ch && ch <= '9' ) {
-      n = ch - '0';
-    } else {
-      break;
+  unsigned int n;
+  if( base == 10 ) {
+    // (note) the compiler makes '* 10' to shift and add.
+    while( (n = (unsigned char)*s++ - '0') < 10 ) {
+      ret = ret * 10 + n;
     }
-    if( n >= base ) break;
 
-    ret = ret * base + n;
+  } else {
+    int ch;
+    while( (ch = *s++) != '\0' ) {
+      if( (n = ch - '0') < 10 ) {
+	// digit
+      } else if( (n = (ch | 0x20) - 'a') < 26 ) {
+	n += 10;
+      } else {
+	break;
+      }
+      if( n >= (unsigned int)base ) break;
+
+      ret = ret * base + n;
+    }
   }
 
   if( sign ) ret = -ret;
 
   return ret;
 }
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! convert ASCII string to double mruby/c version
+
+  A plain decimal number that has up to 19 significant digits and
+  small exponent is converted by one multiplication or division,
+  which is exact. Others are passed to atof().
+
+  @param  s	source string.
+  @return	result.
+*/
+double mrbc_atof( const char *s )
+{
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char *p = s;
+  int sign = 0;
+  uint64_t mant = 0;
+  int n_dig = 0;		// significant digits in mant.
+  int exp10 = 0;
+  int n_read = 0;		// all digits read.
+  unsigned int n;
+
+  while( *p == ' ' ) p++;
+  switch( *p ) {
+  case '-':
+    sign = 1;
+    // fall through.
+  case '+':
+    p++;
+  }
+
+  // integer part
+  while( (n = (unsigned char)*p - '0') < 10 ) {
+    if( mant != 0 || n != 0 ) {
+      if( ++n_dig > 19 ) goto FALLBACK;
+      mant = mant * 10 + n;
+    }
+    p++;
+    n_read++;
+  }
+
+  // fraction part
+  if( *p == '.' ) {
+    p++;
+    while( (n = (unsigned char)*p - '0') < 10 ) {
+      if( mant != 0 || n != 0 ) {
+	if( ++n_dig > 19 ) goto FALLBACK;
+	mant = mant * 10 + n;
+      }
+      exp10--;
+      p++;
+      n_read++;
+    }
+  }
+  if( n_read == 0 ) goto FALLBACK;	// "inf", "nan", "\t1" etc.
+  if( *p == 'x' || *p == 'X' ) goto FALLBACK;	// hexadecimal.
+
+  // exponent part
+  if( *p == 'e' || *p == 'E' ) {
+    const char *p_exp = ++p;
+    int exp_sign = 0;
+    int e = 0;
+
+    switch( *p ) {
+    case '-':
+      exp_sign = 1;
+      // fall through.
+    case '+':
+      p++;
+    }
+    if( (unsigned char)*p - '0' < 10 ) {
+      while( (n = (unsigned char)*p - '0') < 10 ) {
+	if( e > 9999 ) goto FALLBACK;
+	e = e * 10 + n;
+	p++;
+      }
+      exp10 += exp_sign ? -e : e;
+    } else {
+      p = p_exp;		// "1e" is 1.
+    }
+  }
+
+  if( mant > ((uint64_t)1 << 53) ) goto FALLBACK;
+  if( mant == 0 ) exp10 = 0;
+
+  double d = (double)mant;
+  if( exp10 < 0 ) {
+    if( exp10 < -22 ) goto FALLBACK;
+    d /= pow10[-exp10];
+  } else {
+    if( exp10 > 22 ) goto FALLBACK;
+    d *= pow10[exp10];
+  }
+
+  return sign ? -d : d;
+
+ FALLBACK:
+  return atof(s);
+}
+#endif
@@ -27,6 +27,10 @@ extern "C" {
 
 /***** Local headers ********************************************************/
 /***** Constant values ******************************************************/
+//! the range of mrbc_int.
+#define MRBC_INT_MAX	((mrbc_int)((mrbc_uint)-1 >> 1))
+#define MRBC_INT_MIN	(-MRBC_INT_MAX - 1)
+
 /***** Typedefs *************************************************************/
 // pre define of some struct
 struct VM;
@@ -38,10 +42,13 @@ struct RProc;
 // mrbc types
 #if defined(MRBC_INT16)
 typedef int16_t mrbc_int;
+typedef uint16_t mrbc_uint;
 #elif defined(MRBC_INT64)
 typedef int64_t mrbc_int;
+typedef uint64_t mrbc_uint;
 #else
 typedef int32_t mrbc_int;
+typedef uint32_t mrbc_uint;
 #endif
 typedef mrbc_int mrb_int;
 
@@ -119,11 +126,19 @@ typedef enum {
 /*!@brief
   Define the object structure having reference counter.
 */
+#if MRBC_USE_CYCLE_COLLECTOR
+#if defined(MRBC_DEBUG)
+#define MRBC_OBJECT_HEADER  uint8_t type[2]; uint16_t ref_count; uint8_t gc_flag
+#else
+#define MRBC_OBJECT_HEADER  uint16_t ref_count; uint8_t gc_flag
+#endif
+#else
 #if defined(MRBC_DEBUG)
 #define MRBC_OBJECT_HEADER  uint8_t type[2]; uint16_t ref_count;
 #else
 #define MRBC_OBJECT_HEADER  uint16_t ref_count;
 #endif
+#endif
 
 struct RBasic {
   MRBC_OBJECT_HEADER;
@@ -134,7 +149,13 @@ struct RBasic {
 //================================================================
 /*!@brief
   mruby/c value object.
+
+  (note) MRBC_COMPACT_VALUE packs this into 4-byte alignment.
+  With double, it makes 12 bytes instead of 16.
 */
+#if MRBC_COMPACT_VALUE
+#pragma pack(push, 4)
+#endif
 struct RObject {
   mrbc_vtype tt : 8;
   union {
@@ -154,6 +175,9 @@ struct RObject {
     void *handle;		// internal use only.
   };
 };
+#if MRBC_COMPACT_VALUE
+#pragma pack(pop)
+#endif
 typedef struct RObject mrb_object;	// not recommended.
 typedef struct RObject mrb_value;	// not recommended.
 typedef struct RObject mrbc_object;
@@ -243,21 +267,53 @@ typedef struct RObject mrbc_value;
 #define GET_FLOAT_ARG(n)	(v[(n)].d)
 #define GET_STRING_ARG(n)	(v[(n)].string->data)
 
+// reference counter operations, atomic on multi-core.
+#if MRBC_SMP_CORES > 1
+#if MRBC_USE_CYCLE_COLLECTOR || MRBC_USE_DEFERRED_FREE
+#error "Cycle collector and deferred free can't be used with MRBC_SMP_CORES."
+#endif
+#define MRBC_REF_INC(p)	__atomic_add_fetch(&(p)->ref_count, 1, __ATOMIC_RELAXED)
+#define MRBC_REF_DEC(p)	__atomic_sub_fetch(&(p)->ref_count, 1, __ATOMIC_ACQ_REL)
+#else
+#define MRBC_REF_INC(p)	(++(p)->ref_count)
+#define MRBC_REF_DEC(p)	(--(p)->ref_count)
+#endif
+
+#if MRBC_USE_CYCLE_COLLECTOR
+#define MRBC_INIT_GC_FLAG(p)	(p)->gc_flag = 0
+#else
+#define MRBC_INIT_GC_FLAG(p)	((void)0)
+#endif
 #if defined(MRBC_DEBUG)
-#define MRBC_INIT_OBJECT_HEADER(p, t)  (p)->ref_count = 1; (p)->type[0] = (t)[0]; (p)->type[1] = (t)[1]
+#define MRBC_INIT_OBJECT_HEADER(p, t)  (p)->ref_count = 1; (p)->type[0] = (t)[0]; (p)->type[1] = (t)[1]; MRBC_INIT_GC_FLAG(p)
 #else
-#define MRBC_INIT_OBJECT_HEADER(p, t)  (p)->ref_count = 1
+#define MRBC_INIT_OBJECT_HEADER(p, t)  (p)->ref_count = 1; MRBC_INIT_GC_FLAG(p)
 #endif
 
 
 /***** Global variables *****************************************************/
 extern void (* const mrbc_delfunc[])(mrbc_value *);
+#if MRBC_USE_DEFERRED_FREE
+extern MRBC_CONTEXT_LOCAL mrbc_value mrbc_free_queue[MRBC_FREE_QUEUE_SIZE];
+extern MRBC_CONTEXT_LOCAL int mrbc_free_queue_n;
+#endif
 
 
 /***** Function prototypes **************************************************/
 int mrbc_compare(const mrbc_value *v1, const mrbc_value *v2);
-void mrbc_clear_vm_id(mrbc_value *v);
+int mrbc_clear_vm_id(mrbc_value *v, int flag_no_proc);
 mrbc_int mrbc_atoi(const char *s, int base);
+#if MRBC_USE_FLOAT
+double mrbc_atof(const char *s);
+#endif
+#if MRBC_USE_CYCLE_COLLECTOR
+void mrbc_gc_possible_root(mrbc_value *v);
+#endif
+#if MRBC_USE_DEFERRED_FREE
+int mrbc_drain_free_queue(int max_objects);
+#else
+#define mrbc_drain_free_queue(max_objects)	((void)0)
+#endif
 
 
 /***** Inline functions *****************************************************/
@@ -273,7 +329,7 @@ static inline void mrbc_incref(mrbc_value *v)
 
   assert( v->obj->ref_count != 0 );
   assert( v->obj->ref_count != 0xff );	// check max value.
-  v->obj->ref_count++;
+  MRBC_REF_INC( v->obj );
 }
 
 
@@ -289,8 +345,19 @@ static inline void mrbc_decref(mrbc_value *v)
   assert( v->obj->ref_count != 0 );
   assert( v->obj->ref_count != 0xffff );	// check broken data.
 
-  if( --v->obj->ref_count != 0 ) return;
-
+  if( MRBC_REF_DEC( v->obj ) != 0 ) {
+#if MRBC_USE_CYCLE_COLLECTOR
+    mrbc_gc_possible_root(v);
+#endif
+    return;
+  }
+
+#if MRBC_USE_DEFERRED_FREE
+  if( mrbc_free_queue_n < MRBC_FREE_QUEUE_SIZE ) {
+    mrbc_free_queue[mrbc_free_queue_n++] = *v;
+    return;
+  }
+#endif
   (*mrbc_delfunc[ v->tt - MRBC_TT_INC_DEC_THRESHOLD ])(v);
 }
 
@@ -307,6 +374,71 @@ static inline void mrbc_decref_empty(mrbc_value *v)
 }
 
 
+//================================================================
+/*! add mrbc_int with overflow check
+
+  @param  a	value 1
+  @param  b	value 2
+  @param  r	returns a + b. (wrapped around if overflowed)
+  @return	non-zero if overflowed.
+*/
+static inline int mrbc_int_add_overflow(mrbc_int a, mrbc_int b, mrbc_int *r)
+{
+#if defined(__GNUC__) && __GNUC__ >= 5 || defined(__clang__)
+  return __builtin_add_overflow( a, b, r );
+#else
+  *r = (mrbc_uint)a + (mrbc_uint)b;
+  return ((a ^ *r) & (b ^ *r)) < 0;
+#endif
+}
+
+
+//================================================================
+/*! subtract mrbc_int with overflow check
+
+  @param  a	value 1
+  @param  b	value 2
+  @param  r	returns a - b. (wrapped around if overflowed)
+  @return	non-zero if overflowed.
+*/
+static inline int mrbc_int_sub_overflow(mrbc_int a, mrbc_int b, mrbc_int *r)
+{
+#if defined(__GNUC__) && __GNUC__ >= 5 || defined(__clang__)
+  return __builtin_sub_overflow( a, b, r );
+#else
+  *r = (mrbc_uint)a - (mrbc_uint)b;
+  return ((a ^ b) & (a ^ *r)) < 0;
+#endif
+}
+
+
+//================================================================
+/*! multiply mrbc_int with overflow check
+
+  @param  a	value 1
+  @param  b	value 2
+  @param  r	returns a * b. (wrapped around if overflowed)
+  @return	non-zero if overflowed.
+*/
+static inline int mrbc_int_mul_overflow(mrbc_int a, mrbc_int b, mrbc_int *r)
+{
+#if defined(__GNUC__) && __GNUC__ >= 5 || defined(__clang__)
+  return __builtin_mul_overflow( a, b, r );
+#elif !defined(MRBC_INT64)
+  int64_t t = (int64_t)a * b;
+  *r = (mrbc_int)t;
+  return t != *r;
+#else
+  *r = (mrbc_uint)a * (mrbc_uint)b;
+  if( a > 0 ) {
+    return (b > 0) ? (a > MRBC_INT_MAX / b) : (b < MRBC_INT_MIN / a);
+  }
+  if( b > 0 ) return a < MRBC_INT_MIN / b;
+  return a != 0 && b < MRBC_INT_MAX / a;
+#endif
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,7 @@
   </pre>
 */
 
+#define MRBC_ALLOC_TAG MRBC_ALLOC_TAG_CALLINFO
 #include "vm_config.h"
 #include <stddef.h>
 #include <string.h>
@@ -25,12 +26,25 @@
 #include "class.h"
 #include "symbol.h"
 #include "console.h"
+#include "hal_selector.h"
 
 #include "c_object.h"
 #include "c_string.h"
 #include "c_range.h"
 #include "c_array.h"
 #include "c_hash.h"
+#include "gc.h"
+#include "snapshot.h"
+#if MRBC_TRACE_EVENTS > 0
+#include "rrt0.h"
+#endif
+
+#if MRBC_USE_SHARED_LITERAL && !MRBC_USE_SHARED_SLICE
+#error "MRBC_USE_SHARED_LITERAL needs MRBC_USE_SHARED_SLICE."
+#endif
+#if MRBC_USE_SHARED_LITERAL && MRBC_SMP_CORES > 1
+#error "MRBC_USE_SHARED_LITERAL can't be used with MRBC_SMP_CORES."
+#endif
 
 
 /***** Macros ***************************************************************/
@@ -47,7 +61,18 @@
   } while (0)
 
 
-static uint16_t free_vm_bitmap[MAX_VM_COUNT / 16 + 1];
+static MRBC_CONTEXT_LOCAL uint16_t free_vm_bitmap[MAX_VM_COUNT / 16 + 1];
+
+#if MRBC_USE_SHARED_LITERAL
+//! the elements of an Array or Hash literal. (see shared_literal)
+typedef struct LITERAL_CACHE {
+  struct LITERAL_CACHE *next;
+  const uint8_t *inst;		//!< OP_ARRAY or OP_HASH of this literal.
+  mrbc_value value;		//!< hidden Array or Hash, or empty if not shared.
+} mrbc_literal_cache;
+
+static MRBC_CONTEXT_LOCAL mrbc_literal_cache *literal_cache;
+#endif
 
 #define CALL_MAXARGS 255
 
@@ -60,16 +85,55 @@ static uint16_t free_vm_bitmap[MAX_VM_COUNT / 16 + 1];
 */
 static const char * mrbc_get_irep_symbol( struct VM *vm, int n )
 {
-  const uint8_t *p = vm->pc_irep->ptr_to_sym;
-  int cnt = bin_to_uint32(p);
-  if( n >= cnt ) return 0;
-  p += 4;
+#if !MRBC_USE_BYTECODE_VERIFIER
+  // verified bytecode never has an index out of range.
+  if( n >= vm->pc_irep->slen ) return 0;
+#endif
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  // the stream loader leaves no SYMS block.
+  return mrbc_symid_to_str( vm->pc_irep->sym_ids[n] );
+#else
+  const uint8_t *p = vm->pc_irep->ptr_to_sym + 4;
   while( n > 0 ) {
     uint16_t s = bin_to_uint16(p);
     p += 2+s+1;   // size(2 bytes) + symbol len + '\0'
     n--;
   }
   return (char *)p+2;  // skip size(2 bytes)
+#endif
+}
+
+
+//================================================================
+/*! get symbol ID of sym[n] in irep
+
+  @param  vm	Pointer to VM
+  @param  n	n th
+  @return	symbol ID
+*/
+static inline mrbc_sym mrbc_get_irep_symid( struct VM *vm, int n )
+{
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  return vm->pc_irep->sym_ids[n];
+#else
+  return str_to_symid( mrbc_get_irep_symbol(vm, n) );
+#endif
+}
+
+
+//================================================================
+/*! get n-th child irep
+
+  @param  irep	parent irep.
+  @param  n	n th
+  @return	pointer to irep, or NULL if ENOMEM.
+*/
+static inline mrbc_irep * mrbc_get_irep_child( mrbc_irep *irep, int n )
+{
+#if MRBC_USE_LAZY_IREP_LOAD
+  if( irep->reps[n] == NULL ) return mrbc_load_irep_child( irep, n );
+#endif
+  return irep->reps[n];
 }
 
 
@@ -83,17 +147,65 @@ static void not_supported(void)
 
 
 //================================================================
-/*! Method call by method name
+/*! find method, using inline method cache if given
+
+  @param  r_method	pointer to mrbc_method to return values.
+  @param  cls		search class.
+  @param  sym_id	symbol id.
+  @param  cache		pointer to cache entry or NULL.
+  @return		pointer to method or NULL.
+*/
+static inline mrbc_method *find_method_cached( mrbc_method *r_method, mrbc_class *cls, mrbc_sym sym_id, mrbc_method_cache *cache )
+{
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( cache ) {
+    if( cache->cls == cls && cache->epoch == mrbc_method_epoch ) {
+      *r_method = cache->method;
+      return r_method;
+    }
+
+    if( mrbc_find_method( r_method, cls, sym_id ) == 0 ) return 0;
+    cache->cls = cls;
+    cache->epoch = mrbc_method_epoch;
+    cache->method = *r_method;
+    return r_method;
+  }
+#endif
+
+  return mrbc_find_method( r_method, cls, sym_id );
+}
+
+
+//================================================================
+/*! get inline method cache entry of sym[n] in irep
+
+  @param  vm	Pointer to VM
+  @param  n	n th
+  @return	pointer to cache entry or NULL.
+*/
+static inline mrbc_method_cache *mrbc_get_irep_method_cache( struct VM *vm, int n )
+{
+#if MRBC_USE_INLINE_METHOD_CACHE
+  return &vm->pc_irep->method_cache[n];
+#else
+  return 0;
+#endif
+}
+
+
+//================================================================
+/*! Method call by method symbol ID
 
   @param  vm		pointer of VM.
-  @param  method_name	method name
+  @param  sym_id	method symbol ID
   @param  regs		pointer to regs
   @param  a		operand a
   @param  c		operand c
   @param  is_sendb	Is called from OP_SENDB?
+  @param  cache		pointer to inline method cache or NULL.
   @retval 0  No error.
 */
-static int send_by_name( struct VM *vm, const char *method_name, mrbc_value *regs, int a, int c, int is_sendb )
+static int send_by_symid( struct VM *vm, mrbc_sym sym_id, mrbc_value *regs, int a, int c, int is_sendb, mrbc_method_cache *cache )
 {
   mrbc_value *recv = &regs[a];
 
@@ -108,20 +220,23 @@ static int send_by_name( struct VM *vm, const char *method_name, mrbc_value *reg
     regs[bidx].tt = MRBC_TT_NIL;
   }
 
-  mrbc_sym sym_id = str_to_symid(method_name);
   mrbc_class *cls = find_class_by_object(recv);
   mrbc_method method;
 
-  if( mrbc_find_method( &method, cls, sym_id ) == 0 ) {
+  if( find_method_cached( &method, cls, sym_id, cache ) == 0 ) {
     console_printf("Undefined local variable or method '%s' for %s\n",
-		   method_name, symid_to_str( cls->sym_id ));
+		   symid_to_str( sym_id ), symid_to_str( cls->sym_id ));
     return 1;
   }
 
   // call C method.
   if( method.c_func ) {
+    mrbc_callinfo *callinfo_tail = vm->callinfo_tail;
+    MRBC_TRACE( vm, MRBC_TRACE_CFUNC, sym_id );
     method.func(vm, regs + a, c);
-    if( method.func == c_proc_call ) return 0;
+    MRBC_TRACE( vm, MRBC_TRACE_CFUNC_END, sym_id );
+    // the method pushed a frame. e.g. Proc#call, native iterator.
+    if( vm->callinfo_tail != callinfo_tail ) return 0;
     if( vm->exc != NULL || vm->exc_pending != NULL ) return 0;
 
     int release_reg = a+1;
@@ -133,6 +248,7 @@ static int send_by_name( struct VM *vm, const char *method_name, mrbc_value *reg
   }
 
   // call Ruby method.
+  if( mrbc_check_regs( vm, regs + a, method.irep ) ) return 1;
   if( flag_array_arg ) c = CALL_MAXARGS;
   mrbc_callinfo *callinfo = mrbc_push_callinfo(vm, sym_id, a, c);
   callinfo->own_class = method.cls;
@@ -148,13 +264,149 @@ static int send_by_name( struct VM *vm, const char *method_name, mrbc_value *reg
 }
 
 
+//================================================================
+/*! Method call by method name
+
+  @param  vm		pointer of VM.
+  @param  method_name	method name
+  @param  regs		pointer to regs
+  @param  a		operand a
+  @param  c		operand c
+  @param  is_sendb	Is called from OP_SENDB?
+  @retval 0  No error.
+*/
+static int send_by_name( struct VM *vm, const char *method_name, mrbc_value *regs, int a, int c, int is_sendb )
+{
+  return send_by_symid( vm, str_to_symid(method_name), regs, a, c, is_sendb, 0 );
+}
+
+
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! native iterator frame.
+
+  R0 self, R1 block, R2-R4 work, R5 return value, R6 mrbc_native_iter,
+  R7.. the block to call and its arguments.
+*/
+#define NATIVE_ITER_NREGS 11
+static const uint8_t native_iter_code[] = {
+  OP_NATIVE_ITER,
+  OP_RETURN, 5,
+};
+static const uint8_t native_iter_syms[4];
+static const mrbc_irep native_iter_irep = {
+#if defined(MRBC_DEBUG)
+  .type = "RP",
+#endif
+  .nregs = NATIVE_ITER_NREGS,
+  .ilen = sizeof(native_iter_code),
+  .code = (uint8_t *)native_iter_code,
+  .ptr_to_sym = (uint8_t *)native_iter_syms,
+};
+
+
+//================================================================
+/*! start the native iterator.
+
+  Call it from a C method instead of looping over the block there.
+  It pushes a VM frame that calls step() and the block by turns,
+  so break, exceptions and task switching work as a Ruby method.
+  Without a block or with arguments, the Ruby version of the method
+  is called instead.
+
+  @param  vm		pointer of VM.
+  @param  v		v[] of the C method.
+  @param  argc		argc of the C method.
+  @param  iter		iterator.
+*/
+void mrbc_native_iter_start(struct VM *vm, mrbc_value v[], int argc, const mrbc_native_iter *iter)
+{
+  if( argc != 0 || v[1].tt != MRBC_TT_PROC ) {
+    mrbc_native_iter_fallback( vm, v, argc, iter->sym_id );
+    return;
+  }
+
+  if( mrbc_check_regs( vm, v, &native_iter_irep ) ) return;
+  if( !mrbc_push_callinfo(vm, iter->sym_id, v - vm->current_regs, argc) ) {
+    return;	// ENOMEM
+  }
+
+  int i;
+  for( i = 2; i < NATIVE_ITER_NREGS; i++ ) {
+    mrbc_decref_empty( &v[i] );
+  }
+  for( i = 2; i < 5; i++ ) {
+    v[i] = mrbc_fixnum_value(0);
+  }
+  v[5] = v[0];
+  mrbc_incref( &v[5] );
+  v[6].tt = MRBC_TT_HANDLE;
+  v[6].handle = (void *)iter;
+
+  vm->pc_irep = (mrbc_irep *)&native_iter_irep;
+  vm->inst = vm->pc_irep->code;
+  vm->current_regs = v;
+}
+
+
+//================================================================
+/*! call the Ruby version of the method, hidden by the native one.
+
+  @param  vm		pointer of VM.
+  @param  v		v[] of the C method.
+  @param  argc		argc of the C method.
+  @param  sym_id	method name.
+*/
+void mrbc_native_iter_fallback(struct VM *vm, mrbc_value v[], int argc, mrbc_sym sym_id)
+{
+  mrbc_class *cls = find_class_by_object( &v[0] );
+  mrbc_method *method = 0;
+
+  for( ; cls != 0; cls = cls->super ) {
+    for( method = cls->method_link; method != 0; method = method->next ) {
+      if( method->sym_id == sym_id && !method->c_func ) goto FOUND;
+    }
+  }
+  console_printf("Undefined method '%s'\n", symid_to_str( sym_id ));
+  return;
+
+ FOUND:;
+  if( mrbc_check_regs( vm, v, method->irep ) ) return;
+  mrbc_callinfo *callinfo = mrbc_push_callinfo(vm, sym_id, v - vm->current_regs, argc);
+  if( !callinfo ) return;	// ENOMEM
+  callinfo->own_class = cls;
+
+  vm->pc_irep = method->irep;
+  vm->inst = method->irep->code;
+  vm->current_regs = v;
+}
+#endif
+
+
 //================================================================
 /*! cleanup
 */
 void mrbc_cleanup_vm(void)
 {
   memset(free_vm_bitmap, 0, sizeof(free_vm_bitmap));
+  mrbc_method_epoch++;		// expire all method caches.
+  mrbc_sprintf_cache_clear();
+  mrbc_cleanup_load();
+}
+
+
+#if MRBC_USE_SNAPSHOT
+//================================================================
+/*! save or restore the VM table. (see snapshot.c)
+*/
+void mrbc_snapshot_vm(mrbc_snapshot *s)
+{
+  MRBC_SNAPSHOT_VAR( s, free_vm_bitmap );
+#if MRBC_USE_SHARED_LITERAL
+  MRBC_SNAPSHOT_VAR( s, literal_cache );
+#endif
 }
+#endif
 
 
 //================================================================
@@ -181,6 +433,10 @@ mrbc_irep *mrbc_irep_alloc(struct VM *vm)
   mrbc_irep *p = (mrbc_irep *)mrbc_alloc(vm, sizeof(mrbc_irep));
   if( p ) {
     memset(p, 0, sizeof(mrbc_irep));	// caution: assume NULL is zero.
+    MRBC_ALLOC_SET_TAG(p, MRBC_ALLOC_TAG_IREP);
+#if MRBC_USE_HOT_RELOAD
+    p->flag_loaded = 1;
+#endif
   }
 
 #if defined(MRBC_DEBUG)
@@ -200,14 +456,53 @@ void mrbc_irep_free(mrbc_irep *irep)
 {
   int i;
 
+  // the literals may be cached by the address.
+  mrbc_sprintf_cache_clear();
+
   // release pools.
-  for( i = 0; i < irep->plen; i++ ) {
-    mrbc_raw_free( irep->pools[i] );
+#if MRBC_USE_STREAM_LOADER
+  if( irep->flag_str_in_ram ) {
+    for( i = 0; i < irep->plen; i++ ) {
+      if( irep->pools[i].tt != MRBC_TT_STRING ) continue;
+      mrbc_raw_free( (char *)irep->pools[i].str - 2 );
+    }
   }
+#endif
   if( irep->plen ) mrbc_raw_free( irep->pools );
 
+#if MRBC_USE_SUPERINSTRUCTION || MRBC_USE_STREAM_LOADER
+  // release the code copied to RAM.
+  if( irep->flag_code_in_ram ) mrbc_raw_free( irep->code );
+#endif
+
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  // release symbol ID table.
+  if( irep->slen ) mrbc_raw_free( irep->sym_ids );
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( irep->slen ) mrbc_raw_free( irep->method_cache );
+#endif
+#if MRBC_USE_RESCUE_TABLE
+  if( irep->rescue_len ) mrbc_raw_free( irep->rescue_table );
+#endif
+#if MRBC_USE_SHARED_LITERAL
+  // release shared literals of this irep.
+  mrbc_literal_cache **pp = &literal_cache;
+  while( *pp ) {
+    mrbc_literal_cache *c = *pp;
+    if( irep->code <= c->inst && c->inst <= irep->code + irep->ilen ) {
+      *pp = c->next;
+      mrbc_decref( &c->value );
+      mrbc_raw_free( c );
+    } else {
+      pp = &c->next;
+    }
+  }
+#endif
+
   // release child ireps.
   for( i = 0; i < irep->rlen; i++ ) {
+    if( irep->reps[i] == NULL ) continue;	// not loaded.
     mrbc_irep_free( irep->reps[i] );
   }
   if( irep->rlen ) mrbc_raw_free( irep->reps );
@@ -216,12 +511,61 @@ void mrbc_irep_free(mrbc_irep *irep)
 }
 
 
+//================================================================
+/*! allocate a callinfo
+
+  @param  vm	pointer of VM.
+  @return	pointer to callinfo or NULL.
+*/
+mrbc_callinfo *mrbc_callinfo_alloc(struct VM *vm)
+{
+#if MRBC_CALLINFO_POOL_SIZE > 0
+  mrbc_callinfo *callinfo = vm->callinfo_free;
+  if( callinfo ) {
+    vm->callinfo_free = callinfo->prev;
+    callinfo->procs = NULL;
+    return callinfo;
+  }
+#else
+  mrbc_callinfo *callinfo;
+#endif
+
+  callinfo = mrbc_alloc_hint(vm, sizeof(mrbc_callinfo), MRBC_ALLOC_HINT_FAST);
+  if( callinfo ) callinfo->procs = NULL;
+
+  return callinfo;
+}
+
+
+//================================================================
+/*! release a callinfo
+
+  @param  vm		pointer of VM.
+  @param  callinfo	pointer to callinfo.
+*/
+void mrbc_callinfo_free(struct VM *vm, mrbc_callinfo *callinfo)
+{
+  if( callinfo->procs ) mrbc_proc_close_frame( vm, callinfo );
+
+#if MRBC_CALLINFO_POOL_SIZE > 0
+  if( callinfo >= vm->callinfo_pool &&
+      callinfo < vm->callinfo_pool + MRBC_CALLINFO_POOL_SIZE ) {
+    callinfo->prev = vm->callinfo_free;
+    vm->callinfo_free = callinfo;
+    return;
+  }
+#endif
+
+  mrbc_free(vm, callinfo);
+}
+
+
 //================================================================
 /*! Push current status to callinfo stack
 */
 mrbc_callinfo * mrbc_push_callinfo( struct VM *vm, mrbc_sym method_id, int reg_offset, int n_args )
 {
-  mrbc_callinfo *callinfo = mrbc_alloc(vm, sizeof(mrbc_callinfo));
+  mrbc_callinfo *callinfo = mrbc_callinfo_alloc(vm);
   if( !callinfo ) return callinfo;
 
   callinfo->current_regs = vm->current_regs;
@@ -234,6 +578,7 @@ mrbc_callinfo * mrbc_push_callinfo( struct VM *vm, mrbc_sym method_id, int reg_o
   callinfo->own_class = 0;
   callinfo->prev = vm->callinfo_tail;
   vm->callinfo_tail = callinfo;
+  MRBC_TRACE( vm, MRBC_TRACE_CALL, method_id );
 
   return callinfo;
 }
@@ -246,6 +591,7 @@ void mrbc_pop_callinfo( struct VM *vm )
 {
   mrbc_callinfo *callinfo = vm->callinfo_tail;
   if( !callinfo ) return;
+  MRBC_TRACE( vm, MRBC_TRACE_RETURN, callinfo->method_id );
 
   vm->callinfo_tail = callinfo->prev;
   vm->current_regs = callinfo->current_regs;
@@ -253,10 +599,244 @@ void mrbc_pop_callinfo( struct VM *vm )
   vm->inst = callinfo->inst;
   vm->target_class = callinfo->target_class;
 
-  mrbc_free(vm, callinfo);
+  mrbc_callinfo_free(vm, callinfo);
+}
+
+
+//================================================================
+/*! check the registers of a new frame are in the register stack.
+
+  @param  vm		pointer of VM.
+  @param  regs		registers of the new frame.
+  @param  irep		irep of the new frame.
+  @retval 0  No error.
+  @retval 1  Overflow. the VM stops at the next instruction.
+*/
+int mrbc_check_regs( struct VM *vm, const mrbc_value *regs, const mrbc_irep *irep )
+{
+  static const uint8_t stop_code[] = { OP_STOP };
+
+  if( regs + irep->nregs <= vm->regs + MRBC_VM_REGS_SIZE(vm) ) return 0;
+
+  // can't raise the exception without registers. stop the VM.
+  console_printf("Stack level too deep\n");
+  vm->inst = (uint8_t *)stop_code;
+  return 1;
+}
+
+
+#if MRBC_USE_RESCUE_TABLE
+//================================================================
+/*! find the innermost begin clause that covers the instruction.
+
+  @param  irep	irep.
+  @param  inst	pointer to the next instruction of the raised one.
+  @return	rescue table entry or NULL.
+*/
+static const mrbc_rescue_range * find_rescue_range( const mrbc_irep *irep, const uint8_t *inst )
+{
+  const mrbc_rescue_range *ret = NULL;
+  int pos = inst - irep->code;
+  int i;
+
+  for( i = 0; i < irep->rescue_len; i++ ) {
+    const mrbc_rescue_range *r = &irep->rescue_table[i];
+    if( r->begin < pos && pos <= r->target ) ret = r;	// later is inner.
+  }
+  return ret;
+}
+
+
+//================================================================
+/*! jump to the rescue clause of the raised exception (vm->exc).
+
+  @param  vm	pointer of VM.
+  @return	non-zero if jumped.
+
+  <pre>
+  Search the rescue tables from the current frame to the callers,
+  and unwind the frames up to the one found.
+  If the ensure clause at vm->exception_tail is in the begin clause,
+  it is called first, and returns to the rescue clause.
+  Nothing is done and zero is returned if no rescue clause is found,
+  or the frame that owns vm->exception_tail is reached first.
+  Those are treated by the runtime handler stack.
+  </pre>
+*/
+int mrbc_rescue_by_table( struct VM *vm )
+{
+  mrbc_callinfo *ensure = vm->exception_tail;
+  const mrbc_callinfo *callinfo = vm->callinfo_tail;
+  const mrbc_irep *irep = vm->pc_irep;
+  const uint8_t *inst = vm->inst;
+  const mrbc_value *regs = vm->current_regs;
+  const mrbc_rescue_range *r;
+  int flag_ensure = 0;
+  int depth = 0;
+
+  while( 1 ) {
+    r = find_rescue_range( irep, inst );
+    if( ensure && ensure->current_regs == regs ) {
+      if( !r ) return 0;
+      // OP_EPUSH is in the begin clause?
+      flag_ensure = (ensure->inst - irep->code > r->begin);
+      break;
+    }
+    if( r ) break;
+
+    if( !callinfo ) return 0;
+    irep = callinfo->pc_irep;
+    inst = callinfo->inst;
+    regs = callinfo->current_regs;
+    callinfo = callinfo->prev;
+    depth++;
+  }
+
+  while( --depth >= 0 ) {
+    mrbc_pop_callinfo( vm );
+  }
+  vm->inst = vm->pc_irep->code + r->target;
+
+  // same as the runtime handler, OP_EXCEPT gets it from exc_pending.
+  vm->exc_pending = vm->exc;
+  vm->exc = 0;
+
+  if( flag_ensure && mrbc_push_callinfo( vm, 0x7fff, 0, 0 ) ) {
+    vm->exception_tail = ensure->prev;
+    vm->pc_irep = ensure->pc_irep;
+    vm->inst = vm->pc_irep->code;
+    vm->target_class = ensure->target_class;
+    mrbc_callinfo_free(vm, ensure);
+  }
+
+  return 1;
+}
+#endif
+
+
+#if MRBC_TRACE_EVENTS > 0
+MRBC_CONTEXT_LOCAL volatile int mrbc_trace_enabled;
+
+//================================================================
+/*! start tracing in all VMs.
+*/
+void mrbc_trace_start(void)
+{
+  mrbc_trace_enabled = 1;
+}
+
+
+//================================================================
+/*! stop tracing. The events are kept until read.
+*/
+void mrbc_trace_stop(void)
+{
+  mrbc_trace_enabled = 0;
+}
+
+
+//================================================================
+/*! record an event. (use MRBC_TRACE() macro)
+
+  The oldest event is overwritten when the ring is full.
+
+  @param  vm		pointer to VM.
+  @param  type		MRBC_TRACE_*
+  @param  sym_id	method, or class of the exception.
+*/
+void mrbc_trace_put( struct VM *vm, int type, mrbc_sym sym_id )
+{
+  mrbc_trace_event *e = &vm->trace_buf[vm->trace_wp];
+
+  e->time = MRBC_TRACE_CLOCK();
+  e->type = type;
+  e->sym_id = sym_id;
+
+  if( ++vm->trace_wp == MRBC_TRACE_EVENTS ) vm->trace_wp = 0;
+  if( vm->trace_n < MRBC_TRACE_EVENTS ) {
+    vm->trace_n++;
+  } else {
+    vm->trace_dropped++;
+  }
+}
+
+
+//================================================================
+/*! take the events of the VM, oldest first.
+
+  @param  vm		pointer to VM.
+  @param  buf		buffer for the events.
+  @param  size		size of buf, in events.
+  @param  n_dropped	returns # of events overwritten since the last
+			read, or NULL.
+  @return		# of events stored in buf.
+*/
+int mrbc_trace_read( struct VM *vm, mrbc_trace_event *buf, int size, uint32_t *n_dropped )
+{
+  int n = 0;
+
+  hal_disable_irq();
+  int rp = vm->trace_wp - vm->trace_n;
+  if( rp < 0 ) rp += MRBC_TRACE_EVENTS;
+  while( n < size && vm->trace_n > 0 ) {
+    buf[n++] = vm->trace_buf[rp];
+    if( ++rp == MRBC_TRACE_EVENTS ) rp = 0;
+    vm->trace_n--;
+  }
+  if( n_dropped ) {
+    *n_dropped = vm->trace_dropped;
+    vm->trace_dropped = 0;
+  }
+  hal_enable_irq();
+
+  return n;
 }
 
 
+//================================================================
+/*! print and clear the events, for support/trace_to_json.rb.
+
+  <pre>
+  # mrbc trace: vm_id=<n> dropped=<n>
+  <time in hex> <type> <name>
+  ...
+  </pre>
+  type is one of C (call), R (return), F (C function), f (its return),
+  X (raise), S (switched in) and s (switched out).
+*/
+void mrbc_trace_dump( struct VM *vm )
+{
+  static const char type_char[] = "?CRFfXSs";
+  mrbc_trace_event buf[16];
+  uint32_t n_dropped;
+  int n;
+
+  mrbc_trace_read( vm, buf, 0, &n_dropped );
+  console_printf("# mrbc trace: vm_id=%d dropped=%d\n",
+		 vm->vm_id, n_dropped);
+
+  while( (n = mrbc_trace_read( vm, buf, 16, NULL )) > 0 ) {
+    int i;
+    for( i = 0; i < n; i++ ) {
+      const char *name;
+      switch( buf[i].sym_id ) {
+      case 0:
+	name = (buf[i].type == MRBC_TRACE_CALL ||
+		buf[i].type == MRBC_TRACE_RETURN) ? "<main>" : "-";
+	break;
+      case 0x7fff:	name = "<rescue>";	break;
+      case 0x7ffe:	name = "<ensure>";	break;
+      default:		name = symid_to_str( buf[i].sym_id );
+      }
+      console_printf("%08x %c %s\n", buf[i].time,
+		     type_char[buf[i].type < sizeof(type_char) - 1 ?
+			       buf[i].type : 0], name ? name : "?");
+    }
+  }
+}
+#endif
+
+
 //================================================================
 /*! get the self object
 */
@@ -328,7 +908,7 @@ static inline int op_loadl( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
 
   mrbc_decref(&regs[a]);
-  regs[a] = *(vm->pc_irep->pools[b]);
+  regs[a] = vm->pc_irep->pools[b];
 
   return 0;
 }
@@ -411,8 +991,7 @@ static inline int op_loadsym( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
   mrbc_decref(&regs[a]);
   regs[a].tt = MRBC_TT_SYMBOL;
@@ -505,6 +1084,74 @@ static inline int op_loadf( mrbc_vm *vm, mrbc_value *regs )
 }
 
 
+//================================================================
+/*! find global variable, with the inline cache.
+
+  @param  sym_id	symbol id.
+  @param  cache		pointer to cache entry or NULL.
+  @return		pointer to the value or NULL.
+  @note	call it in hal_lock().
+*/
+static inline mrbc_value *find_global_cached( mrbc_sym sym_id, mrbc_method_cache *cache )
+{
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( cache ) {
+    if( cache->epoch == mrbc_global_epoch ) return cache->value;
+
+    mrbc_value *v = mrbc_get_global(sym_id);
+    if( v ) {
+      cache->cls = 0;
+      cache->epoch = mrbc_global_epoch;
+      cache->value = v;
+    }
+    return v;
+  }
+#endif
+
+  return mrbc_get_global(sym_id);
+}
+
+
+//================================================================
+/*! find constant, with the inline cache.
+
+  Searches the class constants of cls and its super classes, and then
+  the global constants if flag_global.
+
+  @param  cls		class to search first, or NULL.
+  @param  sym_id	symbol id.
+  @param  cache		pointer to cache entry or NULL.
+  @param  flag_global	search the global constants too.
+  @return		pointer to the value or NULL.
+  @note	call it in hal_lock().
+*/
+static mrbc_value *find_const_cached( mrbc_class *cls, mrbc_sym sym_id, mrbc_method_cache *cache, int flag_global )
+{
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( cache && cache->cls == cls && cache->epoch == mrbc_const_epoch ) {
+    return cache->value;
+  }
+#endif
+
+  mrbc_class *c;
+  mrbc_value *v = NULL;
+  for( c = cls; c != NULL && v == NULL; c = c->super ) {
+    v = mrbc_get_class_const(c, sym_id);
+  }
+  if( v == NULL && flag_global ) v = mrbc_get_const(sym_id);
+
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( v && cache ) {
+    cache->cls = cls;
+    cache->epoch = mrbc_const_epoch;
+    cache->value = v;
+  }
+#endif
+
+  return v;
+}
+
+
 //================================================================
 /*! OP_GETGV
 
@@ -518,17 +1165,18 @@ static inline int op_getgv( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
   mrbc_decref(&regs[a]);
-  mrbc_value *v = mrbc_get_global(sym_id);
+  hal_lock();
+  mrbc_value *v = find_global_cached(sym_id, mrbc_get_irep_method_cache(vm, b));
   if( v == NULL ) {
     mrbc_set_nil(&regs[a]);
   } else {
     mrbc_incref(v);
     regs[a] = *v;
   }
+  hal_unlock();
 
   return 0;
 }
@@ -547,15 +1195,58 @@ static inline int op_setgv( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
   mrbc_incref(&regs[a]);
-  mrbc_set_global(sym_id, &regs[a]);
+
+  hal_lock();
+  mrbc_value *v = find_global_cached(sym_id, mrbc_get_irep_method_cache(vm, b));
+  if( v != NULL ) {
+    mrbc_decref(v);
+    *v = regs[a];
+  } else {
+    mrbc_set_global(sym_id, &regs[a]);
+  }
+  hal_unlock();
 
   return 0;
 }
 
 
+//================================================================
+/*! get instance variable slot number of Syms(n).
+
+  @param  vm		pointer of VM.
+  @param  self		pointer to self.
+  @param  n		index of irep symbol. (e.g. "@foo")
+  @param  flag_add	add a new slot to the class if not found.
+  @return		slot number or -1.
+*/
+static int get_ivar_slot( struct VM *vm, mrbc_value *self, int n, int flag_add )
+{
+  if( self->tt != MRBC_TT_OBJECT ) return -1;
+  mrbc_class *cls = self->instance->cls;
+
+#if MRBC_USE_INLINE_METHOD_CACHE
+  // slots are never moved, so it's valid while the class is the same.
+  mrbc_method_cache *cache = mrbc_get_irep_method_cache(vm, n);
+  if( cache->cls == cls ) return cache->ivar_slot;
+#endif
+
+  const char *sym_name = symid_to_str( mrbc_get_irep_symid(vm, n) );
+  mrbc_sym sym_id = str_to_symid(sym_name+1);   // skip '@'
+  int slot = mrbc_class_ivar_slot( cls, sym_id, flag_add );
+
+#if MRBC_USE_INLINE_METHOD_CACHE
+  if( slot >= 0 ) {
+    cache->cls = cls;
+    cache->ivar_slot = slot;
+  }
+#endif
+
+  return slot;
+}
+
+
 //================================================================
 /*! OP_GETIV
 
@@ -569,11 +1260,12 @@ static inline int op_getiv( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name+1);   // skip '@'
   mrbc_value *self = mrbc_get_self( vm, regs );
+  int slot = get_ivar_slot( vm, self, b, 0 );
+  mrbc_value val = (slot < 0) ? mrbc_nil_value() :
+				mrbc_instance_getiv_slot(self, slot);
   mrbc_decref(&regs[a]);
-  regs[a] = mrbc_instance_getiv(self, sym_id);
+  regs[a] = val;
 
   return 0;
 }
@@ -592,10 +1284,9 @@ static inline int op_setiv( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name+1);   // skip '@'
   mrbc_value *self = mrbc_get_self( vm, regs );
-  mrbc_instance_setiv(self, sym_id, &regs[a]);
+  int slot = get_ivar_slot( vm, self, b, 1 );
+  if( slot >= 0 ) mrbc_instance_setiv_slot(self, slot, &regs[a]);
 
   return 0;
 }
@@ -614,28 +1305,25 @@ static inline int op_getconst( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
   mrbc_class *cls = NULL;
   mrbc_value *v;
 
+  hal_lock();
   if( vm->callinfo_tail ) cls = vm->callinfo_tail->own_class;
-  while( cls != NULL ) {
-    v = mrbc_get_class_const(cls, sym_id);
-    if( v != NULL ) goto DONE;
-    cls = cls->super;
-  }
-
-  v = mrbc_get_const(sym_id);
+  v = find_const_cached(cls, sym_id, mrbc_get_irep_method_cache(vm, b), 1);
   if( v == NULL ) {		// raise?
-    console_printf( "NameError: uninitialized constant %s\n", sym_name );
+    hal_unlock();
+    console_printf( "NameError: uninitialized constant %s\n",
+		    symid_to_str( sym_id ));
     return 0;
   }
 
- DONE:
   mrbc_incref(v);
+  mrbc_value val = *v;
+  hal_unlock();
   mrbc_decref(&regs[a]);
-  regs[a] = *v;
+  regs[a] = val;
 
   return 0;
 }
@@ -654,8 +1342,7 @@ static inline int op_setconst( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
   mrbc_incref(&regs[a]);
   if( mrbc_type(regs[0]) == MRBC_TT_CLASS ) {
@@ -681,23 +1368,23 @@ static inline int op_getmcnst( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid(sym_name);
-  mrbc_class *cls = regs[a].cls;
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
   mrbc_value *v;
 
-  while( !(v = mrbc_get_class_const(cls, sym_id)) ) {
-    cls = cls->super;
-    if( !cls ) {	// raise?
-      console_printf( "NameError: uninitialized constant %s::%s\n",
-		      symid_to_str( regs[a].cls->sym_id ), sym_name );
-      return 0;
-    }
+  hal_lock();
+  v = find_const_cached(regs[a].cls, sym_id, mrbc_get_irep_method_cache(vm, b), 0);
+  if( v == NULL ) {	// raise?
+    hal_unlock();
+    console_printf( "NameError: uninitialized constant %s::%s\n",
+		    symid_to_str( regs[a].cls->sym_id ), symid_to_str( sym_id ));
+    return 0;
   }
 
   mrbc_incref(v);
+  mrbc_value val = *v;
+  hal_unlock();
   mrbc_decref(&regs[a]);
-  regs[a] = *v;
+  regs[a] = val;
 
   return 0;
 }
@@ -717,23 +1404,20 @@ static inline int op_getupvar( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BBB();
 
   assert( regs[0].tt == MRBC_TT_PROC );
-  mrbc_callinfo *callinfo = regs[0].proc->callinfo;
+  mrbc_proc *proc = regs[0].proc;
 
   int i;
   for( i = 0; i < c; i++ ) {
-    assert( callinfo );
-    mrbc_value *regs0 = callinfo->current_regs + callinfo->reg_offset;
-    assert( regs0->tt == MRBC_TT_PROC );
-    callinfo = regs0->proc->callinfo;
+    assert( proc->upper );
+    proc = proc->upper;
   }
 
-  mrbc_value *p_val;
-  if( callinfo == 0 ) {
-    p_val = vm->regs + b;
+  mrbc_value *p_val = proc->env + b;
+  if( proc->flag_closed && proc->closed_env ) {
+    mrbc_env_incref( proc->closed_env, p_val );
   } else {
-    p_val = callinfo->current_regs + callinfo->reg_offset + b;
+    mrbc_incref( p_val );
   }
-  mrbc_incref( p_val );
 
   mrbc_decref( &regs[a] );
   regs[a] = *p_val;
@@ -756,21 +1440,18 @@ static inline int op_setupvar( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BBB();
 
   assert( regs[0].tt == MRBC_TT_PROC );
-  mrbc_callinfo *callinfo = regs[0].proc->callinfo;
+  mrbc_proc *proc = regs[0].proc;
 
   int i;
   for( i = 0; i < c; i++ ) {
-    assert( callinfo );
-    mrbc_value *regs0 = callinfo->current_regs + callinfo->reg_offset;
-    assert( regs0->tt == MRBC_TT_PROC );
-    callinfo = regs0->proc->callinfo;
+    assert( proc->upper );
+    proc = proc->upper;
   }
 
-  mrbc_value *p_val;
-  if( callinfo == 0 ) {
-    p_val = vm->regs + b;
-  } else {
-    p_val = callinfo->current_regs + callinfo->reg_offset + b;
+  mrbc_value *p_val = proc->env + b;
+  if( proc->flag_closed && proc->closed_env ) {
+    mrbc_env_set( proc->closed_env, p_val, &regs[a] );
+    return 0;
   }
   mrbc_decref( p_val );
 
@@ -876,7 +1557,12 @@ static inline int op_onerr( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_S();
 
-  mrbc_callinfo *callinfo = mrbc_alloc(vm, sizeof(mrbc_callinfo));
+#if MRBC_USE_RESCUE_TABLE
+  // the loader made the rescue table.
+  if( vm->pc_irep->rescue_len ) return 0;
+#endif
+
+  mrbc_callinfo *callinfo = mrbc_callinfo_alloc(vm);
 
   callinfo->current_regs = vm->current_regs;
   callinfo->pc_irep = vm->pc_irep;
@@ -984,13 +1670,17 @@ static inline int op_raise( mrbc_vm *vm, mrbc_value *regs )
   FETCH_B();
 
   vm->exc = regs[a].cls;
+  MRBC_TRACE( vm, MRBC_TRACE_RAISE, vm->exc ? vm->exc->sym_id : 0 );
+#if MRBC_USE_RESCUE_TABLE
+  if( mrbc_rescue_by_table( vm ) ) return 0;
+#endif
 
   mrbc_callinfo *callinfo = vm->callinfo_tail;
   if( callinfo != NULL ){
     vm->callinfo_tail = callinfo->prev;
     vm->pc_irep = callinfo->pc_irep;
     vm->inst = callinfo->inst;
-    mrbc_free(vm, callinfo);
+    mrbc_callinfo_free(vm, callinfo);
   }  else {
     vm->exc = vm->exc_pending;
   }
@@ -1012,11 +1702,14 @@ static inline int op_epush( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  mrbc_callinfo *callinfo = mrbc_alloc(vm, sizeof(mrbc_callinfo));
+  mrbc_irep *irep = mrbc_get_irep_child( vm->pc_irep, a );
+  if( !irep ) return -1;	// ENOMEM
+
+  mrbc_callinfo *callinfo = mrbc_callinfo_alloc(vm);
 
   callinfo->current_regs = vm->current_regs;
-  callinfo->pc_irep = vm->pc_irep->reps[a];
-  callinfo->inst = vm->pc_irep->reps[a]->code;
+  callinfo->pc_irep = irep;
+  callinfo->inst = vm->inst;	// position of the ensure clause.
   callinfo->reg_offset = 0;
   callinfo->method_id = 0x7ffe;   // ensure
   callinfo->n_args = 0;
@@ -1055,7 +1748,7 @@ static inline int op_epop( mrbc_vm *vm, mrbc_value *regs )
   vm->target_class = callinfo->target_class;
   vm->exc = 0;
 
-  mrbc_free(vm, callinfo);
+  mrbc_callinfo_free(vm, callinfo);
 
   return 0;
 }
@@ -1074,9 +1767,10 @@ static inline int op_sendv( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
-  return send_by_name( vm, sym_name, regs, a, CALL_MAXARGS, 0 );
+  return send_by_symid( vm, sym_id, regs, a, CALL_MAXARGS, 0,
+			mrbc_get_irep_method_cache(vm, b) );
 }
 
 
@@ -1093,9 +1787,10 @@ static inline int op_sendvb( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
-  return send_by_name( vm, sym_name, regs, a, CALL_MAXARGS, 1 );
+  return send_by_symid( vm, sym_id, regs, a, CALL_MAXARGS, 1,
+			mrbc_get_irep_method_cache(vm, b) );
 }
 
 
@@ -1112,9 +1807,10 @@ static inline int op_send( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BBB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
-  return send_by_name( vm, sym_name, regs, a, c, 0 );
+  return send_by_symid( vm, sym_id, regs, a, c, 0,
+			mrbc_get_irep_method_cache(vm, b) );
 }
 
 
@@ -1131,9 +1827,10 @@ static inline int op_sendb( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BBB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm, b);
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
 
-  return send_by_name( vm, sym_name, regs, a, c, 1 );
+  return send_by_symid( vm, sym_id, regs, a, c, 1,
+			mrbc_get_irep_method_cache(vm, b) );
 }
 
 
@@ -1166,6 +1863,7 @@ static inline int op_super( mrbc_vm *vm, mrbc_value *regs )
     regs[a+1].tt = MRBC_TT_EMPTY;
     mrbc_value proc = regs[a+2];
     regs[a+2].tt = MRBC_TT_EMPTY;
+    mrbc_array_make_writable( &argary );	// to take the references.
 
     int argc = mrbc_array_size(&argary);
     int i, j;
@@ -1198,6 +1896,7 @@ static inline int op_super( mrbc_vm *vm, mrbc_value *regs )
     return 1;
   }
 
+  if( mrbc_check_regs( vm, regs + a, method.irep ) ) return 1;
   callinfo = mrbc_push_callinfo(vm, callinfo->method_id, a, b);
   callinfo->own_class = method.cls;
 
@@ -1398,6 +2097,27 @@ static inline int op_enter( mrbc_vm *vm, mrbc_value *regs )
 }
 
 
+//================================================================
+/*! close the procs of the returning frame, before R(a) is moved.
+
+  @param  vm    pointer of VM.
+  @param  ret   pointer to the register of the return value.
+
+  The procs take the local variables here, while R(a) still holds
+  one of them. The return value is counted as an escape.
+  (see mrbc_proc_close_frame)
+*/
+static void close_frame_for_return( mrbc_vm *vm, mrbc_value *ret )
+{
+  mrbc_callinfo *callinfo = vm->callinfo_tail;
+  if( !callinfo || !callinfo->procs ) return;
+
+  mrbc_incref( ret );
+  mrbc_proc_close_frame( vm, callinfo );
+  mrbc_decref( ret );
+}
+
+
 //================================================================
 /*! OP_RETURN
 
@@ -1411,6 +2131,8 @@ static inline int op_return( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
+  close_frame_for_return( vm, &regs[a] );
+
   mrbc_decref(&regs[0]);
   regs[0] = regs[a];
   regs[a].tt = MRBC_TT_EMPTY;
@@ -1449,6 +2171,8 @@ static inline int op_return_blk( mrbc_vm *vm, mrbc_value *regs )
   int nregs = vm->pc_irep->nregs;
   mrbc_value *p_reg;
 
+  close_frame_for_return( vm, &regs[a] );
+
   if( regs[0].tt == MRBC_TT_PROC ) {
     mrbc_callinfo *callinfo = vm->callinfo_tail;
     mrbc_callinfo *caller_callinfo = regs[0].proc->callinfo_self;
@@ -1503,6 +2227,8 @@ static inline int op_break( mrbc_vm *vm, mrbc_value *regs )
   mrbc_callinfo *caller_callinfo = regs[0].proc->callinfo;
   mrbc_value *p_reg;
 
+  close_frame_for_return( vm, &regs[a] );
+
   // trace back to caller
   do {
     p_reg = callinfo->current_regs + callinfo->reg_offset;
@@ -1574,6 +2300,26 @@ static inline int op_blkpush( mrbc_vm *vm, mrbc_value *regs )
 }
 
 
+//================================================================
+/*! Fixnum arithmetic in place, for OP_ADD, OP_SUB, OP_MUL and friends.
+
+  v->i = v->i op n. makes Float if the result overflowed mrbc_int.
+*/
+#if MRBC_USE_FLOAT && MRBC_INT_OVERFLOW_TO_FLOAT
+#define FIXNUM_ARITH(func, op, v, n) do {			\
+    mrbc_int r_;						\
+    if( func( (v)->i, (n), &r_ ) ) {				\
+      (v)->tt = MRBC_TT_FLOAT;					\
+      (v)->d = (mrbc_float)(v)->i op (mrbc_float)(n);		\
+    } else {							\
+      (v)->i = r_;						\
+    }								\
+  } while(0)
+#else
+#define FIXNUM_ARITH(func, op, v, n) ((v)->i = (v)->i op (n))
+#endif
+
+
 //================================================================
 /*! OP_ADD
 
@@ -1589,7 +2335,7 @@ static inline int op_add( mrbc_vm *vm, mrbc_value *regs )
 
   if( regs[a].tt == MRBC_TT_FIXNUM ) {
     if( regs[a+1].tt == MRBC_TT_FIXNUM ) {     // in case of Fixnum, Fixnum
-      regs[a].i += regs[a+1].i;
+      FIXNUM_ARITH( mrbc_int_add_overflow, +, &regs[a], regs[a+1].i );
       return 0;
     }
 #if MRBC_USE_FLOAT
@@ -1632,7 +2378,7 @@ static inline int op_addi( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
 
   if( regs[a].tt == MRBC_TT_FIXNUM ) {
-    regs[a].i += b;
+    FIXNUM_ARITH( mrbc_int_add_overflow, +, &regs[a], b );
     return 0;
   }
 
@@ -1664,7 +2410,7 @@ static inline int op_sub( mrbc_vm *vm, mrbc_value *regs )
 
   if( regs[a].tt == MRBC_TT_FIXNUM ) {
     if( regs[a+1].tt == MRBC_TT_FIXNUM ) {     // in case of Fixnum, Fixnum
-      regs[a].i -= regs[a+1].i;
+      FIXNUM_ARITH( mrbc_int_sub_overflow, -, &regs[a], regs[a+1].i );
       return 0;
     }
 #if MRBC_USE_FLOAT
@@ -1707,7 +2453,7 @@ static inline int op_subi( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
 
   if( regs[a].tt == MRBC_TT_FIXNUM ) {
-    regs[a].i -= b;
+    FIXNUM_ARITH( mrbc_int_sub_overflow, -, &regs[a], b );
     return 0;
   }
 
@@ -1739,7 +2485,7 @@ static inline int op_mul( mrbc_vm *vm, mrbc_value *regs )
 
   if( regs[a].tt == MRBC_TT_FIXNUM ) {
     if( regs[a+1].tt == MRBC_TT_FIXNUM ) {     // in case of Fixnum, Fixnum
-      regs[a].i *= regs[a+1].i;
+      FIXNUM_ARITH( mrbc_int_mul_overflow, *, &regs[a], regs[a+1].i );
       return 0;
     }
 #if MRBC_USE_FLOAT
@@ -1802,13 +2548,81 @@ static inline int op_div( mrbc_vm *vm, mrbc_value *regs )
       regs[a].d /= regs[a+1].d;
       return 0;
     }
-#endif
+#endif
+  }
+
+  // other case
+  send_by_name(vm, "/", regs, a, 1, 0);
+
+  return 0;
+}
+
+
+//================================================================
+/*! compare fast path for immediate values
+
+  Handles Fixnum, Float, Symbol, nil, true and false pairs without calling
+  mrbc_compare(). Since these are not reference counted values, the caller
+  does not need to release the register either.
+
+  @param  v1		pointer to value 1
+  @param  v2		pointer to value 2
+  @param  result	returns comparison result, same sign as mrbc_compare().
+  @retval 1		compared.
+  @retval 0		not an immediate pair. use mrbc_compare().
+*/
+static inline int compare_immediate( const mrbc_value *v1, const mrbc_value *v2, int *result )
+{
+  if( v1->tt == MRBC_TT_FIXNUM && v2->tt == MRBC_TT_FIXNUM ) {
+    *result = (v1->i > v2->i) - (v1->i < v2->i);
+    return 1;
+  }
+
+#if MRBC_USE_FLOAT
+  mrbc_float d1, d2;
+
+  if( v1->tt == MRBC_TT_FLOAT ) {
+    d1 = v1->d;
+    if( v2->tt == MRBC_TT_FLOAT ) {
+      d2 = v2->d;
+    } else if( v2->tt == MRBC_TT_FIXNUM ) {
+      d2 = v2->i;
+    } else {
+      return 0;
+    }
+    goto CMP_FLOAT;
+  }
+  if( v1->tt == MRBC_TT_FIXNUM && v2->tt == MRBC_TT_FLOAT ) {
+    d1 = v1->i;
+    d2 = v2->d;
+    goto CMP_FLOAT;
+  }
+#endif
+
+  if( v1->tt == v2->tt ) {
+    switch( v1->tt ) {
+    case MRBC_TT_NIL:
+    case MRBC_TT_FALSE:
+    case MRBC_TT_TRUE:
+      *result = 0;
+      return 1;
+
+    case MRBC_TT_SYMBOL:
+      *result = v1->i - v2->i;
+      return 1;
+
+    default:
+      break;
+    }
   }
 
-  // other case
-  send_by_name(vm, "/", regs, a, 1, 0);
-
   return 0;
+
+#if MRBC_USE_FLOAT
+ CMP_FLOAT:
+  *result = -1 + (d1 == d2) + (d1 > d2)*2;	// caution: NaN == NaN is false
+  return 1;
+#endif
 }
 
 
@@ -1825,10 +2639,12 @@ static inline int op_eq( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  // TODO: case OBJECT == OBJECT is not supported.
-  int result = mrbc_compare(&regs[a], &regs[a+1]);
-
-  mrbc_decref(&regs[a]);
+  int result;
+  if( !compare_immediate(&regs[a], &regs[a+1], &result) ) {
+    // TODO: case OBJECT == OBJECT is not supported.
+    result = mrbc_compare(&regs[a], &regs[a+1]);
+    mrbc_decref(&regs[a]);
+  }
   regs[a].tt = result ? MRBC_TT_FALSE : MRBC_TT_TRUE;
 
   return 0;
@@ -1848,10 +2664,12 @@ static inline int op_lt( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  // TODO: case OBJECT < OBJECT is not supported.
-  int result = mrbc_compare(&regs[a], &regs[a+1]);
-
-  mrbc_decref(&regs[a]);
+  int result;
+  if( !compare_immediate(&regs[a], &regs[a+1], &result) ) {
+    // TODO: case OBJECT < OBJECT is not supported.
+    result = mrbc_compare(&regs[a], &regs[a+1]);
+    mrbc_decref(&regs[a]);
+  }
   regs[a].tt = result < 0 ? MRBC_TT_TRUE : MRBC_TT_FALSE;
 
   return 0;
@@ -1871,10 +2689,12 @@ static inline int op_le( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  // TODO: case OBJECT <= OBJECT is not supported.
-  int result = mrbc_compare(&regs[a], &regs[a+1]);
-
-  mrbc_decref(&regs[a]);
+  int result;
+  if( !compare_immediate(&regs[a], &regs[a+1], &result) ) {
+    // TODO: case OBJECT <= OBJECT is not supported.
+    result = mrbc_compare(&regs[a], &regs[a+1]);
+    mrbc_decref(&regs[a]);
+  }
   regs[a].tt = result <= 0 ? MRBC_TT_TRUE : MRBC_TT_FALSE;
 
   return 0;
@@ -1894,10 +2714,12 @@ static inline int op_gt( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  // TODO: case OBJECT > OBJECT is not supported.
-  int result = mrbc_compare(&regs[a], &regs[a+1]);
-
-  mrbc_decref(&regs[a]);
+  int result;
+  if( !compare_immediate(&regs[a], &regs[a+1], &result) ) {
+    // TODO: case OBJECT > OBJECT is not supported.
+    result = mrbc_compare(&regs[a], &regs[a+1]);
+    mrbc_decref(&regs[a]);
+  }
   regs[a].tt = result > 0 ? MRBC_TT_TRUE : MRBC_TT_FALSE;
 
   return 0;
@@ -1917,16 +2739,138 @@ static inline int op_ge( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  // TODO: case OBJECT >= OBJECT is not supported.
-  int result = mrbc_compare(&regs[a], &regs[a+1]);
-
-  mrbc_decref(&regs[a]);
+  int result;
+  if( !compare_immediate(&regs[a], &regs[a+1], &result) ) {
+    // TODO: case OBJECT >= OBJECT is not supported.
+    result = mrbc_compare(&regs[a], &regs[a+1]);
+    mrbc_decref(&regs[a]);
+  }
   regs[a].tt = result >= 0 ? MRBC_TT_TRUE : MRBC_TT_FALSE;
 
   return 0;
 }
 
 
+#if MRBC_USE_SUPERINSTRUCTION
+//================================================================
+/*! OP_xx_JMPIF, OP_xx_JMPNOT (superinstructions)
+
+  R(a) = R(a) <op> R(a+1); if (!)R(a) pc=b
+
+  The second opcode (OP_JMPIF or OP_JMPNOT) is left in the code as it is,
+  so skip it and continue to decode its operands.
+
+  @param  vm    pointer of VM.
+  @param  regs  pointer to regs
+  @param  op    superinstruction opcode.
+  @retval 0  No error.
+*/
+static inline int op_compare_jmp( mrbc_vm *vm, mrbc_value *regs, int op )
+{
+  switch( op ) {
+  case OP_EQ_JMPIF: case OP_EQ_JMPNOT: op_eq(vm, regs); break;
+  case OP_LT_JMPIF: case OP_LT_JMPNOT: op_lt(vm, regs); break;
+  case OP_LE_JMPIF: case OP_LE_JMPNOT: op_le(vm, regs); break;
+  case OP_GT_JMPIF: case OP_GT_JMPNOT: op_gt(vm, regs); break;
+  case OP_GE_JMPIF: case OP_GE_JMPNOT: op_ge(vm, regs); break;
+  }
+
+  vm->inst++;		// skip OP_JMPIF or OP_JMPNOT
+  if( (op - OP_EQ_JMPIF) & 1 ) {
+    return op_jmpnot(vm, regs);
+  } else {
+    return op_jmpif(vm, regs);
+  }
+}
+#endif
+
+
+#if MRBC_USE_SHARED_LITERAL
+//================================================================
+/*! compare the elements of the literal exactly. (1 and 1.0 differ)
+*/
+static int literal_same( const mrbc_value *v1, const mrbc_value *v2 )
+{
+  if( v1->tt != v2->tt ) return 0;
+
+  switch( v1->tt ) {
+  case MRBC_TT_FIXNUM:
+  case MRBC_TT_SYMBOL:	return v1->i == v2->i;
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT:	return memcmp( &v1->d, &v2->d, sizeof(mrbc_float) ) == 0;
+#endif
+  case MRBC_TT_CLASS:	return v1->cls == v2->cls;
+  default:		return 1;
+  }
+}
+
+
+//================================================================
+/*! make an Array or Hash literal that shares the elements.
+
+  The first run of the OP_ARRAY / OP_HASH keeps a copy of the elements
+  in a hidden object, if all of them are immediate values. The later runs
+  return a new Array or Hash that refers to the copy as a shared slice,
+  and it is copied when first modified. If the elements ever differ from
+  the copy (e.g. [x, y]), the literal is not shared any more.
+
+  @param  vm	pointer of VM.
+  @param  src	pointer to the elements.
+  @param  n	# of the elements. (for Hash, keys and values)
+  @param  tt	MRBC_TT_ARRAY or MRBC_TT_HASH
+  @return	the object, or .array == NULL if not shared.
+*/
+static mrbc_value shared_literal( mrbc_vm *vm, const mrbc_value *src, int n, mrbc_vtype tt )
+{
+  mrbc_value ret = {.tt = tt};
+  ret.array = NULL;
+  int i;
+
+  mrbc_literal_cache *c;
+  for( c = literal_cache; c != NULL; c = c->next ) {
+    if( c->inst == vm->inst ) break;
+  }
+
+  if( c == NULL ) {
+    c = mrbc_raw_alloc( sizeof(mrbc_literal_cache) );
+    if( !c ) return ret;		// ENOMEM
+    c->inst = vm->inst;
+    c->value.tt = MRBC_TT_EMPTY;
+    c->next = literal_cache;
+    literal_cache = c;
+
+    for( i = 0; i < n; i++ ) {
+      if( src[i].tt >= MRBC_TT_INC_DEC_THRESHOLD ) return ret;
+    }
+
+    // the hidden object belongs to no VM, as the irep may be shared.
+    mrbc_value v = (tt == MRBC_TT_ARRAY) ?
+      mrbc_array_new( NULL, n ) : mrbc_hash_new( NULL, n / 2 );
+    if( v.array == NULL ) return ret;	// ENOMEM
+    memcpy( v.array->data, src, sizeof(mrbc_value) * n );
+    v.array->n_stored = n;
+    mrbc_alloc_set_owner( v.array->data, NULL );  // views refer to it.
+    c->value = v;
+    return ret;		// this time, use the registers as usual.
+  }
+
+  if( c->value.tt == MRBC_TT_EMPTY ) return ret;
+
+  const mrbc_value *p = c->value.array->data;
+  for( i = 0; i < n; i++ ) {
+    if( !literal_same( &src[i], &p[i] ) ) {
+      mrbc_decref_empty( &c->value );
+      return ret;
+    }
+  }
+
+  return (tt == MRBC_TT_ARRAY) ?
+    mrbc_array_new_shared( vm, &c->value ) :
+    mrbc_hash_new_shared( vm, &c->value );
+}
+#endif
+
+
 //================================================================
 /*! OP_ARRAY
 
@@ -1940,6 +2884,16 @@ static inline int op_array( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
+#if MRBC_USE_SHARED_LITERAL
+  if( b >= MRBC_SHARED_LITERAL_MIN ) {
+    mrbc_value value = shared_literal( vm, &regs[a], b, MRBC_TT_ARRAY );
+    if( value.array ) {
+      regs[a] = value;		// the elements are immediate values.
+      return 0;
+    }
+  }
+#endif
+
   mrbc_value value = mrbc_array_new(vm, b);
   if( value.array == NULL ) return -1;  // ENOMEM
 
@@ -2015,7 +2969,7 @@ static inline int op_arycat( mrbc_vm *vm, mrbc_value *regs )
 
   // need resize?
   if( regs[a].array->data_size < new_size ){
-    mrbc_array_resize(&regs[a], new_size);
+    if( mrbc_array_resize(&regs[a], new_size) != 0 ) return 0;	// ENOMEM
   }
 
   int i;
@@ -2144,7 +3098,8 @@ static inline int op_intern( mrbc_vm *vm, mrbc_value *regs )
 
   assert( regs[a].tt == MRBC_TT_STRING );
 
-  mrbc_value sym_id = mrbc_symbol_new(vm, (const char*)regs[a].string->data);
+  mrbc_value sym_id = mrbc_symbol_new_with_hash(vm,
+			mrbc_string_cstr(&regs[a]), mrbc_string_hash(&regs[a]));
 
   mrbc_decref( &regs[a] );
   regs[a] = sym_id;
@@ -2167,12 +3122,13 @@ static inline int op_string( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
 
 #if MRBC_USE_STRING
-  mrbc_object *pool_obj = vm->pc_irep->pools[b];
+  const mrbc_object *pool_obj = &vm->pc_irep->pools[b];
 
   /* CAUTION: pool_obj->str - 2. see IREP POOL structure. */
   int len = bin_to_uint16(pool_obj->str - 2);
-  mrbc_value value = mrbc_string_new(vm, pool_obj->str, len);
+  mrbc_value value = mrbc_string_new_literal(vm, pool_obj->str, len);
   if( value.string == NULL ) return -1;         // ENOMEM
+  mrbc_string_keep_irep( &value, vm->pc_irep );
 
   mrbc_decref(&regs[a]);
   regs[a] = value;
@@ -2230,6 +3186,16 @@ static inline int op_hash( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
+#if MRBC_USE_SHARED_LITERAL
+  if( b * 2 >= MRBC_SHARED_LITERAL_MIN ) {
+    mrbc_value value = shared_literal( vm, &regs[a], b * 2, MRBC_TT_HASH );
+    if( value.hash ) {
+      regs[a] = value;		// the elements are immediate values.
+      return 0;
+    }
+  }
+#endif
+
   mrbc_value value = mrbc_hash_new(vm, b);
   if( value.hash == NULL ) return -1;   // ENOMEM
 
@@ -2258,7 +3224,22 @@ static inline int op_method( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  mrbc_value val = mrbc_proc_new( vm, vm->pc_irep->reps[b] );
+  mrbc_irep *irep = mrbc_get_irep_child( vm->pc_irep, b );
+  if( !irep ) return -1;	// ENOMEM
+
+#if MRBC_BLOCK_POOL_SIZE > 0
+  // the block of the next OP_SENDB?
+  const uint8_t *p = vm->inst;
+  mrbc_value val;
+  if( p[0] == OP_SENDB &&
+      p[1] + (p[3] == CALL_MAXARGS ? 1 : p[3]) + 1 == a ) {
+    val = mrbc_proc_new_block( vm, irep );
+  } else {
+    val = mrbc_proc_new( vm, irep );
+  }
+#else
+  mrbc_value val = mrbc_proc_new( vm, irep );
+#endif
   if( !val.proc ) return -1;	// ENOMEM
 
   mrbc_decref(&regs[a]);
@@ -2332,11 +3313,15 @@ static inline int op_exec( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
   assert( regs[a].tt == MRBC_TT_CLASS );
 
+  mrbc_irep *irep = mrbc_get_irep_child( vm->pc_irep, b );
+  if( !irep ) return -1;	// ENOMEM
+  if( mrbc_check_regs( vm, regs + a, irep ) ) return 1;
+
   // prepare callinfo
   mrbc_push_callinfo(vm, 0, 0, 0);
 
   // target irep
-  vm->pc_irep = vm->pc_irep->reps[b];
+  vm->pc_irep = irep;
   vm->inst = vm->pc_irep->code;
 
   // new regs and class
@@ -2364,19 +3349,27 @@ static inline int op_def( mrbc_vm *vm, mrbc_value *regs )
   assert( regs[a+1].tt == MRBC_TT_PROC );
 
   mrbc_class *cls = regs[a].cls;
-  const char *name = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id = str_to_symid( name );
+  mrbc_sym sym_id = mrbc_get_irep_symid(vm, b);
   mrbc_proc *proc = regs[a+1].proc;
 
   mrbc_method *method = mrbc_raw_alloc( sizeof(mrbc_method) );
   if( !method ) return -1; // ENOMEM
+  MRBC_ALLOC_SET_TAG(method, MRBC_ALLOC_TAG_OBJECT);
 
   method->type = 'M';
   method->c_func = 0;
   method->sym_id = sym_id;
   method->irep = proc->irep;
+  hal_lock();
   method->next = cls->method_link;
   cls->method_link = method;
+#if MRBC_METHOD_TABLE_MIN > 0
+  cls->n_method_table = 0;
+#endif
+  mrbc_method_epoch++;
+#if MRBC_USE_HOT_RELOAD
+  MRBC_IREP_ADD_REF( method->irep, 1 );
+#endif
 
   // checking same method
   for( ;method->next != NULL; method = method->next ) {
@@ -2392,11 +3385,15 @@ static inline int op_def( mrbc_vm *vm, mrbc_value *regs )
          Thus not free this memory.
          Case c_func == 2 is builtin C function. maybe create by OP_ALIAS.
       */
+#if MRBC_USE_HOT_RELOAD
+      if( del_method->c_func == 0 ) MRBC_IREP_ADD_REF( del_method->irep, -1 );
+#endif
       if( del_method->c_func != 1 ) mrbc_raw_free( del_method );
 
       break;
     }
   }
+  hal_unlock();
 
   return 0;
 }
@@ -2415,26 +3412,34 @@ static inline int op_alias( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
-  const char *name_new = mrbc_get_irep_symbol(vm, a);
-  const char *name_org = mrbc_get_irep_symbol(vm, b);
-  mrbc_sym sym_id_new = str_to_symid(name_new);
-  mrbc_sym sym_id_org = str_to_symid(name_org);
+  mrbc_sym sym_id_new = mrbc_get_irep_symid(vm, a);
+  mrbc_sym sym_id_org = mrbc_get_irep_symid(vm, b);
   mrbc_class *cls = vm->target_class;
   mrbc_method method_org;
 
   if( mrbc_find_method( &method_org, cls, sym_id_org ) == 0 ) {
-    console_printf("NameError: undefined method '%s'\n", name_org);
+    console_printf("NameError: undefined method '%s'\n",
+		   symid_to_str( sym_id_org ));
     return 0;
   }
 
   // copy method and chain link list.
   mrbc_method *method_new = mrbc_raw_alloc( sizeof(mrbc_method) );
   if( !method_new ) return 0;	// ENOMEM
+  MRBC_ALLOC_SET_TAG(method_new, MRBC_ALLOC_TAG_OBJECT);
 
   *method_new = method_org;
   method_new->sym_id = sym_id_new;
+  hal_lock();
   method_new->next = cls->method_link;
   cls->method_link = method_new;
+#if MRBC_METHOD_TABLE_MIN > 0
+  cls->n_method_table = 0;
+#endif
+  mrbc_method_epoch++;
+#if MRBC_USE_HOT_RELOAD
+  if( method_new->c_func == 0 ) MRBC_IREP_ADD_REF( method_new->irep, 1 );
+#endif
 
   // checking same method
   //  see OP_DEF function. same it.
@@ -2442,10 +3447,14 @@ static inline int op_alias( mrbc_vm *vm, mrbc_value *regs )
     if( method_new->next->sym_id == sym_id_new ) {
       mrbc_method *del_method = method_new->next;
       method_new->next = del_method->next;
+#if MRBC_USE_HOT_RELOAD
+      if( del_method->c_func == 0 ) MRBC_IREP_ADD_REF( del_method->irep, -1 );
+#endif
       if( del_method->c_func != 1 ) mrbc_raw_free( del_method );
       break;
     }
   }
+  hal_unlock();
 
   return 0;
 }
@@ -2529,6 +3538,54 @@ static inline int op_stop( mrbc_vm *vm, mrbc_value *regs )
 }
 
 
+#if MRBC_USE_NATIVE_ITERATOR
+//================================================================
+/*! OP_NATIVE_ITER
+
+  R(7).call(*R(8)..) while step() gives the arguments.
+
+  @param  vm    pointer of VM.
+  @param  regs  pointer to regs
+  @retval 0  No error.
+*/
+static inline int op_native_iter( mrbc_vm *vm, mrbc_value *regs )
+{
+  FETCH_Z();
+
+  const mrbc_native_iter *iter = regs[6].handle;
+  int i;
+  for( i = 8; i < NATIVE_ITER_NREGS; i++ ) {
+    mrbc_decref_empty( &regs[i] );
+  }
+
+  int n = -1;
+  if( vm->exc == NULL ) n = iter->step( vm, regs );
+  if( n < 0 ) {
+    // finished. return R(5) by next OP_RETURN.
+    for( i = 1; i < NATIVE_ITER_NREGS; i++ ) {
+      if( i != 5 ) mrbc_decref_empty( &regs[i] );
+    }
+    return 0;
+  }
+
+  mrbc_decref( &regs[7] );
+  regs[7] = regs[1];
+  mrbc_incref( &regs[7] );
+  regs[8+n] = mrbc_nil_value();		// block of the block.
+
+  // come back here after the block returns.
+  uint8_t *inst = --vm->inst;
+  c_proc_call( vm, &regs[7], n );
+  if( vm->pc_irep == &native_iter_irep && vm->inst == inst ) {
+    vm->inst++;
+    return -1;	// ENOMEM
+  }
+
+  return 0;
+}
+#endif
+
+
 //================================================================
 /*! OP_ABORT
 
@@ -2615,10 +3672,12 @@ mrbc_vm *mrbc_vm_open( struct VM *vm_arg )
     // allocate memory.
     vm = mrbc_raw_alloc( sizeof(mrbc_vm) );
     if( vm == NULL ) return NULL;
+    MRBC_ALLOC_SET_TAG(vm, MRBC_ALLOC_TAG_VM);
   }
 
   // allocate vm id.
   int vm_id;
+  hal_lock();
   for( vm_id = 0; vm_id < MAX_VM_COUNT; vm_id++ ) {
     int idx = vm_id >> 4;
     int bit = 1 << (vm_id & 0x0f);
@@ -2627,6 +3686,7 @@ mrbc_vm *mrbc_vm_open( struct VM *vm_arg )
       break;
     }
   }
+  hal_unlock();
 
   if( vm_id == MAX_VM_COUNT ) {
     if( vm_arg == NULL ) mrbc_raw_free(vm);
@@ -2657,14 +3717,49 @@ void mrbc_vm_close( struct VM *vm )
   // free vm id.
   int idx = (vm->vm_id-1) >> 4;
   int bit = 1 << ((vm->vm_id-1) & 0x0f);
+  hal_lock();
   free_vm_bitmap[idx] &= ~bit;
+  hal_unlock();
+
+#if defined(MRBC_ALLOC_VMID) && MRBC_ALLOC_MAX_POOLS > 1
+  mrbc_set_vm_arena( vm, NULL, 0 );
+#endif
+
+#if MRBC_USE_DYNAMIC_REGS
+  if( vm->regs ) mrbc_raw_free( vm->regs );	// without mrbc_vm_end().
+#endif
 
   // free irep and vm
-  if( vm->irep ) mrbc_irep_free( vm->irep );
+  if( vm->irep && !vm->flag_shared_irep ) mrbc_release_irep( vm->irep );
   if( vm->flag_need_memfree ) mrbc_raw_free(vm);
 }
 
 
+#if MRBC_USE_DYNAMIC_REGS
+//================================================================
+/*! get the maximum nregs of the irep and its loaded children.
+
+  @param  irep	irep.
+  @return	nregs.
+*/
+static int max_nregs( const mrbc_irep *irep )
+{
+  int ret = irep->nregs;
+  int i;
+
+  for( i = 0; i < irep->rlen; i++ ) {
+    // not loaded yet, if MRBC_USE_LAZY_IREP_LOAD.
+    if( !irep->reps[i] ) continue;
+
+    int n = max_nregs( irep->reps[i] );
+    if( ret < n ) ret = n;
+  }
+
+  return ret;
+}
+#endif
+
+
 //================================================================
 /*! VM initializer.
 
@@ -2676,9 +3771,20 @@ void mrbc_vm_begin( struct VM *vm )
   vm->inst = vm->pc_irep->code;
   vm->ext_flag = 0;
 
-  memset(vm->regs, 0, sizeof(vm->regs));
+#if MRBC_USE_DYNAMIC_REGS
+  if( vm->regs ) mrbc_raw_free( vm->regs );
+  int size = max_nregs( vm->irep ) + MRBC_REGS_HEADROOM;
+  if( size > 0xffff ) size = 0xffff;
+  vm->regs = mrbc_raw_alloc( sizeof(mrbc_value) * size );
+  if( vm->regs == NULL ) {
+    vm->regs_size = 0;
+    return;	// ENOMEM
+  }
+  vm->regs_size = size;
+#endif
+  memset(vm->regs, 0, sizeof(mrbc_value) * MRBC_VM_REGS_SIZE(vm));
   int i;
-  for( i = 1; i < MAX_REGS_SIZE; i++ ) {
+  for( i = 1; i < MRBC_VM_REGS_SIZE(vm); i++ ) {
     vm->regs[i].tt = MRBC_TT_NIL;
   }
   // set self to reg[0]
@@ -2692,11 +3798,58 @@ void mrbc_vm_begin( struct VM *vm )
   vm->exc = 0;
   vm->exception_tail = 0;
 
+#if MRBC_CALLINFO_POOL_SIZE > 0
+  vm->callinfo_free = NULL;
+  for( i = MRBC_CALLINFO_POOL_SIZE - 1; i >= 0; i-- ) {
+    vm->callinfo_pool[i].prev = vm->callinfo_free;
+    vm->callinfo_free = &vm->callinfo_pool[i];
+  }
+#endif
+#if MRBC_BLOCK_POOL_SIZE > 0
+  for( i = 0; i < MRBC_BLOCK_POOL_SIZE; i++ ) {
+    vm->block_pool[i].irep = NULL;
+  }
+#endif
+
   vm->error_code = 0;
   vm->flag_preemption = 0;
 }
 
 
+#if MRBC_USE_HOT_RELOAD
+//================================================================
+/*! restart the VM from the top of vm->irep, keeping the objects.
+
+  @param  vm  Pointer to VM
+
+  Unlike mrbc_vm_end() and mrbc_vm_begin(), the memory of the VM is not
+  freed. All frames are dropped, and registers but self are released.
+*/
+void mrbc_vm_restart( struct VM *vm )
+{
+  while( vm->callinfo_tail ) {
+    mrbc_pop_callinfo( vm );
+  }
+
+  int i;
+  for( i = 1; i < MRBC_VM_REGS_SIZE(vm); i++ ) {
+    mrbc_decref( &vm->regs[i] );
+    vm->regs[i].tt = MRBC_TT_NIL;
+  }
+
+  vm->pc_irep = vm->irep;
+  vm->inst = vm->pc_irep->code;
+  vm->ext_flag = 0;
+  vm->current_regs = vm->regs;
+  vm->target_class = mrbc_class_object;
+  vm->exc = 0;
+  vm->exc_pending = 0;
+  vm->exception_tail = 0;
+  vm->error_code = 0;
+}
+#endif
+
+
 //================================================================
 /*! VM finalizer.
 
@@ -2704,16 +3857,75 @@ void mrbc_vm_begin( struct VM *vm )
 */
 void mrbc_vm_end( struct VM *vm )
 {
+  // frames are left if stopped in a method.
+  while( vm->callinfo_tail ) {
+    mrbc_pop_callinfo( vm );
+  }
+
   int i;
-  for( i = 0; i < MAX_REGS_SIZE; i++ ) {
+  for( i = 0; i < MRBC_VM_REGS_SIZE(vm); i++ ) {
     mrbc_decref_empty(&vm->regs[i]);
   }
+#if MRBC_USE_DYNAMIC_REGS
+  if( vm->regs ) mrbc_raw_free( vm->regs );
+  vm->regs = NULL;
+  vm->regs_size = 0;
+#endif
 
+  mrbc_drain_free_queue( -1 );
   mrbc_global_clear_vm_id();
+  mrbc_gc_forget_vm(vm);
+  mrbc_range_free_vm(vm);
   mrbc_free_all(vm);
+  mrbc_console_flush();
 }
 
 
+#if defined(MRBC_DEBUG) || MRBC_USE_OPCODE_STATS
+//! opcode names, for debug and the opcode statistics.
+static const char * const opcode_name_[] = {
+  // 0x00
+  "NOP",     "MOVE",    "LOADL",   "LOADI",
+  "LOADINEG","LOADI__1","LOADI_0", "LOADI_1",
+  "LOADI_2", "LOADI_3", "LOADI_4", "LOADI_5",
+  "LOADI_6", "LOADI_7", "LOADSYM", "LOADNIL",
+  // 0x10
+  "LOADSELF","LOADT",   "LOADF",   "GETGV",
+  "SETGV",   "GETSV",   "SETSV",   "GETIV",
+  "SETIV",   "GETCV",   "SETCV",   "GETCONST",
+  "SETCONST","GETMCNST","SETMCNST","GETUPVAR",
+  // 0x20
+  "SETUPVAR","JMP",     "JMPIF",   "JMPNOT",
+  "JMPNIL",  "ONERR",   "EXCEPT",  "RESCUE",
+  "POPERR",  "RAISE",   "EPUSH",   "EPOP",
+  "SENDV",   "SENDVB",  "SEND",    "SENDB",
+  // 0x30
+  "CALL",    "SUPER",   "ARGARY",  "ENTER",
+  "KEY_P",   "KEYEND",  "KARG",    "RETURN",
+  "RETRUN_BLK","BREAK", "BLKPUSH", "ADD",
+  "ADDI",    "SUB",     "SUBI",    "MUL",
+  // 0x40
+  "DIV",     "EQ",      "LT",      "LE",
+  "GT",      "GE",      "ARRAY",   "ARRAY2",
+  "ARYCAT",  "ARYPUSH", "ARYDUP",  "AREF",
+  "ASET",    "APOST",   "INTERN",  "STRING",
+  // 0x50
+  "STRCAT",  "HASH",    "HASHADD", "HASHCAT",
+  "LAMBDA",  "BLOCK",   "METHOD",  "RANGE_INC",
+  "RANGE_EXC","OCLASS", "CLASS",   "MODULE",
+  "EXEC",    "DEF",     "ALIAS",   "UNDEF",
+  // 0x60
+  "SCLASS",  "TCLASS",  "DEBUG",   "ERR",
+  "EXT1",    "EXT2",    "EXT3",    "STOP",
+  "ABORT",   "EQ_JMPIF","EQ_JMPNOT","LT_JMPIF",
+  // 0x6c
+  "LT_JMPNOT","LE_JMPIF","LE_JMPNOT","GT_JMPIF",
+  "GT_JMPNOT","GE_JMPIF","GE_JMPNOT","NATIVE_ITER",
+};
+#define OPCODE_NAME_SIZE (sizeof(opcode_name_)/sizeof(opcode_name_[0]))
+#endif
+
+
 //================================================================
 /*! output op for debug
 
@@ -2722,46 +3934,9 @@ void mrbc_vm_end( struct VM *vm )
 #ifdef MRBC_DEBUG
 void output_opcode( uint8_t opcode )
 {
-  const char *n[] = {
-    // 0x00
-    "NOP",     "MOVE",    "LOADL",   "LOADI",
-    "LOADINEG","LOADI__1","LOADI_0", "LOADI_1",
-    "LOADI_2", "LOADI_3", "LOADI_4", "LOADI_5",
-    "LOADI_6", "LOADI_7", "LOADSYM", "LOADNIL",
-    // 0x10
-    "LOADSELF","LOADT",   "LOADF",   "GETGV",
-    "SETGV",   "GETSV",   "SETSV",   "GETIV",
-    "SETIV",   "GETCV",   "SETCV",   "GETCONST",
-    "SETCONST","GETMCNST","SETMCNST","GETUPVAR",
-    // 0x20
-    "SETUPVAR","JMP",     "JMPIF",   "JMPNOT",
-    "JMPNIL",  "ONERR",   "EXCEPT",  "RESCUE",
-    "POPERR",  "RAISE",   "EPUSH",   "EPOP",
-    "SENDV",   "SENDVB",  "SEND",    "SENDB",
-    // 0x30
-    "CALL",    "SUPER",   "ARGARY",  "ENTER",
-    "KEY_P",   "KEYEND",  "KARG",    "RETURN",
-    "RETRUN_BLK","BREAK", "BLKPUSH", "ADD",
-    "ADDI",    "SUB",     "SUBI",    "MUL",
-    // 0x40
-    "DIV",     "EQ",      "LT",      "LE",
-    "GT",      "GE",      "ARRAY",   "ARRAY2",
-    "ARYCAT",  "ARYPUSH", "ARYDUP",  "AREF",
-    "ASET",    "APOST",   "INTERN",  "STRING",
-    // 0x50
-    "STRCAT",  "HASH",    "HASHADD", "HASHCAT",
-    "LAMBDA",  "BLOCK",   "METHOD",  "RANGE_INC",
-    "RANGE_EXC","OCLASS", "CLASS",   "MODULE",
-    "EXEC",    "DEF",     "ALIAS",   "UNDEF",
-    // 0x60
-    "SCLASS",  "TCLASS",  "DEBUG",   "ERR",
-    "EXT1",    "EXT2",    "EXT3",    "STOP",
-    "ABORT",
-  };
-
-  if( opcode < sizeof(n)/sizeof(char *) ){
-    if( n[opcode] ){
-      console_printf("(OP_%s)\n", n[opcode]);
+  if( opcode < OPCODE_NAME_SIZE ){
+    if( opcode_name_[opcode] ){
+      console_printf("(OP_%s)\n", opcode_name_[opcode]);
     } else {
       console_printf("(OP=%02x)\n", opcode);
     }
@@ -2772,6 +3947,397 @@ void output_opcode( uint8_t opcode )
 #endif
 
 
+#if MRBC_USE_OPCODE_STATS
+// execution count (and cycles) of each opcode, in all VMs.
+static MRBC_CONTEXT_LOCAL uint32_t opcode_count_[256];
+#if MRBC_USE_OPCODE_STATS >= 2
+static MRBC_CONTEXT_LOCAL uint64_t opcode_cycles_[256];
+static MRBC_CONTEXT_LOCAL uint32_t opcode_max_cycles_[256];
+#endif
+
+
+//================================================================
+/*! clear the opcode statistics.
+*/
+void mrbc_opcode_stats_clear(void)
+{
+  memset( opcode_count_, 0, sizeof(opcode_count_) );
+#if MRBC_USE_OPCODE_STATS >= 2
+  memset( opcode_cycles_, 0, sizeof(opcode_cycles_) );
+  memset( opcode_max_cycles_, 0, sizeof(opcode_max_cycles_) );
+#endif
+}
+
+
+//================================================================
+/*! get the statistics of one opcode.
+
+  @param  opcode	opcode.
+  @param  cycles	returns total cycles, or 0 without the cycle counter.
+  @param  max_cycles	returns the worst cycles, or 0 likewise.
+  @return		execution count.
+  @note	cycles and max_cycles may be NULL.
+*/
+uint32_t mrbc_opcode_stats_get( uint8_t opcode, uint64_t *cycles, uint32_t *max_cycles )
+{
+#if MRBC_USE_OPCODE_STATS >= 2
+  if( cycles ) *cycles = opcode_cycles_[opcode];
+  if( max_cycles ) *max_cycles = opcode_max_cycles_[opcode];
+#else
+  if( cycles ) *cycles = 0;
+  if( max_cycles ) *max_cycles = 0;
+#endif
+  return opcode_count_[opcode];
+}
+
+
+//================================================================
+/*! output the opcode statistics, most executed first.
+*/
+void mrbc_opcode_stats_dump(void)
+{
+  uint8_t idx[256];
+  uint64_t total = 0;
+  int n = 0;
+
+  for( int i = 0; i < 256; i++ ) {
+    if( opcode_count_[i] == 0 ) continue;
+    total += opcode_count_[i];
+
+    // insertion sort by count, descending.
+    int j = n++;
+    for( ; j > 0 && opcode_count_[idx[j-1]] < opcode_count_[i]; j-- ) {
+      idx[j] = idx[j-1];
+    }
+    idx[j] = i;
+  }
+
+  console_printf("# mrbc opcode stats: %d opcodes\n", n);
+#if MRBC_USE_OPCODE_STATS >= 2
+  console_printf("# opcode          count     %%    avg    max (cycles)\n");
+#else
+  console_printf("# opcode          count     %%\n");
+#endif
+
+  for( int i = 0; i < n; i++ ) {
+    int op = idx[i];
+    uint32_t cnt = opcode_count_[op];
+    int permil = (int)(cnt * (uint64_t)1000 / total);
+
+    if( op < OPCODE_NAME_SIZE && opcode_name_[op] ) {
+      console_printf("%-12s", opcode_name_[op]);
+    } else {
+      console_printf("OP=%02x       ", op);
+    }
+    console_printf(" %10u %3d.%d", cnt, permil / 10, permil % 10);
+#if MRBC_USE_OPCODE_STATS >= 2
+    console_printf(" %6u %6u", (uint32_t)(opcode_cycles_[op] / cnt),
+                   opcode_max_cycles_[op]);
+#endif
+    console_printf("\n");
+  }
+}
+
+
+// count the opcode at dispatch, and the cycles until the next dispatch.
+#if MRBC_USE_OPCODE_STATS >= 2
+#define OPSTAT_BEGIN(op) (opcode_count_[op]++, op_cycle_ = hal_cycle_count())
+#define OPSTAT_END(op)                                         \
+  do {                                                         \
+    uint32_t c_ = (uint32_t)(hal_cycle_count() - op_cycle_);   \
+    opcode_cycles_[op] += c_;                                  \
+    if( opcode_max_cycles_[op] < c_ ) opcode_max_cycles_[op] = c_; \
+  } while(0)
+#else
+#define OPSTAT_BEGIN(op) (opcode_count_[op]++)
+#define OPSTAT_END(op)   ((void)0)
+#endif
+#else
+#define OPSTAT_BEGIN(op) ((void)0)
+#define OPSTAT_END(op)   ((void)0)
+#endif
+
+
+#if MRBC_USE_TASK_STATS
+#define COUNT_OP()	(vm->n_ops++)
+#else
+#define COUNT_OP()	((void)0)
+#endif
+
+// counts down the instruction budget, if given.
+#if defined(MRBC_NO_TIMER)
+#define OP_BUDGET_EXHAUSTED() (vm->op_budget != 0 && --vm->op_budget == 0)
+#else
+#define OP_BUDGET_EXHAUSTED() 0
+#endif
+
+
+#if MRBC_USE_THREADED_CODE
+#if !defined(__GNUC__)
+#error "MRBC_USE_THREADED_CODE needs GCC or Clang (labels as values)."
+#endif
+//================================================================
+/*! Fetch a bytecode and execute (threaded code version)
+
+  @param  vm    A pointer of VM.
+  @retval 0  No error.
+*/
+int mrbc_vm_run( struct VM *vm )
+{
+  static const void * const dispatch_table[256] = {
+    [0 ... 255]    = &&L_UNKNOWN,
+    [OP_NOP      ] = &&L_OP_NOP,
+    [OP_MOVE     ] = &&L_OP_MOVE,
+    [OP_LOADL    ] = &&L_OP_LOADL,
+    [OP_LOADI    ] = &&L_OP_LOADI,
+    [OP_LOADINEG ] = &&L_OP_LOADINEG,
+    [OP_LOADI__1 ] = &&L_OP_LOADI_N,
+    [OP_LOADI_0  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_1  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_2  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_3  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_4  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_5  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_6  ] = &&L_OP_LOADI_N,
+    [OP_LOADI_7  ] = &&L_OP_LOADI_N,
+    [OP_LOADSYM  ] = &&L_OP_LOADSYM,
+    [OP_LOADNIL  ] = &&L_OP_LOADNIL,
+    [OP_LOADSELF ] = &&L_OP_LOADSELF,
+    [OP_LOADT    ] = &&L_OP_LOADT,
+    [OP_LOADF    ] = &&L_OP_LOADF,
+    [OP_GETGV    ] = &&L_OP_GETGV,
+    [OP_SETGV    ] = &&L_OP_SETGV,
+    [OP_GETSV    ] = &&L_OP_GETSV,
+    [OP_SETSV    ] = &&L_OP_SETSV,
+    [OP_GETIV    ] = &&L_OP_GETIV,
+    [OP_SETIV    ] = &&L_OP_SETIV,
+    [OP_GETCV    ] = &&L_OP_GETCV,
+    [OP_SETCV    ] = &&L_OP_SETCV,
+    [OP_GETCONST ] = &&L_OP_GETCONST,
+    [OP_SETCONST ] = &&L_OP_SETCONST,
+    [OP_GETMCNST ] = &&L_OP_GETMCNST,
+    [OP_SETMCNST ] = &&L_OP_SETMCNST,
+    [OP_GETUPVAR ] = &&L_OP_GETUPVAR,
+    [OP_SETUPVAR ] = &&L_OP_SETUPVAR,
+    [OP_JMP      ] = &&L_OP_JMP,
+    [OP_JMPIF    ] = &&L_OP_JMPIF,
+    [OP_JMPNOT   ] = &&L_OP_JMPNOT,
+    [OP_JMPNIL   ] = &&L_OP_JMPNIL,
+    [OP_ONERR    ] = &&L_OP_ONERR,
+    [OP_EXCEPT   ] = &&L_OP_EXCEPT,
+    [OP_RESCUE   ] = &&L_OP_RESCUE,
+    [OP_POPERR   ] = &&L_OP_POPERR,
+    [OP_RAISE    ] = &&L_OP_RAISE,
+    [OP_EPUSH    ] = &&L_OP_EPUSH,
+    [OP_EPOP     ] = &&L_OP_EPOP,
+    [OP_SENDV    ] = &&L_OP_SENDV,
+    [OP_SENDVB   ] = &&L_OP_SENDVB,
+    [OP_SEND     ] = &&L_OP_SEND,
+    [OP_SENDB    ] = &&L_OP_SENDB,
+    [OP_CALL     ] = &&L_OP_CALL,
+    [OP_SUPER    ] = &&L_OP_SUPER,
+    [OP_ARGARY   ] = &&L_OP_ARGARY,
+    [OP_ENTER    ] = &&L_OP_ENTER,
+    [OP_KEY_P    ] = &&L_OP_KEY_P,
+    [OP_KEYEND   ] = &&L_OP_KEYEND,
+    [OP_KARG     ] = &&L_OP_KARG,
+    [OP_RETURN   ] = &&L_OP_RETURN,
+    [OP_RETURN_BLK] = &&L_OP_RETURN_BLK,
+    [OP_BREAK    ] = &&L_OP_BREAK,
+    [OP_BLKPUSH  ] = &&L_OP_BLKPUSH,
+    [OP_ADD      ] = &&L_OP_ADD,
+    [OP_ADDI     ] = &&L_OP_ADDI,
+    [OP_SUB      ] = &&L_OP_SUB,
+    [OP_SUBI     ] = &&L_OP_SUBI,
+    [OP_MUL      ] = &&L_OP_MUL,
+    [OP_DIV      ] = &&L_OP_DIV,
+    [OP_EQ       ] = &&L_OP_EQ,
+    [OP_LT       ] = &&L_OP_LT,
+    [OP_LE       ] = &&L_OP_LE,
+    [OP_GT       ] = &&L_OP_GT,
+    [OP_GE       ] = &&L_OP_GE,
+    [OP_ARRAY    ] = &&L_OP_ARRAY,
+    [OP_ARRAY2   ] = &&L_OP_ARRAY2,
+    [OP_ARYCAT   ] = &&L_OP_ARYCAT,
+    [OP_ARYPUSH  ] = &&L_OP_ARYPUSH,
+    [OP_ARYDUP   ] = &&L_OP_ARYDUP,
+    [OP_AREF     ] = &&L_OP_AREF,
+    [OP_ASET     ] = &&L_OP_ASET,
+    [OP_APOST    ] = &&L_OP_APOST,
+    [OP_INTERN   ] = &&L_OP_INTERN,
+    [OP_STRING   ] = &&L_OP_STRING,
+    [OP_STRCAT   ] = &&L_OP_STRCAT,
+    [OP_HASH     ] = &&L_OP_HASH,
+    [OP_HASHADD  ] = &&L_OP_HASHADD,
+    [OP_HASHCAT  ] = &&L_OP_HASHCAT,
+    [OP_LAMBDA   ] = &&L_OP_LAMBDA,
+    [OP_BLOCK    ] = &&L_OP_METHOD,
+    [OP_METHOD   ] = &&L_OP_METHOD,
+    [OP_RANGE_INC] = &&L_OP_RANGE,
+    [OP_RANGE_EXC] = &&L_OP_RANGE,
+    [OP_OCLASS   ] = &&L_OP_OCLASS,
+    [OP_CLASS    ] = &&L_OP_CLASS,
+    [OP_MODULE   ] = &&L_OP_MODULE,
+    [OP_EXEC     ] = &&L_OP_EXEC,
+    [OP_DEF      ] = &&L_OP_DEF,
+    [OP_ALIAS    ] = &&L_OP_ALIAS,
+    [OP_UNDEF    ] = &&L_OP_UNDEF,
+    [OP_SCLASS   ] = &&L_OP_SCLASS,
+    [OP_TCLASS   ] = &&L_OP_TCLASS,
+    [OP_DEBUG    ] = &&L_OP_DEBUG,
+    [OP_ERR      ] = &&L_OP_ERR,
+    [OP_EXT1     ] = &&L_OP_EXT,
+    [OP_EXT2     ] = &&L_OP_EXT,
+    [OP_EXT3     ] = &&L_OP_EXT,
+    [OP_STOP     ] = &&L_OP_STOP,
+    [OP_ABORT    ] = &&L_OP_ABORT,
+#if MRBC_USE_SUPERINSTRUCTION
+    [OP_EQ_JMPIF ... OP_GE_JMPNOT] = &&L_OP_COMPARE_JMP,
+#endif
+#if MRBC_USE_NATIVE_ITERATOR
+    [OP_NATIVE_ITER] = &&L_OP_NATIVE_ITER,
+#endif
+  };
+  mrbc_value *regs = vm->current_regs;
+  int ret = 0;
+  uint8_t op;
+#if MRBC_USE_OPCODE_STATS >= 2
+  uint32_t op_cycle_;
+#endif
+
+#define DISPATCH_NEXT()                                                 \
+  do {                                                                  \
+    OPSTAT_END(op);                                                     \
+    if( vm->exception_tail == NULL && vm->callinfo_tail == NULL &&      \
+        vm->exc ) return 0;                                             \
+    if( vm->flag_preemption || OP_BUDGET_EXHAUSTED() ) goto PREEMPTION; \
+    regs = vm->current_regs;                                            \
+    COUNT_OP();                                                         \
+    op = *vm->inst++;                                                   \
+    OPSTAT_BEGIN(op);                                                   \
+    goto *dispatch_table[op];                                           \
+  } while(0)
+
+  COUNT_OP();
+  op = *vm->inst++;
+  OPSTAT_BEGIN(op);
+  goto *dispatch_table[op];
+
+  L_OP_NOP:      ret = op_nop       (vm, regs); DISPATCH_NEXT();
+  L_OP_MOVE:     ret = op_move      (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADL:    ret = op_loadl     (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADI:    ret = op_loadi     (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADINEG: ret = op_loadineg  (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADI_N: ret = op_loadi_n   (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADSYM:  ret = op_loadsym   (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADNIL:  ret = op_loadnil   (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADSELF: ret = op_loadself  (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADT:    ret = op_loadt     (vm, regs); DISPATCH_NEXT();
+  L_OP_LOADF:    ret = op_loadf     (vm, regs); DISPATCH_NEXT();
+  L_OP_GETGV:    ret = op_getgv     (vm, regs); DISPATCH_NEXT();
+  L_OP_SETGV:    ret = op_setgv     (vm, regs); DISPATCH_NEXT();
+  L_OP_GETSV:    ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_SETSV:    ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_GETIV:    ret = op_getiv     (vm, regs); DISPATCH_NEXT();
+  L_OP_SETIV:    ret = op_setiv     (vm, regs); DISPATCH_NEXT();
+  L_OP_GETCV:    ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_SETCV:    ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_GETCONST: ret = op_getconst  (vm, regs); DISPATCH_NEXT();
+  L_OP_SETCONST: ret = op_setconst  (vm, regs); DISPATCH_NEXT();
+  L_OP_GETMCNST: ret = op_getmcnst  (vm, regs); DISPATCH_NEXT();
+  L_OP_SETMCNST: ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_GETUPVAR: ret = op_getupvar  (vm, regs); DISPATCH_NEXT();
+  L_OP_SETUPVAR: ret = op_setupvar  (vm, regs); DISPATCH_NEXT();
+  L_OP_JMP:      ret = op_jmp       (vm, regs); DISPATCH_NEXT();
+  L_OP_JMPIF:    ret = op_jmpif     (vm, regs); DISPATCH_NEXT();
+  L_OP_JMPNOT:   ret = op_jmpnot    (vm, regs); DISPATCH_NEXT();
+  L_OP_JMPNIL:   ret = op_jmpnil    (vm, regs); DISPATCH_NEXT();
+  L_OP_ONERR:    ret = op_onerr     (vm, regs); DISPATCH_NEXT();
+  L_OP_EXCEPT:   ret = op_except    (vm, regs); DISPATCH_NEXT();
+  L_OP_RESCUE:   ret = op_rescue    (vm, regs); DISPATCH_NEXT();
+  L_OP_POPERR:   ret = op_poperr    (vm, regs); DISPATCH_NEXT();
+  L_OP_RAISE:    ret = op_raise     (vm, regs); DISPATCH_NEXT();
+  L_OP_EPUSH:    ret = op_epush     (vm, regs); DISPATCH_NEXT();
+  L_OP_EPOP:     ret = op_epop      (vm, regs); DISPATCH_NEXT();
+  L_OP_SENDV:    ret = op_sendv     (vm, regs); DISPATCH_NEXT();
+  L_OP_SENDVB:   ret = op_sendvb    (vm, regs); DISPATCH_NEXT();
+  L_OP_SEND:     ret = op_send      (vm, regs); DISPATCH_NEXT();
+  L_OP_SENDB:    ret = op_sendb     (vm, regs); DISPATCH_NEXT();
+  L_OP_CALL:     ret = op_dummy_Z   (vm, regs); DISPATCH_NEXT();
+  L_OP_SUPER:    ret = op_super     (vm, regs); DISPATCH_NEXT();
+  L_OP_ARGARY:   ret = op_argary    (vm, regs); DISPATCH_NEXT();
+  L_OP_ENTER:    ret = op_enter     (vm, regs); DISPATCH_NEXT();
+  L_OP_KEY_P:    ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_KEYEND:   ret = op_dummy_Z   (vm, regs); DISPATCH_NEXT();
+  L_OP_KARG:     ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_RETURN:   ret = op_return    (vm, regs); DISPATCH_NEXT();
+  L_OP_RETURN_BLK:ret = op_return_blk(vm, regs); DISPATCH_NEXT();
+  L_OP_BREAK:    ret = op_break     (vm, regs); DISPATCH_NEXT();
+  L_OP_BLKPUSH:  ret = op_blkpush   (vm, regs); DISPATCH_NEXT();
+  L_OP_ADD:      ret = op_add       (vm, regs); DISPATCH_NEXT();
+  L_OP_ADDI:     ret = op_addi      (vm, regs); DISPATCH_NEXT();
+  L_OP_SUB:      ret = op_sub       (vm, regs); DISPATCH_NEXT();
+  L_OP_SUBI:     ret = op_subi      (vm, regs); DISPATCH_NEXT();
+  L_OP_MUL:      ret = op_mul       (vm, regs); DISPATCH_NEXT();
+  L_OP_DIV:      ret = op_div       (vm, regs); DISPATCH_NEXT();
+  L_OP_EQ:       ret = op_eq        (vm, regs); DISPATCH_NEXT();
+  L_OP_LT:       ret = op_lt        (vm, regs); DISPATCH_NEXT();
+  L_OP_LE:       ret = op_le        (vm, regs); DISPATCH_NEXT();
+  L_OP_GT:       ret = op_gt        (vm, regs); DISPATCH_NEXT();
+  L_OP_GE:       ret = op_ge        (vm, regs); DISPATCH_NEXT();
+  L_OP_ARRAY:    ret = op_array     (vm, regs); DISPATCH_NEXT();
+  L_OP_ARRAY2:   ret = op_array2    (vm, regs); DISPATCH_NEXT();
+  L_OP_ARYCAT:   ret = op_arycat    (vm, regs); DISPATCH_NEXT();
+  L_OP_ARYPUSH:  ret = op_dummy_B   (vm, regs); DISPATCH_NEXT();
+  L_OP_ARYDUP:   ret = op_arydup    (vm, regs); DISPATCH_NEXT();
+  L_OP_AREF:     ret = op_aref      (vm, regs); DISPATCH_NEXT();
+  L_OP_ASET:     ret = op_dummy_BBB (vm, regs); DISPATCH_NEXT();
+  L_OP_APOST:    ret = op_apost     (vm, regs); DISPATCH_NEXT();
+  L_OP_INTERN:   ret = op_intern    (vm, regs); DISPATCH_NEXT();
+  L_OP_STRING:   ret = op_string    (vm, regs); DISPATCH_NEXT();
+  L_OP_STRCAT:   ret = op_strcat    (vm, regs); DISPATCH_NEXT();
+  L_OP_HASH:     ret = op_hash      (vm, regs); DISPATCH_NEXT();
+  L_OP_HASHADD:  ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_HASHCAT:  ret = op_dummy_B   (vm, regs); DISPATCH_NEXT();
+  L_OP_LAMBDA:   ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_METHOD:   ret = op_method    (vm, regs); DISPATCH_NEXT();
+  L_OP_RANGE:    ret = op_range     (vm, regs); DISPATCH_NEXT();
+  L_OP_OCLASS:   ret = op_dummy_B   (vm, regs); DISPATCH_NEXT();
+  L_OP_CLASS:    ret = op_class     (vm, regs); DISPATCH_NEXT();
+  L_OP_MODULE:   ret = op_dummy_BB  (vm, regs); DISPATCH_NEXT();
+  L_OP_EXEC:     ret = op_exec      (vm, regs); DISPATCH_NEXT();
+  L_OP_DEF:      ret = op_def       (vm, regs); DISPATCH_NEXT();
+  L_OP_ALIAS:    ret = op_alias     (vm, regs); DISPATCH_NEXT();
+  L_OP_UNDEF:    ret = op_dummy_B   (vm, regs); DISPATCH_NEXT();
+  L_OP_SCLASS:   ret = op_sclass    (vm, regs); DISPATCH_NEXT();
+  L_OP_TCLASS:   ret = op_tclass    (vm, regs); DISPATCH_NEXT();
+  L_OP_DEBUG:    ret = op_dummy_BBB (vm, regs); DISPATCH_NEXT();
+  L_OP_ERR:      ret = op_dummy_B   (vm, regs); DISPATCH_NEXT();
+  L_OP_EXT:      ret = op_ext       (vm, regs); DISPATCH_NEXT();
+  L_OP_STOP:     ret = op_stop      (vm, regs); DISPATCH_NEXT();
+  L_OP_ABORT:    ret = op_abort     (vm, regs); DISPATCH_NEXT();
+#if MRBC_USE_SUPERINSTRUCTION
+  L_OP_COMPARE_JMP: ret = op_compare_jmp(vm, regs, op); DISPATCH_NEXT();
+#endif
+#if MRBC_USE_NATIVE_ITERATOR
+  L_OP_NATIVE_ITER: ret = op_native_iter(vm, regs); DISPATCH_NEXT();
+#endif
+
+  L_UNKNOWN:
+  console_printf("Unknown OP 0x%02x\n", op);
+  DISPATCH_NEXT();
+
+#undef DISPATCH_NEXT
+
+ PREEMPTION:
+  vm->flag_preemption = 0;
+  mrbc_drain_free_queue( MRBC_FREE_QUEUE_SIZE );
+
+  return ret;
+}
+
+
+#else
 //================================================================
 /*! Fetch a bytecode and execute
 
@@ -2787,7 +4353,12 @@ int mrbc_vm_run( struct VM *vm )
     mrbc_value *regs = vm->current_regs;
 
     // Dispatch
+    COUNT_OP();
     uint8_t op = *vm->inst++;
+#if MRBC_USE_OPCODE_STATS >= 2
+    uint32_t op_cycle_;
+#endif
+    OPSTAT_BEGIN(op);
 
     // output OP_XXX for debug
     //if( vm->flag_debug_mode )output_opcode( op );
@@ -2899,17 +4470,35 @@ int mrbc_vm_run( struct VM *vm )
     case OP_STOP:       ret = op_stop      (vm, regs); break;
 
     case OP_ABORT:      ret = op_abort     (vm, regs); break;
+#if MRBC_USE_SUPERINSTRUCTION
+    case OP_EQ_JMPIF:   // fall through
+    case OP_EQ_JMPNOT:  // fall through
+    case OP_LT_JMPIF:   // fall through
+    case OP_LT_JMPNOT:  // fall through
+    case OP_LE_JMPIF:   // fall through
+    case OP_LE_JMPNOT:  // fall through
+    case OP_GT_JMPIF:   // fall through
+    case OP_GT_JMPNOT:  // fall through
+    case OP_GE_JMPIF:   // fall through
+    case OP_GE_JMPNOT:  ret = op_compare_jmp(vm, regs, op); break;
+#endif
+#if MRBC_USE_NATIVE_ITERATOR
+    case OP_NATIVE_ITER: ret = op_native_iter(vm, regs); break;
+#endif
     default:
       console_printf("Unknown OP 0x%02x\n", op);
       break;
     }
+    OPSTAT_END(op);
 
     // raise in top level
     // exit vm
     if( vm->exception_tail == NULL && vm->callinfo_tail == NULL && vm->exc ) return 0;
-  } while( !vm->flag_preemption );
+  } while( !vm->flag_preemption && !OP_BUDGET_EXHAUSTED() );
 
   vm->flag_preemption = 0;
+  mrbc_drain_free_queue( MRBC_FREE_QUEUE_SIZE );
 
   return ret;
 }
+#endif
@@ -25,6 +25,39 @@ extern "C" {
 #endif
 
 
+//================================================================
+/*!@brief
+  Method cache entry.
+
+  For instance variable names (OP_GETIV/SETIV), it holds the slot
+  number instead of a method. For constants and global variables, it
+  holds the slot of the value, with mrbc_const_epoch or
+  mrbc_global_epoch that never equal mrbc_method_epoch.
+*/
+typedef struct METHOD_CACHE {
+  mrbc_class *cls;		//!< receiver class of cached method.
+  uint32_t epoch;		//!< copy of mrbc_method_epoch when cached.
+  union {
+    mrbc_method method;		//!< result of mrbc_find_method.
+    int ivar_slot;		//!< result of mrbc_class_ivar_slot.
+    mrbc_value *value;		//!< slot of constant or global variable.
+  };
+} mrbc_method_cache;
+
+
+//================================================================
+/*!@brief
+  Rescue table entry. (see MRBC_USE_RESCUE_TABLE)
+
+  An exception raised by the instruction that ends in (begin, target]
+  is rescued by the code at target.
+*/
+typedef struct RESCUE_RANGE {
+  uint16_t begin;		//!< offset of the instruction next to OP_ONERR.
+  uint16_t target;		//!< offset of the rescue clause.
+} mrbc_rescue_range;
+
+
 //================================================================
 /*!@brief
   IREP Internal REPresentation
@@ -39,16 +72,50 @@ typedef struct IREP {
   uint16_t rlen;		//!< # of child IREP blocks
   uint16_t ilen;		//!< # of irep
   uint16_t plen;		//!< # of pool
+  uint16_t slen;		//!< # of symbol
+#if MRBC_USE_RESCUE_TABLE
+  uint16_t rescue_len;		//!< # of rescue table entries.
+#endif
+#if MRBC_USE_SUPERINSTRUCTION || MRBC_USE_STREAM_LOADER
+  uint8_t flag_code_in_ram;	//!< code is in RAM, owned by this irep.
+#endif
+#if MRBC_USE_STREAM_LOADER
+  uint8_t flag_str_in_ram;	//!< string literals are owned by this irep.
+#endif
+#if MRBC_USE_HOT_RELOAD
+  uint8_t flag_loaded;		//!< made by the loader. (n_refs is counted)
+  uint32_t n_refs;		//!< # of Procs, methods and literal Strings refer to.
+#endif
 
   uint8_t     *code;		//!< ISEQ (code) BLOCK
-  mrbc_object **pools;		//!< array of POOL objects pointer.
+  mrbc_object *pools;		//!< array of POOL objects.
   uint8_t     *ptr_to_sym;
+#if MRBC_USE_IREP_SYMBOL_TABLE
+  mrbc_sym    *sym_ids;		//!< array of pre-resolved symbol IDs.
+#endif
+#if MRBC_USE_INLINE_METHOD_CACHE
+  mrbc_method_cache *method_cache;	//!< inline method cache per symbol.
+#endif
+#if MRBC_USE_RESCUE_TABLE
+  mrbc_rescue_range *rescue_table;	//!< begin/rescue ranges, by OP_ONERR.
+#endif
   struct IREP **reps;		//!< array of child IREP's pointer.
+#if MRBC_USE_LAZY_IREP_LOAD
+  const uint8_t *reps_pos;	//!< bytecode of the first child IREP.
+  uint8_t mrb_align;		//!< address of bytecode & 3, for padding.
+#endif
 
 } mrbc_irep;
 typedef struct IREP mrb_irep;
 
 
+#if MRBC_USE_HOT_RELOAD
+// count the references to the irep. call it in hal_lock().
+#define MRBC_IREP_ADD_REF(irep, n) \
+  do { if( (irep)->flag_loaded ) (irep)->n_refs += (n); } while(0)
+#endif
+
+
 //================================================================
 /*!@brief
   Call information
@@ -61,12 +128,50 @@ typedef struct CALLINFO {
   mrbc_class *target_class;	//!< copy from mrbc_vm.
   mrbc_class *own_class;	//!< class that owns method.
   mrbc_sym method_id;		//!< called method ID.
+  struct RProc *procs;		//!< procs made in this frame.
   uint8_t reg_offset;		//!< register offset after call.
   uint8_t n_args;		//!< # of arguments.
 } mrbc_callinfo;
 typedef struct CALLINFO mrb_callinfo;
 
 
+//================================================================
+/*!@brief
+  Native iterator (see MRBC_USE_NATIVE_ITERATOR)
+
+  step() puts the next block arguments to v[8]..,
+  and returns the number of them, or -1 when the iteration is finished.
+  v[2]..v[4] are free for step(), and start with fixnum 0.
+  v[5] is the return value of the method (self by default),
+  and v[7] is the return value of the last block call.
+*/
+typedef struct NATIVE_ITER {
+  mrbc_sym sym_id;		//!< method name, to find the Ruby version.
+  int (*step)(struct VM *vm, mrbc_value v[]);
+} mrbc_native_iter;
+
+
+//================================================================
+/*!@brief
+  Trace event (see MRBC_TRACE_EVENTS)
+*/
+typedef struct TRACE_EVENT {
+  uint32_t time;		//!< MRBC_TRACE_CLOCK() at the event.
+  uint8_t type;			//!< MRBC_TRACE_*
+  mrbc_sym sym_id;		//!< method, or class of the exception.
+} mrbc_trace_event;
+
+enum {
+  MRBC_TRACE_CALL = 1,		//!< Ruby method or block called.
+  MRBC_TRACE_RETURN,		//!< returned from it.
+  MRBC_TRACE_CFUNC,		//!< C function called.
+  MRBC_TRACE_CFUNC_END,		//!< returned from it.
+  MRBC_TRACE_RAISE,		//!< exception raised.
+  MRBC_TRACE_RUN,		//!< task switched in.
+  MRBC_TRACE_STOP,		//!< task switched out.
+};
+
+
 //================================================================
 /*!@brief
   Virtual Machine
@@ -81,7 +186,12 @@ typedef struct VM {
   uint8_t *inst;        // instruction
   uint8_t ext_flag;     // 1:EXT1, 2:EXT2, 3:EXT3, 0:otherwize
 
+#if MRBC_USE_DYNAMIC_REGS
+  mrbc_value   *regs;
+  uint16_t      regs_size;	//!< # of regs.
+#else
   mrbc_value    regs[MAX_REGS_SIZE];
+#endif
   mrbc_value   *current_regs;
   mrbc_callinfo *callinfo_tail;
 
@@ -95,26 +205,84 @@ typedef struct VM {
   mrbc_value exc_message;  // exception message
   mrbc_callinfo *exception_tail;
 
+#if MRBC_CALLINFO_POOL_SIZE > 0
+  mrbc_callinfo *callinfo_free;	//!< free list of callinfo_pool.
+  mrbc_callinfo callinfo_pool[MRBC_CALLINFO_POOL_SIZE];
+#endif
+#if MRBC_BLOCK_POOL_SIZE > 0
+  mrbc_proc block_pool[MRBC_BLOCK_POOL_SIZE];	//!< free if irep is NULL.
+#endif
+
   int32_t error_code;
 
   volatile int8_t flag_preemption;
   int8_t flag_need_memfree;
+  int8_t flag_shared_irep;	//!< irep is owned by another VM.
+
+#if MRBC_USE_TASK_STATS
+  uint32_t n_ops;	//!< number of executed opcodes.
+#endif
+#if defined(MRBC_NO_TIMER)
+  uint16_t op_budget;	//!< opcodes to run before preemption, or 0.
+#endif
+#if MRBC_TRACE_EVENTS > 0
+  uint16_t trace_wp;	//!< write index of trace_buf.
+  uint16_t trace_n;	//!< # of events stored in trace_buf.
+  uint32_t trace_dropped;	//!< events overwritten before read.
+  mrbc_trace_event trace_buf[MRBC_TRACE_EVENTS];
+#endif
 } mrbc_vm;
 typedef struct VM mrb_vm;
 
 
+#if MRBC_USE_DYNAMIC_REGS
+#define MRBC_VM_REGS_SIZE(vm) ((vm)->regs_size)
+#else
+#define MRBC_VM_REGS_SIZE(vm) MAX_REGS_SIZE
+#endif
+
 
 void mrbc_cleanup_vm(void);
 const char *mrbc_get_callee_name(struct VM *vm);
 mrbc_irep *mrbc_irep_alloc(struct VM *vm);
 void mrbc_irep_free(mrbc_irep *irep);
+mrbc_callinfo *mrbc_callinfo_alloc(struct VM *vm);
+void mrbc_callinfo_free(struct VM *vm, mrbc_callinfo *callinfo);
 mrbc_callinfo * mrbc_push_callinfo( struct VM *vm, mrbc_sym method_id, int reg_offset, int n_args );
 void mrbc_pop_callinfo(struct VM *vm);
+int mrbc_check_regs(struct VM *vm, const mrbc_value *regs, const mrbc_irep *irep);
+#if MRBC_USE_RESCUE_TABLE
+int mrbc_rescue_by_table(struct VM *vm);
+#endif
 mrbc_vm *mrbc_vm_open(struct VM *vm_arg);
 void mrbc_vm_close(struct VM *vm);
 void mrbc_vm_begin(struct VM *vm);
 void mrbc_vm_end(struct VM *vm);
+#if MRBC_USE_HOT_RELOAD
+void mrbc_vm_restart(struct VM *vm);
+#endif
 int mrbc_vm_run(struct VM *vm);
+#if MRBC_USE_NATIVE_ITERATOR
+void mrbc_native_iter_start(struct VM *vm, mrbc_value v[], int argc, const mrbc_native_iter *iter);
+void mrbc_native_iter_fallback(struct VM *vm, mrbc_value v[], int argc, mrbc_sym sym_id);
+#endif
+#if MRBC_TRACE_EVENTS > 0
+extern MRBC_CONTEXT_LOCAL volatile int mrbc_trace_enabled;
+void mrbc_trace_start(void);
+void mrbc_trace_stop(void);
+void mrbc_trace_put(struct VM *vm, int type, mrbc_sym sym_id);
+int mrbc_trace_read(struct VM *vm, mrbc_trace_event *buf, int size, uint32_t *n_dropped);
+void mrbc_trace_dump(struct VM *vm);
+#define MRBC_TRACE(vm, type, sym_id) \
+  (mrbc_trace_enabled ? mrbc_trace_put(vm, type, sym_id) : (void)0)
+#else
+#define MRBC_TRACE(vm, type, sym_id) ((void)0)
+#endif
+#if MRBC_USE_OPCODE_STATS
+void mrbc_opcode_stats_clear(void);
+uint32_t mrbc_opcode_stats_get(uint8_t opcode, uint64_t *cycles, uint32_t *max_cycles);
+void mrbc_opcode_stats_dump(void);
+#endif
 
 
 
@@ -20,16 +20,387 @@
 #define MAX_VM_COUNT 5
 #endif
 
+// number of ready queues.
+//  Task priorities (0..255) are divided into this many levels, and each
+//  level has its own ready queue. 1, 2, 4, 8, 16 or 32.
+#if !defined(MRBC_READY_QUEUE_LEVELS)
+#define MRBC_READY_QUEUE_LEVELS 32
+#endif
+
+// number of CPU cores that run the scheduler.
+//  With 2 or more, call mrbc_run_core() on each core (thread), and the
+//  shared tables are protected by hal_lock(). Needs the timer.
+#if !defined(MRBC_SMP_CORES)
+#define MRBC_SMP_CORES 1
+#endif
+
+// thread local interpreter context.
+//  Keep the whole state of the interpreter (memory pool, symbols,
+//  globals, classes, tasks and so on) per thread, so that each thread
+//  of a hosted process runs its own instance by mrbc_init() and
+//  mrbc_run(), without any lock. Needs MRBC_NO_TIMER, and can't be used
+//  with MRBC_SMP_CORES or MRBC_USE_MRBLIB_IMAGE.
+//  MRBC_CONTEXT_LOCAL is the storage class, __thread by default.
+#if !defined(MRBC_USE_THREAD_CONTEXT)
+#define MRBC_USE_THREAD_CONTEXT 0
+#endif
+#if !defined(MRBC_CONTEXT_LOCAL)
+#if MRBC_USE_THREAD_CONTEXT
+#define MRBC_CONTEXT_LOCAL __thread
+#else
+#define MRBC_CONTEXT_LOCAL
+#endif
+#endif
+
+// interrupt events.
+//  A task waits in wait_event(n), and an ISR signals it with
+//  mrbc_event_signal_from_isr(). The task becomes ready at the top
+//  priority and runs after the current opcode of the running task.
+//  MRBC_EVENT_CLOCK times the worst latency, e.g. hal_cycle_count.
+//  See mrbc_event_max_latency(). 0 to disable, up to 256.
+#if !defined(MRBC_NUM_EVENTS)
+#define MRBC_NUM_EVENTS 0
+#endif
+#if !defined(MRBC_EVENT_CLOCK)
+#define MRBC_EVENT_CLOCK mrbc_get_tick
+#endif
+
+// per-task statistics.
+//  Count the ticks run, opcodes executed, preemptions, ticks waited for
+//  mutexes and the worst ready-to-run latency of each task, and keep a
+//  latency histogram. See mrbc_get_task_stats().
+#if !defined(MRBC_USE_TASK_STATS)
+#define MRBC_USE_TASK_STATS 0
+#endif
+
+// hard real-time profile.
+//  Bound the worst case time of the allocator and the tick handler.
+//  mrbc_raw_alloc() is TLSF only, without the first-fit fallback, and
+//  mrbc_raw_alloc_no_free() is the same as mrbc_raw_alloc(). Objects
+//  are freed through the deferred free queue. mrbc_tick() doesn't wake
+//  up the sleeping tasks, but only requests a switch, and the scheduler
+//  wakes them up one by one with the interrupts enabled in between.
+//  And a task can be periodic with a deadline. See mrbc_set_period().
+//  MRBC_DEADLINE_MISS_HOOK(tcb) is called when a job ends too late.
+#if !defined(MRBC_USE_REALTIME)
+#define MRBC_USE_REALTIME 0
+#endif
+// #define MRBC_DEADLINE_MISS_HOOK(tcb) my_deadline_miss(tcb)
+
+// sampling profiler.
+//  Every MRBC_PROFILER_INTERVAL ticks, mrbc_tick() records the irep,
+//  instruction offset and method of each running task into a ring buffer
+//  of MRBC_PROFILER_SAMPLES, while started by mrbc_profiler_start().
+//  See mrbc_profiler_dump() and support/fold_profile.rb. 0 to disable.
+#if !defined(MRBC_PROFILER_INTERVAL)
+#define MRBC_PROFILER_INTERVAL 0
+#endif
+#if !defined(MRBC_PROFILER_SAMPLES)
+#define MRBC_PROFILER_SAMPLES 256
+#endif
+
+// opcode statistics.
+//  1 to count the executions of each opcode in mrbc_vm_run(), and 2 to
+//  also measure the cycles of each, by hal_cycle_count() of the HAL
+//  (rdtsc on posix, CCOUNT on ESP32, DWT CYCCNT on Cortex-M).
+//  The counters are shared by all VMs. See mrbc_opcode_stats_dump().
+#if !defined(MRBC_USE_OPCODE_STATS)
+#define MRBC_USE_OPCODE_STATS 0
+#endif
+
+// method call tracing.
+//  Each VM (task) records calls and returns of methods and C functions,
+//  exceptions and task switches into a ring of MRBC_TRACE_EVENTS events,
+//  while started by mrbc_trace_start(). The time stamps are ticks by
+//  default, or e.g. -DMRBC_TRACE_CLOCK=hal_cycle_count for cycles.
+//  See mrbc_trace_dump() and support/trace_to_json.rb. 0 to disable.
+#if !defined(MRBC_TRACE_EVENTS)
+#define MRBC_TRACE_EVENTS 0
+#endif
+#if !defined(MRBC_TRACE_CLOCK)
+#define MRBC_TRACE_CLOCK mrbc_get_tick
+#endif
+
 // maximum size of registers
 #if !defined(MAX_REGS_SIZE)
 #define MAX_REGS_SIZE 100
 #endif
 
+// allocate the registers of each VM at mrbc_vm_begin(), instead of
+// regs[MAX_REGS_SIZE] in the VM. The size is the maximum nregs of the
+// loaded ireps, plus MRBC_REGS_HEADROOM for nested calls.
+#if !defined(MRBC_USE_DYNAMIC_REGS)
+#define MRBC_USE_DYNAMIC_REGS 0
+#endif
+#if !defined(MRBC_REGS_HEADROOM)
+#define MRBC_REGS_HEADROOM 64
+#endif
+
+// callinfo pool size per VM.
+//  Method calls and block yields take their callinfo from a pool in
+//  the VM, and fall back to the memory pool when it is exhausted.
+//  0 to always use the memory pool.
+#if !defined(MRBC_CALLINFO_POOL_SIZE)
+#define MRBC_CALLINFO_POOL_SIZE 16
+#endif
+
+// block pool size.
+//  A block passed to a method at once, e.g. ary.each {...}, takes its
+//  Proc object from a pool in the VM, because it does not escape from
+//  the method in most cases. It falls back to the memory pool when the
+//  pool is exhausted. 0 to always use the memory pool.
+#if !defined(MRBC_BLOCK_POOL_SIZE)
+#define MRBC_BLOCK_POOL_SIZE 4
+#endif
+
+// range pool size.
+//  Ranges of two Fixnums, e.g. (0...n).each, take their object from a
+//  static pool instead of the memory pool, and fall back to it when
+//  the pool is exhausted. 0 to always use the memory pool.
+#if !defined(MRBC_RANGE_POOL_SIZE)
+#define MRBC_RANGE_POOL_SIZE 8
+#endif
+
 // maximum number of symbols
 #if !defined(MAX_SYMBOLS_COUNT)
 #define MAX_SYMBOLS_COUNT 255
 #endif
 
+// symbol table growth.
+//  Allocate the symbol table from the memory pool and grow it on demand
+//  up to MAX_SYMBOLS_COUNT, instead of static arrays.
+#if !defined(MRBC_USE_SYMBOL_TABLE_GROWTH)
+#define MRBC_USE_SYMBOL_TABLE_GROWTH 0
+#endif
+
+// irep cache size.
+//  VMs that load the same bytecode (same address and CRC) share one
+//  irep tree, released when the last of them is closed. 0 to disable.
+//  Not used with MRBC_SMP_CORES > 1 and the inline method cache.
+#if !defined(MRBC_IREP_CACHE_SIZE)
+#define MRBC_IREP_CACHE_SIZE MAX_VM_COUNT
+#endif
+
+// lazy irep loading.
+//  Child ireps (method bodies, blocks) are loaded from the bytecode when
+//  first used by OP_METHOD, OP_BLOCK, OP_EXEC and the like, instead of
+//  all at once. The bytecode must stay in place while the VM is running.
+#if !defined(MRBC_USE_LAZY_IREP_LOAD)
+#define MRBC_USE_LAZY_IREP_LOAD 0
+#endif
+
+// bytecode verifier.
+//  mrbc_load_mrb() checks the whole bytecode once (CRC, section and
+//  record sizes, opcodes, register, symbol, pool, child irep indexes and
+//  jump targets) and refuses a bad one, e.g. a broken OTA image.
+//  Then the VM omits the per-op index checks.
+#if !defined(MRBC_USE_BYTECODE_VERIFIER)
+#define MRBC_USE_BYTECODE_VERIFIER 0
+#endif
+
+// streaming loader, mrbc_load_mrb_stream().
+//  Loads bytecode through a read callback, e.g. from serial or SPI flash,
+//  without buffering the whole file. Needs MRBC_USE_IREP_SYMBOL_TABLE.
+#if !defined(MRBC_USE_STREAM_LOADER)
+#define MRBC_USE_STREAM_LOADER 0
+#endif
+
+// hot code reload, mrbc_reload_task().
+//  Replaces the bytecode of a task at its next task switch, keeping its
+//  objects, globals and constants. The old ireps are freed later, when
+//  no task, Proc or method refers to them any more.
+#if !defined(MRBC_USE_HOT_RELOAD)
+#define MRBC_USE_HOT_RELOAD 0
+#endif
+// number of old irep trees waiting to be freed.
+#if !defined(MRBC_HOT_RELOAD_MAX_RETIRED)
+#define MRBC_HOT_RELOAD_MAX_RETIRED 4
+#endif
+
+// pre-linked mrblib.
+//  Use the class library in src/mrblib_image.c, whose ireps are constant
+//  data, instead of loading src/mrblib.c at boot.
+#if !defined(MRBC_USE_MRBLIB_IMAGE)
+#define MRBC_USE_MRBLIB_IMAGE 1
+#endif
+
+// pre-resolved symbol ID table per irep.
+//  It costs sizeof(mrbc_sym) bytes per symbol, but OP_SEND and the like
+//  no longer need to walk the SYMS block and hash the name at runtime.
+//  Set 0 for targets with very little RAM.
+#if !defined(MRBC_USE_IREP_SYMBOL_TABLE)
+#define MRBC_USE_IREP_SYMBOL_TABLE 1
+#endif
+
+// inline method cache for OP_SEND family.
+//  Each irep symbol slot remembers the last (class, method) pair found,
+//  and is invalidated when any method is (re)defined.
+//  It costs sizeof(mrbc_method_cache) bytes per symbol.
+#if !defined(MRBC_USE_INLINE_METHOD_CACHE)
+#define MRBC_USE_INLINE_METHOD_CACHE 1
+#endif
+
+// global method cache size. (number of entries, power of 2)
+//  Caches (class, symbol) -> method for polymorphic call sites
+//  that the inline method cache can not hold. 0 to disable.
+#if !defined(MRBC_METHOD_CACHE_SIZE)
+#define MRBC_METHOD_CACHE_SIZE 16
+#endif
+
+// sorted method tables.
+//  A class with this many or more methods defined by mrbc_define_method()
+//  or def gets them sorted by symbol ID at the first lookup after the
+//  definitions, and binary searched as the built-in ones. 0 to disable.
+#if !defined(MRBC_METHOD_TABLE_MIN)
+#define MRBC_METHOD_TABLE_MIN 8
+#endif
+
+// threaded code (computed goto) dispatch for mrbc_vm_run().
+//  Needs GCC or Clang, e.g. posix and ESP32 targets.
+//  Set 0 to use the portable switch statement.
+#if !defined(MRBC_USE_THREADED_CODE)
+#define MRBC_USE_THREADED_CODE 0
+#endif
+
+// superinstructions.
+//  A load time peephole pass fuses compare and branch opcode pairs.
+//  Rewritten ireps get a RAM copy of their code (ilen bytes each),
+//  so it works with bytecode in flash too.
+#if !defined(MRBC_USE_SUPERINSTRUCTION)
+#define MRBC_USE_SUPERINSTRUCTION 0
+#endif
+
+// native C versions of the hot mrblib iterators.
+//  Array#each, each_with_index, collect, map, sort, sort!, Fixnum#times,
+//  Range#each and Hash#each (with the C only Hash#each_key, each_value)
+//  step the loop in C, and yield to the block through a VM frame, so
+//  that break and task switching work as the Ruby versions.
+//  The Ruby versions in mrblib remain as the fallback.
+#if !defined(MRBC_USE_NATIVE_ITERATOR)
+#define MRBC_USE_NATIVE_ITERATOR 1
+#endif
+
+// Hash search index.
+//  Hashes with at least this many entries get an open addressing
+//  index (about 4 bytes per entry) built on demand. 0 to disable.
+#if !defined(MRBC_HASH_INDEX_THRESHOLD)
+#define MRBC_HASH_INDEX_THRESHOLD 8
+#endif
+
+// String hash cache.
+//  Each String remembers its hash value until modified. It is used by
+//  the Hash index and String#to_sym. Costs 2 bytes per String.
+#if !defined(MRBC_USE_STRING_HASH_CACHE)
+#define MRBC_USE_STRING_HASH_CACHE 1
+#endif
+
+// String capacity.
+//  Each String remembers its buffer size, and appending grows the buffer
+//  geometrically instead of to the exact size. Costs 2 bytes per String.
+#if !defined(MRBC_USE_STRING_CAPACITY)
+#define MRBC_USE_STRING_CAPACITY 1
+#endif
+
+// copy-on-write string literals.
+//  OP_STRING makes a String that refers to the literal in the bytecode,
+//  and the contents are copied to the memory pool when first modified.
+//  The bytecode must stay in place while the VM is running.
+#if !defined(MRBC_USE_STRING_COW)
+#define MRBC_USE_STRING_COW 1
+#endif
+
+// sprintf format cache.
+//  sprintf and printf split the format string into at most
+//  MRBC_SPRINTF_MAX_ITEMS literal parts and directives, to size the
+//  result at once. The split of MRBC_SPRINTF_CACHE_SIZE literal format
+//  strings is kept by the address of the literal. (needs
+//  MRBC_USE_STRING_COW) Costs about MRBC_SPRINTF_MAX_ITEMS * 16 bytes of
+//  RAM per entry. 0 disables the cache.
+#if !defined(MRBC_SPRINTF_MAX_ITEMS)
+#define MRBC_SPRINTF_MAX_ITEMS 8
+#endif
+#if !defined(MRBC_SPRINTF_CACHE_SIZE)
+#define MRBC_SPRINTF_CACHE_SIZE 4
+#endif
+
+// heap snapshot.
+//  mrbc_snapshot_save() writes the memory pool and the static variables
+//  to retained RAM or flash, and mrbc_snapshot_restore() loads them
+//  instead of mrbc_init(), to warm start. The bytecode must stay at the
+//  same address in the same build, and no task may be running at the
+//  save. Only the main pool is saved. (see snapshot.c)
+#if !defined(MRBC_USE_SNAPSHOT)
+#define MRBC_USE_SNAPSHOT 0
+#endif
+
+// shared slices.
+//  Array#[] with start and length or a range, first(n) and last(n)
+//  return a view that shares the elements of the receiver, and String#[]
+//  to the end of the string shares its bytes. Either is copied when
+//  first modified, and the whole buffer stays alive while a view refers
+//  to it. Shorter slices than MRBC_SHARED_SLICE_MIN are copied as usual.
+//  Costs 1 pointer per Array, Hash and String. (String needs
+//  MRBC_USE_STRING_COW)
+#if !defined(MRBC_USE_SHARED_SLICE)
+#define MRBC_USE_SHARED_SLICE 0
+#endif
+#if !defined(MRBC_SHARED_SLICE_MIN)
+#define MRBC_SHARED_SLICE_MIN 16
+#endif
+
+// shared literals.
+//  An Array or Hash literal made only of immediate values (Fixnum, Float,
+//  Symbol, nil, true, false) keeps its elements at the first run, and
+//  the later runs make a new object that shares them as a slice does,
+//  instead of copying. Literals with fewer than MRBC_SHARED_LITERAL_MIN
+//  elements (keys and values for Hash) are made as usual.
+//  Costs the copy and 3 words per literal, until the irep is freed.
+//  Needs MRBC_USE_SHARED_SLICE.
+#if !defined(MRBC_USE_SHARED_LITERAL)
+#define MRBC_USE_SHARED_LITERAL 0
+#endif
+#if !defined(MRBC_SHARED_LITERAL_MIN)
+#define MRBC_SHARED_LITERAL_MIN 4
+#endif
+
+// cycle collector.
+//  Collect garbage cycles that the reference counter can not release,
+//  by trial deletion from the objects whose counter was decremented.
+//  The scheduler processes MRBC_GC_ROOTS_PER_RUN roots when idle.
+//  Costs 1 byte per object, and the C stack in proportion to
+//  the depth of nested objects.
+#if !defined(MRBC_USE_CYCLE_COLLECTOR)
+#define MRBC_USE_CYCLE_COLLECTOR 0
+#endif
+#if !defined(MRBC_GC_ROOT_BUFFER_SIZE)
+#define MRBC_GC_ROOT_BUFFER_SIZE 32
+#endif
+#if !defined(MRBC_GC_ROOTS_PER_RUN)
+#define MRBC_GC_ROOTS_PER_RUN 8
+#endif
+
+// deferred free.
+//  mrbc_decref() that drops the counter to zero puts the object in a
+//  queue instead of deleting it at once, and the queue is drained
+//  when mrbc_vm_run() returns and when idle. If the queue is full,
+//  the object is deleted immediately as usual. On by MRBC_USE_REALTIME.
+#if !defined(MRBC_USE_DEFERRED_FREE)
+#define MRBC_USE_DEFERRED_FREE MRBC_USE_REALTIME
+#endif
+#if !defined(MRBC_FREE_QUEUE_SIZE)
+#define MRBC_FREE_QUEUE_SIZE 16
+#endif
+
+// rescue table.
+//  The loader makes a table of begin/rescue ranges per irep from
+//  OP_ONERR, and a raised exception looks it up. So OP_ONERR and
+//  OP_POPERR cost nothing unless something is raised.
+//  It costs 4 bytes per begin clause. Ensure clauses are still pushed
+//  at runtime by OP_EPUSH.
+#if !defined(MRBC_USE_RESCUE_TABLE)
+#define MRBC_USE_RESCUE_TABLE 1
+#endif
+
 // maximum number of exception depth
 #if !defined(MAX_EXCEPTION_COUNT)
 #define MAX_EXCEPTION_COUNT 16
@@ -40,11 +411,74 @@
 //  MRBC_ALLOC_16BIT or MRBC_ALLOC_24BIT
 #define MRBC_ALLOC_24BIT
 
+// maximum number of memory pools.
+//  Needs 2 or more to use mrbc_add_alloc_pool() and mrbc_set_vm_arena().
+#if !defined(MRBC_ALLOC_MAX_POOLS)
+#define MRBC_ALLOC_MAX_POOLS 1
+#endif
+
+// VM block list.
+//  With MRBC_ALLOC_VMID, link the blocks of each VM in a list so that
+//  mrbc_free_all() costs time proportional to that VM's blocks,
+//  not to the pool size. Costs 2 pointers per block.
+// #define MRBC_ALLOC_VMID_LIST
+
+// slab allocator for small objects.
+//  Requests up to 8 pointers size are served from per size free lists,
+//  refilled by MRBC_ALLOC_SLAB_CHUNK_SLOTS slots from the memory pool.
+//  Chunks are never returned to the pool.
+#if !defined(MRBC_USE_ALLOC_SLAB)
+#define MRBC_USE_ALLOC_SLAB 0
+#endif
+#if !defined(MRBC_ALLOC_SLAB_CHUNK_SLOTS)
+#define MRBC_ALLOC_SLAB_CHUNK_SLOTS 16
+#endif
+
+// per-core block caches. (MRBC_SMP_CORES > 1)
+//  Each core keeps up to this many freed small blocks per size, and
+//  reuses them without hal_lock(). The blocks in the caches are
+//  counted as used. 0 to disable. Not used with MRBC_ALLOC_PROFILE.
+#if !defined(MRBC_ALLOC_CORE_CACHE_SLOTS)
+#define MRBC_ALLOC_CORE_CACHE_SLOTS 8
+#endif
+
+// allocation profiler.
+//  Tag each block with its type (MRBC_ALLOC_TAG_*) and keep live counts,
+//  bytes, a size histogram and the high-water mark.
+//  Costs 1 byte per block. See mrbc_alloc_get_profile().
+// #define MRBC_ALLOC_PROFILE
+
+// compaction.
+//  String and Array buffers can be moved by mrbc_alloc_compact() to
+//  merge free blocks. The scheduler calls it with the following steps
+//  when idle. Costs 1 pointer per block.
+// #define MRBC_ALLOC_COMPACT
+#if !defined(MRBC_ALLOC_COMPACT_STEPS)
+#define MRBC_ALLOC_COMPACT_STEPS 8
+#endif
+
 
 // Console new-line mode.
 //  If you need to convert LF to CRLF in console output, enable the following:
 // #define MRBC_CONVERT_CRLF
 
+// Console output buffer.
+//  puts, p, printf and console_*() store the output into a ring buffer of
+//  this size, instead of calling hal_write() for each piece. It is written
+//  out by hal_write() when full, when the scheduler is idle, and at
+//  mrbc_vm_end(). 0 to write directly.
+//  With MRBC_CONSOLE_HAL_DRAIN, the HAL sends it by DMA or interrupt
+//  instead: hal_console_start() is called when data is added, and the HAL
+//  takes the data by mrbc_console_peek() and mrbc_console_consume().
+//  (hal_console_start() is called again while sending, just ignore it.)
+//  A HAL that has no such drain defines it as mrbc_console_drain(), which
+//  writes out the data by hal_write() at once.
+//  The task waits only when the buffer is full.
+#if !defined(MRBC_CONSOLE_BUFFER_SIZE)
+#define MRBC_CONSOLE_BUFFER_SIZE 0
+#endif
+// #define MRBC_CONSOLE_HAL_DRAIN
+
 
 /* Configure environment
    0: NOT USE
@@ -56,10 +490,41 @@
 #define MRBC_USE_FLOAT 2
 #endif
 
+// Integer overflow.
+//  Fixnum +, -, * and ** that overflow mrbc_int make a Float instead of
+//  wrapping around, same as mruby without Bignum. A double keeps
+//  integers up to 2^53 exactly. (e.g. msec timestamps on 32-bit mrbc_int)
+//  Needs MRBC_USE_FLOAT.
+#if !defined(MRBC_INT_OVERFLOW_TO_FLOAT)
+#define MRBC_INT_OVERFLOW_TO_FLOAT 1
+#endif
+
+// Compact mrbc_value.
+//  Pack mrbc_value (register, Array element, Hash entry) into 4-byte
+//  alignment. With MRBC_USE_FLOAT == 2 on 32-bit CPUs, this makes it
+//  12 bytes instead of 16. The CPU must allow a double on a 4-byte
+//  boundary. (e.g. Cortex-M with FPU: yes, x86: yes.)
+#if !defined(MRBC_COMPACT_VALUE)
+#define MRBC_COMPACT_VALUE 0
+#endif
+
 // Use math. Support Math class.
 #if !defined(MRBC_USE_MATH)
 #define MRBC_USE_MATH 0
 #endif
+
+// Use PackedArray class. (typed numeric buffers)
+#if !defined(MRBC_USE_PACKED_ARRAY)
+#define MRBC_USE_PACKED_ARRAY 0
+#endif
+
+// Use JSON and MessagePack modules. (native serializer, needs String)
+#if !defined(MRBC_USE_JSON)
+#define MRBC_USE_JSON 0
+#endif
+#if !defined(MRBC_USE_MSGPACK)
+#define MRBC_USE_MSGPACK 0
+#endif
 /* (NOTE)
    maybe you need
    $ export LDFLAGS=-lm
@@ -97,4 +562,17 @@
 
 // #define MRBC_NO_TIMER
 
+// instruction budget. (MRBC_NO_TIMER)
+//  The scheduler gives each task this many opcodes per timeslice count,
+//  instead of one.
+#if !defined(MRBC_NO_TIMER_OP_BUDGET)
+#define MRBC_NO_TIMER_OP_BUDGET 64
+#endif
+
+// tickless idle.
+//  When no task is ready, the scheduler stops the tick and sleeps until
+//  the nearest wakeup time with hal_idle_cpu_ticks().
+//  HALs without a one-shot timer idle as usual.
+// #define MRBC_TICKLESS
+
 #endif
@@ -0,0 +1,78 @@
+#!/usr/bin/env ruby
+#
+# fold the samples of mrbc_profiler_dump() for flame graphs
+#
+#  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+#  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+#
+#  This file is distributed under BSD 3-Clause License.
+#
+# (usage)
+# ruby fold_profile.rb [option] [dump file]
+#
+#  -i fold by instruction (irep and offset) in each method.
+#  -t separate tasks (VM id) at the root.
+#  -s print the summary sorted by samples, instead of folded stacks.
+#
+#  The folded output is the input of flamegraph.pl.
+#  (e.g.) ruby fold_profile.rb -t log.txt | flamegraph.pl > prof.svg
+#
+
+require "optparse"
+
+
+##
+# parse command line option
+#
+def get_options
+  opt = OptionParser.new
+  ret = {}
+
+  opt.on("-i") {|v| ret[:i] = v }
+  opt.on("-t") {|v| ret[:t] = v }
+  opt.on("-s") {|v| ret[:s] = v }
+  opt.parse!(ARGV)
+  return ret
+
+rescue OptionParser::MissingArgument =>ex
+  STDERR.puts ex.message
+  return nil
+end
+
+
+##
+# main
+#
+$options = get_options()
+exit 1 if !$options
+
+counts = Hash.new(0)
+total = 0
+dropped = 0
+
+ARGF.each_line {|line|
+  if line =~ /^# mrbc profile:.*dropped=(\d+)/
+    dropped += $1.to_i
+    next
+  end
+
+  # <vm_id> <irep address> <offset> <method name>
+  next if line !~ /^(\d+) (\S+) (\d+) (\S+)/
+  vm_id, irep, inst, name = $1, $2, $3.to_i, $4
+
+  frames = []
+  frames << "vm#{vm_id}"  if $options[:t]
+  frames << name
+  frames << "#{irep}+#{inst}"  if $options[:i]
+  counts[frames.join(";")] += 1
+  total += 1
+}
+
+if $options[:s]
+  counts.sort_by {|k,v| -v }.each {|k,v|
+    printf("%6d %5.1f%%  %s\n", v, v * 100.0 / total, k)
+  }
+  STDERR.puts "#{total} samples, #{dropped} dropped."
+else
+  counts.each {|k,v| puts "#{k} #{v}" }
+end
@@ -0,0 +1,368 @@
+#!/usr/bin/env ruby
+#
+# create pre-linked image from mruby bytecode (.mrb)
+#
+#  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+#  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+#
+#  This file is distributed under BSD 3-Clause License.
+#
+# (usage)
+# ruby make_prelinked_image.rb [option] file.mrb
+#
+#  -o output filename.
+#  -n image variable name.
+#  -s built-in symbol table filename. (symbol_builtin.h)
+#  -v verbose
+#
+# The output is a C source file that has the irep tree as constant
+# data, and defines "const mrbc_prelinked_image <name>".
+# Load it with mrbc_load_prelinked(), or give it to mrbc_create_task().
+#
+#  e.g.)
+#   mrbc -o sample.mrb sample.rb
+#   ruby make_prelinked_image.rb -n sample -o sample_image.c sample.mrb
+#   ...
+#   extern const mrbc_prelinked_image sample;
+#   mrbc_create_task( (const uint8_t *)&sample, 0 );
+#
+# The symbol IDs of the built-in symbols are resolved at compile time
+# with MRBC_SYMID_* in symbol_builtin.h, so the image must be compiled
+# with the same symbol_builtin.h as the VM.
+#
+
+require "optparse"
+require_relative "common_sub"
+
+OUTPUT_FILENAME = "prelinked_image.c"
+IMAGE_NAME = "mrbc_image"
+SYMBOL_TABLE_FILENAME = File.join(__dir__, "../src/symbol_builtin.h")
+PREFIX = "prelink_"
+
+
+##
+# verbose print
+#
+def vp( s, level = 1 )
+  STDERR.puts s  if $options[:v] >= level
+end
+
+
+##
+# parse command line option
+#
+def get_options
+  opt = OptionParser.new
+  ret = {:v=>0}
+
+  opt.on("-o output file", "(default #{OUTPUT_FILENAME})") {|v| ret[:o] = v }
+  opt.on("-n image name", "(default #{IMAGE_NAME})") {|v| ret[:n] = v }
+  opt.on("-s symbol table file", "(default symbol_builtin.h)") {|v| ret[:s] = v }
+  opt.on("-v", "verbose mode") {|v| ret[:v] += 1 }
+  opt.parse!(ARGV)
+  return ret
+
+rescue OptionParser::MissingArgument =>ex
+  STDERR.puts ex.message
+  return nil
+end
+
+
+##
+# read built-in symbol names from symbol_builtin.h
+#
+def read_builtin_symbols( filename )
+  ret = {}
+  File.open( filename ) {|file|
+    while txt = file.gets
+      break if /builtin_symbols\[\]/ =~ txt
+    end
+    while txt = file.gets
+      break if /^\};/ =~ txt
+      ret[strip_double_quot( txt.strip.chomp(",") )] = true
+    end
+  }
+  return ret
+end
+
+
+##
+# parse RITE binary (same as src/load.c)
+#
+class RiteReader
+  def initialize( bin )
+    @bin = bin
+    @pos = 0
+  end
+
+  def u8;  v = @bin.getbyte(@pos); @pos += 1; v; end
+  def u16; v = @bin[@pos,2].unpack1("n"); @pos += 2; v; end
+  def u32; v = @bin[@pos,4].unpack1("N"); @pos += 4; v; end
+  def bytes( n ); v = @bin[@pos,n]; @pos += n; v; end
+
+  def read
+    raise "Not a RITE0006 binary." if bytes(8) != "RITE0006"
+    bytes(6)				# CRC, size
+    raise "Unknown compiler." if bytes(8) != "MATZ0000"
+
+    irep = nil
+    while @pos < @bin.size
+      ident = bytes(4)
+      size = u32
+      case ident
+      when "IREP"
+        raise "Unknown IREP version." if bytes(4) != "0002"
+        irep = read_irep
+      when "END\0"
+        break
+      else
+        @pos += size - 8
+      end
+    end
+    raise "IREP section not found." if !irep
+    return irep
+  end
+
+  def read_irep
+    irep = {:pools=>[], :syms=>[], :reps=>[]}
+    u32						# record size
+    irep[:nlocals] = u16
+    irep[:nregs] = u16
+    rlen = u16
+    ilen = u32
+    @pos += (-@pos) & 0x03			# padding
+    irep[:code] = bytes(ilen)
+
+    u32.times {
+      tt = u8
+      data = bytes(u16)
+      irep[:pools] << [tt, data]
+    }
+
+    syms_start = @pos
+    u32.times {
+      len = u16
+      irep[:syms] << bytes(len)
+      @pos += 1					# '\0'
+    }
+    irep[:syms_block] = @bin[syms_start ... @pos]
+
+    rlen.times { irep[:reps] << read_irep }
+    return irep
+  end
+end
+
+
+##
+# numbering ireps in pre-order.
+#
+def number_irep( irep, list = [] )
+  irep[:n] = list.size
+  list << irep
+  irep[:reps].each {|r| number_irep( r, list ) }
+  return list
+end
+
+
+##
+# C array initializer
+#
+def c_bytes( bin )
+  bin.bytes.each_slice(16).map {|a|
+    "  " + a.map {|b| format("0x%02x,", b) }.join
+  }.join("\n")
+end
+
+
+##
+# C float literal
+#
+def c_float( s )
+  d = Float( s )
+  return "(1.0/0.0)"  if d == Float::INFINITY
+  return "(-1.0/0.0)" if d == -Float::INFINITY
+  return "(0.0/0.0)"  if d.nan?
+  return d.inspect
+end
+
+
+##
+# output one irep.
+#
+def output_irep( file, irep, builtin, fixups )
+  n = irep[:n]
+  file.puts "/* irep #{n} */"
+  file.puts "static const uint8_t #{PREFIX}code_#{n}[] = {"
+  file.puts c_bytes( irep[:code] )
+  file.puts "};"
+  file.puts "static const uint8_t #{PREFIX}syms_#{n}[] = {"
+  file.puts c_bytes( irep[:syms_block] )
+  file.puts "};"
+
+  # POOL
+  pools = irep[:pools]
+  if pools.any? {|tt,data| tt == 0 }
+    file.puts "#if MRBC_USE_STRING"
+    pools.each_with_index {|(tt,data),i|
+      next if tt != 0
+      # CAUTION: op_string() reads the length at str - 2.
+      file.puts "static const uint8_t #{PREFIX}str_#{n}_#{i}[] = {"
+      file.puts c_bytes( [data.bytesize].pack("n") + data + "\0" )
+      file.puts "};"
+    }
+    file.puts "#endif"
+  end
+  if !pools.empty?
+    file.puts "static const mrbc_object #{PREFIX}pool_#{n}[] = {"
+    pools.each_with_index {|(tt,data),i|
+      case tt
+      when 0
+        file.puts "#if MRBC_USE_STRING"
+        file.puts "  {.tt = MRBC_TT_STRING, .str = (const char *)#{PREFIX}str_#{n}_#{i} + 2},"
+        file.puts "#else"
+        file.puts "  {.tt = MRBC_TT_NIL},\t// OP_STRING is not supported."
+        file.puts "#endif"
+      when 1
+        file.puts "  {.tt = MRBC_TT_FIXNUM, .i = #{Integer(data, 10)}},"
+      when 2
+        file.puts "  {.tt = MRBC_TT_FLOAT, .d = #{c_float(data)}},"
+      else
+        raise "Unknown pool type #{tt}."
+      end
+    }
+    file.puts "};"
+  end
+
+  # SYMS
+  syms = irep[:syms]
+  if !syms.empty?
+    all_builtin = syms.all? {|s| builtin[s] }
+    file.puts "#if MRBC_USE_IREP_SYMBOL_TABLE"
+    file.puts "static #{all_builtin ? 'const ' : ''}mrbc_sym #{PREFIX}symid_#{n}[] = {"
+    syms.each_with_index {|s,i|
+      if builtin[s]
+        file.puts "  MRBC_SYMID_#{rename_for_symbol(s)},"
+      else
+        file.puts "  -1,\t// #{s}"
+        fixups << [s, "&#{PREFIX}symid_#{n}[#{i}]"]
+      end
+    }
+    file.puts "};"
+    file.puts "#endif"
+    file.puts "#if MRBC_USE_INLINE_METHOD_CACHE"
+    file.puts "static mrbc_method_cache #{PREFIX}mcache_#{n}[#{syms.size}];"
+    file.puts "#endif"
+  end
+
+  # REPS
+  if !irep[:reps].empty?
+    file.puts "static mrbc_irep * const #{PREFIX}reps_#{n}[] = {"
+    irep[:reps].each {|r|
+      file.puts "  (mrbc_irep *)&#{PREFIX}irep_#{r[:n]},"
+    }
+    file.puts "};"
+  end
+
+  file.puts "static const mrbc_irep #{PREFIX}irep_#{n} = {"
+  file.puts "#if defined(MRBC_DEBUG)"
+  file.puts '  .type = "RP",'
+  file.puts "#endif"
+  file.puts "  .nlocals = #{irep[:nlocals]},"
+  file.puts "  .nregs = #{irep[:nregs]},"
+  file.puts "  .rlen = #{irep[:reps].size},"
+  file.puts "  .ilen = #{irep[:code].bytesize},"
+  file.puts "  .plen = #{pools.size},"
+  file.puts "  .slen = #{syms.size},"
+  file.puts "  .code = (uint8_t *)#{PREFIX}code_#{n},"
+  file.puts "  .pools = (mrbc_object *)#{PREFIX}pool_#{n},"  if !pools.empty?
+  file.puts "  .ptr_to_sym = (uint8_t *)#{PREFIX}syms_#{n},"
+  if !syms.empty?
+    file.puts "#if MRBC_USE_IREP_SYMBOL_TABLE"
+    file.puts "  .sym_ids = (mrbc_sym *)#{PREFIX}symid_#{n},"
+    file.puts "#endif"
+    file.puts "#if MRBC_USE_INLINE_METHOD_CACHE"
+    file.puts "  .method_cache = #{PREFIX}mcache_#{n},"
+    file.puts "#endif"
+  end
+  file.puts "  .reps = (struct IREP **)#{PREFIX}reps_#{n},"  if !irep[:reps].empty?
+  file.puts "};"
+  file.puts
+end
+
+
+
+##
+# main
+#
+$options = get_options()
+exit 1 if !$options
+
+if ARGV.size != 1
+  STDERR.puts "File not given."
+  exit 1
+end
+
+begin
+  bin = File.binread( ARGV[0] )
+  top = RiteReader.new( bin ).read
+  builtin = read_builtin_symbols( $options[:s] || SYMBOL_TABLE_FILENAME )
+rescue => ex
+  STDERR.puts ex.message
+  exit 1
+end
+
+ireps = number_irep( top )
+vp("#{ireps.size} ireps, #{builtin.size} built-in symbols.")
+
+pool_types = ireps.map {|r| r[:pools].map {|p| p[0] } }.flatten.uniq
+image_name = $options[:n] || IMAGE_NAME
+output_filename = $options[:o] || OUTPUT_FILENAME
+vp("Output file '#{output_filename}'")
+begin
+  file = File.open( output_filename, "w" )
+rescue Errno::ENOENT
+  puts "File can't open. #{output_filename}"
+  exit 1
+end
+
+file.puts "/* Auto generated by make_prelinked_image.rb from #{File.basename(ARGV[0])} */"
+file.puts '#include "vm.h"'
+file.puts '#include "load.h"'
+file.puts '#include "symbol_builtin.h"'
+file.puts
+if pool_types.include?(2)
+  file.puts "#if !MRBC_USE_FLOAT"
+  file.puts '#error "This image needs MRBC_USE_FLOAT."'
+  file.puts "#endif"
+end
+file.puts
+
+# children first, so that no forward declaration is needed.
+fixups = []
+ireps.reverse_each {|irep| output_irep( file, irep, builtin, fixups ) }
+
+vp("#{fixups.size} symbols are resolved at load.")
+if !fixups.empty?
+  file.puts "#if MRBC_USE_IREP_SYMBOL_TABLE"
+  file.puts "static const mrbc_prelink_symbol #{PREFIX}symbols[] = {"
+  fixups.each {|name,slot|
+    file.puts "  {#{name.inspect}, #{slot}},"
+  }
+  file.puts "};"
+  file.puts "#endif"
+  file.puts
+end
+
+file.puts "const mrbc_prelinked_image #{image_name} = {"
+file.puts "  .ident = MRBC_PRELINK_IDENT,"
+file.puts "  .irep = &#{PREFIX}irep_0,"
+if !fixups.empty?
+  file.puts "#if MRBC_USE_IREP_SYMBOL_TABLE"
+  file.puts "  .n_symbols = #{fixups.size},"
+  file.puts "  .symbols = #{PREFIX}symbols,"
+  file.puts "#endif"
+end
+file.puts "};"
+
+file.close
+vp("Done")
@@ -0,0 +1,171 @@
+#!/usr/bin/env ruby
+#
+# convert the events of mrbc_trace_dump() to Chrome trace JSON
+#
+#  Copyright (C) 2015-2020 Kyushu Institute of Technology.
+#  Copyright (C) 2015-2020 Shimane IT Open-Innovation Center.
+#
+#  This file is distributed under BSD 3-Clause License.
+#
+# (usage)
+# ruby trace_to_json.rb [option] [dump file]
+#
+#  -u usec   microseconds per time unit of MRBC_TRACE_CLOCK (default 1000)
+#  -o file   output file name (default stdout)
+#
+#  The output can be opened by chrome://tracing or ui.perfetto.dev.
+#  Each VM has a track of method calls and a track of its run slices.
+#  Frames left by exceptions are closed by the return of an outer frame,
+#  a C function that returns leaving a frame (e.g. native iterator) is
+#  closed with the frame, and frames still open are closed at the last
+#  event.
+#
+
+require "optparse"
+require "json"
+
+
+##
+# parse command line option
+#
+def get_options
+  opt = OptionParser.new
+  ret = {:u => 1000.0}
+
+  opt.on("-u usec") {|v| ret[:u] = v.to_f }
+  opt.on("-o file") {|v| ret[:o] = v }
+  opt.parse!(ARGV)
+  return ret
+
+rescue OptionParser::MissingArgument =>ex
+  STDERR.puts ex.message
+  return nil
+end
+
+
+##
+# converter of one VM
+#
+class TraceVM
+  PID_CALLS = 1
+  PID_TASKS = 2
+
+  def initialize( vm_id, events )
+    @vm_id = vm_id
+    @events = events
+    @stack = []
+    @running = false
+    @last_ts = 0
+    @wrap = 0
+  end
+
+  def begin_frame( ts, name, cat )
+    @stack << [name, cat, false]
+    @events << {:ph=>"B", :pid=>PID_CALLS, :tid=>@vm_id, :ts=>ts,
+                :name=>name, :cat=>cat}
+  end
+
+  def end_frame( ts, name, cat )
+    idx = @stack.rindex {|f| f[0] == name && f[1] == cat && !f[2] }
+    return if !idx
+
+    if cat == "c" && idx != @stack.size - 1
+      @stack[idx][2] = true     # close it with the frames above.
+      return
+    end
+    @stack.slice!(idx..-1).each {
+      @events << {:ph=>"E", :pid=>PID_CALLS, :tid=>@vm_id, :ts=>ts}
+    }
+    while !@stack.empty? && @stack[-1][2]
+      @stack.pop
+      @events << {:ph=>"E", :pid=>PID_CALLS, :tid=>@vm_id, :ts=>ts}
+    end
+  end
+
+  def add( time, type, name )
+    # unwrap the 32 bit clock.
+    @wrap += 0x100000000  if @prev && time < @prev - 0x80000000
+    @prev = time
+    ts = time + @wrap
+    @last_ts = ts
+    case type
+    when "C"
+      begin_frame( ts, name, "ruby" )
+    when "R"
+      end_frame( ts, name, "ruby" )
+    when "F"
+      begin_frame( ts, name, "c" )
+    when "f"
+      end_frame( ts, name, "c" )
+    when "X"
+      @events << {:ph=>"i", :pid=>PID_CALLS, :tid=>@vm_id, :ts=>ts,
+                  :s=>"t", :name=>"raise #{name}"}
+    when "S"
+      finish_run( ts )
+      @running = true
+      @events << {:ph=>"B", :pid=>PID_TASKS, :tid=>@vm_id, :ts=>ts,
+                  :name=>"running"}
+    when "s"
+      finish_run( ts )
+    end
+  end
+
+  def finish_run( ts )
+    return if !@running
+    @running = false
+    @events << {:ph=>"E", :pid=>PID_TASKS, :tid=>@vm_id, :ts=>ts}
+  end
+
+  def finish
+    finish_run( @last_ts )
+    @stack.each {
+      @events << {:ph=>"E", :pid=>PID_CALLS, :tid=>@vm_id, :ts=>@last_ts}
+    }
+    @stack.clear
+  end
+end
+
+
+##
+# main
+#
+$options = get_options()
+exit 1 if !$options
+
+events = []
+vms = {}
+vm = nil
+dropped = 0
+
+ARGF.each_line {|line|
+  if line =~ /^# mrbc trace: vm_id=(\d+) dropped=(\d+)/
+    vm_id = $1.to_i
+    dropped += $2.to_i
+    vm = vms[vm_id] ||= TraceVM.new( vm_id, events )
+    next
+  end
+
+  # <time in hex> <type> <name>
+  next if !vm || line !~ /^(\h+) ([CRFfXSs]) (\S+)/
+  vm.add( $1.hex, $2, $3 )
+}
+vms.each_value {|v| v.finish }
+
+# microseconds from the first event.
+origin = events.map {|e| e[:ts] }.min
+events.each {|e| e[:ts] = (e[:ts] - origin) * $options[:u] }
+
+vms.each_key {|vm_id|
+  [[TraceVM::PID_CALLS, "calls"], [TraceVM::PID_TASKS, "tasks"]].each {|pid, s|
+    events << {:ph=>"M", :pid=>pid, :tid=>vm_id, :name=>"thread_name",
+               :args=>{:name=>"vm#{vm_id} #{s}"}}
+  }
+}
+
+json = JSON.generate({:traceEvents=>events, :displayTimeUnit=>"ms"})
+if $options[:o]
+  File.write( $options[:o], json )
+else
+  puts json
+end
+STDERR.puts "#{dropped} events dropped." if dropped > 0
@@ -100,6 +100,56 @@ class ArrayTest < MrubycTestCase
     assert_equal nil, a[-10000,-10000]
   end
 
+  description "getter with range, first(n), last(n)"
+  def slice_case
+    a = [1,2,3,4]
+    assert_equal [2,3], a[1..2]
+    assert_equal [2], a[1...2]
+    assert_equal [3,4], a[-2..-1]
+    assert_equal [1,2,3], a[0...-1]
+    assert_equal [4], a[3..10000]
+    assert_equal [], a[4..5]
+    assert_equal nil, a[5..6]
+    assert_equal [], a[2..0]
+
+    assert_equal [1,2], a.first(2)
+    assert_equal [3,4], a.last(2)
+    assert_equal [1,2,3,4], a.first(10)
+    assert_equal [], a.last(0)
+  end
+
+  description "modify the slice and the receiver"
+  def slice_modify_case
+    a = []
+    40.times {|i| a << i.to_s }
+    s1 = a[10, 20]
+    s2 = a[10..29]
+    s3 = a.last(20)
+    assert_equal "10", s1[0]
+    assert_equal s1, s2
+
+    a[10] = "X"
+    assert_equal "10", s1[0]
+    s1[1] = "Y"
+    assert_equal "11", a[11]
+    assert_equal "11", s2[1]
+
+    assert_equal "29", s2.pop
+    assert_equal "10", s2.shift
+    s2 << "Z"
+    assert_equal 19, s2.size
+    assert_equal "Z", s2[-1]
+    assert_equal "30", a[30]
+
+    a.clear
+    assert_equal "20", s3[0]
+    assert_equal "39", s3[-1]
+    s3.sort!
+    assert_equal "20", s3.first
+    s3.clear
+    assert_equal [], s3
+  end
+
   description "index / first / last"
   def index_case
     a = [1,2,3,4]
@@ -250,4 +300,31 @@ class ArrayTest < MrubycTestCase
     assert_equal [2,4,6], a
   end
 
+  description "sort"
+  def sort_case
+    a = [5, 3, 9, 1, 7, 2, 8, 6, 4, 0, 3]
+    assert_equal [0, 1, 2, 3, 3, 4, 5, 6, 7, 8, 9], a.sort
+    assert_equal [9, 8, 7, 6, 5, 4, 3, 3, 2, 1, 0], a.sort {|x, y| y <=> x}
+    assert_equal 5, a[0]
+    a.sort! {|x, y| y <=> x}
+    assert_equal [9, 8, 7, 6, 5, 4, 3, 3, 2, 1, 0], a
+    a.sort!
+    assert_equal [0, 1, 2, 3, 3, 4, 5, 6, 7, 8, 9], a
+  end
+
+  description "literal"
+  def literal_case
+    3.times do |i|
+      a = [1, 2, 3, 4, :x]
+      assert_equal [1, 2, 3, 4, :x], a
+      a << i
+      a[0] = 9
+      assert_equal [9, 2, 3, 4, :x, i], a
+    end
+    3.times do |i|
+      a = [i, i, i, i]
+      assert_equal [i, i, i, i], a
+    end
+  end
+
 end
@@ -46,6 +46,26 @@ class FixnumTest < MrubycTestCase
     assert_equal( "-1", -1.to_s )
     assert_equal( "-10", -10.to_s )
     assert_equal( "-15wx", -54321.to_s(36) )
+
+    assert_equal( "1234567890", 1234567890.to_s )
+    assert_equal( "-1000000007", -1000000007.to_s )
+    assert_equal( "1001011010110100000001111", 19753999.to_s(2) )
+    assert_equal( "12d687", 1234567.to_s(16) )
+    assert_equal( 1234567, "12d687".to_i(16) )
+    assert_equal( -19753999, "-1001011010110100000001111".to_i(2) )
+  end
+
+  description "overflow"
+  def overflow_case
+    x = 1 << 30
+    assert_equal( x * 4.0, x * 4 )
+    assert_equal( x * 4.0, x + x + x + x )
+    assert_equal( -x * 4.0, -x - x - x - x )
+    assert_equal( x * 2.0 + 1, x + x + 1 )
+    assert_equal( (x * 2.0) ** 2, (x * 2) ** 2 )
+    assert_equal( 1024.0 ** 7, 1024 ** 7 )
+    assert_equal( 10000, 100 * 100 )
+    assert_equal( -2**30, -x )
   end
 
 end
@@ -174,4 +174,61 @@ class HashTest < MrubycTestCase
     assert_equal( {}, h.to_h )
   end
 
+  description "many entries"
+  def many_entries_case
+    h = {}
+    100.times {|i| h[i] = i * 2 }
+    h["foo"] = 1
+    h[:bar] = 2
+    assert_equal( 102, h.size )
+    assert_equal( 198, h[99] )
+    assert_equal( 1, h["foo"] )
+    assert_equal( 2, h[:bar] )
+    assert_equal( nil, h[100] )
+
+    50.times {|i| h.delete(i) }
+    assert_equal( 52, h.size )
+    assert_equal( nil, h[0] )
+    assert_equal( 100, h[50] )
+    assert_equal( 50, h.keys[0] )
+    assert_equal( :bar, h.keys[-1] )
+    assert_equal( 2, h.values[-1] )
+  end
+
+  description "each, each_key, each_value"
+  def each_case
+    h = {1=>10, :a=>20, "b"=>30}
+    a = []
+    ret = h.each {|k,v| a << k << v }
+    assert_equal( [1, 10, :a, 20, "b", 30], a )
+    assert_equal( h, ret )
+
+    a = []
+    h.each_key {|k| a << k }
+    assert_equal( [1, :a, "b"], a )
+
+    a = []
+    h.each_value {|v| a << v }
+    assert_equal( [10, 20, 30], a )
+
+    ret = h.each {|k,v| break v if k == :a }
+    assert_equal( 20, ret )
+
+    h = {1=>2, 3=>4}
+    h.each_key {|k| h[k + 100] = k if k < 100 }
+    assert_equal( {1=>2, 3=>4, 101=>1, 103=>3}, h )
+  end
+
+  description "literal"
+  def literal_case
+    3.times do |i|
+      h = {1=>2, 3=>4, :a=>5}
+      assert_equal( {1=>2, 3=>4, :a=>5}, h )
+      h[3] = i
+      h.delete(1)
+      h[:b] = i
+      assert_equal( {3=>i, :a=>5, :b=>i}, h )
+    end
+  end
+
 end
@@ -0,0 +1,36 @@
+# frozen_string_literal: true
+
+class JSONTest < MrubycTestCase
+
+  description "generate"
+  def generate_case
+    assert_equal 'null', JSON.generate(nil)
+    assert_equal '[1,-2,1.5,true,false,null]', JSON.generate([1, -2, 1.5, true, false, nil])
+    assert_equal '{"a":1,"b":[2.0],"c":"x"}', JSON.generate({"a"=>1, :b=>[2.0], "c"=>:x})
+    assert_equal '"a\"b\\\\c\n"', JSON.generate("a\"b\\c\n")
+    assert_equal '{"1":2}', JSON.generate({1=>2})
+  end
+
+  description "generate into buffer"
+  def generate_buffer_case
+    buf = "data=".dup
+    JSON.generate([1, 2], buf)
+    assert_equal 'data=[1,2]', buf
+
+    a = []
+    200.times {|i| a << i * 1000 }
+    s = JSON.generate(a)
+    assert_equal 1288, s.size
+    assert_equal a, JSON.parse(s)
+  end
+
+  description "parse"
+  def parse_case
+    assert_equal 12, JSON.parse('12')
+    assert_equal( -0.25, JSON.parse('-2.5e-1') )
+    assert_equal nil, JSON.parse(' null ')
+    assert_equal [1, [2, {}], "x"], JSON.parse('[1, [2, {}], "x"]')
+    assert_equal({"t"=>12, "v"=>[true, false]}, JSON.parse('{"t":12,"v":[true,false]}'))
+    assert_equal "a\"b\né", JSON.parse('"a\"b\né"')
+  end
+end
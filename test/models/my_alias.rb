@@ -27,4 +27,19 @@ class MyAlias
     return "MyClass#method3_alternate"
   end
   alias :method3_alias :method3
+
+  # more methods than MRBC_METHOD_TABLE_MIN
+  def method4
+    return "MyClass#method4"
+  end
+  def method5
+    return "MyClass#method5"
+  end
+  alias :method4_alias :method4
+  def method6
+    return "MyClass#method6"
+  end
+  def method5
+    return "MyClass#method5_alternate"
+  end
 end
@@ -20,4 +20,27 @@ class MyBlock
   def result
     @result
   end
+
+  def keep(&block)
+    @result << block
+  end
+
+  def counter(n)
+    Proc.new { n += 1 }
+  end
+
+  def keep_and_return(x)
+    @result << Proc.new { x }
+    x
+  end
+
+  def keep_local(x)
+    cb = Proc.new { x }
+    @result << cb
+  end
+
+  def twice(x)
+    helper = Proc.new { x }
+    Proc.new { helper.call + helper.call }
+  end
 end
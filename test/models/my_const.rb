@@ -0,0 +1,21 @@
+MY_CONST = 1
+
+class MyConst0
+  MY_CONST = 10
+
+  def value
+    MY_CONST
+  end
+end
+
+class MyConst1 < MyConst0
+  def value1
+    MY_CONST
+  end
+end
+
+class MyConst2
+  def value
+    MY_CONST
+  end
+end
@@ -7,3 +7,11 @@ class MyInstanceVariable
     @r2 = v2
   end
 end
+
+class MyInstanceVariableSub < MyInstanceVariable
+  def method2(v)
+    @s1 = v
+    @r1 = v * 2
+  end
+  attr_reader :s1
+end
@@ -0,0 +1,51 @@
+class MyRescue
+  def rescue_here
+    begin
+      raise "error"
+    rescue
+      return 1
+    end
+    2
+  end
+
+  def raise_deep(n)
+    raise "error" if n == 0
+    raise_deep(n - 1)
+  end
+
+  def rescue_deep
+    begin
+      raise_deep(3)
+    rescue
+      return :rescued
+    end
+    :not_rescued
+  end
+
+  def rescue_loop(n)
+    count = 0
+    n.times {|i|
+      begin
+        raise "error" if i % 2 == 0
+      rescue
+        count += 1
+      end
+    }
+    count
+  end
+
+  def rescue_nested
+    ret = []
+    begin
+      begin
+        raise "error"
+      rescue
+        ret << 1
+        raise "again"
+      end
+    rescue
+      ret << 2
+    end
+    ret
+  end
+end
@@ -0,0 +1,23 @@
+# frozen_string_literal: true
+
+class MessagePackTest < MrubycTestCase
+
+  description "pack"
+  def pack_case
+    assert_equal "\xc0", MessagePack.pack(nil)
+    assert_equal "\x93\x01\xcc\xc8\xff", MessagePack.pack([1, 200, -1])
+    assert_equal "\x81\xa1a\xc3", MessagePack.pack({"a"=>true})
+    assert_equal "\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00", MessagePack.pack(1.5)
+  end
+
+  description "pack and unpack"
+  def unpack_case
+    v = {"t"=>12, "v"=>[1.5, nil, true, -70000], "s"=>"str"}
+    assert_equal v, MessagePack.unpack(MessagePack.pack(v))
+
+    buf = "\x92".dup
+    MessagePack.pack(1, buf)
+    MessagePack.pack("a", buf)
+    assert_equal [1, "a"], MessagePack.unpack(buf)
+  end
+end
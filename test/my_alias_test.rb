@@ -22,4 +22,14 @@ class MyAliasTest < MrubycTestCase
     assert_equal "MyClass#method3_alternate", @obj.method3
     assert_equal "MyClass#method3_alternate", @obj.method3_alias
   end
+
+  description 'many methods'
+  def many_methods_case
+    assert_equal "MyClass#method1", @obj.method1_alias
+    assert_equal "MyClass#method4", @obj.method4
+    assert_equal "MyClass#method4", @obj.method4_alias
+    assert_equal "MyClass#method5_alternate", @obj.method5
+    assert_equal "MyClass#method6", @obj.method6
+    assert_equal "MyClass#method2", @obj.method2_alias
+  end
 end
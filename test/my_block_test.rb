@@ -18,4 +18,40 @@ class MyBlockTest < MrubycTestCase
     @obj.each_double([1, 2, 3])
     assert_equal [2, 4, 6], @obj.result
   end
+
+  description "blocks kept by the method"
+  def keep_block_case
+    8.times { @obj.keep { 10 } }
+    [1, 2].each {|v| v }
+    assert_equal 8, @obj.result.size
+    assert_equal 10, @obj.result[0].call
+    assert_equal 10, @obj.result[7].call
+  end
+
+  description "escaped block reads and writes the locals"
+  def escaped_upvar_case
+    8.times {|i| @obj.keep { i * 10 } }
+    counter = @obj.counter(5)
+    [1, 2].each {|v| v }
+    assert_equal 0, @obj.result[0].call
+    assert_equal 70, @obj.result[7].call
+    assert_equal 6, counter.call
+    assert_equal 7, counter.call
+  end
+
+  description "escaped block reads the local returned by the method"
+  def returned_upvar_case
+    assert_equal 10, @obj.keep_and_return(10)
+    assert_equal 10, @obj.result[0].call
+  end
+
+  description "escaped block held by a local variable of its frame"
+  def local_proc_case
+    8.times {|i| @obj.keep_local(i) }
+    assert_equal 7, @obj.result[7].call
+    tw = @obj.twice(3)
+    [1, 2].each {|v| v }
+    assert_equal 6, tw.call
+    assert_equal 6, tw.call
+  end
 end
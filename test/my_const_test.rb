@@ -0,0 +1,31 @@
+# frozen_string_literal: true
+
+class MyConstTest < MrubycTestCase
+
+  description "constant"
+  def const_case
+    3.times {
+      assert_equal 1,  MY_CONST
+      assert_equal 10, MyConst0.new.value
+      assert_equal 10, MyConst1.new.value1
+      assert_equal 1,  MyConst2.new.value
+      assert_equal 10, MyConst0::MY_CONST
+      assert_equal 10, MyConst1::MY_CONST
+    }
+  end
+
+  description "global variable"
+  def global_case
+    $my_const_a = 1
+    sum = 0
+    5.times {|i|
+      sum += $my_const_a
+      $my_const_a += 1
+      $my_const_b = i if i == 2   # added while looping.
+    }
+    assert_equal 15, sum
+    assert_equal 6, $my_const_a
+    assert_equal 2, $my_const_b
+  end
+
+end
@@ -27,4 +27,20 @@ class MyInstanceVariableTest < MrubycTestCase
     assert_equal [111,222,333,444], [obj1.r1, obj1.r2, obj1.rw1, obj1.rw2]
     assert_equal [nil,nil,2211,2222], [obj2.r1, obj2.r2, obj2.rw1, obj2.rw2]
   end
+
+  description 'subclass and dup'
+  def subclass_and_dup
+    obj1 = MyInstanceVariableSub.new
+    obj1.method2( 5 )
+    obj1.rw1 = 1
+    assert_equal [10,nil,1,nil,5], [obj1.r1, obj1.r2, obj1.rw1, obj1.rw2, obj1.s1]
+
+    obj2 = obj1.dup
+    obj2.rw2 = 2
+    assert_equal [10,nil,1,nil,5], [obj1.r1, obj1.r2, obj1.rw1, obj1.rw2, obj1.s1]
+    assert_equal [10,nil,1,2,5], [obj2.r1, obj2.r2, obj2.rw1, obj2.rw2, obj2.s1]
+
+    obj3 = MyInstanceVariable.new
+    assert_equal [nil,nil,nil,nil], [obj3.r1, obj3.r2, obj3.rw1, obj3.rw2]
+  end
 end
@@ -0,0 +1,30 @@
+# frozen_string_literal: true
+
+class MyRescueTest < MrubycTestCase
+
+  def setup
+    @obj = MyRescue.new
+  end
+
+  description "rescue in the same method"
+  def rescue_here_case
+    assert_equal 1, @obj.rescue_here
+    assert_equal 1, @obj.rescue_here
+  end
+
+  description "rescue the exception from callee"
+  def rescue_deep_case
+    assert_equal :rescued, @obj.rescue_deep
+  end
+
+  description "rescue in a loop"
+  def rescue_loop_case
+    assert_equal 5, @obj.rescue_loop(10)
+  end
+
+  description "raise in rescue clause"
+  def rescue_nested_case
+    assert_equal [1, 2], @obj.rescue_nested
+  end
+
+end
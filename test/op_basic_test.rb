@@ -235,4 +235,37 @@ class OpBasicTest < MrubycTestCase
     assert_true( a >= b )
   end
 
+  description "op_eq"
+  def op_eq_case
+    a = 1
+    b = 1
+    assert_true( a == b )
+    assert_false( a == 2 )
+
+    a = 1
+    b = 1.0
+    assert_true( a == b )
+    assert_true( b == a )
+
+    a = :sym
+    assert_true( a == :sym )
+    assert_false( a == :other )
+
+    assert_true( nil == nil )
+    assert_true( true == true )
+    assert_false( true == false )
+    assert_false( nil == false )
+    assert_false( 1 == nil )
+  end
+
+  description "compare large fixnum"
+  def compare_large_fixnum_case
+    a = 2147483647
+    b = -2
+    assert_true( a > b )
+    assert_false( a < b )
+    assert_true( b <= a )
+    assert_false( a == b )
+  end
+
 end
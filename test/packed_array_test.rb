@@ -0,0 +1,61 @@
+# frozen_string_literal: true
+
+class PackedArrayTest < MrubycTestCase
+
+  description "new, from and element access"
+  def access_case
+    a = PackedArray.new(:int16, 3)
+    assert_equal 3, a.size
+    assert_equal :int16, a.type
+    assert_equal [0, 0, 0], a.to_a
+
+    a[0] = 1234
+    a[-1] = -5
+    assert_equal 1234, a[0]
+    assert_equal -5, a[2]
+    assert_equal nil, a[3]
+
+    b = PackedArray.from(:float32, [1, 2.5, 3])
+    assert_equal [1.0, 2.5, 3.0], b.to_a
+    assert_equal [1234, 0, -5], PackedArray.from(:int32, a).to_a
+  end
+
+  description "integer elements are clamped"
+  def clamp_case
+    a = PackedArray.from(:int8, [100, -100, 1])
+    a[2] = 300
+    assert_equal [100, -100, 127], a.to_a
+    a.scale(2)
+    assert_equal [127, -128, 127], a.to_a
+  end
+
+  description "bulk operations"
+  def bulk_case
+    a = PackedArray.from(:int16, [100, -5, 30000, 7])
+    assert_equal 30102, a.sum
+    assert_equal -5, a.min
+    assert_equal 30000, a.max
+    assert_equal [-5, 30000], a.minmax
+    assert_in_delta 7525.5, a.mean
+
+    a.scale(2, 1)
+    assert_equal [201, -9, 32767, 15], a.to_a
+
+    b = PackedArray.from(:int8, [1, 2, 3, 4, 5, 6])
+    assert_equal [2, 3, 4, 5], b.moving_average(3).to_a
+    assert_equal [], b.moving_average(7).to_a
+
+    c = PackedArray.new(:float64, 4, 1.5)
+    c.scale(2.0, 0.25)
+    assert_in_delta 13.0, c.sum
+  end
+
+  description "empty"
+  def empty_case
+    a = PackedArray.new(:int32, 0)
+    assert_equal 0, a.sum
+    assert_equal nil, a.min
+    assert_equal nil, a.mean
+    assert_equal [], a.to_a
+  end
+end
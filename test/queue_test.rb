@@ -0,0 +1,58 @@
+# frozen_string_literal: true
+
+class QueueTest < MrubycTestCase
+
+  description "values"
+  def values_case
+    q = Queue.new(4)
+    assert_true q.push(1)
+    assert_true q.push(:a)
+    assert_equal 2, q.size
+    assert_equal 1, q.pop
+    assert_equal :a, q.pop
+    assert_true q.empty?
+  end
+
+  description "objects are moved"
+  def objects_case
+    q = Queue.new(4)
+    s = "abc"
+    a = [s, 1, {2=>"z"}]
+    assert_true q.push(s)
+    assert_true q << a
+    assert_true q.push(1..3)
+    assert_equal "abc", q.pop
+    assert_equal ["abc", 1, {2=>"z"}], q.pop
+    assert_equal (1..3), q.pop
+  end
+
+  description "full"
+  def full_case
+    q = Queue.new(1)
+    assert_true q.push("x")
+    assert_false q.push("y")
+    assert_equal "x", q.pop
+  end
+
+  description "reference cycle"
+  def cycle_case
+    q = Queue.new(2)
+    a = [1]
+    a << a
+    h = {}
+    h[1] = h
+    assert_true q.push(a)
+    assert_true q.push(h)
+    assert_equal 2, q.pop.size
+    assert_equal 1, q.pop.size
+  end
+
+  description "proc in a container"
+  def proc_case
+    q = Queue.new(2)
+    assert_false q.push([1, Proc.new { 1 }])
+    assert_false q.push({a: Proc.new { 1 }})
+    assert_true q.empty?
+  end
+
+end
@@ -26,4 +26,17 @@ class RangeTest < MrubycTestCase
     assert_false r === 3
     assert_false r === 4
   end
+
+  description "many ranges alive"
+  def many_case
+    a = []
+    20.times {|i| a << (i..i+2) }
+    assert_equal (19..21), a[19]
+    a.clear
+    20.times {|i| a << (i...i+2) }
+    sum = 0
+    a.each {|r| r.each {|j| sum += j } }
+    assert_equal 400, sum
+    assert_equal (3...5), a[3]
+  end
 end
@@ -189,4 +189,28 @@ class SprintfTest < MrubycTestCase
     assert_equal "1000", sprintf("%04b", -8)
     assert_equal "0111", sprintf("%04b", -9)
   end
+
+  description "%g"
+  def g_case
+    assert_equal "2.5", sprintf("%g", 2.5)
+    assert_equal "-0.125", sprintf("%g", -0.125)
+    assert_equal "0.0001", sprintf("%g", 0.0001)
+    assert_equal "123457", sprintf("%g", 123456.7)
+    assert_equal "1.23457e+06", sprintf("%g", 1234567.0)
+    assert_equal "1e-05", sprintf("%g", 0.00001)
+    assert_equal "  1.5", sprintf("%5g", 1.5)
+    assert_equal "0.3", 0.3.to_s
+    assert_equal "-12.375", -12.375.to_s
+  end
+
+  description "same format repeatedly"
+  def repeat_case
+    a = []
+    3.times {|i|
+      a << sprintf("%04d,%-3s|%%%x", i, "ab", i + 10)
+    }
+    assert_equal ["0000,ab |%a", "0001,ab |%b", "0002,ab |%c"], a
+    assert_equal "  ABCDEFGHIJ|", sprintf("%12s|", "ABCDEFGHIJ")
+    assert_equal "1 2 3 4 5 6 7 8 9", sprintf("%d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9)
+  end
 end
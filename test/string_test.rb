@@ -85,6 +85,26 @@ class StringTest < MrubycTestCase
     assert_equal "bar", str0      #(str0 は無傷、 str1 は str0 と内容を共有していない
   end
 
+  description "modify the slice to the end"
+  def slice_tail_case
+    str0 = "0123456789" * 4
+    str1 = str0[5, 100]
+    str2 = str0[-30, 30]
+    assert_equal 35, str1.size
+    assert_equal "56789", str1[0, 5]
+
+    str0 << "X"
+    assert_equal "789", str1[-3, 3]
+    str1 << "Y"
+    assert_equal "89Y", str1[-3, 3]
+    assert_equal "89X", str0[-3, 3]
+
+    str2[0] = "Z"
+    assert_equal "Z123", str2[0, 4]
+    assert_equal "0123", str0[10, 4]
+    assert_equal :"123456789", str0[-10, 9].to_sym
+  end
+
   description "境界値チェックを詳細にかけておく"
   def boundary_value_case
     s1 = "0123456"
@@ -436,6 +456,9 @@ class StringTest < MrubycTestCase
     assert_equal 1000.0, "10e2".to_f
     assert_equal 0.01, "1e-2".to_f
     assert_equal 0.1, ".1".to_f
+    assert_equal( -12.375, "-12.375".to_f )
+    assert_equal 0.0005, "0.5e-3".to_f
+    assert_equal 1.5, "1.5abc".to_f
 
     # not support this case.
     #assert_equal 0.0, "nan".to_f
@@ -476,4 +499,18 @@ class StringTest < MrubycTestCase
     assert_equal "str", "str".to_s
   end
 
+  description "to_sym after modified"
+  def to_sym_modified_case
+    s = "abc"
+    assert_equal :abc, s.to_sym
+    s << "d"
+    assert_equal :abcd, s.to_sym
+    s[0] = "X"
+    assert_equal :Xbcd, s.intern
+    s.tr!("bc", "BC")
+    assert_equal :XBCd, s.to_sym
+    h = {"XBCd"=>1}
+    assert_equal 1, h[s]
+  end
+
 end